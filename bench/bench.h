@@ -0,0 +1,65 @@
+/**
+ * @file bench.h
+ * @brief Minimal timing helpers shared by the benchmarks.
+ *
+ */
+#pragma once
+
+// Library headers
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+namespace allok8or {
+namespace bench {
+
+/**
+ * @brief Keeps the compiler from optimizing away a value, or the work that
+ * produced it.
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(_MSC_VER)
+  const volatile T sink = value;
+  (void)sink;
+#else
+  asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+/**
+ * @brief Returns the iteration count from the command line, if given.
+ */
+inline size_t iterations(int argc, char** argv, size_t default_iterations) {
+  return argc > 1 ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10))
+                  : default_iterations;
+}
+
+/**
+ * @brief Times iterations calls of func (after a short warm-up) and prints the
+ * mean time per call.
+ *
+ * @return double Mean nanoseconds per call.
+ */
+template <typename TFunc>
+double run(const char* name, size_t iterations, TFunc&& func) {
+  for (size_t i = 0; i < iterations / 10; ++i) {
+    func();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    func();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double ns =
+      std::chrono::duration<double, std::nano>(end - start).count() /
+      static_cast<double>(iterations ? iterations : 1);
+  std::printf("%-40s %10.2f ns/op\n", name, ns);
+  return ns;
+}
+
+} // namespace bench
+} // namespace allok8or
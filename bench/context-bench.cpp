@@ -0,0 +1,129 @@
+/**
+ * @file context-bench.cpp
+ * @brief Compares calling an allocator directly with dispatching through
+ * GlobalAllocator and ScopedAllocatorContext, and times deletes inside an
+ * Arena's context, of its own blocks and others'.
+ *
+ * Usage: context-bench [iterations]
+ */
+
+// Project headers
+#include "allocator.h"
+#include "arena.h"
+#include "bench.h"
+#include "context.h"
+#include "global.h"
+#include "page.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdio>
+
+using namespace allok8or;
+
+namespace {
+
+/**
+ * @brief LIFO bump allocator; about as cheap as an allocator gets, so the
+ * numbers are dominated by the dispatch cost.
+ */
+class StackAllocator : public Allocator<StackAllocator> {
+public:
+  void* allocate(size_t size, size_t alignment = 16) const {
+    auto top = (m_top + alignment - 1) & ~(alignment - 1);
+    m_top = top + size;
+    return m_buffer + top;
+  }
+
+  void deallocate(void* data) const {
+    m_top = static_cast<size_t>(static_cast<char*>(data) - m_buffer);
+  }
+
+  void deallocate(void* data, size_t, size_t) const { deallocate(data); }
+
+  bool owns(const void* data) const {
+    auto address = static_cast<const char*>(data);
+    return address >= m_buffer && address < m_buffer + sizeof(m_buffer);
+  }
+
+private:
+  alignas(64) mutable char m_buffer[4096];
+  mutable size_t m_top = 0;
+};
+
+using Global = global::GlobalAllocator<StackAllocator>;
+
+const size_t block_size = 64;
+const size_t block_alignment = 16;
+
+// Pages given to the arena before timing deletes in its context, so that a
+// cost per page would show.
+const size_t arena_pages = 1024;
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto iterations = bench::iterations(argc, argv, 50000000);
+  std::printf("%zu iterations of allocate + deallocate(%zu bytes)\n",
+              iterations,
+              block_size);
+
+  StackAllocator allocator;
+  Global::init(&allocator);
+
+  bench::run("direct", iterations, [&] {
+    auto memory = allocator.allocate(block_size, block_alignment);
+    bench::do_not_optimize(memory);
+    allocator.deallocate(memory, block_size, block_alignment);
+  });
+
+  bench::run("GlobalAllocator", iterations, [&] {
+    auto memory = Global::allocate(block_size, block_alignment);
+    bench::do_not_optimize(memory);
+    Global::deallocate(memory, block_size, block_alignment);
+  });
+
+  {
+    ScopedAllocatorContext context(allocator);
+
+    bench::run("current_allocator_context", iterations, [&] {
+      auto context = current_allocator_context();
+      auto memory =
+          context->allocate(context->allocator, block_size, block_alignment);
+      bench::do_not_optimize(memory);
+      context->deallocate(
+          context->allocator, memory, block_size, block_alignment);
+    });
+
+    bench::run("GlobalAllocator + ScopedAllocatorContext", iterations, [&] {
+      auto memory = Global::allocate(block_size, block_alignment);
+      bench::do_not_optimize(memory);
+      Global::deallocate(memory, block_size, block_alignment);
+    });
+  }
+
+  {
+    PageAllocator pages(4096);
+    Arena arena(pages);
+    ScopedAllocatorContext context(arena);
+
+    void* owned = nullptr;
+    for (size_t i = 0; i < arena_pages; ++i) {
+      owned = Global::allocate(2048, block_alignment);
+    }
+
+    bench::run("delete in Arena context (own block)", iterations, [&] {
+      Global::deallocate(owned, 2048, block_alignment);
+      bench::do_not_optimize(owned);
+    });
+
+    bench::run("delete in Arena context (other block)", iterations, [&] {
+      auto memory = allocator.allocate(block_size, block_alignment);
+      bench::do_not_optimize(memory);
+      Global::deallocate(memory, block_size, block_alignment);
+    });
+  }
+
+  Global::cleanup();
+  return 0;
+}
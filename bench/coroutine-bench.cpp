@@ -0,0 +1,110 @@
+/**
+ * @file coroutine-bench.cpp
+ * @brief Compares default coroutine frame allocation with
+ * PooledCoroutineFrame on a chain of awaiting coroutines.
+ *
+ * Usage: coroutine-bench [iterations]
+ *
+ * NOTE: C++20 only.
+ */
+
+// Project headers
+#include "bench.h"
+#include "coroutine_frame.h"
+
+// Library headers
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+using namespace allok8or;
+
+namespace {
+
+// Frames from the global operator new.
+struct DefaultFrame {};
+
+/**
+ * @brief Lazily started coroutine returning an int.
+ *
+ * @tparam TFrame Base of the promise type; decides where frames come from.
+ */
+template <typename TFrame>
+struct Task {
+  struct promise_type : TFrame {
+    int value = 0;
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_value(int result) { value = result; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  bool await_ready() { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  int await_resume() { return handle.promise().value; }
+
+  int run() {
+    handle.resume();
+    return handle.promise().value;
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <typename TFrame>
+Task<TFrame> chain(int depth) {
+  if (!depth) {
+    co_return 0;
+  }
+  co_return co_await chain<TFrame>(depth - 1) + 1;
+}
+
+const int chain_depth = 8;
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto iterations = bench::iterations(argc, argv, 2000000);
+  std::printf("%zu iterations of a %d-deep chain of awaits\n",
+              iterations,
+              chain_depth);
+
+  const auto default_ns = bench::run("default frames", iterations, [] {
+    bench::do_not_optimize(chain<DefaultFrame>(chain_depth).run());
+  });
+
+  const auto pooled_ns = bench::run("PooledCoroutineFrame", iterations, [] {
+    bench::do_not_optimize(chain<PooledCoroutineFrame>(chain_depth).run());
+  });
+
+  std::printf("pooled / default: %.2f\n", pooled_ns / default_ns);
+  return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file diagnostic-bench.cpp
+ * @brief Compares DiagnosticAllocator tracking behind one global lock with
+ * ShardedDiagnosticAllocator, with sampled tracking, and with recording a
+ * trace, as the number of threads grows; untracked allocation is the baseline.
+ * First prints the tracking memory per block, for the block header layout
+ * built.
+ *
+ * Usage: diagnostic-bench [iterations] [max threads]
+ */
+
+// Project headers
+#include "bench.h"
+#include "diagnostic.h"
+#include "pass_through.h"
+#include "trace_recorder.h"
+
+// Library headers
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace allok8or;
+
+namespace {
+
+/**
+ * @brief AllocationTrackingPool behind one mutex; the simplest thread-safe
+ * tracking, for comparison.
+ */
+class LockedTrackingPool {
+public:
+  bool add(diagnostic::BlockHeader* block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pool.add(block);
+  }
+
+  bool remove(diagnostic::BlockHeader* block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pool.remove(block);
+  }
+
+  bool set_site(diagnostic::BlockHeader* block, diagnostic::site_id_t site) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pool.set_site(block, site);
+  }
+
+private:
+  std::mutex m_mutex;
+  diagnostic::AllocationTrackingPool m_pool;
+};
+
+const size_t block_size = 64;
+const size_t live_blocks = 16;
+
+/**
+ * @brief Runs iterations allocate + deallocate pairs split over num_threads
+ * threads, and prints the mean time per pair per thread.
+ */
+template <typename TAllocator>
+void run_threads(const char* name,
+                 TAllocator& allocator,
+                 size_t iterations,
+                 size_t num_threads) {
+  const auto per_thread = iterations / num_threads;
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&] {
+      void* blocks[live_blocks] = {};
+      for (size_t i = 0; i < per_thread; ++i) {
+        auto& block = blocks[i % live_blocks];
+        if (block) {
+          allocator.deallocate(block, block_size, alignof(std::max_align_t));
+        }
+        block = allocator.allocate(block_size, alignof(std::max_align_t));
+        bench::do_not_optimize(block);
+      }
+      for (auto block : blocks) {
+        if (block) {
+          allocator.deallocate(block, block_size, alignof(std::max_align_t));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  // Wall time per operation on each thread; flat when the threads scale.
+  const double ns = std::chrono::duration<double, std::nano>(end - start)
+                        .count() /
+                    static_cast<double>(per_thread ? per_thread : 1);
+  std::printf("%-20s %3zu threads %10.2f ns/op\n", name, num_threads, ns);
+}
+
+/**
+ * @brief Prints the memory each tracked block costs beyond its user data:
+ * the block header (and padding), and with the compact layout, its entry in
+ * the tracking pool's side index (which has up to as many spare entries).
+ */
+void print_overhead() {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  const char* layout = "full";
+  const size_t index_size = 0;
+#else
+  const char* layout = "compact";
+  const size_t index_size =
+      sizeof(diagnostic::AllocationTrackingPool::BlockIndexT::Entry);
+#endif
+  std::printf("%s block header: bytes per block beyond the user data\n",
+              layout);
+  std::printf("%8s %8s %8s %10s\n", "size", "header", "index", "overhead");
+
+  const size_t alignment = alignof(std::max_align_t);
+  for (size_t size = 16; size <= 256; size *= 2) {
+    // As DiagnosticAllocator sizes the block.
+    const auto user_data_size = align::get_aligned_size(size, alignment);
+    const auto header_size =
+        diagnostic::BlockHeader::block_size(user_data_size, alignment) -
+        user_data_size;
+    std::printf("%8zu %8zu %8zu %9.1f%%\n",
+                size,
+                header_size,
+                index_size,
+                100.0 * static_cast<double>(header_size + index_size) /
+                    static_cast<double>(size));
+  }
+  std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const auto iterations = bench::iterations(argc, argv, 2000000);
+  const auto max_threads =
+      argc > 2 ? static_cast<size_t>(std::strtoull(argv[2], nullptr, 10)) : 32;
+
+  print_overhead();
+  std::printf("%zu iterations of allocate + deallocate(%zu bytes)\n",
+              iterations,
+              block_size);
+
+  PassThroughAllocator pass_through;
+  const char* trace_path = "diagnostic-bench.trace";
+  for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+    Allocator<PassThroughAllocator>& untracked = pass_through;
+    run_threads("untracked", untracked, iterations * num_threads, num_threads);
+
+    DiagnosticAllocator<PassThroughAllocator, LockedTrackingPool> locked(
+        pass_through);
+    run_threads("global lock", locked, iterations * num_threads, num_threads);
+
+    ShardedDiagnosticAllocator<PassThroughAllocator> sharded(pass_through);
+    run_threads("sharded", sharded, iterations * num_threads, num_threads);
+
+    SamplingDiagnosticAllocator<PassThroughAllocator,
+                                diagnostic::ShardedTrackingPool>
+        sampled(pass_through);
+    run_threads("sampled", sampled, iterations * num_threads, num_threads);
+
+    AllocationTraceRecorder<PassThroughAllocator> traced(pass_through,
+                                                         trace_path);
+    run_threads("traced", traced, iterations * num_threads, num_threads);
+  }
+  std::remove(trace_path);
+  return 0;
+}
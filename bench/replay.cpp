@@ -0,0 +1,720 @@
+/**
+ * @file replay.cpp
+ * @brief allok8or-replay: replays an allocation trace (see
+ * AllocationTraceRecorder) against allocator configurations, and compares
+ * their throughput, latency, peak RSS and fragmentation.
+ *
+ * Usage: allok8or-replay <trace> [pass-through|size-class|thread-cached|arena]
+ *
+ * Each recorded thread is replayed on a thread of its own, in the order it
+ * made its calls. A deallocation of a block allocated by another thread waits
+ * until that thread has allocated it, so the replay never frees a block
+ * before it exists. With no configuration named, all are run in turn.
+ *
+ * Metrics:
+ * - Throughput: calls per second of wall time, over all threads.
+ * - Latency: of each call, from the time-stamp counter; includes the
+ *   counter's own overhead, which is printed.
+ * - Peak RSS: growth of the process's peak resident set over its resident set
+ *   before the replay (Linux only).
+ * - Fragmentation: share of that peak not explained by the peak of bytes
+ *   requested and not yet freed.
+ */
+
+// Project headers
+#include "arena.h"
+#include "diagnostic/trace.h"
+#include "page.h"
+#include "pass_through.h"
+#include "size_class.h"
+
+// Library headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _MSC_VER
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace allok8or;
+using diagnostic::TraceEvent;
+using diagnostic::TraceFileHeader;
+
+namespace {
+
+//
+// Trace file
+//
+
+/**
+ * @brief A trace file, mapped into memory; falls back to reading it.
+ */
+class MappedTrace {
+public:
+  explicit MappedTrace(const char* path) : m_data(nullptr), m_size(0) {
+#ifdef _MSC_VER
+    auto file = std::fopen(path, "rb");
+    if (!file) {
+      return;
+    }
+    std::fseek(file, 0, SEEK_END);
+    m_buffer.resize(static_cast<size_t>(std::ftell(file)));
+    std::fseek(file, 0, SEEK_SET);
+    m_size = std::fread(&m_buffer[0], 1, m_buffer.size(), file);
+    m_data = m_buffer.data();
+    std::fclose(file);
+#else
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      auto data = mmap(nullptr,
+                       static_cast<size_t>(info.st_size),
+                       PROT_READ,
+                       MAP_PRIVATE,
+                       fd,
+                       0);
+      if (data != MAP_FAILED) {
+        m_data = static_cast<const char*>(data);
+        m_size = static_cast<size_t>(info.st_size);
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedTrace() {
+#ifndef _MSC_VER
+    if (m_data) {
+      munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+  }
+
+  MappedTrace(const MappedTrace&) = delete;
+  MappedTrace& operator=(const MappedTrace&) = delete;
+
+  const TraceFileHeader* header() const {
+    return m_size >= sizeof(TraceFileHeader)
+               ? reinterpret_cast<const TraceFileHeader*>(m_data)
+               : nullptr;
+  }
+
+  const TraceEvent* events() const {
+    return reinterpret_cast<const TraceEvent*>(m_data +
+                                               sizeof(TraceFileHeader));
+  }
+
+  // Complete events only; a trace cut short may end mid-event.
+  size_t num_events() const {
+    return header() ? (m_size - sizeof(TraceFileHeader)) / sizeof(TraceEvent)
+                    : 0;
+  }
+
+private:
+  const char* m_data;
+  size_t m_size;
+#ifdef _MSC_VER
+  std::vector<char> m_buffer;
+#endif
+};
+
+//
+// Replay plan
+//
+
+/**
+ * @brief One call to replay. Blocks are numbered (slots) rather than keyed by
+ * address, so the replay needs no map.
+ */
+struct ReplayOp {
+  uint64_t size;
+  uint32_t alignment;
+  uint32_t slot;
+  bool allocate;
+};
+
+/**
+ * @brief The trace, split into each thread's calls.
+ */
+struct ReplayPlan {
+  struct BlockInfo {
+    uint64_t size;
+    uint32_t alignment;
+  };
+
+  std::vector<std::vector<ReplayOp>> threads;
+  std::vector<BlockInfo> blocks; // Indexed by slot.
+  size_t num_ops = 0;
+  size_t num_skipped = 0; // Frees of blocks allocated before the trace.
+  uint64_t peak_live_bytes = 0;
+};
+
+/**
+ * @brief Builds the plan: numbers each block, matches frees to allocations
+ * in timestamp order (keeping each thread's own order), and finds the peak of
+ * live bytes.
+ */
+ReplayPlan make_plan(const MappedTrace& trace) {
+  const auto events = trace.events();
+  const auto num_events = trace.num_events();
+
+  // Each thread's calls, in file order: the order it made them, even where
+  // its timestamps step back (e.g. on moving to a core whose counter lags).
+  std::map<uint32_t, std::vector<uint32_t>> streams;
+  for (size_t i = 0; i < num_events; ++i) {
+    streams[events[i].thread].push_back(static_cast<uint32_t>(i));
+  }
+
+  // Merges the streams by timestamp, so no thread's calls are reordered;
+  // ties go to the lower thread number, then to the earlier event.
+  struct Next {
+    uint64_t timestamp;
+    uint32_t thread;
+    uint32_t index;
+    const std::vector<uint32_t>* stream;
+    size_t position;
+
+    bool operator>(const Next& other) const {
+      return std::tie(timestamp, thread, index) >
+             std::tie(other.timestamp, other.thread, other.index);
+    }
+  };
+  std::priority_queue<Next, std::vector<Next>, std::greater<Next>> heads;
+  for (const auto& stream : streams) {
+    const auto index = stream.second.front();
+    heads.push(Next{events[index].timestamp, stream.first, index,
+                    &stream.second, 0});
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(num_events);
+  while (!heads.empty()) {
+    auto next = heads.top();
+    heads.pop();
+    order.push_back(next.index);
+    if (++next.position < next.stream->size()) {
+      next.index = (*next.stream)[next.position];
+      next.timestamp = events[next.index].timestamp;
+      heads.push(next);
+    }
+  }
+
+  ReplayPlan plan;
+  std::map<uint32_t, size_t> thread_index;
+  struct LiveBlock {
+    uint32_t slot;
+    uint64_t size;
+    uint32_t alignment;
+  };
+  std::unordered_map<uint64_t, LiveBlock> live;
+  uint64_t live_bytes = 0;
+
+  for (auto index : order) {
+    const auto& event = events[index];
+    auto it = thread_index.find(event.thread);
+    if (it == thread_index.end()) {
+      it = thread_index.emplace(event.thread, plan.threads.size()).first;
+      plan.threads.emplace_back();
+    }
+    auto& ops = plan.threads[it->second];
+
+    if (event.type == diagnostic::TRACE_ALLOCATE) {
+      const auto slot = static_cast<uint32_t>(plan.blocks.size());
+      const auto alignment =
+          event.alignment ? event.alignment
+                          : static_cast<uint32_t>(alignof(std::max_align_t));
+      live[event.pointer] = LiveBlock{slot, event.size, alignment};
+      plan.blocks.push_back(ReplayPlan::BlockInfo{event.size, alignment});
+      ops.push_back(ReplayOp{event.size, alignment, slot, true});
+      live_bytes += event.size;
+      plan.peak_live_bytes = std::max(plan.peak_live_bytes, live_bytes);
+    } else if (event.type == diagnostic::TRACE_DEALLOCATE) {
+      auto block = live.find(event.pointer);
+      if (block == live.end()) {
+        ++plan.num_skipped;
+        continue;
+      }
+      ops.push_back(ReplayOp{
+          block->second.size, block->second.alignment, block->second.slot,
+          false});
+      live_bytes -= block->second.size;
+      live.erase(block);
+    } else {
+      ++plan.num_skipped;
+      continue;
+    }
+    ++plan.num_ops;
+  }
+  return plan;
+}
+
+//
+// Allocator configurations
+//
+// Each has a per-thread Local, and allocates and deallocates through it.
+// deallocate() is told whether the block came from the same thread, for
+// configurations with per-thread heaps.
+//
+
+const size_t ARENA_PAGE_SIZE = 1024 * 1024;
+
+struct PassThroughConfig {
+  static const char* name() { return "pass-through"; }
+
+  struct Local {};
+
+  void* allocate(Local&, size_t size, size_t alignment) {
+    return allocator.allocate(size, alignment);
+  }
+  void deallocate(Local&, void* data, size_t, size_t, bool) {
+    allocator.deallocate(data);
+  }
+  void finish(Local&) {}
+
+  PassThroughAllocator allocator;
+};
+
+struct SizeClassConfig {
+  static const char* name() { return "size-class"; }
+
+  struct Local {};
+
+  void* allocate(Local&, size_t size, size_t alignment) {
+    return allocator.allocate(size, alignment);
+  }
+  void deallocate(Local&, void* data, size_t, size_t, bool) {
+    allocator.deallocate(data);
+  }
+  void finish(Local&) {}
+
+  ~SizeClassConfig() { allocator.release(); }
+
+  SizeClassAllocator allocator;
+};
+
+struct ThreadCachedConfig {
+  static const char* name() { return "thread-cached"; }
+
+  struct Local {
+    SizeClassAllocator::ThreadCache cache = {};
+  };
+
+  void* allocate(Local& local, size_t size, size_t alignment) {
+    return allocator.allocate(local.cache, size, alignment);
+  }
+  void deallocate(Local& local, void* data, size_t, size_t, bool) {
+    allocator.deallocate(local.cache, data);
+  }
+  void finish(Local& local) { allocator.flush(local.cache); }
+
+  ~ThreadCachedConfig() { allocator.release(); }
+
+  SizeClassAllocator allocator;
+};
+
+/**
+ * @brief An Arena per thread. Frees are no-ops, so blocks from other threads
+ * are simply dropped. Blocks too large for a page come from the system, and
+ * are freed.
+ */
+struct ArenaConfig {
+  static const char* name() { return "arena"; }
+
+  struct Local {
+    Local() : pages(ARENA_PAGE_SIZE), arena(pages) {}
+
+    PageAllocator pages;
+    Arena arena;
+  };
+
+  // Leaves room for the arena's page header.
+  static bool is_large(size_t size, size_t alignment) {
+    return size + alignment > ARENA_PAGE_SIZE / 2;
+  }
+
+  void* allocate(Local& local, size_t size, size_t alignment) {
+    return is_large(size, alignment) ? large.allocate(size, alignment)
+                                     : local.arena.allocate(size, alignment);
+  }
+  void deallocate(Local& local,
+                  void* data,
+                  size_t size,
+                  size_t alignment,
+                  bool same_thread) {
+    if (is_large(size, alignment)) {
+      large.deallocate(data);
+    } else if (same_thread) {
+      local.arena.deallocate(data);
+    }
+  }
+  void finish(Local&) {}
+
+  PassThroughAllocator large;
+};
+
+//
+// Measurement
+//
+
+/**
+ * @brief Returns a field of /proc/self/status in bytes, or 0 if unknown.
+ */
+uint64_t proc_status_bytes(const char* field) {
+  uint64_t bytes = 0;
+#if defined(__linux__)
+  auto file = std::fopen("/proc/self/status", "r");
+  if (!file) {
+    return 0;
+  }
+  char line[256];
+  const auto length = std::strlen(field);
+  while (std::fgets(line, sizeof(line), file)) {
+    if (!std::strncmp(line, field, length) && line[length] == ':') {
+      bytes = std::strtoull(line + length + 1, nullptr, 10) * 1024;
+      break;
+    }
+  }
+  std::fclose(file);
+#else
+  (void)field;
+#endif
+  return bytes;
+}
+
+/**
+ * @brief Resets the peak resident set (VmHWM) to the current one.
+ *
+ * @return false If it can't be reset; peak RSS is then not reported.
+ */
+bool reset_peak_rss() {
+#if defined(__linux__)
+  auto file = std::fopen("/proc/self/clear_refs", "w");
+  if (!file) {
+    return false;
+  }
+  const bool reset = std::fputs("5", file) >= 0;
+  return std::fclose(file) == 0 && reset;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Returns the number of time-stamp counter ticks per second, measured
+ * against steady_clock.
+ */
+double ticks_per_second() {
+  const auto start = std::chrono::steady_clock::now();
+  const auto start_ticks = diagnostic::trace_ticks();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  const auto ticks = diagnostic::trace_ticks() - start_ticks;
+  const auto seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  return static_cast<double>(ticks) / seconds;
+}
+
+/**
+ * @brief Returns the cost of reading the time-stamp counter twice, in ticks.
+ */
+uint64_t timer_overhead() {
+  uint64_t best = ~uint64_t(0);
+  for (int i = 0; i < 1000; ++i) {
+    const auto start = diagnostic::trace_ticks();
+    const auto end = diagnostic::trace_ticks();
+    best = std::min(best, end - start);
+  }
+  return best;
+}
+
+//
+// Replay
+//
+
+struct ReplayResult {
+  double seconds = 0;
+  std::vector<uint32_t> latencies; // Ticks, per call.
+  size_t num_failed = 0;
+  uint64_t peak_rss = 0;
+};
+
+/**
+ * @brief Writes to each page of a block, as the traced program presumably
+ * did, so that it counts towards RSS. Not timed.
+ */
+void touch(void* data, uint64_t size) {
+  const size_t page_size = 4096;
+  auto bytes = static_cast<volatile char*>(data);
+  for (uint64_t offset = 0; offset < size; offset += page_size) {
+    bytes[offset] = 0;
+  }
+}
+
+/**
+ * @brief Replays one thread's calls.
+ *
+ * NOTE: Slots hold each block's address once allocated; a thread freeing a
+ * block from another thread waits for it there.
+ */
+template <typename TConfig>
+void replay_thread(TConfig& config,
+                   typename TConfig::Local& local,
+                   const std::vector<ReplayOp>& ops,
+                   std::atomic<void*>* slots,
+                   std::atomic<uint32_t>* owners,
+                   uint32_t thread,
+                   std::vector<uint32_t>& latencies,
+                   size_t& num_failed) {
+  latencies.reserve(ops.size());
+  for (const auto& op : ops) {
+    auto& slot = slots[op.slot];
+    if (op.allocate) {
+      const auto start = diagnostic::trace_ticks();
+      auto data = config.allocate(local, op.size, op.alignment);
+      const auto end = diagnostic::trace_ticks();
+      latencies.push_back(
+          static_cast<uint32_t>(std::min<uint64_t>(end - start, UINT32_MAX)));
+
+      if (data) {
+        touch(data, op.size);
+      } else {
+        ++num_failed;
+      }
+      owners[op.slot].store(thread, std::memory_order_relaxed);
+      // Failed allocations still publish, so that frees don't wait forever.
+      slot.store(data ? data : &slot, std::memory_order_release);
+      continue;
+    }
+
+    void* data;
+    while (!(data = slot.load(std::memory_order_acquire))) {
+      std::this_thread::yield();
+    }
+    slot.store(nullptr, std::memory_order_relaxed);
+    if (data == &slot) {
+      continue;
+    }
+
+    const bool same_thread =
+        owners[op.slot].load(std::memory_order_relaxed) == thread;
+    const auto start = diagnostic::trace_ticks();
+    config.deallocate(local, data, op.size, op.alignment, same_thread);
+    const auto end = diagnostic::trace_ticks();
+    latencies.push_back(
+        static_cast<uint32_t>(std::min<uint64_t>(end - start, UINT32_MAX)));
+  }
+  config.finish(local);
+}
+
+template <typename TConfig>
+ReplayResult replay(const ReplayPlan& plan) {
+  ReplayResult result;
+  const auto num_threads = plan.threads.size();
+
+  std::unique_ptr<std::atomic<void*>[]> slots(
+      new std::atomic<void*>[plan.blocks.size()]);
+  std::unique_ptr<std::atomic<uint32_t>[]> owners(
+      new std::atomic<uint32_t>[plan.blocks.size()]);
+  for (size_t i = 0; i < plan.blocks.size(); ++i) {
+    slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<TConfig> config(new TConfig());
+  std::vector<std::unique_ptr<typename TConfig::Local>> locals;
+  for (size_t t = 0; t <= num_threads; ++t) {
+    locals.emplace_back(new typename TConfig::Local());
+  }
+  std::vector<std::vector<uint32_t>> latencies(num_threads);
+  std::vector<size_t> failed(num_threads);
+
+  const auto peak_known = reset_peak_rss();
+  const auto base_rss = proc_status_bytes("VmRSS");
+
+  std::atomic<size_t> ready(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      ready.fetch_add(1, std::memory_order_acq_rel);
+      while (ready.load(std::memory_order_acquire) <= num_threads) {
+        std::this_thread::yield();
+      }
+      replay_thread(*config,
+                    *locals[t],
+                    plan.threads[t],
+                    slots.get(),
+                    owners.get(),
+                    static_cast<uint32_t>(t),
+                    latencies[t],
+                    failed[t]);
+    });
+  }
+  while (ready.load(std::memory_order_acquire) < num_threads) {
+    std::this_thread::yield();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  ready.fetch_add(1, std::memory_order_acq_rel);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(end - start).count();
+
+  if (peak_known) {
+    const auto peak_rss = proc_status_bytes("VmHWM");
+    result.peak_rss = peak_rss > base_rss ? peak_rss - base_rss : 0;
+  }
+
+  // Blocks still live at the end of the trace.
+  auto& main_local = *locals[num_threads];
+  for (size_t i = 0; i < plan.blocks.size(); ++i) {
+    auto data = slots[i].load(std::memory_order_relaxed);
+    if (data && data != &slots[i]) {
+      const auto& block = plan.blocks[i];
+      config->deallocate(main_local, data, block.size, block.alignment, false);
+    }
+  }
+  config->finish(main_local);
+
+  for (size_t t = 0; t < num_threads; ++t) {
+    result.num_failed += failed[t];
+    result.latencies.insert(
+        result.latencies.end(), latencies[t].begin(), latencies[t].end());
+  }
+  return result;
+}
+
+/**
+ * @brief Returns the latency at a percentile, in nanoseconds.
+ */
+double percentile(const std::vector<uint32_t>& sorted,
+                  double fraction,
+                  double ns_per_tick) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto index = static_cast<size_t>(fraction * (sorted.size() - 1));
+  return sorted[index] * ns_per_tick;
+}
+
+template <typename TConfig>
+void run(const ReplayPlan& plan, double ns_per_tick) {
+  auto result = replay<TConfig>(plan);
+  std::sort(result.latencies.begin(), result.latencies.end());
+
+  const auto mops =
+      result.seconds > 0 ? plan.num_ops / result.seconds / 1e6 : 0.0;
+  std::printf("%-14s %8.2f %8.0f %8.0f %8.0f %8.0f %10.0f",
+              TConfig::name(),
+              mops,
+              percentile(result.latencies, 0.5, ns_per_tick),
+              percentile(result.latencies, 0.9, ns_per_tick),
+              percentile(result.latencies, 0.99, ns_per_tick),
+              percentile(result.latencies, 0.999, ns_per_tick),
+              percentile(result.latencies, 1.0, ns_per_tick));
+
+  if (result.peak_rss) {
+    const auto fragmentation =
+        result.peak_rss > plan.peak_live_bytes
+            ? 100.0 * (result.peak_rss - plan.peak_live_bytes) /
+                  result.peak_rss
+            : 0.0;
+    std::printf(" %10.1f %6.1f%%",
+                result.peak_rss / (1024.0 * 1024.0),
+                fragmentation);
+  } else {
+    std::printf(" %10s %7s", "n/a", "n/a");
+  }
+  std::printf(" %8zu\n", result.num_failed);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr,
+                 "Usage: %s <trace> "
+                 "[pass-through|size-class|thread-cached|arena]\n",
+                 argv[0]);
+    return 2;
+  }
+  const std::string only = argc > 2 ? argv[2] : "";
+  if (!only.empty() && only != PassThroughConfig::name() &&
+      only != SizeClassConfig::name() && only != ThreadCachedConfig::name() &&
+      only != ArenaConfig::name()) {
+    std::fprintf(stderr, "Unknown allocator [%s]\n", only.c_str());
+    return 2;
+  }
+
+  MappedTrace trace(argv[1]);
+  const auto header = trace.header();
+  if (!header ||
+      std::memcmp(header->magic, diagnostic::TRACE_MAGIC,
+                  sizeof(header->magic)) ||
+      header->version != diagnostic::TRACE_VERSION ||
+      header->event_size != sizeof(TraceEvent)) {
+    std::fprintf(stderr, "%s: not a version %u allocation trace\n",
+                 argv[1],
+                 diagnostic::TRACE_VERSION);
+    return 1;
+  }
+
+  const auto plan = make_plan(trace);
+  const auto ns_per_tick = 1e9 / ticks_per_second();
+  std::printf("%s: %zu calls on %zu threads (%zu skipped), "
+              "peak live %.1f MiB\n",
+              argv[1],
+              plan.num_ops,
+              plan.threads.size(),
+              plan.num_skipped,
+              plan.peak_live_bytes / (1024.0 * 1024.0));
+  std::printf("Latencies in ns, including %.0f ns of timer overhead.\n",
+              timer_overhead() * ns_per_tick);
+  std::printf("%-14s %8s %8s %8s %8s %8s %10s %10s %7s %8s\n",
+              "allocator",
+              "Mops/s",
+              "p50",
+              "p90",
+              "p99",
+              "p99.9",
+              "max",
+              "peak MiB",
+              "frag",
+              "failed");
+
+  if (only.empty() || only == PassThroughConfig::name()) {
+    run<PassThroughConfig>(plan, ns_per_tick);
+  }
+  if (only.empty() || only == SizeClassConfig::name()) {
+    run<SizeClassConfig>(plan, ns_per_tick);
+  }
+  if (only.empty() || only == ThreadCachedConfig::name()) {
+    run<ThreadCachedConfig>(plan, ns_per_tick);
+  }
+  if (only.empty() || only == ArenaConfig::name()) {
+    run<ArenaConfig>(plan, ns_per_tick);
+  }
+  return 0;
+}
@@ -6,6 +6,10 @@
  */
 #pragma once
 
+// Project headers
+#include "allocator_traits.h"
+
+// Library headers
 #include <cstddef>
 
 namespace allok8or {
@@ -26,6 +30,57 @@ public:
 
   constexpr void deallocate(void* data) const { impl().deallocate(data); }
 
+  /**
+   * @brief Deallocate a block of memory whose size and alignment are known.
+   *
+   * Lets implementations skip header or page-map lookups. Implementations
+   * without a sized deallocate fall back to deallocate(data).
+   *
+   * @param data Block to deallocate.
+   * @param size Size of the block as originally requested.
+   * @param alignment Alignment of the block as originally requested.
+   */
+  void deallocate(void* data, size_t size, size_t alignment) const {
+    AllocatorTraits<TImpl>::deallocate(impl(), data, size, alignment);
+  }
+
+  /**
+   * @brief Resize a block of memory, preserving its contents.
+   *
+   * Uses the implementation's own reallocate() if it has one. Otherwise tries
+   * to resize the block in place, and falls back to allocate-copy-deallocate.
+   *
+   * NOTE: Like realloc(), returns nullptr and leaves the original block
+   * untouched if the new block can't be allocated.
+   *
+   * @param data Block to resize; may be nullptr.
+   * @param old_size Size of the block as originally requested.
+   * @param new_size Requested new size of the block.
+   * @param alignment Alignment of the block.
+   * @return void* Pointer to the resized block.
+   */
+  void* reallocate(void* data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const {
+    return AllocatorTraits<TImpl>::reallocate(
+        impl(), data, old_size, new_size, alignment);
+  }
+
+  /**
+   * @brief Try to resize a block of memory without moving it.
+   *
+   * NOTE: Implementations without in-place support always return false.
+   *
+   * @param data Block to resize.
+   * @param new_size Requested new size of the block.
+   * @return true If the block now holds new_size bytes at the same address.
+   * @return false If the block was not changed.
+   */
+  bool try_expand_in_place(void* data, size_t new_size) const {
+    return AllocatorTraits<TImpl>::try_expand_in_place(impl(), data, new_size);
+  }
+
 protected:
   constexpr Allocator() {}  // Don't create the base class.
 
@@ -0,0 +1,353 @@
+/**
+ * @file allocator_traits.h
+ * @brief Compile-time detection of optional allocator capabilities, with
+ * fallbacks for implementations that lack them.
+ *
+ */
+#pragma once
+
+// Library headers
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace allok8or {
+
+namespace detail {
+
+// std::void_t is C++17.
+template <typename... Ts>
+struct make_void {
+  typedef void type;
+};
+
+template <typename... Ts>
+using void_t = typename make_void<Ts...>::type;
+
+/**
+ * @brief Deduces the class that declares a const member function with the
+ * signature R(Args...), picking it out of an overload set if necessary.
+ */
+template <typename R, typename... Args>
+struct member_owner {
+  template <typename C>
+  static C deduce(R (C::*)(Args...) const);
+};
+
+/**
+ * @brief True if TImpl itself declares the member selected by TOwner, rather
+ * than inheriting it from Allocator<TImpl>.
+ */
+template <typename TImpl, typename TOwner>
+using is_own_member = std::is_same<TImpl, TOwner>;
+
+/**
+ * @brief Detects whether an implementation class provides its own
+ * reallocate(data, old_size, new_size, alignment).
+ */
+template <typename TImpl, typename = void>
+struct has_reallocate : std::false_type {};
+
+template <typename TImpl>
+struct has_reallocate<
+    TImpl,
+    void_t<decltype(member_owner<void*, void*, size_t, size_t, size_t>::deduce(
+        &TImpl::reallocate))>>
+    : is_own_member<TImpl,
+                    decltype(member_owner<void*, void*, size_t, size_t, size_t>::
+                                 deduce(&TImpl::reallocate))> {};
+
+/**
+ * @brief Detects whether an implementation class provides its own
+ * try_expand_in_place(data, new_size).
+ */
+template <typename TImpl, typename = void>
+struct has_try_expand_in_place : std::false_type {};
+
+template <typename TImpl>
+struct has_try_expand_in_place<
+    TImpl,
+    void_t<decltype(member_owner<bool, void*, size_t>::deduce(
+        &TImpl::try_expand_in_place))>>
+    : is_own_member<TImpl,
+                    decltype(member_owner<bool, void*, size_t>::deduce(
+                        &TImpl::try_expand_in_place))> {};
+
+/**
+ * @brief Detects whether an implementation class provides a sized
+ * deallocate(data, size, alignment).
+ *
+ * NOTE: Every implementation declares deallocate(data), which hides the
+ * sized overload in Allocator<TImpl>, so no inherited match is possible.
+ */
+template <typename TImpl, typename = void>
+struct has_sized_deallocate : std::false_type {};
+
+template <typename TImpl>
+struct has_sized_deallocate<
+    TImpl,
+    void_t<decltype(static_cast<void (TImpl::*)(void*, size_t, size_t) const>(
+        &TImpl::deallocate))>> : std::true_type {};
+
+/**
+ * @brief Detects whether an implementation class can tell whether it owns a
+ * block, via owns(data).
+ */
+template <typename TImpl, typename = void>
+struct has_owns : std::false_type {};
+
+template <typename TImpl>
+struct has_owns<TImpl,
+                void_t<decltype(std::declval<const TImpl&>().owns(
+                    std::declval<const void*>()))>> : std::true_type {};
+
+/**
+ * @brief Detects whether an implementation class can release every block at
+ * once, via deallocate_all().
+ */
+template <typename TImpl, typename = void>
+struct has_deallocate_all : std::false_type {};
+
+template <typename TImpl>
+struct has_deallocate_all<
+    TImpl,
+    void_t<decltype(std::declval<const TImpl&>().deallocate_all())>>
+    : std::true_type {};
+
+/**
+ * @brief Detects whether an implementation class provides
+ * allocate_bulk(size, alignment, blocks, count).
+ */
+template <typename TImpl, typename = void>
+struct has_allocate_bulk : std::false_type {};
+
+template <typename TImpl>
+struct has_allocate_bulk<
+    TImpl,
+    void_t<decltype(std::declval<const TImpl&>().allocate_bulk(
+        size_t(), size_t(), std::declval<void**>(), size_t()))>>
+    : std::true_type {};
+
+/**
+ * @brief Detects whether an implementation class can report the usable size
+ * of a block, via usable_size(data).
+ */
+template <typename TImpl, typename = void>
+struct has_usable_size : std::false_type {};
+
+template <typename TImpl>
+struct has_usable_size<TImpl,
+                       void_t<decltype(std::declval<const TImpl&>().usable_size(
+                           std::declval<const void*>()))>> : std::true_type {};
+
+} // namespace detail
+
+/**
+ * @brief Uniform access to the optional parts of an allocator implementation.
+ *
+ * Every function takes the implementation object and calls its own member if
+ * it has one, otherwise a fallback chosen at compile time; there is no runtime
+ * check. Use it from adapters and composites, which shouldn't care which
+ * capabilities their parts have:
+ *
+ *   - owns(data): no fallback; a compile error if missing.
+ *   - reallocate(): try_expand_in_place(), then allocate-copy-deallocate.
+ *   - try_expand_in_place(): always fails.
+ *   - sized deallocate(): deallocate(data).
+ *   - deallocate_all(): does nothing and returns false.
+ *   - allocate_bulk(): allocate() in a loop.
+ *   - usable_size(data, size): size.
+ *
+ * The has_* members say which are native, e.g. to static_assert on them.
+ *
+ * @tparam TImpl Allocator implementation class.
+ */
+template <typename TImpl>
+struct AllocatorTraits {
+  using has_owns = detail::has_owns<TImpl>;
+  using has_reallocate = detail::has_reallocate<TImpl>;
+  using has_try_expand_in_place = detail::has_try_expand_in_place<TImpl>;
+  using has_sized_deallocate = detail::has_sized_deallocate<TImpl>;
+  using has_deallocate_all = detail::has_deallocate_all<TImpl>;
+  using has_allocate_bulk = detail::has_allocate_bulk<TImpl>;
+  using has_usable_size = detail::has_usable_size<TImpl>;
+
+  static bool owns(const TImpl& allocator, const void* data) {
+    static_assert(has_owns::value, "Allocator does not provide owns()");
+    return allocator.owns(data);
+  }
+
+  /**
+   * @brief Resize a block of memory, preserving its contents.
+   *
+   * NOTE: Like realloc(), returns nullptr and leaves the original block
+   * untouched if the new block can't be allocated.
+   */
+  static void* reallocate(const TImpl& allocator,
+                          void* data,
+                          size_t old_size,
+                          size_t new_size,
+                          size_t alignment) {
+    return reallocate(
+        allocator, data, old_size, new_size, alignment, has_reallocate());
+  }
+
+  static bool try_expand_in_place(const TImpl& allocator,
+                                  void* data,
+                                  size_t new_size) {
+    return try_expand_in_place(
+        allocator, data, new_size, has_try_expand_in_place());
+  }
+
+  static void deallocate(const TImpl& allocator,
+                         void* data,
+                         size_t size,
+                         size_t alignment) {
+    deallocate(allocator, data, size, alignment, has_sized_deallocate());
+  }
+
+  /**
+   * @brief Releases every block the allocator has handed out.
+   *
+   * @return true If the allocator supports it (and so did it).
+   * @return false If the allocator has no deallocate_all().
+   */
+  static bool deallocate_all(const TImpl& allocator) {
+    return deallocate_all(allocator, has_deallocate_all());
+  }
+
+  /**
+   * @brief Allocates count blocks of the same size and alignment.
+   *
+   * @param blocks Receives the blocks; must have room for count pointers.
+   * @return size_t Number of blocks allocated; less than count only if the
+   * allocator ran out of memory.
+   */
+  static size_t allocate_bulk(const TImpl& allocator,
+                              size_t size,
+                              size_t alignment,
+                              void** blocks,
+                              size_t count) {
+    return allocate_bulk(
+        allocator, size, alignment, blocks, count, has_allocate_bulk());
+  }
+
+  /**
+   * @brief Returns the number of bytes actually available in a block, which
+   * may be more than were asked for.
+   *
+   * @param size Size of the block as originally requested.
+   */
+  static size_t usable_size(const TImpl& allocator,
+                            const void* data,
+                            size_t size) {
+    return usable_size(allocator, data, size, has_usable_size());
+  }
+
+private:
+  static void* reallocate(const TImpl& allocator,
+                          void* data,
+                          size_t old_size,
+                          size_t new_size,
+                          size_t alignment,
+                          std::true_type) {
+    return allocator.reallocate(data, old_size, new_size, alignment);
+  }
+
+  static void* reallocate(const TImpl& allocator,
+                          void* data,
+                          size_t old_size,
+                          size_t new_size,
+                          size_t alignment,
+                          std::false_type) {
+    if (!data) {
+      return allocator.allocate(new_size, alignment);
+    }
+
+    if (try_expand_in_place(allocator, data, new_size)) {
+      return data;
+    }
+
+    void* new_data = allocator.allocate(new_size, alignment);
+    if (new_data) {
+      std::memcpy(new_data, data, std::min(old_size, new_size));
+      deallocate(allocator, data, old_size, alignment);
+    }
+
+    return new_data;
+  }
+
+  static bool try_expand_in_place(const TImpl& allocator,
+                                  void* data,
+                                  size_t new_size,
+                                  std::true_type) {
+    return allocator.try_expand_in_place(data, new_size);
+  }
+
+  static bool
+  try_expand_in_place(const TImpl&, void*, size_t, std::false_type) {
+    return false;
+  }
+
+  static void deallocate(const TImpl& allocator,
+                         void* data,
+                         size_t size,
+                         size_t alignment,
+                         std::true_type) {
+    allocator.deallocate(data, size, alignment);
+  }
+
+  static void deallocate(
+      const TImpl& allocator, void* data, size_t, size_t, std::false_type) {
+    allocator.deallocate(data);
+  }
+
+  static bool deallocate_all(const TImpl& allocator, std::true_type) {
+    allocator.deallocate_all();
+    return true;
+  }
+
+  static bool deallocate_all(const TImpl&, std::false_type) { return false; }
+
+  static size_t allocate_bulk(const TImpl& allocator,
+                              size_t size,
+                              size_t alignment,
+                              void** blocks,
+                              size_t count,
+                              std::true_type) {
+    return allocator.allocate_bulk(size, alignment, blocks, count);
+  }
+
+  static size_t allocate_bulk(const TImpl& allocator,
+                              size_t size,
+                              size_t alignment,
+                              void** blocks,
+                              size_t count,
+                              std::false_type) {
+    size_t allocated = 0;
+    while (allocated < count) {
+      auto block = allocator.allocate(size, alignment);
+      if (!block) {
+        break;
+      }
+      blocks[allocated++] = block;
+    }
+    return allocated;
+  }
+
+  static size_t usable_size(const TImpl& allocator,
+                            const void* data,
+                            size_t,
+                            std::true_type) {
+    return allocator.usable_size(data);
+  }
+
+  static size_t
+  usable_size(const TImpl&, const void*, size_t size, std::false_type) {
+    return size;
+  }
+};
+
+} // namespace allok8or
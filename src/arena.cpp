@@ -0,0 +1,510 @@
+/**
+ * @file arena.cpp
+ * @brief Implementation of the hierarchical arena allocator.
+ *
+ */
+
+// My header
+#include "arena.h"
+
+// Project headers
+#include "align.h"
+#include "logging.h"
+#include "memory.h"
+
+// Library headers
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace allok8or {
+
+/**
+ * @brief Header at the start of each page used by an arena.
+ * Links the arena's pages so they can all be returned at once.
+ */
+struct Arena::ArenaPage {
+  ArenaPage* next;
+};
+
+/**
+ * @brief Header at the start of a run of system pages holding one allocation
+ * too large for a page.
+ */
+struct Arena::LargeRun {
+  LargeRun* next;
+  size_t size; // Of the whole run, this header included.
+};
+
+/**
+ * @brief Constructor for a root arena.
+ *
+ * @param page_allocator Source of the pages used by this arena and all of its
+ * descendants. Must outlive the arena.
+ */
+Arena::Arena(PageAllocator& page_allocator)
+    : m_page_allocator(page_allocator),
+      m_parent(nullptr),
+      m_first_child(nullptr),
+      m_prev_sibling(nullptr),
+      m_next_sibling(nullptr),
+      m_pages(nullptr),
+      m_cursor(nullptr),
+      m_end(nullptr),
+      m_last(nullptr),
+      m_num_pages(0),
+      m_large_runs(nullptr),
+      m_large_runs_start(UINTPTR_MAX),
+      m_large_runs_end(0),
+      m_granule_shift(granule_shift(page_allocator)),
+      m_page_map(nullptr),
+      m_page_map_capacity(0),
+      m_page_map_size(0),
+      m_destructors(nullptr) {}
+
+/**
+ * @brief Constructor for a child arena.
+ *
+ * The child borrows pages from its parent's PageAllocator, and is released
+ * along with the parent if it has not already been destroyed.
+ *
+ * @param parent The parent arena; must not be nullptr.
+ */
+Arena::Arena(Arena* parent)
+    : m_page_allocator(parent->m_page_allocator),
+      m_parent(parent),
+      m_first_child(nullptr),
+      m_prev_sibling(nullptr),
+      m_next_sibling(nullptr),
+      m_pages(nullptr),
+      m_cursor(nullptr),
+      m_end(nullptr),
+      m_last(nullptr),
+      m_num_pages(0),
+      m_large_runs(nullptr),
+      m_large_runs_start(UINTPTR_MAX),
+      m_large_runs_end(0),
+      m_granule_shift(parent->m_granule_shift),
+      m_page_map(nullptr),
+      m_page_map_capacity(0),
+      m_page_map_size(0),
+      m_destructors(nullptr) {
+  parent->attach(this);
+}
+
+/**
+ * @brief Destructor
+ * Releases this arena and all of its descendants, then detaches it from its
+ * parent (if any).
+ */
+Arena::~Arena() {
+  release();
+
+  if (m_page_map) {
+    memory::aligned_free(m_page_map);
+  }
+
+  if (m_parent) {
+    m_parent->detach(this);
+  }
+}
+
+/**
+ * @brief Allocates memory from the current page, borrowing a new page from the
+ * PageAllocator if the current one is exhausted. Requests too large for a page
+ * get a run of their own; see allocate_large().
+ *
+ * @param size The number of bytes to allocate.
+ * @param alignment Alignment of the returned memory; must be a power of 2.
+ * @return void* Pointer to the allocated memory, or nullptr on failure.
+ */
+void* Arena::allocate(size_t size, size_t alignment) const {
+  assert(alignment && !(alignment & (alignment - 1)));
+
+  const size_t capacity =
+      m_page_allocator.user_data_size() - sizeof(ArenaPage);
+  if (size + alignment - 1 > capacity) {
+    return allocate_large(size, alignment);
+  }
+
+  char* start = nullptr;
+  if (m_cursor) {
+    start = static_cast<char*>(
+        align::get_next_aligned_address(m_cursor, alignment));
+  }
+
+  if (!start || start > m_end || static_cast<size_t>(m_end - start) < size) {
+    if (!add_page()) {
+      return nullptr;
+    }
+
+    start = static_cast<char*>(
+        align::get_next_aligned_address(m_cursor, alignment));
+  }
+
+  assert(static_cast<size_t>(m_end - start) >= size);
+  m_cursor = start + size;
+  m_last = start;
+
+  return start;
+}
+
+/**
+ * @brief Does nothing; arena memory is reclaimed only by release().
+ */
+void Arena::deallocate(void*) const {}
+
+/**
+ * @brief Grows or shrinks the most recent allocation without moving it, if
+ * the current page has room.
+ *
+ * @param user_data Block to resize.
+ * @param new_size Requested new size of the block.
+ * @return true If the block was resized.
+ * @return false If the block is not the most recent allocation, or the page
+ * is too small.
+ */
+bool Arena::try_expand_in_place(void* user_data, size_t new_size) const {
+  char* block = static_cast<char*>(user_data);
+  if (!block || block != m_last ||
+      static_cast<size_t>(m_end - block) < new_size) {
+    return false;
+  }
+
+  m_cursor = block + new_size;
+  return true;
+}
+
+/**
+ * @brief Returns true if the given block was allocated from one of this
+ * arena's pages or large runs (not its children's).
+ *
+ * NOTE: Looks up the pages overlapping the block's granule in the page map, so
+ * the cost doesn't grow with the number of pages. Large runs (rare) are walked
+ * only if the block is within their bounds.
+ */
+bool Arena::owns(const void* user_data) const {
+  const auto address = reinterpret_cast<uintptr_t>(user_data);
+
+  if (m_page_map_size) {
+    const auto granule = address >> m_granule_shift;
+    for (auto slot = page_map_slot(granule); m_page_map[slot].page;
+         slot = (slot + 1) & (m_page_map_capacity - 1)) {
+      const auto& entry = m_page_map[slot];
+      const auto start = reinterpret_cast<uintptr_t>(entry.page);
+      if (entry.granule == granule && address >= start + sizeof(ArenaPage) &&
+          address < start + m_page_allocator.user_data_size()) {
+        return true;
+      }
+    }
+  }
+
+  if (address >= m_large_runs_start && address < m_large_runs_end) {
+    for (LargeRun* run = m_large_runs; run; run = run->next) {
+      const auto start = reinterpret_cast<uintptr_t>(run);
+      if (address >= start + sizeof(LargeRun) && address < start + run->size) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Registers a destructor to be called on the given object when the
+ * arena is released.
+ *
+ * @param object Object to be destroyed; normally allocated from this arena.
+ * @param destructor Function that destroys the object.
+ * @return true If the destructor was registered.
+ * @return false If out of memory.
+ */
+bool Arena::register_destructor(void* object, Destructor destructor) const {
+  assert(destructor);
+
+  DestructorRecord* record = allocate_destructor_record();
+  if (!record) {
+    return false;
+  }
+
+  record->destructor = destructor;
+  record->object = object;
+  record->next = m_destructors;
+  m_destructors = record;
+
+  return true;
+}
+
+/**
+ * @brief Releases everything owned by the arena.
+ *
+ * Releases all descendant arenas first, then runs registered destructors in
+ * reverse order of registration, then returns all pages to the PageAllocator.
+ * Cost is proportional to the number of descendants, registered destructors
+ * and pages, never to the number of allocations.
+ *
+ * Released children are detached from this arena; they remain valid (and
+ * empty) until they are destroyed by their owners.
+ */
+void Arena::release() const {
+  while (m_first_child) {
+    Arena* child = m_first_child;
+    child->release();
+    detach(child);
+  }
+
+  while (m_destructors) {
+    DestructorRecord* record = m_destructors;
+    m_destructors = record->next;
+    record->destructor(record->object);
+  }
+
+  while (m_pages) {
+    ArenaPage* page = m_pages;
+    m_pages = page->next;
+    m_page_allocator.deallocate(page);
+  }
+
+  while (m_large_runs) {
+    LargeRun* run = m_large_runs;
+    m_large_runs = run->next;
+    memory::unmap_pages(run, run->size);
+  }
+  m_large_runs_start = UINTPTR_MAX;
+  m_large_runs_end = 0;
+
+  if (m_page_map_size) {
+    std::memset(m_page_map, 0, m_page_map_capacity * sizeof(PageMapEntry));
+    m_page_map_size = 0;
+  }
+
+  m_cursor = nullptr;
+  m_end = nullptr;
+  m_last = nullptr;
+  m_num_pages = 0;
+}
+
+/**
+ * @brief Returns the number of runs holding allocations too large for a page.
+ */
+size_t Arena::num_large_runs() const {
+  size_t count = 0;
+  for (LargeRun* run = m_large_runs; run; run = run->next) {
+    ++count;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Returns the number of child arenas currently attached.
+ */
+size_t Arena::num_children() const {
+  size_t count = 0;
+  for (Arena* child = m_first_child; child; child = child->m_next_sibling) {
+    ++count;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Borrows a new page from the PageAllocator and makes it current.
+ *
+ * @return true If a page was added.
+ * @return false If out of memory.
+ */
+bool Arena::add_page() const {
+  void* memory = m_page_allocator.allocate();
+  if (!memory) {
+    LOG_ERROR("Arena failed to allocate new page.");
+    return false;
+  }
+
+  ArenaPage* page = ::new (memory) ArenaPage{m_pages};
+  if (!map_page(page)) {
+    LOG_ERROR("Arena failed to grow its page map.");
+    m_page_allocator.deallocate(memory);
+    return false;
+  }
+  m_pages = page;
+  ++m_num_pages;
+
+  m_last = nullptr;
+  m_cursor = reinterpret_cast<char*>(page) + sizeof(ArenaPage);
+  m_end = reinterpret_cast<char*>(page) + m_page_allocator.user_data_size();
+
+  return true;
+}
+
+/**
+ * @brief Maps a run of system pages for one allocation too large for a page;
+ * it's unmapped by release().
+ *
+ * NOTE: Doesn't change the current page, so doesn't become the most recent
+ * allocation either; it can't be resized in place.
+ *
+ * @return void* Pointer to the allocated memory, or nullptr on failure.
+ */
+void* Arena::allocate_large(size_t size, size_t alignment) const {
+  const size_t page_size = memory::system_page_size();
+  if (size > SIZE_MAX - sizeof(LargeRun) - alignment - page_size) {
+    LOG_ERROR("Arena allocation of [%zu] bytes is too large.", size);
+    return nullptr;
+  }
+
+  const size_t run_size =
+      (sizeof(LargeRun) + alignment - 1 + size + page_size - 1) &
+      ~(page_size - 1);
+  void* memory = memory::map_pages(run_size);
+  if (!memory) {
+    LOG_ERROR("Arena failed to map [%zu] bytes for a large allocation.",
+              run_size);
+    return nullptr;
+  }
+
+  LargeRun* run = ::new (memory) LargeRun{m_large_runs, run_size};
+  m_large_runs = run;
+
+  const auto start = reinterpret_cast<uintptr_t>(run);
+  if (start < m_large_runs_start) {
+    m_large_runs_start = start;
+  }
+  if (start + run_size > m_large_runs_end) {
+    m_large_runs_end = start + run_size;
+  }
+  m_last = nullptr;
+
+  return align::get_next_aligned_address(
+      reinterpret_cast<char*>(run) + sizeof(LargeRun), alignment);
+}
+
+/**
+ * @brief Returns log2 of the granule size: the page size rounded up to a power
+ * of 2.
+ */
+size_t Arena::granule_shift(PageAllocator& page_allocator) {
+  size_t shift = 0;
+  while ((static_cast<size_t>(1) << shift) < page_allocator.page_size()) {
+    ++shift;
+  }
+  return shift;
+}
+
+/**
+ * @brief Returns the page map slot to start probing at for a granule.
+ */
+size_t Arena::page_map_slot(uintptr_t granule) const {
+  return static_cast<size_t>((granule * 0x9e3779b97f4a7c15ull) >> 32) &
+         (m_page_map_capacity - 1);
+}
+
+/**
+ * @brief Adds a page to the page map, under each granule it overlaps.
+ *
+ * @return false If the map couldn't grow; it's unchanged.
+ */
+bool Arena::map_page(ArenaPage* page) const {
+  // Kept at most half full, so probes stay short.
+  if ((m_page_map_size + 2) * 2 > m_page_map_capacity && !grow_page_map()) {
+    return false;
+  }
+
+  const auto start = reinterpret_cast<uintptr_t>(page);
+  const auto end = start + m_page_allocator.user_data_size();
+  for (auto granule = start >> m_granule_shift;
+       granule <= (end - 1) >> m_granule_shift;
+       ++granule) {
+    auto slot = page_map_slot(granule);
+    while (m_page_map[slot].page) {
+      slot = (slot + 1) & (m_page_map_capacity - 1);
+    }
+    m_page_map[slot] = PageMapEntry{granule, page};
+    ++m_page_map_size;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Doubles the page map, rehashing its entries.
+ */
+bool Arena::grow_page_map() const {
+  const size_t new_capacity =
+      m_page_map_capacity ? m_page_map_capacity * 2 : 16;
+  auto new_map = static_cast<PageMapEntry*>(memory::aligned_malloc(
+      new_capacity * sizeof(PageMapEntry), alignof(PageMapEntry)));
+  if (!new_map) {
+    return false;
+  }
+  std::memset(new_map, 0, new_capacity * sizeof(PageMapEntry));
+
+  auto old_map = m_page_map;
+  const auto old_capacity = m_page_map_capacity;
+  m_page_map = new_map;
+  m_page_map_capacity = new_capacity;
+
+  for (size_t ix = 0; ix < old_capacity; ++ix) {
+    if (old_map[ix].page) {
+      auto slot = page_map_slot(old_map[ix].granule);
+      while (m_page_map[slot].page) {
+        slot = (slot + 1) & (m_page_map_capacity - 1);
+      }
+      m_page_map[slot] = old_map[ix];
+    }
+  }
+
+  if (old_map) {
+    memory::aligned_free(old_map);
+  }
+  return true;
+}
+
+/**
+ * @brief Allocates an (unlinked) destructor record from the arena.
+ */
+Arena::DestructorRecord* Arena::allocate_destructor_record() const {
+  return static_cast<DestructorRecord*>(
+      allocate(sizeof(DestructorRecord), alignof(DestructorRecord)));
+}
+
+/**
+ * @brief Links a child arena into this arena's list of children.
+ */
+void Arena::attach(Arena* child) {
+  assert(child);
+  assert(!child->m_prev_sibling && !child->m_next_sibling);
+
+  child->m_parent = this;
+  child->m_next_sibling = m_first_child;
+  if (m_first_child) {
+    m_first_child->m_prev_sibling = child;
+  }
+  m_first_child = child;
+}
+
+/**
+ * @brief Unlinks a child arena from this arena's list of children.
+ */
+void Arena::detach(Arena* child) const {
+  assert(child);
+  assert(child->m_parent == this);
+
+  if (child->m_prev_sibling) {
+    child->m_prev_sibling->m_next_sibling = child->m_next_sibling;
+  } else {
+    assert(m_first_child == child);
+    m_first_child = child->m_next_sibling;
+  }
+
+  if (child->m_next_sibling) {
+    child->m_next_sibling->m_prev_sibling = child->m_prev_sibling;
+  }
+
+  child->m_parent = nullptr;
+  child->m_prev_sibling = nullptr;
+  child->m_next_sibling = nullptr;
+}
+
+} // namespace allok8or
@@ -0,0 +1,196 @@
+/**
+ * @file arena.h
+ * @brief Header for a hierarchical arena allocator backed by a PageAllocator.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+#include "page.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace allok8or {
+
+/**
+ * @brief Linear allocator that carves allocations out of pages borrowed from a
+ * PageAllocator, and releases all of them at once.
+ *
+ * Arenas form a hierarchy: a child arena borrows pages from the same
+ * PageAllocator as its parent, and hands them back when the child is
+ * destroyed. Destroying (or releasing) a parent releases all of its descendants
+ * first, so tearing down a whole tree of arenas never walks individual
+ * allocations.
+ *
+ * Objects with non-trivial destructors may be registered with the arena (see
+ * create() and register_destructor()); their destructors run in reverse order
+ * of registration when the arena is released. Nothing else is visited.
+ *
+ * NOTE: Individual deallocation is a no-op; memory is reclaimed by release().
+ * NOTE: Only the most recent allocation can be resized in place.
+ * NOTE: This allocator cannot be copied; it must be shared.
+ * NOTE: Allocations too large for a page get a run of system pages of their
+ * own, returned with the arena's pages.
+ * TODO: Not thread safe.
+ */
+class Arena : public Allocator<Arena> {
+public:
+  typedef void (*Destructor)(void*);
+
+  explicit Arena(PageAllocator& page_allocator);
+  explicit Arena(Arena* parent);
+  ~Arena();
+
+  // No copies; share this when appropriate.
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void deallocate(void* user_data) const;
+  bool try_expand_in_place(void* user_data, size_t new_size) const;
+  bool owns(const void* user_data) const;
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) const;
+
+  bool register_destructor(void* object, Destructor destructor) const;
+
+  void release() const;
+  void deallocate_all() const { release(); }
+
+  // Accessors
+  PageAllocator& page_allocator() const { return m_page_allocator; }
+  Arena* parent() const { return m_parent; }
+  size_t num_pages() const { return m_num_pages; }
+  size_t num_large_runs() const;
+  size_t num_children() const;
+
+private:
+  struct ArenaPage;
+  struct LargeRun;
+  struct DestructorRecord;
+
+  // Entry of the page map: a page overlapping a granule (see owns()).
+  struct PageMapEntry {
+    uintptr_t granule;
+    ArenaPage* page; // nullptr when the slot is empty.
+  };
+
+  template <typename T>
+  static void destroy(void* object) {
+    static_cast<T*>(object)->~T();
+  }
+
+  bool add_page() const;
+  void* allocate_large(size_t size, size_t alignment) const;
+
+  static size_t granule_shift(PageAllocator& page_allocator);
+  size_t page_map_slot(uintptr_t granule) const;
+  bool map_page(ArenaPage* page) const;
+  bool grow_page_map() const;
+  DestructorRecord* allocate_destructor_record() const;
+
+  void attach(Arena* child);
+  void detach(Arena* child) const;
+
+  PageAllocator& m_page_allocator;
+
+  // Hierarchy (intrusive lists, so attaching/detaching never allocates).
+  Arena* m_parent;
+  mutable Arena* m_first_child;
+  Arena* m_prev_sibling;
+  Arena* m_next_sibling;
+
+  // Linear allocation state. mutable required because all
+  // Allocator<T>-derived classes must have const API.
+  mutable ArenaPage* m_pages;
+  mutable char* m_cursor;
+  mutable char* m_end;
+  mutable char* m_last; // Most recent allocation; may be resized in place.
+  mutable size_t m_num_pages;
+  mutable LargeRun* m_large_runs;
+  mutable uintptr_t m_large_runs_start; // Bounds of all the large runs.
+  mutable uintptr_t m_large_runs_end;
+
+  // Pages by the granules they overlap, so owns() needn't walk them. A
+  // granule is the page size rounded up to a power of 2, so each page
+  // overlaps at most two.
+  const size_t m_granule_shift;
+  mutable PageMapEntry* m_page_map;
+  mutable size_t m_page_map_capacity; // 0 or a power of 2.
+  mutable size_t m_page_map_size;
+  mutable DestructorRecord* m_destructors;
+};
+
+/**
+ * @brief Equality test. Arenas are unique, so equal only to themselves.
+ */
+inline bool operator==(const Arena& lhs, const Arena& rhs) {
+  return &lhs == &rhs;
+}
+
+/**
+ * @brief Inequality test. Arenas are unique, so equal only to themselves.
+ */
+inline bool operator!=(const Arena& lhs, const Arena& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Record of a registered destructor, allocated in the arena itself.
+ */
+struct Arena::DestructorRecord {
+  Destructor destructor;
+  void* object;
+  DestructorRecord* next;
+};
+
+/**
+ * @brief Allocate memory for, and construct, an object of type T in the arena.
+ *
+ * If T is not trivially destructible, its destructor is registered to run
+ * when the arena is released.
+ *
+ * @tparam T Type of the object to create.
+ * @tparam Args Types of the constructor arguments.
+ * @param args Arguments forwarded to the constructor of T.
+ * @return T* Pointer to the new object, or nullptr if out of memory.
+ */
+template <typename T, typename... Args>
+T* Arena::create(Args&&... args) const {
+  DestructorRecord* record = nullptr;
+  if (!std::is_trivially_destructible<T>::value) {
+    // Reserve the record first so a constructed object is never left without
+    // its destructor.
+    record = allocate_destructor_record();
+    if (!record) {
+      return nullptr;
+    }
+  }
+
+  void* memory = allocate(sizeof(T), alignof(T));
+  if (!memory) {
+    return nullptr;
+  }
+
+  T* object = ::new (memory) T(std::forward<Args>(args)...);
+
+  if (record) {
+    record->destructor = &destroy<T>;
+    record->object = object;
+    record->next = m_destructors;
+    m_destructors = record;
+  }
+
+  return object;
+}
+
+} // namespace allok8or
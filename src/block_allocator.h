@@ -10,16 +10,40 @@
 #include "fixed_block_header.h"
 #include "fixed_block_pool.h"
 #include "fixed_size_allocator.h"
+#include "logging.h"
+#include "page.h"
 
 // Library headers
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 
 namespace allok8or {
-template <size_t TSize, size_t TAlign, typename TPageAllocator>
+
+/**
+ * @brief Pool allocator for blocks of TSize bytes, aligned to TAlign.
+ *
+ * Pages are borrowed from a PageAllocator and carved into blocks, each with a
+ * FixedBlockHeader in front of it. Free blocks are kept in a FixedBlockPool;
+ * allocating and deallocating a block is a pop/push at the head of that list.
+ * Pages are returned to the PageAllocator only when this allocator is
+ * destroyed.
+ *
+ * NOTE: This allocator cannot be copied; it must be shared.
+ * TODO: Not thread safe.
+ *
+ * @tparam TSize Size of the blocks this allocator creates.
+ * @tparam TAlign Memory alignment of the blocks this allocator creates.
+ * @tparam TPageAllocator Type of the allocator that supplies pages.
+ */
+template <size_t TSize, size_t TAlign, typename TPageAllocator = PageAllocator>
 class BlockAllocator
-    : public FixedSizeAllocator<BlockAllocator<TSize, TAlign>> {
+    : public FixedSizeAllocator<BlockAllocator<TSize, TAlign, TPageAllocator>,
+                                TSize,
+                                TAlign> {
 public:
-  constexpr BlockAllocator() = default;
+  explicit BlockAllocator(TPageAllocator& page_allocator);
+  ~BlockAllocator();
 
   // No copies; share this when appropriate.
   BlockAllocator(const BlockAllocator&) = delete;
@@ -28,42 +52,184 @@ public:
   BlockAllocator& operator=(const BlockAllocator&&) = delete;
 
   // Allocation API
-  constexpr void* allocate() const;
-  constexpr void deallocate(void* user_data) const;
+  void* allocate() const;
+  void deallocate(void* user_data) const;
 
-private:
-  PageHeader* get_page();
+  // Accessors
+  TPageAllocator& page_allocator() const { return m_page_allocator; }
+  size_t num_pages() const { return m_num_pages; }
+  size_t num_allocated() const { return m_num_allocated; }
+  size_t num_free() const { return static_cast<size_t>(m_pool.num_blocks()); }
 
+private:
   using BlockHeaderT = FixedBlockHeader<TSize, TAlign>;
   using PoolT = FixedBlockPool<BlockHeaderT>;
 
-  PoolT m_pool; 
-  TPageAllocator m_page_allocator;
+  // Start of each page borrowed from the page allocator.
+  struct BlockPage {
+    BlockPage* next;
+  };
+
+  static constexpr size_t round_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  // Offset of the user data from the start of its header.
+  static constexpr size_t header_size =
+      align::get_aligned_size(sizeof(BlockHeaderT), alignof(BlockHeaderT));
+  static constexpr size_t block_alignment =
+      TAlign > alignof(BlockHeaderT) ? TAlign : alignof(BlockHeaderT);
+  static constexpr size_t block_stride =
+      round_up(header_size + TSize, block_alignment);
+
+  bool add_page() const;
+
+  TPageAllocator& m_page_allocator;
+
+  // mutable required because all allocators must have const API.
+  mutable PoolT m_pool;
+  mutable BlockPage* m_pages;
+  mutable size_t m_num_pages;
+  mutable size_t m_num_allocated;
 };
 
 template <size_t TSize, size_t TAlign, typename TPageAllocator>
-inline constexpr bool
+inline bool
 operator==(const BlockAllocator<TSize, TAlign, TPageAllocator>& lhs,
            const BlockAllocator<TSize, TAlign, TPageAllocator>& rhs) {
   return &lhs == &rhs;
 }
 
 template <size_t TSize, size_t TAlign, typename TPageAllocator>
-inline constexpr bool
+inline bool
 operator!=(const BlockAllocator<TSize, TAlign, TPageAllocator>& lhs,
            const BlockAllocator<TSize, TAlign, TPageAllocator>& rhs) {
   return !(&lhs == &rhs);
 }
 
+/**
+ * @brief Constructor. No pages are borrowed until the first allocation.
+ *
+ * @param page_allocator Allocator that supplies the pages to carve into blocks.
+ */
+template <size_t TSize, size_t TAlign, typename TPageAllocator>
+BlockAllocator<TSize, TAlign, TPageAllocator>::BlockAllocator(
+    TPageAllocator& page_allocator)
+    : m_page_allocator(page_allocator),
+      m_pages(nullptr),
+      m_num_pages(0),
+      m_num_allocated(0) {}
+
+/**
+ * @brief Destructor. Returns all pages to the page allocator.
+ *
+ * Logs an error if any blocks are still in use.
+ */
+template <size_t TSize, size_t TAlign, typename TPageAllocator>
+BlockAllocator<TSize, TAlign, TPageAllocator>::~BlockAllocator() {
+  if (m_num_allocated) {
+    LOG_ERROR("Detected memory leaks when deleting BlockAllocator<%zu, %zu>; "
+              "leaking [%zu] blocks.",
+              TSize,
+              TAlign,
+              m_num_allocated);
+  }
+
+  // Empty the free list so the pool doesn't mistake free blocks for leaks.
+  while (m_pool.get()) {
+  }
+
+  while (m_pages) {
+    auto page = m_pages;
+    m_pages = page->next;
+    m_page_allocator.deallocate(page);
+  }
+}
+
+/**
+ * @brief Allocates one block, borrowing a new page if none are free.
+ *
+ * @return void* Pointer to the user data of the block, or nullptr if out of
+ * memory.
+ */
 template <size_t TSize, size_t TAlign, typename TPageAllocator>
-inline constexpr void*
-BlockAllocator<TSize, TAlign, TPageAllocator>::allocate() const {
+void* BlockAllocator<TSize, TAlign, TPageAllocator>::allocate() const {
   auto block = m_pool.get();
   if (!block) {
-    auto page = m_page_allocator.allocate();
+    if (!add_page()) {
+      return nullptr;
+    }
+    block = m_pool.get();
+  }
+
+  ++m_num_allocated;
+  return block->user_data();
+}
+
+/**
+ * @brief Returns a block to the pool.
+ *
+ * @param user_data Pointer to the user data of the block to deallocate.
+ */
+template <size_t TSize, size_t TAlign, typename TPageAllocator>
+void BlockAllocator<TSize, TAlign, TPageAllocator>::deallocate(
+    void* user_data) const {
+  if (!user_data) {
+    return;
+  }
+
+  assert(m_num_allocated);
+  m_pool.add(BlockHeaderT::get_header(user_data));
+  --m_num_allocated;
+}
+
+/**
+ * @brief Borrows a page and carves it into free blocks.
+ *
+ * @return true If the page was added.
+ * @return false If the page allocator is out of memory, or its pages are too
+ * small for a single block.
+ */
+template <size_t TSize, size_t TAlign, typename TPageAllocator>
+bool BlockAllocator<TSize, TAlign, TPageAllocator>::add_page() const {
+  auto memory = m_page_allocator.allocate();
+  if (!memory) {
+    LOG_ERROR("Failed to allocate page for BlockAllocator<%zu, %zu>.",
+              TSize,
+              TAlign);
+    return false;
+  }
+
+  auto page_start = reinterpret_cast<uintptr_t>(memory);
+  auto page_end = page_start + m_page_allocator.user_data_size();
+
+  // Place the first header so that its user data is aligned; the stride keeps
+  // the rest aligned too.
+  auto block = round_up(page_start + sizeof(BlockPage) + header_size,
+                        block_alignment) -
+               header_size;
+  if (block + block_stride > page_end) {
+    LOG_ERROR("Page size [%zu] is too small for BlockAllocator<%zu, %zu>.",
+              m_page_allocator.page_size(),
+              TSize,
+              TAlign);
+    m_page_allocator.deallocate(memory);
+    return false;
+  }
+
+  auto page = static_cast<BlockPage*>(memory);
+  page->next = m_pages;
+  m_pages = page;
+  ++m_num_pages;
+
+  // Add in reverse so that blocks are handed out in address order.
+  auto num_blocks = (page_end - block) / block_stride;
+  for (auto ix = num_blocks; ix > 0; --ix) {
+    m_pool.add(BlockHeaderT::create(
+        reinterpret_cast<void*>(block + (ix - 1) * block_stride)));
   }
 
-  m_used_pool.add(block);
+  return true;
 }
 
 } // namespace allok8or
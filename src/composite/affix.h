@@ -0,0 +1,256 @@
+/**
+ * @file affix.h
+ * @brief Header for a composite allocator that stores an object before and/or
+ * after every block.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+
+// Library headers
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace allok8or {
+
+namespace affix {
+
+// Size of an affix; void means none.
+template <typename T>
+struct affix_size : std::integral_constant<size_t, sizeof(T)> {};
+
+template <>
+struct affix_size<void> : std::integral_constant<size_t, 0> {};
+
+// Alignment of an affix; void means none.
+template <typename T>
+struct affix_alignment : std::integral_constant<size_t, alignof(T)> {};
+
+template <>
+struct affix_alignment<void> : std::integral_constant<size_t, 1> {};
+
+// Value-initializes an affix in place.
+template <typename T>
+inline void construct(void* where) {
+  new (where) T();
+}
+
+template <>
+inline void construct<void>(void*) {}
+
+} // namespace affix
+
+/**
+ * @brief Wraps every block from TAllocator with a TPrefix object just before
+ * the user memory and a TSuffix object just after it, e.g. for sizes, tags,
+ * reference counts or guard values.
+ *
+ * The affixes are value-initialized on allocation. Either may be void.
+ *
+ * Example:
+ * @code
+ *   struct Guard { uint32_t value = 0xdeadbeef; };
+ *   AffixAllocator<PassThroughAllocator, Guard, Guard> guarded(pass_through);
+ *   auto data = guarded.allocate(100);
+ *   ...
+ *   assert(guarded.prefix(data).value == 0xdeadbeef);
+ *   assert(guarded.suffix(data, 100).value == 0xdeadbeef);
+ * @endcode
+ *
+ * NOTE: Affixes must be trivially destructible; unsized deallocate() can't
+ * find the suffix.
+ * NOTE: A block allocated with more than alignof(std::max_align_t) alignment
+ * must be deallocated with the sized overload, which needs the alignment to
+ * find the start of the block.
+ * NOTE: Holds a reference to the wrapped allocator, which must outlive it.
+ *
+ * @tparam TAllocator Type of the allocator that provides the blocks.
+ * @tparam TPrefix Type of the object stored before each block, or void.
+ * @tparam TSuffix Type of the object stored after each block, or void.
+ */
+template <typename TAllocator, typename TPrefix, typename TSuffix = void>
+class AffixAllocator
+    : public Allocator<AffixAllocator<TAllocator, TPrefix, TSuffix>> {
+  static_assert(std::is_void<TPrefix>::value ||
+                    std::is_trivially_destructible<TPrefix>::value,
+                "AffixAllocator prefix must be trivially destructible");
+  static_assert(std::is_void<TSuffix>::value ||
+                    std::is_trivially_destructible<TSuffix>::value,
+                "AffixAllocator suffix must be trivially destructible");
+
+public:
+  static const size_t PREFIX_SIZE = affix::affix_size<TPrefix>::value;
+  static const size_t SUFFIX_SIZE = affix::affix_size<TSuffix>::value;
+
+  explicit AffixAllocator(Allocator<TAllocator>& allocator)
+      : m_allocator(static_cast<TAllocator&>(allocator)) {}
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+
+  // Affix access
+  template <typename T = TPrefix>
+  static T& prefix(void* user_data) {
+    return *reinterpret_cast<T*>(static_cast<char*>(user_data) - PREFIX_SIZE);
+  }
+
+  template <typename T = TSuffix>
+  static T& suffix(void* user_data, size_t size) {
+    return *reinterpret_cast<T*>(suffix_address(user_data, size));
+  }
+
+  // Accessors
+  TAllocator& allocator() const { return m_allocator; }
+
+private:
+  static constexpr size_t round_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+  // Alignment of the whole block; enough for the prefix and the user memory.
+  static constexpr size_t block_alignment(size_t alignment) {
+    return std::max({alignment,
+                     alignof(std::max_align_t),
+                     affix::affix_alignment<TPrefix>::value,
+                     affix::affix_alignment<TSuffix>::value});
+  }
+
+  // Offset from the start of the block to the user memory.
+  static constexpr size_t user_offset(size_t alignment) {
+    return round_up(PREFIX_SIZE, block_alignment(alignment));
+  }
+
+  static constexpr size_t block_size(size_t size, size_t alignment) {
+    return user_offset(alignment) +
+           round_up(size, affix::affix_alignment<TSuffix>::value) +
+           SUFFIX_SIZE;
+  }
+
+  static char* suffix_address(void* user_data, size_t size) {
+    return static_cast<char*>(user_data) +
+           round_up(size, affix::affix_alignment<TSuffix>::value);
+  }
+
+  const Allocator<TAllocator>& allocator_base() const { return m_allocator; }
+
+  TAllocator& m_allocator;
+};
+
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+const size_t AffixAllocator<TAllocator, TPrefix, TSuffix>::PREFIX_SIZE;
+
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+const size_t AffixAllocator<TAllocator, TPrefix, TSuffix>::SUFFIX_SIZE;
+
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+bool operator==(const AffixAllocator<TAllocator, TPrefix, TSuffix>& lhs,
+                const AffixAllocator<TAllocator, TPrefix, TSuffix>& rhs) {
+  return &lhs.allocator() == &rhs.allocator();
+}
+
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+bool operator!=(const AffixAllocator<TAllocator, TPrefix, TSuffix>& lhs,
+                const AffixAllocator<TAllocator, TPrefix, TSuffix>& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Allocates a block with room for the affixes, and constructs them.
+ *
+ * @return void* Pointer to the user memory, between the affixes.
+ */
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+inline void*
+AffixAllocator<TAllocator, TPrefix, TSuffix>::allocate(size_t size,
+                                                       size_t alignment) const {
+  auto block = static_cast<char*>(allocator_base().allocate(
+      block_size(size, alignment), block_alignment(alignment)));
+  if (!block) {
+    return nullptr;
+  }
+
+  auto user_data = block + user_offset(alignment);
+  affix::construct<TPrefix>(user_data - PREFIX_SIZE);
+  affix::construct<TSuffix>(suffix_address(user_data, size));
+  return user_data;
+}
+
+/**
+ * @brief Resizes a block, carrying the prefix over and re-creating the
+ * suffix at the new end.
+ */
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+void* AffixAllocator<TAllocator, TPrefix, TSuffix>::reallocate(
+    void* user_data,
+    size_t old_size,
+    size_t new_size,
+    size_t alignment) const {
+  if (!user_data) {
+    return allocate(new_size, alignment);
+  }
+
+  const auto offset = user_offset(alignment);
+  auto block = static_cast<char*>(user_data) - offset;
+  block = static_cast<char*>(
+      allocator_base().reallocate(block,
+                                  block_size(old_size, alignment),
+                                  block_size(new_size, alignment),
+                                  block_alignment(alignment)));
+  if (!block) {
+    return nullptr;
+  }
+
+  auto new_data = block + offset;
+  affix::construct<TSuffix>(suffix_address(new_data, new_size));
+  return new_data;
+}
+
+/**
+ * @brief Returns the whole block to the wrapped allocator.
+ *
+ * NOTE: Only for blocks allocated with at most alignof(std::max_align_t)
+ * alignment.
+ */
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+inline void
+AffixAllocator<TAllocator, TPrefix, TSuffix>::deallocate(void* user_data) const {
+  if (!user_data) {
+    return;
+  }
+
+  allocator_base().deallocate(static_cast<char*>(user_data) -
+                              user_offset(alignof(std::max_align_t)));
+}
+
+/**
+ * @brief Returns the whole block to the wrapped allocator, passing along its
+ * size and alignment.
+ */
+template <typename TAllocator, typename TPrefix, typename TSuffix>
+inline void AffixAllocator<TAllocator, TPrefix, TSuffix>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (!user_data) {
+    return;
+  }
+
+  allocator_base().deallocate(static_cast<char*>(user_data) -
+                                  user_offset(alignment),
+                              block_size(size, alignment),
+                              block_alignment(alignment));
+}
+
+} // namespace allok8or
@@ -0,0 +1,304 @@
+/**
+ * @file bucketizer.h
+ * @brief Header for a composite allocator that spreads a range of request
+ * sizes over equally sized buckets, each with its own allocator.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+
+// Library headers
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace allok8or {
+
+/**
+ * @brief Holds one TAllocator per bucket of TStep request sizes between TMin
+ * and TMax bytes inclusive, and sends each request to its bucket's allocator.
+ *
+ * Bucket i serves sizes [TMin + i * TStep, TMin + (i + 1) * TStep - 1], and
+ * always asks its allocator for the largest of those, so a block can grow
+ * within its bucket without moving. Requests outside [TMin, TMax] fail; put a
+ * Segregator or FallbackAllocator in front to handle them.
+ *
+ * The buckets are constructed in place, each from the same constructor
+ * arguments.
+ *
+ * Example:
+ * @code
+ *   // Eight arenas for 1..256 byte requests, sharing one page allocator.
+ *   Bucketizer<Arena, 1, 256, 32> allocator(pages);
+ * @endcode
+ *
+ * NOTE: Unsized deallocate() and try_expand_in_place() ask each bucket whether
+ * it owns the block, so they require owns() on TAllocator.
+ * NOTE: This allocator cannot be copied; it must be shared.
+ *
+ * @tparam TAllocator Type of the allocator for each bucket.
+ * @tparam TMin Smallest request size served.
+ * @tparam TMax Largest request size served.
+ * @tparam TStep Range of request sizes in each bucket.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+class Bucketizer
+    : public Allocator<Bucketizer<TAllocator, TMin, TMax, TStep>> {
+  static_assert(TStep > 0, "Bucketizer requires a non-zero step");
+  static_assert(TMax >= TMin && (TMax - TMin + 1) % TStep == 0,
+                "Bucketizer size range must be a whole number of steps");
+
+public:
+  static const size_t NUM_BUCKETS = (TMax - TMin + 1) / TStep;
+
+  template <typename... TArgs>
+  explicit Bucketizer(TArgs&&... args);
+  ~Bucketizer();
+
+  // No copies; the buckets may hold state.
+  Bucketizer(const Bucketizer&) = delete;
+  Bucketizer& operator=(const Bucketizer&) = delete;
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+  bool try_expand_in_place(void* user_data, size_t new_size) const;
+  size_t allocate_bulk(size_t size,
+                       size_t alignment,
+                       void** blocks,
+                       size_t count) const;
+
+  // Declared only if TAllocator supports them, so that AllocatorTraits
+  // detects them correctly.
+  template <typename T = TAllocator,
+            typename = typename std::enable_if<
+                AllocatorTraits<T>::has_owns::value>::type>
+  bool owns(const void* user_data) const;
+
+  template <typename T = TAllocator,
+            typename = typename std::enable_if<
+                AllocatorTraits<T>::has_deallocate_all::value>::type>
+  void deallocate_all() const;
+
+  // Bucket helpers
+  static constexpr bool in_range(size_t size) {
+    return size >= TMin && size <= TMax;
+  }
+
+  static constexpr size_t bucket_index(size_t size) {
+    return (size - TMin) / TStep;
+  }
+
+  static constexpr size_t bucket_size(size_t index) {
+    return TMin + (index + 1) * TStep - 1;
+  }
+
+  const TAllocator& bucket(size_t index) const {
+    assert(index < NUM_BUCKETS);
+    return *reinterpret_cast<const TAllocator*>(&m_buckets[index]);
+  }
+
+private:
+  const Allocator<TAllocator>& bucket_base(size_t index) const {
+    return bucket(index);
+  }
+
+  // Index of the bucket that owns the block, or NUM_BUCKETS if none does.
+  size_t find_bucket(const void* user_data) const;
+
+  typename std::aligned_storage<sizeof(TAllocator), alignof(TAllocator)>::type
+      m_buckets[NUM_BUCKETS];
+};
+
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+bool operator==(const Bucketizer<TAllocator, TMin, TMax, TStep>& lhs,
+                const Bucketizer<TAllocator, TMin, TMax, TStep>& rhs) {
+  return &lhs == &rhs;
+}
+
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+bool operator!=(const Bucketizer<TAllocator, TMin, TMax, TStep>& lhs,
+                const Bucketizer<TAllocator, TMin, TMax, TStep>& rhs) {
+  return !(lhs == rhs);
+}
+
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+const size_t Bucketizer<TAllocator, TMin, TMax, TStep>::NUM_BUCKETS;
+
+/**
+ * @brief Constructor. Constructs every bucket's allocator from args.
+ *
+ * @param args Arguments for each bucket allocator's constructor; passed as
+ * lvalues, since they're used once per bucket.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+template <typename... TArgs>
+Bucketizer<TAllocator, TMin, TMax, TStep>::Bucketizer(TArgs&&... args) {
+  for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+    new (&m_buckets[index]) TAllocator(args...);
+  }
+}
+
+/**
+ * @brief Destructor. Destroys the bucket allocators in reverse order.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+Bucketizer<TAllocator, TMin, TMax, TStep>::~Bucketizer() {
+  for (size_t index = NUM_BUCKETS; index > 0; --index) {
+    bucket(index - 1).~TAllocator();
+  }
+}
+
+/**
+ * @brief Allocates a block of the bucket's size from the bucket's allocator.
+ *
+ * @return void* Pointer to the block, or nullptr if size is out of range.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+inline void*
+Bucketizer<TAllocator, TMin, TMax, TStep>::allocate(size_t size,
+                                                    size_t alignment) const {
+  if (!in_range(size)) {
+    return nullptr;
+  }
+
+  const auto index = bucket_index(size);
+  return bucket_base(index).allocate(bucket_size(index), alignment);
+}
+
+/**
+ * @brief Resizes a block. Within its bucket that's free; otherwise the block
+ * moves to the new bucket.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+void* Bucketizer<TAllocator, TMin, TMax, TStep>::reallocate(
+    void* user_data,
+    size_t old_size,
+    size_t new_size,
+    size_t alignment) const {
+  if (!user_data) {
+    return allocate(new_size, alignment);
+  }
+
+  if (in_range(new_size) && bucket_index(new_size) == bucket_index(old_size)) {
+    return user_data;
+  }
+
+  auto memory = allocate(new_size, alignment);
+  if (memory) {
+    std::memcpy(memory, user_data, old_size < new_size ? old_size : new_size);
+    deallocate(user_data, old_size, alignment);
+  }
+  return memory;
+}
+
+/**
+ * @brief Returns the block to the bucket that owns it.
+ *
+ * NOTE: Prefer the sized overload, which needs no search.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+void Bucketizer<TAllocator, TMin, TMax, TStep>::deallocate(
+    void* user_data) const {
+  if (!user_data) {
+    return;
+  }
+
+  const auto index = find_bucket(user_data);
+  assert(index < NUM_BUCKETS && "Block not owned by any bucket");
+  if (index < NUM_BUCKETS) {
+    bucket_base(index).deallocate(user_data);
+  }
+}
+
+/**
+ * @brief Returns the block to the bucket for its size.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+inline void Bucketizer<TAllocator, TMin, TMax, TStep>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (!user_data) {
+    return;
+  }
+
+  assert(in_range(size));
+  const auto index = bucket_index(size);
+  bucket_base(index).deallocate(user_data, bucket_size(index), alignment);
+}
+
+/**
+ * @brief Succeeds if the new size still fits the block's bucket.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+bool Bucketizer<TAllocator, TMin, TMax, TStep>::try_expand_in_place(
+    void* user_data, size_t new_size) const {
+  const auto index = find_bucket(user_data);
+  return index < NUM_BUCKETS && in_range(new_size) &&
+         bucket_index(new_size) == index;
+}
+
+/**
+ * @brief Allocates count blocks of the same size from one bucket, using the
+ * bucket allocator's own allocate_bulk() if it has one.
+ *
+ * @return size_t Number of blocks allocated; 0 if size is out of range.
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+inline size_t Bucketizer<TAllocator, TMin, TMax, TStep>::allocate_bulk(
+    size_t size, size_t alignment, void** blocks, size_t count) const {
+  if (!in_range(size)) {
+    return 0;
+  }
+
+  const auto index = bucket_index(size);
+  return AllocatorTraits<TAllocator>::allocate_bulk(
+      bucket(index), bucket_size(index), alignment, blocks, count);
+}
+
+/**
+ * @brief Returns true if any bucket owns the block.
+ *
+ * NOTE: Declared only if TAllocator has owns().
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+template <typename T, typename>
+inline bool
+Bucketizer<TAllocator, TMin, TMax, TStep>::owns(const void* user_data) const {
+  return find_bucket(user_data) < NUM_BUCKETS;
+}
+
+/**
+ * @brief Releases every block from every bucket.
+ *
+ * NOTE: Declared only if TAllocator has deallocate_all().
+ */
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+template <typename T, typename>
+void Bucketizer<TAllocator, TMin, TMax, TStep>::deallocate_all() const {
+  for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+    bucket(index).deallocate_all();
+  }
+}
+
+template <typename TAllocator, size_t TMin, size_t TMax, size_t TStep>
+size_t Bucketizer<TAllocator, TMin, TMax, TStep>::find_bucket(
+    const void* user_data) const {
+  for (size_t index = 0; index < NUM_BUCKETS; ++index) {
+    if (AllocatorTraits<TAllocator>::owns(bucket(index), user_data)) {
+      return index;
+    }
+  }
+  return NUM_BUCKETS;
+}
+
+} // namespace allok8or
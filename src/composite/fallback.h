@@ -0,0 +1,209 @@
+/**
+ * @file fallback.h
+ * @brief Header for a composite allocator that tries one allocator, then
+ * another.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+
+// Library headers
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace allok8or {
+
+/**
+ * @brief Allocates from the primary allocator, and from the fallback allocator
+ * when the primary fails.
+ *
+ * Deallocation asks the primary whether it owns the block, so the primary must
+ * provide owns(data). The fallback needs owns() only if this allocator's own
+ * owns() is used, e.g. when nesting it as the primary of another
+ * FallbackAllocator.
+ *
+ * Example:
+ * @code
+ *   // 4 KiB on the stack, then the heap.
+ *   InlineAllocator<4096, PassThroughAllocator> local(pass_through);
+ *   FallbackAllocator<decltype(local), PassThroughAllocator> allocator(
+ *       local, pass_through);
+ * @endcode
+ *
+ * NOTE: Holds references to its parts, which must outlive it.
+ *
+ * @tparam TPrimary Type of the allocator tried first.
+ * @tparam TFallback Type of the allocator used when the primary fails.
+ */
+template <typename TPrimary, typename TFallback>
+class FallbackAllocator
+    : public Allocator<FallbackAllocator<TPrimary, TFallback>> {
+  static_assert(AllocatorTraits<TPrimary>::has_owns::value,
+                "FallbackAllocator requires a primary allocator with owns()");
+
+public:
+  FallbackAllocator(Allocator<TPrimary>& primary,
+                    Allocator<TFallback>& fallback)
+      : m_primary(static_cast<TPrimary&>(primary)),
+        m_fallback(static_cast<TFallback&>(fallback)) {}
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+  bool try_expand_in_place(void* user_data, size_t new_size) const;
+
+  // Declared only if both parts support them, so that AllocatorTraits
+  // detects them correctly.
+  template <typename TF = TFallback,
+            typename = typename std::enable_if<
+                AllocatorTraits<TF>::has_owns::value>::type>
+  bool owns(const void* user_data) const;
+
+  template <typename TP = TPrimary,
+            typename TF = TFallback,
+            typename = typename std::enable_if<
+                AllocatorTraits<TP>::has_deallocate_all::value &&
+                AllocatorTraits<TF>::has_deallocate_all::value>::type>
+  void deallocate_all() const;
+
+  // Accessors
+  TPrimary& primary() const { return m_primary; }
+  TFallback& fallback() const { return m_fallback; }
+
+private:
+  const Allocator<TPrimary>& primary_base() const { return m_primary; }
+  const Allocator<TFallback>& fallback_base() const { return m_fallback; }
+
+  TPrimary& m_primary;
+  TFallback& m_fallback;
+};
+
+template <typename TPrimary, typename TFallback>
+bool operator==(const FallbackAllocator<TPrimary, TFallback>& lhs,
+                const FallbackAllocator<TPrimary, TFallback>& rhs) {
+  return &lhs.primary() == &rhs.primary() &&
+         &lhs.fallback() == &rhs.fallback();
+}
+
+template <typename TPrimary, typename TFallback>
+bool operator!=(const FallbackAllocator<TPrimary, TFallback>& lhs,
+                const FallbackAllocator<TPrimary, TFallback>& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Allocates from the primary allocator, or the fallback if the primary
+ * returns nullptr.
+ */
+template <typename TPrimary, typename TFallback>
+inline void* FallbackAllocator<TPrimary, TFallback>::allocate(
+    size_t size, size_t alignment) const {
+  auto memory = primary_base().allocate(size, alignment);
+  return memory ? memory : fallback_base().allocate(size, alignment);
+}
+
+/**
+ * @brief Resizes the block with the allocator that owns it. A primary block
+ * that the primary can't resize moves to the fallback.
+ */
+template <typename TPrimary, typename TFallback>
+void* FallbackAllocator<TPrimary, TFallback>::reallocate(
+    void* user_data,
+    size_t old_size,
+    size_t new_size,
+    size_t alignment) const {
+  if (!user_data) {
+    return allocate(new_size, alignment);
+  }
+
+  if (!m_primary.owns(user_data)) {
+    return fallback_base().reallocate(user_data, old_size, new_size, alignment);
+  }
+
+  auto memory =
+      primary_base().reallocate(user_data, old_size, new_size, alignment);
+  if (memory) {
+    return memory;
+  }
+
+  memory = fallback_base().allocate(new_size, alignment);
+  if (memory) {
+    std::memcpy(memory, user_data, std::min(old_size, new_size));
+    primary_base().deallocate(user_data, old_size, alignment);
+  }
+  return memory;
+}
+
+/**
+ * @brief Returns the block to the allocator that owns it.
+ */
+template <typename TPrimary, typename TFallback>
+inline void
+FallbackAllocator<TPrimary, TFallback>::deallocate(void* user_data) const {
+  if (m_primary.owns(user_data)) {
+    primary_base().deallocate(user_data);
+  } else {
+    fallback_base().deallocate(user_data);
+  }
+}
+
+/**
+ * @brief Returns the block to the allocator that owns it, passing along its
+ * size and alignment.
+ */
+template <typename TPrimary, typename TFallback>
+inline void FallbackAllocator<TPrimary, TFallback>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (m_primary.owns(user_data)) {
+    primary_base().deallocate(user_data, size, alignment);
+  } else {
+    fallback_base().deallocate(user_data, size, alignment);
+  }
+}
+
+/**
+ * @brief Asks the allocator that owns the block to grow it in place.
+ */
+template <typename TPrimary, typename TFallback>
+inline bool FallbackAllocator<TPrimary, TFallback>::try_expand_in_place(
+    void* user_data, size_t new_size) const {
+  return m_primary.owns(user_data)
+             ? primary_base().try_expand_in_place(user_data, new_size)
+             : fallback_base().try_expand_in_place(user_data, new_size);
+}
+
+/**
+ * @brief Returns true if either part owns the block.
+ *
+ * NOTE: Declared only if the fallback allocator has owns() too.
+ */
+template <typename TPrimary, typename TFallback>
+template <typename TF, typename>
+inline bool
+FallbackAllocator<TPrimary, TFallback>::owns(const void* user_data) const {
+  return m_primary.owns(user_data) || m_fallback.owns(user_data);
+}
+
+/**
+ * @brief Releases every block from both parts.
+ *
+ * NOTE: Declared only if both allocators have deallocate_all().
+ */
+template <typename TPrimary, typename TFallback>
+template <typename TP, typename TF, typename>
+inline void FallbackAllocator<TPrimary, TFallback>::deallocate_all() const {
+  m_primary.deallocate_all();
+  m_fallback.deallocate_all();
+}
+
+} // namespace allok8or
@@ -0,0 +1,211 @@
+/**
+ * @file segregator.h
+ * @brief Header for a composite allocator that picks one of two allocators by
+ * request size.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+
+// Library headers
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace allok8or {
+
+/**
+ * @brief Sends requests of up to TThreshold bytes to the small allocator, and
+ * larger ones to the large allocator.
+ *
+ * The sized calls route by size alone, with no lookup. Unsized deallocate()
+ * and try_expand_in_place() ask the small allocator whether it owns the block,
+ * so they require owns() on TSmall.
+ *
+ * Example:
+ * @code
+ *   // Small blocks from a size-class allocator, the rest from the system.
+ *   Segregator<256, SizeClassAllocator, PassThroughAllocator> allocator(
+ *       size_classes, pass_through);
+ * @endcode
+ *
+ * NOTE: Holds references to its parts, which must outlive it.
+ *
+ * @tparam TThreshold Largest request size sent to the small allocator.
+ * @tparam TSmall Type of the allocator for requests of up to TThreshold bytes.
+ * @tparam TLarge Type of the allocator for larger requests.
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+class Segregator : public Allocator<Segregator<TThreshold, TSmall, TLarge>> {
+public:
+  Segregator(Allocator<TSmall>& small, Allocator<TLarge>& large)
+      : m_small(static_cast<TSmall&>(small)),
+        m_large(static_cast<TLarge&>(large)) {}
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+  bool try_expand_in_place(void* user_data, size_t new_size) const;
+
+  // Declared only if both parts support them, so that AllocatorTraits
+  // detects them correctly.
+  template <typename TS = TSmall,
+            typename TL = TLarge,
+            typename = typename std::enable_if<
+                AllocatorTraits<TS>::has_owns::value &&
+                AllocatorTraits<TL>::has_owns::value>::type>
+  bool owns(const void* user_data) const;
+
+  template <typename TS = TSmall,
+            typename TL = TLarge,
+            typename = typename std::enable_if<
+                AllocatorTraits<TS>::has_deallocate_all::value &&
+                AllocatorTraits<TL>::has_deallocate_all::value>::type>
+  void deallocate_all() const;
+
+  // Accessors
+  static constexpr size_t threshold() { return TThreshold; }
+  TSmall& small() const { return m_small; }
+  TLarge& large() const { return m_large; }
+
+private:
+  const Allocator<TSmall>& small_base() const { return m_small; }
+  const Allocator<TLarge>& large_base() const { return m_large; }
+
+  TSmall& m_small;
+  TLarge& m_large;
+};
+
+template <size_t TThreshold, typename TSmall, typename TLarge>
+bool operator==(const Segregator<TThreshold, TSmall, TLarge>& lhs,
+                const Segregator<TThreshold, TSmall, TLarge>& rhs) {
+  return &lhs.small() == &rhs.small() && &lhs.large() == &rhs.large();
+}
+
+template <size_t TThreshold, typename TSmall, typename TLarge>
+bool operator!=(const Segregator<TThreshold, TSmall, TLarge>& lhs,
+                const Segregator<TThreshold, TSmall, TLarge>& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Allocates from the small or large allocator, by size.
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+inline void*
+Segregator<TThreshold, TSmall, TLarge>::allocate(size_t size,
+                                                 size_t alignment) const {
+  return size <= TThreshold ? small_base().allocate(size, alignment)
+                            : large_base().allocate(size, alignment);
+}
+
+/**
+ * @brief Resizes the block within its allocator, or moves it to the other one
+ * if the new size crosses the threshold.
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+void* Segregator<TThreshold, TSmall, TLarge>::reallocate(
+    void* user_data,
+    size_t old_size,
+    size_t new_size,
+    size_t alignment) const {
+  if (!user_data) {
+    return allocate(new_size, alignment);
+  }
+
+  const bool was_small = old_size <= TThreshold;
+  const bool is_small = new_size <= TThreshold;
+  if (was_small == is_small) {
+    return is_small ? small_base().reallocate(
+                          user_data, old_size, new_size, alignment)
+                    : large_base().reallocate(
+                          user_data, old_size, new_size, alignment);
+  }
+
+  auto memory = allocate(new_size, alignment);
+  if (memory) {
+    std::memcpy(memory, user_data, std::min(old_size, new_size));
+    deallocate(user_data, old_size, alignment);
+  }
+  return memory;
+}
+
+/**
+ * @brief Returns the block to the small allocator if it owns it, otherwise to
+ * the large allocator.
+ *
+ * NOTE: Prefer the sized overload, which needs no owns().
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+inline void
+Segregator<TThreshold, TSmall, TLarge>::deallocate(void* user_data) const {
+  if (AllocatorTraits<TSmall>::owns(m_small, user_data)) {
+    small_base().deallocate(user_data);
+  } else {
+    large_base().deallocate(user_data);
+  }
+}
+
+/**
+ * @brief Returns the block to the small or large allocator, by size.
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+inline void Segregator<TThreshold, TSmall, TLarge>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (size <= TThreshold) {
+    small_base().deallocate(user_data, size, alignment);
+  } else {
+    large_base().deallocate(user_data, size, alignment);
+  }
+}
+
+/**
+ * @brief Grows the block in place, as long as the new size stays on the same
+ * side of the threshold; otherwise a sized deallocate() would send it to the
+ * wrong part.
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+inline bool Segregator<TThreshold, TSmall, TLarge>::try_expand_in_place(
+    void* user_data, size_t new_size) const {
+  if (AllocatorTraits<TSmall>::owns(m_small, user_data)) {
+    return new_size <= TThreshold &&
+           small_base().try_expand_in_place(user_data, new_size);
+  }
+  return new_size > TThreshold &&
+         large_base().try_expand_in_place(user_data, new_size);
+}
+
+/**
+ * @brief Returns true if either part owns the block.
+ *
+ * NOTE: Declared only if both allocators have owns().
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+template <typename TS, typename TL, typename>
+inline bool
+Segregator<TThreshold, TSmall, TLarge>::owns(const void* user_data) const {
+  return m_small.owns(user_data) || m_large.owns(user_data);
+}
+
+/**
+ * @brief Releases every block from both parts.
+ *
+ * NOTE: Declared only if both allocators have deallocate_all().
+ */
+template <size_t TThreshold, typename TSmall, typename TLarge>
+template <typename TS, typename TL, typename>
+inline void Segregator<TThreshold, TSmall, TLarge>::deallocate_all() const {
+  m_small.deallocate_all();
+  m_large.deallocate_all();
+}
+
+} // namespace allok8or
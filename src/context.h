@@ -0,0 +1,249 @@
+/**
+ * @file context.h
+ * @brief Header for temporarily redirecting global allocations on the current
+ * thread to a given allocator.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+
+// Library headers
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+namespace allok8or {
+
+/**
+ * @brief Type-erased allocator entry on the current thread's context stack.
+ *
+ * deallocate() is passed a size of 0 when the caller doesn't know it. owns()
+ * is nullptr if the allocator was declared to own every block deallocated in
+ * its context; see OwnsEveryBlock.
+ */
+struct AllocatorContext {
+  const void* allocator;
+  bool (*owns)(const void* allocator, const void* data);
+  void* (*allocate)(const void* allocator, size_t size, size_t alignment);
+  void* (*reallocate)(const void* allocator,
+                      void* data,
+                      size_t old_size,
+                      size_t new_size,
+                      size_t alignment);
+  void (*deallocate)(const void* allocator,
+                     void* data,
+                     size_t size,
+                     size_t alignment);
+  const AllocatorContext* previous;
+};
+
+namespace detail {
+
+/**
+ * @brief Holder for the top of each thread's context stack.
+ *
+ * A static member of a class template, so that its constant initializer is
+ * visible everywhere it's used: the compiler then reads it with a plain TLS
+ * load, instead of going through a thread_local init wrapper.
+ */
+template <typename = void>
+struct AllocatorContextStack {
+  static thread_local const AllocatorContext* top;
+};
+
+template <typename T>
+thread_local const AllocatorContext* AllocatorContextStack<T>::top = nullptr;
+
+template <typename TAllocator>
+bool context_owns(const void* allocator, const void* data) {
+  return AllocatorTraits<TAllocator>::owns(
+      *static_cast<const TAllocator*>(allocator), data);
+}
+
+template <typename TAllocator>
+void* context_allocate(const void* allocator, size_t size, size_t alignment) {
+  return static_cast<const TAllocator*>(allocator)->allocate(size, alignment);
+}
+
+template <typename TAllocator>
+void* context_reallocate(const void* allocator,
+                         void* data,
+                         size_t old_size,
+                         size_t new_size,
+                         size_t alignment) {
+  return static_cast<const Allocator<TAllocator>&>(
+             *static_cast<const TAllocator*>(allocator))
+      .reallocate(data, old_size, new_size, alignment);
+}
+
+template <typename TAllocator>
+void context_deallocate(const void* allocator,
+                        void* data,
+                        size_t size,
+                        size_t alignment) {
+  auto& base = static_cast<const Allocator<TAllocator>&>(
+      *static_cast<const TAllocator*>(allocator));
+  if (size) {
+    base.deallocate(data, size, alignment);
+  } else {
+    base.deallocate(data);
+  }
+}
+
+} // namespace detail
+
+/**
+ * @brief Returns the innermost allocator context of the current thread, or
+ * nullptr if there is none.
+ */
+inline const AllocatorContext* current_allocator_context() {
+  return detail::AllocatorContextStack<>::top;
+}
+
+/**
+ * @brief Returns true if the given context's allocator owns a block; see
+ * OwnsEveryBlock.
+ */
+inline bool context_owns(const AllocatorContext* context, const void* data) {
+  return !context->owns || context->owns(context->allocator, data);
+}
+
+/**
+ * @brief Returns the innermost allocator context of the current thread that
+ * owns a block, or nullptr if there is none; see context_owns().
+ *
+ * Blocks allocated before or outside the current contexts go back to where
+ * they came from. Each context costs a call to its allocator's owns(), so keep
+ * that cheap (Arena's doesn't depend on its number of pages).
+ */
+inline const AllocatorContext* owning_allocator_context(const void* data) {
+  for (auto context = current_allocator_context(); context;
+       context = context->previous) {
+    if (context_owns(context, data)) {
+      return context;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Tag for a ScopedAllocatorContext whose allocator can't tell which
+ * blocks are its own (has no owns()); the caller promises that every block
+ * deallocated inside the context was allocated by it.
+ *
+ * Example:
+ * @code
+ *   ScopedAllocatorContext context(stack_allocator, owns_every_block);
+ * @endcode
+ */
+struct OwnsEveryBlock {};
+constexpr OwnsEveryBlock owns_every_block{};
+
+/**
+ * @brief Makes an allocator the current thread's allocator for the lifetime of
+ * this object.
+ *
+ * While it's alive, GlobalAllocator (of any type) and, if allok8or-new is
+ * linked, operator new/delete on this thread use the given allocator instead.
+ * Contexts nest; destroying one restores the previous.
+ *
+ * Example:
+ * @code
+ *   void handle(const Request& request) {
+ *     Arena arena(pages);
+ *     ScopedAllocatorContext context(arena);
+ *     ... // Everything allocated here comes from the arena.
+ *   }
+ * @endcode
+ *
+ * Memory deallocated inside a context goes to the context's allocator only if
+ * it owns it (see owning_allocator_context()), so blocks allocated before the
+ * context are freed where they came from.
+ *
+ * NOTE: Memory allocated inside a context must be deallocated inside the same
+ * context, or not individually at all (as with an Arena, whose memory goes
+ * when the arena does).
+ * NOTE: The allocator must provide owns(), so that blocks allocated elsewhere
+ * are never freed to it; an allocator without one only compiles with the
+ * OwnsEveryBlock tag.
+ * NOTE: Contexts must be destroyed in reverse order of creation, on the thread
+ * that created them; use them only as local variables.
+ */
+class ScopedAllocatorContext {
+public:
+  template <typename TAllocator>
+  explicit ScopedAllocatorContext(Allocator<TAllocator>& allocator);
+  template <typename TAllocator>
+  ScopedAllocatorContext(Allocator<TAllocator>& allocator, OwnsEveryBlock);
+  ~ScopedAllocatorContext();
+
+  // Lives on the stack, in the thread's context stack.
+  ScopedAllocatorContext(const ScopedAllocatorContext&) = delete;
+  ScopedAllocatorContext& operator=(const ScopedAllocatorContext&) = delete;
+
+  const AllocatorContext& context() const { return m_context; }
+
+private:
+  template <typename TAllocator>
+  ScopedAllocatorContext(Allocator<TAllocator>& allocator,
+                         bool (*owns)(const void*, const void*));
+
+  AllocatorContext m_context;
+};
+
+/**
+ * @brief Constructor. Pushes the allocator onto the current thread's context
+ * stack.
+ *
+ * @tparam TAllocator Type of the allocator implementation class; must provide
+ * owns().
+ * @param allocator The allocator to use; must outlive this object.
+ */
+template <typename TAllocator>
+ScopedAllocatorContext::ScopedAllocatorContext(Allocator<TAllocator>& allocator)
+    : ScopedAllocatorContext(allocator, &detail::context_owns<TAllocator>) {
+  static_assert(AllocatorTraits<TAllocator>::has_owns::value,
+                "A context's allocator must provide owns(); or pass "
+                "owns_every_block if every block freed in it is its own");
+}
+
+/**
+ * @brief Constructor for an allocator that owns every block deallocated inside
+ * the context; see OwnsEveryBlock.
+ *
+ * @tparam TAllocator Type of the allocator implementation class.
+ * @param allocator The allocator to use; must outlive this object.
+ */
+template <typename TAllocator>
+ScopedAllocatorContext::ScopedAllocatorContext(Allocator<TAllocator>& allocator,
+                                               OwnsEveryBlock)
+    : ScopedAllocatorContext(allocator, nullptr) {}
+
+/**
+ * @brief Pushes the allocator onto the current thread's context stack.
+ */
+template <typename TAllocator>
+ScopedAllocatorContext::ScopedAllocatorContext(
+    Allocator<TAllocator>& allocator, bool (*owns)(const void*, const void*))
+    : m_context{&static_cast<TAllocator&>(allocator),
+                owns,
+                &detail::context_allocate<TAllocator>,
+                &detail::context_reallocate<TAllocator>,
+                &detail::context_deallocate<TAllocator>,
+                detail::AllocatorContextStack<>::top} {
+  detail::AllocatorContextStack<>::top = &m_context;
+}
+
+/**
+ * @brief Destructor. Pops the allocator off the current thread's context
+ * stack.
+ */
+inline ScopedAllocatorContext::~ScopedAllocatorContext() {
+  assert(detail::AllocatorContextStack<>::top == &m_context &&
+         "ScopedAllocatorContext destroyed out of order");
+  detail::AllocatorContextStack<>::top = m_context.previous;
+}
+
+} // namespace allok8or
@@ -0,0 +1,344 @@
+/**
+ * @file coroutine_frame.h
+ * @brief Header for serving C++20 coroutine frames from per-thread block
+ * pools.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "block_allocator.h"
+#include "page.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <utility>
+
+namespace allok8or {
+namespace coroutine {
+
+// Pooled frame sizes: multiples of FRAME_SIZE_STEP up to MAX_POOLED_FRAME_SIZE.
+const size_t FRAME_SIZE_STEP = 64;
+const size_t NUM_FRAME_CLASSES = 16;
+const size_t MAX_POOLED_FRAME_SIZE = FRAME_SIZE_STEP * NUM_FRAME_CLASSES;
+
+// Size of the pages the pools carve frames from.
+const size_t FRAME_PAGE_SIZE = 64 * 1024;
+
+class FramePools;
+
+/**
+ * @brief Stored just before each pooled frame, so that any thread can return
+ * the frame to the pools it came from.
+ */
+struct alignas(std::max_align_t) FrameHeader {
+  FramePools* owner;
+  size_t index; // Size class.
+};
+
+/**
+ * @brief One BlockAllocator per frame size class, owned by one thread at a
+ * time.
+ *
+ * Frames freed by the owning thread go straight back to their block pool.
+ * Frames freed by other threads (a coroutine that migrated) are pushed onto a
+ * lock-free list, which the owner drains on its next allocation.
+ *
+ * When a thread exits, its pools aren't destroyed (some of their frames may
+ * still be alive on other threads) but kept for the next new thread to adopt.
+ */
+class FramePools {
+public:
+  FramePools();
+
+  // No copies; frames point back at their pools.
+  FramePools(const FramePools&) = delete;
+  FramePools& operator=(const FramePools&) = delete;
+
+  static FramePools& local();
+
+  static void* allocate_frame(size_t size);
+  static void deallocate_frame(void* frame, size_t size) noexcept;
+
+  // Accessors
+  size_t num_allocated() const { return num_allocated(Indices()); }
+
+private:
+  using Indices = std::make_index_sequence<NUM_FRAME_CLASSES>;
+
+  template <size_t I>
+  using BlockAllocatorT =
+      BlockAllocator<(I + 1) * FRAME_SIZE_STEP + sizeof(FrameHeader),
+                     alignof(FrameHeader)>;
+
+  template <typename TIndices>
+  struct Blocks;
+
+  template <size_t... I>
+  struct Blocks<std::index_sequence<I...>> {
+    using type = std::tuple<BlockAllocatorT<I>...>;
+  };
+
+  using BlocksT = typename Blocks<Indices>::type;
+
+  // Owner thread only.
+  FrameHeader* allocate(size_t index);
+  void deallocate(FrameHeader* header);
+  void drain_remote();
+
+  // Any thread.
+  void push_remote(FrameHeader* header);
+
+  template <size_t I>
+  static void* allocate_block(BlocksT& blocks) {
+    return std::get<I>(blocks).allocate();
+  }
+
+  template <size_t I>
+  static void deallocate_block(BlocksT& blocks, void* block) {
+    std::get<I>(blocks).deallocate(block);
+  }
+
+  template <size_t... I>
+  void* allocate_block(size_t index, std::index_sequence<I...>);
+
+  template <size_t... I>
+  void deallocate_block(size_t index, void* block, std::index_sequence<I...>);
+
+  template <size_t... I>
+  size_t num_allocated(std::index_sequence<I...>) const;
+
+  template <size_t... I>
+  static BlocksT make_blocks(PageAllocator& pages, std::index_sequence<I...>);
+
+  // Per-thread ownership.
+  static FramePools*& current();
+  static FramePools* adopt();
+  static void retire(FramePools* pools);
+  static std::mutex& idle_mutex();
+  static FramePools*& idle_head();
+
+  PageAllocator m_pages;
+  BlocksT m_blocks;
+  std::atomic<FrameHeader*> m_remote;
+  FramePools* m_next_idle;
+};
+
+inline FramePools::FramePools()
+    : m_pages(FRAME_PAGE_SIZE, alignof(FrameHeader)),
+      m_blocks(make_blocks(m_pages, Indices())),
+      m_remote(nullptr),
+      m_next_idle(nullptr) {}
+
+/**
+ * @brief Returns the calling thread's pools, adopting some on first use.
+ */
+inline FramePools& FramePools::local() {
+  auto pools = current();
+  return pools ? *pools : *adopt();
+}
+
+/**
+ * @brief Allocates a coroutine frame; pooled if it's small enough.
+ *
+ * @throw std::bad_alloc If no memory is available.
+ */
+inline void* FramePools::allocate_frame(size_t size) {
+  if (size > MAX_POOLED_FRAME_SIZE) {
+    return ::operator new(size);
+  }
+
+  const size_t index = size ? (size - 1) / FRAME_SIZE_STEP : 0;
+  auto header = local().allocate(index);
+  if (!header) {
+    throw std::bad_alloc();
+  }
+  return header + 1;
+}
+
+/**
+ * @brief Returns a coroutine frame to the pools it came from, from any thread.
+ *
+ * @param size Size passed to allocate_frame().
+ */
+inline void FramePools::deallocate_frame(void* frame, size_t size) noexcept {
+  if (size > MAX_POOLED_FRAME_SIZE) {
+    ::operator delete(frame);
+    return;
+  }
+
+  auto header = static_cast<FrameHeader*>(frame) - 1;
+  auto owner = header->owner;
+  if (owner == current()) {
+    owner->deallocate(header);
+  } else {
+    owner->push_remote(header);
+  }
+}
+
+inline FrameHeader* FramePools::allocate(size_t index) {
+  if (m_remote.load(std::memory_order_relaxed)) {
+    drain_remote();
+  }
+
+  auto header = static_cast<FrameHeader*>(allocate_block(index, Indices()));
+  if (header) {
+    header->owner = this;
+    header->index = index;
+  }
+  return header;
+}
+
+inline void FramePools::deallocate(FrameHeader* header) {
+  deallocate_block(header->index, header, Indices());
+}
+
+/**
+ * @brief Returns every frame freed by other threads to its block pool.
+ */
+inline void FramePools::drain_remote() {
+  auto header = m_remote.exchange(nullptr, std::memory_order_acquire);
+  while (header) {
+    auto next = *reinterpret_cast<FrameHeader**>(header + 1);
+    deallocate(header);
+    header = next;
+  }
+}
+
+/**
+ * @brief Pushes a frame freed by another thread; the link is stored in the
+ * dead frame itself.
+ */
+inline void FramePools::push_remote(FrameHeader* header) {
+  auto link = reinterpret_cast<FrameHeader**>(header + 1);
+  auto head = m_remote.load(std::memory_order_relaxed);
+  do {
+    *link = head;
+  } while (!m_remote.compare_exchange_weak(
+      head, header, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template <size_t... I>
+inline void* FramePools::allocate_block(size_t index,
+                                        std::index_sequence<I...>) {
+  using AllocateFn = void* (*)(BlocksT&);
+  static const AllocateFn table[] = {&FramePools::allocate_block<I>...};
+  return table[index](m_blocks);
+}
+
+template <size_t... I>
+inline void FramePools::deallocate_block(size_t index,
+                                         void* block,
+                                         std::index_sequence<I...>) {
+  using DeallocateFn = void (*)(BlocksT&, void*);
+  static const DeallocateFn table[] = {&FramePools::deallocate_block<I>...};
+  table[index](m_blocks, block);
+}
+
+template <size_t... I>
+inline size_t FramePools::num_allocated(std::index_sequence<I...>) const {
+  size_t counts[] = {std::get<I>(m_blocks).num_allocated()...};
+  size_t total = 0;
+  for (auto count : counts) {
+    total += count;
+  }
+  return total;
+}
+
+template <size_t... I>
+inline FramePools::BlocksT FramePools::make_blocks(PageAllocator& pages,
+                                                   std::index_sequence<I...>) {
+  // Each element is constructed in place from the page allocator.
+  return BlocksT(((void)I, pages)...);
+}
+
+inline FramePools*& FramePools::current() {
+  // Constant-initialized, so reading it is a plain TLS load.
+  static thread_local FramePools* pools = nullptr;
+  return pools;
+}
+
+/**
+ * @brief Gives the calling thread idle pools, or new ones, and arranges for
+ * them to be retired when the thread exits.
+ */
+inline FramePools* FramePools::adopt() {
+  FramePools* pools = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex());
+    pools = idle_head();
+    if (pools) {
+      idle_head() = pools->m_next_idle;
+      pools->m_next_idle = nullptr;
+    }
+  }
+  if (!pools) {
+    pools = new FramePools();
+  }
+
+  struct Retirer {
+    FramePools* pools = nullptr;
+    ~Retirer() {
+      if (pools) {
+        retire(pools);
+      }
+    }
+  };
+  static thread_local Retirer retirer;
+  retirer.pools = pools;
+
+  current() = pools;
+  return pools;
+}
+
+inline void FramePools::retire(FramePools* pools) {
+  current() = nullptr;
+  std::lock_guard<std::mutex> lock(idle_mutex());
+  pools->m_next_idle = idle_head();
+  idle_head() = pools;
+}
+
+inline std::mutex& FramePools::idle_mutex() {
+  // Never destroyed; threads may exit during static destruction.
+  static auto mutex = new std::mutex();
+  return *mutex;
+}
+
+inline FramePools*& FramePools::idle_head() {
+  static FramePools* head = nullptr;
+  return head;
+}
+
+} // namespace coroutine
+
+/**
+ * @brief Mixin for coroutine promise types that serves their frames from the
+ * current thread's FramePools.
+ *
+ * Example:
+ * @code
+ *   struct Task {
+ *     struct promise_type : allok8or::PooledCoroutineFrame {
+ *       ...
+ *     };
+ *   };
+ * @endcode
+ *
+ * A frame may be destroyed on any thread. Frames larger than
+ * coroutine::MAX_POOLED_FRAME_SIZE go to the global operator new.
+ */
+struct PooledCoroutineFrame {
+  static void* operator new(std::size_t size) {
+    return coroutine::FramePools::allocate_frame(size);
+  }
+
+  static void operator delete(void* frame, std::size_t size) noexcept {
+    coroutine::FramePools::deallocate_frame(frame, size);
+  }
+};
+
+} // namespace allok8or
@@ -8,8 +8,12 @@
 
 // Project headers
 #include "allocator.h"
-#include "diagnostic/tracking_pool.h"
 #include "diagnostic/block_header.h"
+#include "diagnostic/sampler.h"
+#include "diagnostic/sharded_tracking_pool.h"
+#include "diagnostic/stack_table.h"
+#include "diagnostic/tracking_pool.h"
+#include "logging.h"
 
 // Library headers
 #include <cstddef>
@@ -23,18 +27,26 @@ namespace allok8or {
  * This allocator does not itself manage allocated memory. Rather, another
  * allocator passed in as a ctor argument does that.
  *
+ * Optionally captures each allocation's call stack (see capture_stacks()), so
+ * that allocations made without the `new` macro in diagnostic/new.h, e.g. by
+ * std containers, are attributed too. Stacks are stored once each in the
+ * diagnostic::StackTable, and each distinct stack is a call site of its own.
+ *
  * NOTE: This allocator cannot be copied; it must be shared.
- * TODO: Thread safety.
+ * NOTE: Not thread-safe with the default AllocationTrackingPool; see
+ * ShardedDiagnosticAllocator.
  *
  * @tparam TBackingAllocator Type of the backing allocator; must be an
  * allok8or::Allocator-derived class.
+ * @tparam TTrackingPool Type of the pool that tracks the blocks.
  */
-template <typename TBackingAllocator>
+template <typename TBackingAllocator,
+          typename TTrackingPool = diagnostic::AllocationTrackingPool>
 class DiagnosticAllocator
-    : public Allocator<DiagnosticAllocator<TBackingAllocator>> {
+    : public Allocator<DiagnosticAllocator<TBackingAllocator, TTrackingPool>> {
 public:
   DiagnosticAllocator(Allocator<TBackingAllocator>& allocator);
-  ~DiagnosticAllocator(){};
+  ~DiagnosticAllocator();
 
   // No copies; share this when appropriate.
   DiagnosticAllocator(const DiagnosticAllocator&) = delete;
@@ -43,25 +55,56 @@ public:
   void* allocate(size_t size) const;
   void* allocate(size_t size, size_t alignment) const;
   void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
 
-  const diagnostic::AllocationTrackingPool& Tracker() const { return m_tracker; }
+  const TTrackingPool& Tracker() const { return m_tracker; }
+
+  // Off by default; set before allocating from other threads.
+  bool capture_stacks() const { return m_capture_stacks; }
+  void capture_stacks(bool val) { m_capture_stacks = val; }
 
 private:
+  void release(diagnostic::BlockHeader* header) const;
+
+  static bool set_site(void* tracker,
+                       diagnostic::BlockHeader* block,
+                       diagnostic::site_id_t site) {
+    return static_cast<TTrackingPool*>(tracker)->set_site(block, site);
+  }
+
   TBackingAllocator& m_allocator;
-  mutable diagnostic::AllocationTrackingPool
+  bool m_capture_stacks;
+  mutable TTrackingPool
       m_tracker; // mutable required because all Allocator<T>-derived classes
                  // must have const API.
+  const diagnostic::PoolRegistry::Entry m_registration;
+  const diagnostic::pool_id_t m_pool_id; // Stamped in each block's header.
 };
 
+/**
+ * @brief DiagnosticAllocator that may be used from many threads at once.
+ *
+ * Each thread tracks its blocks in its own shard; see
+ * diagnostic::ShardedTrackingPool. Use Tracker().snapshot() for merged stats,
+ * and Tracker().heap_snapshot() for the live blocks of each site.
+ *
+ * NOTE: The backing allocator must be thread-safe too.
+ */
 template <typename TBackingAllocator>
-constexpr bool operator==(const DiagnosticAllocator<TBackingAllocator>& lhs,
-                          const DiagnosticAllocator<TBackingAllocator>& rhs) {
+using ShardedDiagnosticAllocator =
+    DiagnosticAllocator<TBackingAllocator, diagnostic::ShardedTrackingPool>;
+
+template <typename TBackingAllocator, typename TTrackingPool>
+constexpr bool
+operator==(const DiagnosticAllocator<TBackingAllocator, TTrackingPool>& lhs,
+           const DiagnosticAllocator<TBackingAllocator, TTrackingPool>& rhs) {
   return &lhs == &rhs;
 }
 
-template <typename TBackingAllocator>
-constexpr bool operator!=(const DiagnosticAllocator<TBackingAllocator>& lhs,
-                          const DiagnosticAllocator<TBackingAllocator>& rhs) {
+template <typename TBackingAllocator, typename TTrackingPool>
+constexpr bool
+operator!=(const DiagnosticAllocator<TBackingAllocator, TTrackingPool>& lhs,
+           const DiagnosticAllocator<TBackingAllocator, TTrackingPool>& rhs) {
   return !(&lhs == &rhs);
 }
 
@@ -71,10 +114,23 @@ constexpr bool operator!=(const DiagnosticAllocator<TBackingAllocator>& lhs,
  * @tparam TBackingAllocator Type of the backing allocator.
  * @param allocator The backing allocator to actually allocate/deallocate heap
  */
-template <typename TBackingAllocator>
-DiagnosticAllocator<TBackingAllocator>::DiagnosticAllocator(
+template <typename TBackingAllocator, typename TTrackingPool>
+DiagnosticAllocator<TBackingAllocator, TTrackingPool>::DiagnosticAllocator(
     Allocator<TBackingAllocator>& allocator)
-    : m_allocator(static_cast<TBackingAllocator&>(allocator)) {}
+    : m_allocator(static_cast<TBackingAllocator&>(allocator)),
+      m_capture_stacks(false),
+      m_registration{&m_tracker, &set_site},
+      m_pool_id(diagnostic::PoolRegistry::add(&m_registration)) {}
+
+/**
+ * @brief Destructor
+ *
+ * NOTE: Unregisters the tracking pool; see diagnostic::PoolRegistry.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+DiagnosticAllocator<TBackingAllocator, TTrackingPool>::~DiagnosticAllocator() {
+  diagnostic::PoolRegistry::remove(m_pool_id);
+}
 
 /**
  * @brief Gets memory from the backing allocator using default alignment and
@@ -88,8 +144,8 @@ DiagnosticAllocator<TBackingAllocator>::DiagnosticAllocator(
  * @param user_data_size The size of the memory requested by the caller.
  * @return void* Pointer to the user portion of the memory.
  */
-template <typename TBackingAllocator>
-void* allok8or::DiagnosticAllocator<TBackingAllocator>::allocate(
+template <typename TBackingAllocator, typename TTrackingPool>
+void* DiagnosticAllocator<TBackingAllocator, TTrackingPool>::allocate(
     size_t user_data_size) const {
   return allocate(user_data_size, alignof(std::max_align_t));
 }
@@ -107,20 +163,41 @@ void* allok8or::DiagnosticAllocator<TBackingAllocator>::allocate(
  * @param user_data_alignment The alignment requested by the caller.
  * @return void* Pointer to the user portion of the memory.
  */
-template <typename TBackingAllocator>
-void* allok8or::DiagnosticAllocator<TBackingAllocator>::allocate(
+template <typename TBackingAllocator, typename TTrackingPool>
+void* DiagnosticAllocator<TBackingAllocator, TTrackingPool>::allocate(
     size_t user_data_size, size_t user_data_alignment) const {
   auto aligned_user_data_size =
       align::get_aligned_size(user_data_size, user_data_alignment);
-  auto total_size = aligned_user_data_size +
-                    align::get_aligned_size(sizeof(diagnostic::BlockHeader),
-                                            alignof(diagnostic::BlockHeader));
+  auto total_size = diagnostic::BlockHeader::block_size(aligned_user_data_size,
+                                                        user_data_alignment);
+  auto block_alignment =
+      diagnostic::BlockHeader::block_alignment(user_data_alignment);
+
+  const auto site = m_capture_stacks ? diagnostic::capture_stack_site()
+                                      : diagnostic::UNKNOWN_SITE;
+
+  auto memory_block = m_allocator.allocate(total_size, block_alignment);
+  if (!memory_block) {
+    return nullptr;
+  }
 
-  auto memory_block = m_allocator.allocate(total_size, user_data_alignment);
   auto header = diagnostic::BlockHeader::create(
-      memory_block, aligned_user_data_size, user_data_alignment);
+      memory_block, aligned_user_data_size, user_data_alignment, site);
+  if (!header) {
+    // The compact header can't record this size or alignment.
+    static_cast<Allocator<TBackingAllocator>&>(m_allocator)
+        .deallocate(memory_block, total_size, block_alignment);
+    return nullptr;
+  }
 
-  m_tracker.add(header);
+  // For the `new` macro, which sets the site through the pool.
+  header->pool(m_pool_id);
+  if (!m_tracker.add(header)) {
+    // The pool couldn't record it, e.g. its index couldn't grow.
+    static_cast<Allocator<TBackingAllocator>&>(m_allocator)
+        .deallocate(memory_block, total_size, block_alignment);
+    return nullptr;
+  }
 
   return header->user_data();
 }
@@ -129,19 +206,248 @@ void* allok8or::DiagnosticAllocator<TBackingAllocator>::allocate(
  * @brief Releases memory back to the backing allocator.
  *
  * NOTE: Looks up the header using the pointer to the user memory provided.
+ * Blocks without a valid header, or that the tracking pool doesn't remove
+ * (untracked), aren't released.
  *
  * @tparam TBackingAllocator Type of the backing allocator.
  * @param user_data Pointer to the user portion of the memory block to
  * deallocate.
  */
-template <typename TBackingAllocator>
-void DiagnosticAllocator<TBackingAllocator>::deallocate(void* user_data) const {
+template <typename TBackingAllocator, typename TTrackingPool>
+void DiagnosticAllocator<TBackingAllocator, TTrackingPool>::deallocate(
+    void* user_data) const {
+  diagnostic::BlockHeader* header =
+      diagnostic::BlockHeader::get_header(user_data);
+  if (!header->is_valid()) {
+    LOG_ERROR("Deallocating [%p], which has no valid block header.", user_data);
+    return;
+  }
+  assert(header->user_data() == user_data);
+
+  if (m_tracker.remove(header)) {
+    m_allocator.deallocate(header->block_start());
+  }
+}
+
+/**
+ * @brief Releases memory back to the backing allocator, verifying the size and
+ * alignment given by the caller against those recorded in the header.
+ *
+ * NOTE: Mismatches are logged as errors; the recorded values are used.
+ *
+ * @tparam TBackingAllocator Type of the backing allocator.
+ * @param user_data Pointer to the user portion of the memory block to
+ * deallocate.
+ * @param size Size of the user portion as originally requested.
+ * @param alignment Alignment of the user portion as originally requested.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void DiagnosticAllocator<TBackingAllocator, TTrackingPool>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
   diagnostic::BlockHeader* header =
       diagnostic::BlockHeader::get_header(user_data);
+  if (!header->is_valid()) {
+    LOG_ERROR("Deallocating [%p], which has no valid block header.", user_data);
+    return;
+  }
   assert(header->user_data() == user_data);
 
-  m_tracker.remove(header);
-  m_allocator.deallocate(header);
+  const auto recorded_alignment = header->user_data_alignment();
+  if (alignment != recorded_alignment ||
+      align::get_aligned_size(size, recorded_alignment) !=
+          header->user_data_size()) {
+    LOG_ERROR("Sized deallocation mismatch at [%p]: size [%zu] alignment [%zu], "
+              "allocated with size [%zu] alignment [%zu].",
+              user_data,
+              size,
+              alignment,
+              header->user_data_size(),
+              recorded_alignment);
+  }
+
+  if (m_tracker.remove(header)) {
+    release(header);
+  }
+}
+
+/**
+ * @brief Returns a block, header and all, to the backing allocator, using the
+ * size and alignment recorded in the header.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void DiagnosticAllocator<TBackingAllocator, TTrackingPool>::release(
+    diagnostic::BlockHeader* header) const {
+  static_cast<Allocator<TBackingAllocator>&>(m_allocator)
+      .deallocate(header->block_start(),
+                  header->block_size(),
+                  header->block_alignment());
+}
+
+/**
+ * @brief An allocator that tracks a statistical sample of allocations, cheaply
+ * enough for production use.
+ *
+ * About one allocation per sample interval bytes (see
+ * diagnostic::AllocationSampler) gets a header and is tracked, as by
+ * DiagnosticAllocator; the rest go straight to the backing allocator, at the
+ * cost of one counter decrement. Sampled blocks are recorded in a side table,
+ * which deallocation checks, without locking, to tell them apart.
+ *
+ * Stats count sampled allocations only; diagnostic::extrapolate_stats() scales
+ * them up to estimates of the real totals.
+ *
+ * NOTE: This allocator cannot be copied; it must be shared.
+ * NOTE: Thread-safe if the tracking pool and backing allocator are, e.g. with
+ * diagnostic::ShardedTrackingPool.
+ * NOTE: Unsampled blocks have no header, so can't be stamped with caller
+ * details (diagnostic/new.h).
+ *
+ * @tparam TBackingAllocator Type of the backing allocator; must be an
+ * allok8or::Allocator-derived class.
+ * @tparam TTrackingPool Type of the pool that tracks the sampled blocks.
+ */
+template <typename TBackingAllocator,
+          typename TTrackingPool = diagnostic::AllocationTrackingPool>
+class SamplingDiagnosticAllocator
+    : public Allocator<
+          SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>> {
+public:
+  SamplingDiagnosticAllocator(Allocator<TBackingAllocator>& allocator);
+  ~SamplingDiagnosticAllocator(){};
+
+  // No copies; share this when appropriate.
+  SamplingDiagnosticAllocator(const SamplingDiagnosticAllocator&) = delete;
+  SamplingDiagnosticAllocator&
+  operator=(const SamplingDiagnosticAllocator&) = delete;
+
+  void* allocate(size_t size) const;
+  void* allocate(size_t size, size_t alignment) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+
+  const TTrackingPool& Tracker() const { return m_sampled.Tracker(); }
+  size_t num_sampled() const { return m_sampled_blocks.size(); }
+
+  // Stacks are captured for sampled allocations only.
+  bool capture_stacks() const { return m_sampled.capture_stacks(); }
+  void capture_stacks(bool val) { m_sampled.capture_stacks(val); }
+
+private:
+  const Allocator<TBackingAllocator>& allocator_base() const {
+    return m_allocator;
+  }
+
+  TBackingAllocator& m_allocator;
+  DiagnosticAllocator<TBackingAllocator, TTrackingPool> m_sampled;
+  mutable diagnostic::SampledBlockTable
+      m_sampled_blocks; // mutable required because all Allocator<T>-derived
+                        // classes must have const API.
+};
+
+template <typename TBackingAllocator, typename TTrackingPool>
+constexpr bool operator==(
+    const SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>& lhs,
+    const SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>& rhs) {
+  return &lhs == &rhs;
+}
+
+template <typename TBackingAllocator, typename TTrackingPool>
+constexpr bool operator!=(
+    const SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>& lhs,
+    const SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>& rhs) {
+  return !(&lhs == &rhs);
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param allocator The backing allocator to actually allocate/deallocate heap
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>::
+    SamplingDiagnosticAllocator(Allocator<TBackingAllocator>& allocator)
+    : m_allocator(static_cast<TBackingAllocator&>(allocator)),
+      m_sampled(allocator) {}
+
+/**
+ * @brief Gets memory using default alignment; see allocate(size, alignment).
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void* SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>::allocate(
+    size_t user_data_size) const {
+  return allocate(user_data_size, alignof(std::max_align_t));
+}
+
+/**
+ * @brief Gets memory from the backing allocator, with a tracking header if the
+ * allocation is sampled.
+ *
+ * @param user_data_size The size of the memory requested by the caller.
+ * @param user_data_alignment The alignment requested by the caller.
+ * @return void* Pointer to the user portion of the memory.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void* SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>::allocate(
+    size_t user_data_size, size_t user_data_alignment) const {
+  // Counts the size a header would record, so estimates scale by the chance
+  // of sampling what was recorded.
+  const auto sampled_size =
+      align::get_aligned_size(user_data_size, user_data_alignment);
+  if (!diagnostic::AllocationSampler::local().sample(sampled_size)) {
+    return m_allocator.allocate(user_data_size, user_data_alignment);
+  }
+
+  auto user_data = m_sampled.allocate(user_data_size, user_data_alignment);
+  if (!user_data) {
+    return nullptr;
+  }
+
+  if (!m_sampled_blocks.insert(user_data)) {
+    // Can't record it, so don't sample it.
+    m_sampled.deallocate(user_data);
+    return m_allocator.allocate(user_data_size, user_data_alignment);
+  }
+
+  return user_data;
+}
+
+/**
+ * @brief Releases memory back to the backing allocator, removing its header
+ * from tracking if it was sampled.
+ *
+ * @param user_data Pointer to the user portion of the memory block to
+ * deallocate.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>::deallocate(
+    void* user_data) const {
+  if (m_sampled_blocks.erase(user_data)) {
+    m_sampled.deallocate(user_data);
+  } else {
+    m_allocator.deallocate(user_data);
+  }
+}
+
+/**
+ * @brief Releases memory back to the backing allocator, passing the size and
+ * alignment given by the caller.
+ *
+ * NOTE: For sampled blocks these are verified against the header, as by
+ * DiagnosticAllocator.
+ *
+ * @param user_data Pointer to the user portion of the memory block to
+ * deallocate.
+ * @param size Size of the user portion as originally requested.
+ * @param alignment Alignment of the user portion as originally requested.
+ */
+template <typename TBackingAllocator, typename TTrackingPool>
+void SamplingDiagnosticAllocator<TBackingAllocator, TTrackingPool>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (m_sampled_blocks.erase(user_data)) {
+    m_sampled.deallocate(user_data, size, alignment);
+  } else {
+    allocator_base().deallocate(user_data, size, alignment);
+  }
 }
 
 } // namespace allok8or
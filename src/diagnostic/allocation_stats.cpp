@@ -0,0 +1,25 @@
+/**
+ * @file allocation_stats.cpp
+ * @brief Class for keeping track of allocation statistics.
+ *
+ */
+
+// My header
+#include "allocation_stats.h"
+
+namespace allok8or {
+namespace diagnostic {
+
+// Static init.
+const AllocationStats AllocationStats::null_stats;
+const size_t AllocationStats::SIZE_BUCKETS;
+const size_t AllocationStats::LIFETIME_BUCKETS;
+
+const size_t SiteStatsMap::LEAF_BITS;
+const size_t SiteStatsMap::LEAF_SIZE;
+
+AllocationStatsTracker::backing_allocator_type
+    AllocationStatsTracker::m_backing_allocator;
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -7,57 +7,274 @@
 
 // Project headers
 #include "../pass_through.h"
-#include "../std_allocator_adapter.h"
 #include "../types.h"
+#include "call_site.h"
+#include "heap_snapshot.h"
+#include "histogram.h"
 
 // Library headers
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include <unordered_map>
+#include <new>
+#include <utility>
 
 namespace allok8or {
 namespace diagnostic {
 
-struct AllocationStatsKey {
-  const char* type_name;
-  const char* file_name;
-  int line;
-
-  struct hash {
-    size_t operator()(const AllocationStatsKey& k) const {
-      auto h1 = std::hash<const char*>()(k.type_name);
-      auto h2 = std::hash<const char*>()(k.file_name);
-      auto h3 = std::hash<int>()(k.line);
-
-      return h1 ^ (h2 << 1) ^ (h3 << 1);
-    }
-  };
-
-  struct equal_to {
-    constexpr size_t operator()(const AllocationStatsKey& lhs,
-                                const AllocationStatsKey& rhs) const {
-      return (&lhs == &rhs) ||
-             (lhs.type_name == rhs.type_name &&
-              lhs.file_name == rhs.file_name && lhs.line == rhs.line);
-    }
-  };
-};
+// Stats are kept per call site.
+using AllocationStatsKey = CallSite;
 
 struct AllocationStats {
   static const AllocationStats null_stats;
 
+  // Sizes up to 1 GiB, and lifetimes up to about 39 hours, get their own
+  // buckets.
+  static const size_t SIZE_BUCKETS = 32;
+  static const size_t LIFETIME_BUCKETS = 48;
+
+  using SizeHistogram = Log2Histogram<SIZE_BUCKETS>;
+  using LifetimeHistogram = Log2Histogram<LIFETIME_BUCKETS>;
+
   llong_t allocations = 0;
   llong_t bytes_allocated = 0;
 
   llong_t deallocations = 0;
   llong_t bytes_deallocated = 0;
 
+  SizeHistogram sizes; // Bytes, per allocation.
+  LifetimeHistogram lifetimes; // Nanoseconds, per timed deallocation.
+
   llong_t net_allocations() const { return allocations - deallocations; };
   llong_t net_bytes() const { return bytes_allocated - bytes_deallocated; };
 };
 
-// Static init.
-const AllocationStats AllocationStats::null_stats;
+/**
+ * @brief AllocationStats for each call site this map has seen, indexed by site
+ * ID.
+ *
+ * Recording an event is two array indexes, with no hashing: the site ID picks
+ * a leaf of LEAF_SIZE pointers, then the site's stats. Leaves are allocated
+ * only for the ranges of IDs in use, and the stats (histograms and all) only
+ * for each site's first event, so a map costs nothing until used, and little
+ * for a few sites with high IDs. Iteration visits the sites that have any
+ * events, in ID order, as std::pair<AllocationStatsKey, const
+ * AllocationStats&>.
+ */
+class SiteStatsMap {
+public:
+  // Refers to the stats in the map; they're too big to copy per site.
+  using value_type = std::pair<AllocationStatsKey, const AllocationStats&>;
+
+  class const_iterator;
+
+  explicit SiteStatsMap(Allocator<PassThroughAllocator>& allocator);
+  ~SiteStatsMap();
+
+  // No copies; the stats belong to this map.
+  SiteStatsMap(const SiteStatsMap&) = delete;
+  SiteStatsMap& operator=(const SiteStatsMap&) = delete;
+
+  AllocationStats& operator[](site_id_t site) {
+    auto stats = lookup(site);
+    return stats ? *stats : add(site);
+  }
+  const AllocationStats* find(site_id_t site) const { return lookup(site); }
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  size_t size() const;
+
+private:
+  static const size_t LEAF_BITS = 8;
+  static const size_t LEAF_SIZE = static_cast<size_t>(1) << LEAF_BITS;
+
+  struct Leaf {
+    AllocationStats* stats[LEAF_SIZE]; // nullptr for sites without events.
+  };
+
+  static bool is_used(const AllocationStats* stats) {
+    return stats && (stats->allocations || stats->deallocations);
+  }
+
+  AllocationStats* lookup(site_id_t site) const {
+    const size_t leaf = site >> LEAF_BITS;
+    return leaf < m_num_leaves && m_leaves[leaf]
+               ? m_leaves[leaf]->stats[site & (LEAF_SIZE - 1)]
+               : nullptr;
+  }
+  AllocationStats& add(site_id_t site);
+  bool grow_leaves(size_t leaf);
+
+  const Allocator<PassThroughAllocator>& allocator() const {
+    return m_allocator;
+  }
+
+  PassThroughAllocator& m_allocator;
+  Leaf** m_leaves;
+  size_t m_num_leaves;
+  AllocationStats m_overflow; // Returned if out of memory.
+};
+
+/**
+ * @brief Visits the sites of a SiteStatsMap that have any events.
+ */
+class SiteStatsMap::const_iterator {
+public:
+  const_iterator(const SiteStatsMap& map, size_t site)
+      : m_map(&map), m_site(site) {
+    skip_unused();
+  }
+
+  value_type operator*() const {
+    return value_type(
+        CallSiteRegistry::instance().site(static_cast<site_id_t>(m_site)),
+        *m_map->find(static_cast<site_id_t>(m_site)));
+  }
+
+  const_iterator& operator++() {
+    ++m_site;
+    skip_unused();
+    return *this;
+  }
+
+  bool operator==(const const_iterator& other) const {
+    return m_site == other.m_site;
+  }
+  bool operator!=(const const_iterator& other) const {
+    return m_site != other.m_site;
+  }
+
+  // Accessors
+  site_id_t site() const { return static_cast<site_id_t>(m_site); }
+
+private:
+  void skip_unused() {
+    const auto end = m_map->m_num_leaves * LEAF_SIZE;
+    while (m_site < end) {
+      if (!m_map->m_leaves[m_site >> LEAF_BITS]) {
+        // Skips the whole missing leaf.
+        m_site = ((m_site >> LEAF_BITS) + 1) << LEAF_BITS;
+      } else if (!is_used(m_map->find(static_cast<site_id_t>(m_site)))) {
+        ++m_site;
+      } else {
+        break;
+      }
+    }
+  }
+
+  const SiteStatsMap* m_map;
+  size_t m_site;
+};
+
+inline SiteStatsMap::SiteStatsMap(Allocator<PassThroughAllocator>& allocator)
+    : m_allocator(static_cast<PassThroughAllocator&>(allocator)),
+      m_leaves(nullptr),
+      m_num_leaves(0),
+      m_overflow() {}
+
+inline SiteStatsMap::~SiteStatsMap() {
+  for (size_t leaf = 0; leaf < m_num_leaves; ++leaf) {
+    if (!m_leaves[leaf]) {
+      continue;
+    }
+    for (auto stats : m_leaves[leaf]->stats) {
+      if (stats) {
+        allocator().deallocate(
+            stats, sizeof(AllocationStats), alignof(AllocationStats));
+      }
+    }
+    allocator().deallocate(m_leaves[leaf], sizeof(Leaf), alignof(Leaf));
+  }
+
+  if (m_leaves) {
+    allocator().deallocate(
+        m_leaves, m_num_leaves * sizeof(Leaf*), alignof(Leaf*));
+  }
+}
+
+inline SiteStatsMap::const_iterator SiteStatsMap::begin() const {
+  return const_iterator(*this, 0);
+}
+
+inline SiteStatsMap::const_iterator SiteStatsMap::end() const {
+  return const_iterator(*this, m_num_leaves * LEAF_SIZE);
+}
+
+/**
+ * @brief Returns the number of sites with any events.
+ */
+inline size_t SiteStatsMap::size() const {
+  size_t count = 0;
+  for (auto it = begin(); it != end(); ++it) {
+    ++count;
+  }
+  return count;
+}
+
+/**
+ * @brief Allocates the stats of a site on its first event, and the leaf that
+ * holds them if need be.
+ *
+ * @return AllocationStats& The new stats, or an overflow entry (not part of
+ * the map) if out of memory.
+ */
+inline AllocationStats& SiteStatsMap::add(site_id_t site) {
+  const size_t leaf = site >> LEAF_BITS;
+  if (leaf >= m_num_leaves && !grow_leaves(leaf)) {
+    return m_overflow;
+  }
+
+  if (!m_leaves[leaf]) {
+    auto memory = allocator().allocate(sizeof(Leaf), alignof(Leaf));
+    if (!memory) {
+      return m_overflow;
+    }
+    m_leaves[leaf] = new (memory) Leaf();
+  }
+
+  auto memory =
+      allocator().allocate(sizeof(AllocationStats), alignof(AllocationStats));
+  if (!memory) {
+    return m_overflow;
+  }
+
+  auto stats = new (memory) AllocationStats();
+  m_leaves[leaf]->stats[site & (LEAF_SIZE - 1)] = stats;
+  return *stats;
+}
+
+/**
+ * @brief Grows the array of leaves to hold leaf, at least doubling it.
+ *
+ * @return false If the new array couldn't be allocated; the map is unchanged.
+ */
+inline bool SiteStatsMap::grow_leaves(size_t leaf) {
+  auto new_num_leaves = m_num_leaves ? m_num_leaves * 2 : 1;
+  while (new_num_leaves <= leaf) {
+    new_num_leaves *= 2;
+  }
+
+  auto new_leaves = static_cast<Leaf**>(
+      allocator().allocate(new_num_leaves * sizeof(Leaf*), alignof(Leaf*)));
+  if (!new_leaves) {
+    return false;
+  }
+
+  for (size_t i = 0; i < new_num_leaves; ++i) {
+    new_leaves[i] = i < m_num_leaves ? m_leaves[i] : nullptr;
+  }
+
+  if (m_leaves) {
+    allocator().deallocate(
+        m_leaves, m_num_leaves * sizeof(Leaf*), alignof(Leaf*));
+  }
+  m_leaves = new_leaves;
+  m_num_leaves = new_num_leaves;
+  return true;
+}
 
 /**
  * @brief Responsible for recording and reporting cumulative statistics on
@@ -69,6 +286,9 @@ const AllocationStats AllocationStats::null_stats;
  * operator new/delete, and we don't want internal operations of this class to
  * get caught up in any inadvertent recursion.
  *
+ * Stats are indexed by call site ID (see CallSiteRegistry). The overloads
+ * taking a key or the caller details intern the site first.
+ *
  * This class overloads operator new/delete to force use of the backing
  * allocator for instance creation.
  */
@@ -77,22 +297,16 @@ public:
   //
   // Types
   //
-  using value_type = std::pair<const AllocationStatsKey, AllocationStats>;
-
   // PassThroughAllocator calls system allocation APIs directly; no new/delete.
-  using allocator_type = StdAllocatorAdapter<value_type, PassThroughAllocator>;
+  using backing_allocator_type = PassThroughAllocator;
   using deleter_type = std::function<void(AllocationStatsTracker*)>;
-  typedef std::unordered_map<AllocationStatsKey,
-                             AllocationStats,
-                             AllocationStatsKey::hash,
-                             AllocationStatsKey::equal_to,
-                             allocator_type>
-      StatsMap;
+  typedef SiteStatsMap StatsMap;
+  using value_type = StatsMap::value_type;
 
   //
   // ctor/dtor
   //
-  AllocationStatsTracker() : m_stats(allocator_type(m_backing_allocator)) {}
+  AllocationStatsTracker() : m_stats(m_backing_allocator) {}
   ~AllocationStatsTracker() {}
 
   //
@@ -104,6 +318,8 @@ public:
                 size_t bytes);
 
   void track_allocation(const AllocationStatsKey& key, size_t bytes);
+  void track_allocation(site_id_t site, size_t bytes);
+  void move_allocation(site_id_t from, site_id_t to, size_t bytes);
 
   void track_deallocation(const char* type_name,
                   const char* file_name,
@@ -111,24 +327,28 @@ public:
                   size_t bytes);
 
   void track_deallocation(const AllocationStatsKey& key, size_t bytes);
+  void track_deallocation(site_id_t site, size_t bytes);
+  void track_deallocation(site_id_t site, size_t bytes, uint64_t lifetime_ns);
+
+  void merge(const AllocationStatsTracker& other);
+  void merge(site_id_t site, const AllocationStats& other);
 
   const StatsMap& stats() const { return m_stats; }
   const AllocationStats& stats(const AllocationStatsKey& key) const;
+  const AllocationStats& stats(site_id_t site) const;
+
+  HeapSnapshot snapshot() const;
 
   void* operator new(size_t count);
   void operator delete(void* pointer);
 
 private:
-  static allocator_type::backing_allocator_type
+  static backing_allocator_type
       m_backing_allocator; // stateless, so static is safe.
 
   StatsMap m_stats;
 };
 
-// Static init.
-AllocationStatsTracker::allocator_type::backing_allocator_type
-    AllocationStatsTracker::m_backing_allocator;
-
 /**
  * @brief Records stats about an allocation.
  *
@@ -153,8 +373,40 @@ inline void AllocationStatsTracker::track_allocation(const char* type_name,
  */
 inline void AllocationStatsTracker::track_allocation(const AllocationStatsKey& key,
                                              size_t bytes) {
-  m_stats[key].allocations++;
-  m_stats[key].bytes_allocated += bytes;
+  track_allocation(CallSiteRegistry::instance().intern(key), bytes);
+}
+
+/**
+ * @brief Records stats about an allocation, identified by call site ID.
+ *
+ * @param site ID of the call site from which the allocation call occurred.
+ * @param bytes Number of bytes allocated.
+ */
+inline void AllocationStatsTracker::track_allocation(site_id_t site,
+                                                     size_t bytes) {
+  auto& stats = m_stats[site];
+  stats.allocations++;
+  stats.bytes_allocated += bytes;
+  stats.sizes.record(bytes);
+}
+
+/**
+ * @brief Moves an allocation recorded at one call site to another, once the
+ * block's real site is known.
+ *
+ * @param from ID of the call site it was recorded at.
+ * @param to ID of the call site to record it at.
+ * @param bytes Number of bytes allocated.
+ */
+inline void AllocationStatsTracker::move_allocation(site_id_t from,
+                                                    site_id_t to,
+                                                    size_t bytes) {
+  auto& stats = m_stats[from];
+  stats.allocations--;
+  stats.bytes_allocated -= bytes;
+  stats.sizes.counts[AllocationStats::SizeHistogram::bucket(bytes)]--;
+
+  track_allocation(to, bytes);
 }
 
 /**
@@ -182,17 +434,96 @@ inline void AllocationStatsTracker::track_deallocation(const char* type_name,
  */
 inline void AllocationStatsTracker::track_deallocation(const AllocationStatsKey& key,
                                                size_t bytes) {
-  m_stats[key].deallocations++;
-  m_stats[key].bytes_deallocated += bytes;
+  track_deallocation(CallSiteRegistry::instance().intern(key), bytes);
+}
+
+/**
+ * @brief Records stats about a deallocation, identified by call site ID.
+ *
+ * @param site ID of the call site from which the original allocation call
+ * occurred.
+ * @param bytes Number of bytes orignally allocated.
+ */
+inline void AllocationStatsTracker::track_deallocation(site_id_t site,
+                                                       size_t bytes) {
+  auto& stats = m_stats[site];
+  stats.deallocations++;
+  stats.bytes_deallocated += bytes;
+}
+
+/**
+ * @brief Records stats about a deallocation, including how long the block
+ * lived.
+ *
+ * @param site ID of the call site from which the original allocation call
+ * occurred.
+ * @param bytes Number of bytes orignally allocated.
+ * @param lifetime_ns Nanoseconds from allocation to deallocation.
+ */
+inline void AllocationStatsTracker::track_deallocation(site_id_t site,
+                                                       size_t bytes,
+                                                       uint64_t lifetime_ns) {
+  auto& stats = m_stats[site];
+  stats.deallocations++;
+  stats.bytes_deallocated += bytes;
+  stats.lifetimes.record(lifetime_ns);
+}
+
+/**
+ * @brief Adds the stats recorded by another tracker to this one's.
+ *
+ * @param other Tracker whose stats to add.
+ */
+inline void AllocationStatsTracker::merge(const AllocationStatsTracker& other) {
+  for (auto it = other.m_stats.begin(); it != other.m_stats.end(); ++it) {
+    merge(it.site(), (*it).second);
+  }
+}
+
+/**
+ * @brief Adds stats to those of one call site.
+ *
+ * @param site ID of the call site.
+ * @param other Stats to add.
+ */
+inline void AllocationStatsTracker::merge(site_id_t site,
+                                          const AllocationStats& other) {
+  auto& stats = m_stats[site];
+  stats.allocations += other.allocations;
+  stats.bytes_allocated += other.bytes_allocated;
+  stats.deallocations += other.deallocations;
+  stats.bytes_deallocated += other.bytes_deallocated;
+  stats.sizes.merge(other.sizes);
+  stats.lifetimes.merge(other.lifetimes);
 }
 
 inline const AllocationStats&
 AllocationStatsTracker::stats(const AllocationStatsKey& key) const {
-  auto stats = m_stats.find(key);
-  if (stats == m_stats.end())
+  site_id_t site;
+  if (!CallSiteRegistry::instance().find(key, site))
+    return AllocationStats::null_stats;
+
+  return stats(site);
+}
+
+inline const AllocationStats&
+AllocationStatsTracker::stats(site_id_t site) const {
+  auto stats = m_stats.find(site);
+  if (!stats)
     return AllocationStats::null_stats;
 
-  return stats->second;
+  return *stats;
+}
+
+/**
+ * @brief Copies the live blocks and bytes of each call site.
+ *
+ * Costs O(sites), however many blocks are live.
+ */
+inline HeapSnapshot AllocationStatsTracker::snapshot() const {
+  HeapSnapshot snapshot;
+  snapshot.add(*this);
+  return snapshot;
 }
 
 /**
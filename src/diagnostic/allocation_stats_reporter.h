@@ -7,6 +7,7 @@
 
 // Project headers.
 #include "allocation_stats.h"
+#include "stack_table.h"
 
 // Library headers.
 #include <iostream>
@@ -64,7 +65,8 @@ inline void AllocationStatsCsvReporter::report_stats(
              << "Allocs" << "," << "Alloc Bytes" << ","
              << "Deallocs" << "," << "Dealloc Bytes" << ","
              << "Net Allocs" << "," 
-             << "Net Alloc Bytes" << "\n";
+             << "Net Alloc Bytes" << ","
+             << "Stack" << "\n";
              
   for (const auto& stat_pair : stats) {
     output << stat_pair.first.type_name << ","
@@ -75,7 +77,106 @@ inline void AllocationStatsCsvReporter::report_stats(
            << stat_pair.second.deallocations << ","
            << stat_pair.second.bytes_deallocated << ","
            << stat_pair.second.net_allocations() << ","
-           << stat_pair.second.net_bytes() << "\n";
+           << stat_pair.second.net_bytes() << ","
+           << stat_pair.first.stack << "\n";
+  }
+
+  output << std::flush;
+}
+
+/**
+ * @brief AllocationStatsReporter that lists each site's size and lifetime
+ * histograms as CSV, one row per non-empty bucket.
+ *
+ * "Bucket Min" is the smallest value counted in the bucket: bytes for the
+ * Size histogram, nanoseconds for the Lifetime histogram.
+ */
+class AllocationHistogramCsvReporter
+    : public AllocationStatsReporter<AllocationHistogramCsvReporter> {
+public:
+  void report_stats(const AllocationStatsTracker::StatsMap& stats,
+                    std::ostream& output) const;
+
+private:
+  template <size_t N>
+  static void report_histogram(const AllocationStatsKey& key,
+                               const char* name,
+                               const Log2Histogram<N>& histogram,
+                               std::ostream& output);
+};
+
+/**
+ * @brief Dump histograms to output stream.
+ *
+ * @param stats An AllocationTracker::StatsMap contiaining allocation stats.
+ * @param output A std::ostream to collect the output.
+ */
+inline void AllocationHistogramCsvReporter::report_stats(
+    const AllocationStatsTracker::StatsMap& stats, std::ostream& output) const {
+  // Header row (column names)
+  output << "TypeName" << "," << "File" << "," << "Line" << ","
+         << "Histogram" << "," << "Bucket Min" << "," << "Count" << "\n";
+
+  for (const auto& stat_pair : stats) {
+    report_histogram(stat_pair.first, "Size", stat_pair.second.sizes, output);
+    report_histogram(
+        stat_pair.first, "Lifetime", stat_pair.second.lifetimes, output);
+  }
+
+  output << std::flush;
+}
+
+template <size_t N>
+inline void AllocationHistogramCsvReporter::report_histogram(
+    const AllocationStatsKey& key,
+    const char* name,
+    const Log2Histogram<N>& histogram,
+    std::ostream& output) {
+  for (size_t bucket = 0; bucket < N; ++bucket) {
+    if (!histogram.counts[bucket])
+      continue;
+
+    output << key.type_name << ","
+           << key.file_name << ","
+           << key.line << ","
+           << name << ","
+           << Log2Histogram<N>::lower_bound(bucket) << ","
+           << histogram.counts[bucket] << "\n";
+  }
+}
+
+/**
+ * @brief AllocationStatsReporter that lists the sites with captured stacks,
+ * each with its net allocations and its symbolized stack.
+ *
+ * NOTE: Looks up symbols; see StackTable::symbolize().
+ */
+class AllocationStackReporter
+    : public AllocationStatsReporter<AllocationStackReporter> {
+public:
+  void report_stats(const AllocationStatsTracker::StatsMap& stats,
+                    std::ostream& output) const;
+};
+
+/**
+ * @brief Dump stacks to output stream.
+ *
+ * @param stats An AllocationTracker::StatsMap contiaining allocation stats.
+ * @param output A std::ostream to collect the output.
+ */
+inline void AllocationStackReporter::report_stats(
+    const AllocationStatsTracker::StatsMap& stats, std::ostream& output) const {
+  auto& stack_table = StackTable::instance();
+
+  for (const auto& stat_pair : stats) {
+    if (stat_pair.first.stack == NO_STACK)
+      continue;
+
+    output << "Stack " << stat_pair.first.stack << ": "
+           << stat_pair.second.allocations << " allocs, "
+           << stat_pair.second.net_allocations() << " net allocs, "
+           << stat_pair.second.net_bytes() << " net bytes\n";
+    stack_table.symbolize(stat_pair.first.stack, output);
   }
 
   output << std::flush;
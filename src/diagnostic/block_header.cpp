@@ -11,15 +11,78 @@
 
 // Project headers
 #include "../align.h"
+#include "../logging.h"
 
 // Library headers
+#include <atomic>
 
 namespace allok8or {
 namespace diagnostic {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
 //
 // BlockSignature implementation.
 //
 const BlockSignature BlockHeader::BLOCK_SIGNATURE;
+#else
+// Static init.
+const uint16_t BlockHeader::CHECKSUM_SEED;
+#endif
+
+namespace {
+
+// Indexed by pool ID; NO_POOL's slot stays empty. Zero-initialized, so usable
+// before any constructor runs.
+std::atomic<const PoolRegistry::Entry*> s_pools[PoolRegistry::MAX_POOLS + 1];
+
+} // namespace
+
+//
+// PoolRegistry Implementation
+//
+
+const size_t PoolRegistry::MAX_POOLS;
+
+/**
+ * @brief Registers a pool, returning its ID, or NO_POOL if the registry is
+ * full.
+ */
+pool_id_t PoolRegistry::add(const Entry* entry) {
+  assert(entry);
+  for (size_t id = NO_POOL + 1; id <= MAX_POOLS; ++id) {
+    const Entry* expected = nullptr;
+    if (s_pools[id].compare_exchange_strong(
+            expected, entry, std::memory_order_acq_rel)) {
+      return static_cast<pool_id_t>(id);
+    }
+  }
+
+  LOG_ERROR("Too many live tracking pools; caller details can't be set on the "
+            "blocks of another one.");
+  return NO_POOL;
+}
+
+/**
+ * @brief Unregisters a pool, freeing its ID for reuse.
+ */
+void PoolRegistry::remove(pool_id_t id) {
+  if (id != NO_POOL) {
+    s_pools[id].store(nullptr, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Sets the site of a block through the pool with the given ID.
+ *
+ * @return false If there's no such pool, or it doesn't track the block or
+ * refuses.
+ */
+bool PoolRegistry::set_site(pool_id_t id, BlockHeader* block, site_id_t site) {
+  const auto entry = s_pools[id].load(std::memory_order_acquire);
+  if (!entry) {
+    return false;
+  }
+  return entry->set_site(entry->pool, block, site);
+}
 
 //
 // BlockHeader Implementation
@@ -51,9 +114,54 @@ BlockHeader* BlockHeader::create(void* block_start,
   if (!block_start || !user_data_size || !user_data_alignment)
     return nullptr;
 
+  auto site = UNKNOWN_SITE;
+  if (type_name || file_name || line) {
+    site = CallSiteRegistry::instance().intern(
+        CallSite{type_name, file_name, line});
+  }
+
+  return create(block_start, user_data_size, user_data_alignment, site);
+}
+
+/**
+ * @brief Factory method for a block whose call site is already interned.
+ *
+ * @param block_start Start address of the complete memory block (and pointer to
+ * the BlockHeader).
+ * @param user_data_size Size of the user portion of the memory block.
+ * @param user_data_alignment Alignment of the data in the user portion of the
+ * memory block.
+ * @param site ID of the call site; see CallSiteRegistry.
+ * @return BlockHeader* Pointer to the header; at the start of the block with
+ * the full layout, or just before the user data with the compact one. nullptr
+ * if the compact layout can't record the size or alignment.
+ */
+BlockHeader* BlockHeader::create(void* block_start,
+                                 size_t user_data_size,
+                                 size_t user_data_alignment,
+                                 site_id_t site) {
+  assert(block_start);
+  assert(user_data_size);
+  assert(user_data_alignment);
+
+  if (!block_start || !user_data_size || !user_data_alignment)
+    return nullptr;
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   // Use placement new to init the header in the given memory block.
-  BlockHeader* header = new (block_start) BlockHeader(
-      user_data_size, user_data_alignment, file_name, line, type_name);
+  BlockHeader* header =
+      new (block_start) BlockHeader(user_data_size, user_data_alignment, site);
+#else
+  if (user_data_size > UINT32_MAX ||
+      (user_data_alignment & (user_data_alignment - 1)))
+    return nullptr;
+
+  // The header ends where the user data starts.
+  auto header_start = static_cast<char*>(block_start) +
+                      header_offset(user_data_alignment) - sizeof(BlockHeader);
+  BlockHeader* header =
+      new (header_start) BlockHeader(user_data_size, user_data_alignment, site);
+#endif
 
   return header;
 }
@@ -8,6 +8,7 @@
 
 // Project headers
 #include "../align.h"
+#include "call_site.h"
 #include "util.h"
 #include "type_name_helper.h"
 #include "../types.h"
@@ -15,11 +16,17 @@
 // Library headers
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 
 namespace allok8or {
 namespace diagnostic {
 
+// ID of a live tracking pool; see PoolRegistry.
+typedef uint8_t pool_id_t;
+const pool_id_t NO_POOL = 0;
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
 /**
  * @brief Identifies a block of memory that can be tracked.
  */
@@ -37,19 +44,31 @@ struct BlockSignature {
   uint_t m_sig2;
   uint_t m_sig3;
 };
+#endif
 
 /**
  * @brief Header for a single block of allocated memory.
  *
- * Contains diagnostic data used for keeping track of a block of memory.
+ * Contains diagnostic data used for keeping track of a block of memory. There
+ * are two layouts:
+ *
+ * - Compact (the default): 16 bytes just before the user data, holding the
+ *   site in 24 bits, the pool in 8, the size in 32, and a 16-bit checksum
+ *   instead of a signature. The tracking pool lists its blocks, and their allocation times,
+ *   in a side index (see BlockIndex) rather than linking them. Sizes must fit
+ *   in 32 bits, and alignments must be powers of 2.
+ * - Full (built with ALLOK8OR_FULL_BLOCK_HEADER): at the start of the block,
+ *   with list links, a 16-byte signature and the allocation time; about 90
+ *   bytes.
+ *
+ * Use block_size(), block_alignment() and block_start() to allocate and free
+ * blocks with either layout.
  */
 class BlockHeader {
   // Private; to be used only by the static factory method.
   BlockHeader(size_t user_data_size,
               size_t user_data_alignment,
-              const char* file_name = nullptr,
-              int line = 0,
-              const char* type_name = nullptr);
+              site_id_t site = UNKNOWN_SITE);
 
 public:
   static BlockHeader* create(void* block_start,
@@ -58,6 +77,12 @@ public:
                              const char* type_name = nullptr,
                              const char* file_name = nullptr,
                              int line = 0);
+  static BlockHeader* create(void* block_start,
+                             size_t user_data_size,
+                             size_t user_data_alignment,
+                             site_id_t site);
+  static size_t block_size(size_t user_data_size, size_t user_data_alignment);
+  static size_t block_alignment(size_t user_data_alignment);
   ~BlockHeader() = default;
 
   BlockHeader() = delete;
@@ -65,43 +90,102 @@ public:
   BlockHeader(const BlockHeader&&) = delete;
 
   // Accessors
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   constexpr BlockHeader* next() const { return m_next; }
   void next(BlockHeader* val) { m_next = val; }
 
   constexpr BlockHeader* prev() const { return m_prev; }
   void prev(BlockHeader* val) { m_prev = val; }
 
-  constexpr const char* type_name() const { return m_type_name; }
-  constexpr const char* file_name() const { return m_file_name; }
-  constexpr int line() const { return m_line; }
+  // Used by ShardedTrackingPool.
+  constexpr size_t shard() const { return m_shard; }
+  void shard(size_t val) { m_shard = val; }
+#else
+  // Slot in the tracking pool's BlockIndex.
+  constexpr uint32_t index() const { return m_index; }
+  void index(uint32_t val) { m_index = val; }
+
+  // Used by ShardedTrackingPool.
+  constexpr size_t shard() const { return m_shard; }
+  void shard(size_t val) {
+    assert(val <= UINT8_MAX);
+    m_shard = static_cast<uint8_t>(val);
+  }
+#endif
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  constexpr site_id_t site() const { return m_site; }
+  // Only for the tracking pool; see set_caller_details().
+  void site(site_id_t val) { m_site = val; }
+#else
+  constexpr site_id_t site() const { return m_site; }
+  // Only for the tracking pool; see set_caller_details().
+  void site(site_id_t val) {
+    assert(val < CallSiteRegistry::MAX_SITES);
+    m_site = val;
+  }
+#endif
+
+  // The pool tracking the block, for set_caller_details(); see PoolRegistry.
+  constexpr pool_id_t pool() const { return m_pool; }
+  void pool(pool_id_t val) { m_pool = val; }
+  const char* type_name() const { return call_site().type_name; }
+  const char* file_name() const { return call_site().file_name; }
+  int line() const { return call_site().line; }
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  constexpr uint64_t timestamp() const { return m_timestamp; }
 
   constexpr size_t user_data_size() const { return m_user_data_size; }
   size_t user_data_alignment() const { return m_user_data_alignment; }
 
   constexpr void* user_data() const { return m_user_data; }
+#else
+  constexpr size_t user_data_size() const { return m_user_data_size; }
+  size_t user_data_alignment() const {
+    return static_cast<size_t>(1) << m_alignment_shift;
+  }
+
+  void* user_data() const {
+    return const_cast<BlockHeader*>(this) + 1;
+  }
+#endif
+
+  void* block_start() const;
+  size_t block_size() const {
+    return block_size(user_data_size(), user_data_alignment());
+  }
+  size_t block_alignment() const {
+    return block_alignment(user_data_alignment());
+  }
 
   // Utility methods
   template <size_t N>
-  constexpr void get_block_info_string(char (&buffer)[N]) const;
+  void get_block_info_string(char (&buffer)[N]) const;
   static BlockHeader* get_header(const void* memory);
   template <typename T>
-  constexpr static bool set_caller_details(const CallerDetails& caller_details,
-                                           const T* user_data);
-  constexpr bool is_valid() const;
+  static bool set_caller_details(const CallerDetails& caller_details,
+                                 const T* user_data);
+  bool is_valid() const;
 
 private:
-  constexpr bool
-  set_caller_details(const char* file_name, int line, const char* type_name);
+  const CallSite& call_site() const {
+    return CallSiteRegistry::instance().site(m_site);
+  }
 
+  bool set_site(site_id_t site);
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   BlockHeader* m_next;
   BlockHeader* m_prev;
 
+  size_t m_shard; // Owning shard.
+
   size_t m_user_data_size;
   size_t m_user_data_alignment;
 
-  mutable const char* m_file_name;
-  mutable int m_line;
-  mutable const char* m_type_name;
+  site_id_t m_site; // See CallSiteRegistry.
+  pool_id_t m_pool; // See PoolRegistry.
 
   static const BlockSignature BLOCK_SIGNATURE;
 
@@ -109,37 +193,157 @@ private:
 
   void* m_user_data;
 
-  // TODO: timestamp
+  uint64_t m_timestamp; // Allocation time; see timestamp_ns().
+#else
+  static size_t header_offset(size_t user_data_alignment);
+  uint16_t checksum() const;
+
+  static const uint16_t CHECKSUM_SEED = 0xA18B;
+
+  uint32_t m_site : 24; // See CallSiteRegistry.
+  uint32_t m_pool : 8; // See PoolRegistry.
+  uint32_t m_user_data_size;
+  uint32_t m_index; // See BlockIndex.
+  uint8_t m_alignment_shift; // log2 of the alignment.
+  uint8_t m_shard; // Owning shard.
+  uint16_t m_checksum; // See checksum().
+#endif
+};
+
+#ifndef ALLOK8OR_FULL_BLOCK_HEADER
+static_assert(sizeof(BlockHeader) == 16, "Compact header layout changed");
+static_assert(CallSiteRegistry::MAX_SITES <= (1u << 24),
+              "Site IDs don't fit in the compact header");
+#endif
+
+/**
+ * @brief The live tracking pools, by the small ID each block's header keeps
+ * (see BlockHeader::pool()), so that a header leads to its pool.
+ *
+ * The pool has to move the block's stats when the `new` macro in
+ * diagnostic/new.h sets its call site (see BlockHeader::set_caller_details()).
+ * IDs are reused once their pools are removed; a pool checks that it tracks a
+ * block before setting its site, so a stale ID is harmless.
+ *
+ * NOTE: Entries must outlive their registration. Holds up to MAX_POOLS pools;
+ * blocks of pools added beyond that get NO_POOL, and keep their sites.
+ */
+class PoolRegistry {
+public:
+  static const size_t MAX_POOLS = UINT8_MAX; // IDs 1 to 255.
+
+  // Sets a block's site, if the pool tracks the block.
+  using SetSiteFn = bool (*)(void* pool, BlockHeader* block, site_id_t site);
+
+  struct Entry {
+    void* pool;
+    SetSiteFn set_site;
+  };
+
+  static pool_id_t add(const Entry* entry);
+  static void remove(pool_id_t id);
+  static bool set_site(pool_id_t id, BlockHeader* block, site_id_t site);
 };
 
 /**
  * @brief Ctor for internal use only.
  * 
- * NOTE: file_name, line, and type_name are reserved for special cases, 
- *       not yet implemented. Those cases will probably require an overload of
- *       the factory method. TODO: remove these until needed?
- * 
  * @param user_data_size Size of memory block requested by the caller.
  * @param user_data_alignment Alignment requested by the caller.
- * @param file_name __FILE__ at the call site, or null (default).
- * @param line __LINE__ at the call site, or 0 (default).
- * @param type_name String representation of the type for which the block is created, or null (default).
+ * @param site ID of the call site, or UNKNOWN_SITE (default).
  */
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
 inline BlockHeader::BlockHeader(size_t user_data_size,
                                 size_t user_data_alignment,
-                                const char* file_name /*= nullptr*/,
-                                int line /*= 0*/,
-                                const char* type_name /*= nullptr */)
+                                site_id_t site /*= UNKNOWN_SITE*/)
     : m_next(nullptr),
       m_prev(nullptr),
+      m_shard(0),
       m_user_data_size(user_data_size),
       m_user_data_alignment(user_data_alignment),
-      m_file_name(file_name),
-      m_line(line),
-      m_type_name(type_name),
+      m_site(site),
+      m_pool(NO_POOL),
       m_user_data(reinterpret_cast<void*>(
           reinterpret_cast<uintptr_t>(this) +
-          align::get_aligned_size(sizeof(BlockHeader), alignof(BlockHeader)))) {
+          align::get_aligned_size(sizeof(BlockHeader), alignof(BlockHeader)))),
+      m_timestamp(timestamp_ns()) {
+}
+#else
+inline BlockHeader::BlockHeader(size_t user_data_size,
+                                size_t user_data_alignment,
+                                site_id_t site /*= UNKNOWN_SITE*/)
+    : m_site(site),
+      m_pool(NO_POOL),
+      m_user_data_size(static_cast<uint32_t>(user_data_size)),
+      m_index(UINT32_MAX), // Not indexed.
+      m_alignment_shift(0),
+      m_shard(0) {
+  while ((static_cast<size_t>(1) << m_alignment_shift) < user_data_alignment)
+    ++m_alignment_shift;
+
+  m_checksum = checksum();
+}
+
+/**
+ * @brief Returns a checksum of the header's address and the fields fixed when
+ * it was created, so that anything else is unlikely to pass for a header.
+ */
+inline uint16_t BlockHeader::checksum() const {
+  const uint64_t value =
+      (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(this)) ^
+       (static_cast<uint64_t>(m_user_data_size) << 8) ^ m_alignment_shift) *
+      0x9e3779b97f4a7c15ULL;
+  return static_cast<uint16_t>((value >> 48) ^ CHECKSUM_SEED);
+}
+
+/**
+ * @brief Returns the bytes from the start of the block to the user data:
+ * room for the header, rounded up to the alignment.
+ */
+inline size_t BlockHeader::header_offset(size_t user_data_alignment) {
+  return user_data_alignment > sizeof(BlockHeader) ? user_data_alignment
+                                                   : sizeof(BlockHeader);
+}
+#endif
+
+/**
+ * @brief Returns the size of a block, header included, for user data of the
+ * given size and alignment.
+ */
+inline size_t BlockHeader::block_size(size_t user_data_size,
+                                      size_t user_data_alignment) {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  (void)user_data_alignment;
+  return user_data_size +
+         align::get_aligned_size(sizeof(BlockHeader), alignof(BlockHeader));
+#else
+  return header_offset(user_data_alignment) + user_data_size;
+#endif
+}
+
+/**
+ * @brief Returns the alignment to allocate a block with, for user data of the
+ * given alignment.
+ */
+inline size_t BlockHeader::block_alignment(size_t user_data_alignment) {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  return user_data_alignment;
+#else
+  return user_data_alignment > alignof(BlockHeader) ? user_data_alignment
+                                                    : alignof(BlockHeader);
+#endif
+}
+
+/**
+ * @brief Returns the start of the block, as allocated; see block_size().
+ */
+inline void* BlockHeader::block_start() const {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  return const_cast<BlockHeader*>(this);
+#else
+  return static_cast<char*>(user_data()) -
+         header_offset(user_data_alignment());
+#endif
 }
 
 /**
@@ -150,8 +354,7 @@ inline BlockHeader::BlockHeader(size_t user_data_size,
  * 
  */
 template <size_t N>
-inline constexpr void
-BlockHeader::get_block_info_string(char (&buffer)[N]) const {
+inline void BlockHeader::get_block_info_string(char (&buffer)[N]) const {
   snprintf(buffer,
            N,
            "type [%s] file [%s] line [%d] size [%d]",
@@ -167,8 +370,12 @@ BlockHeader::get_block_info_string(char (&buffer)[N]) const {
  * @return true When the header has a signature that matches the global one.
  * @return false When the header does not have a signature that matches the global one.
  */
-inline constexpr bool BlockHeader::is_valid() const {
+inline bool BlockHeader::is_valid() const {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   return m_signature == BLOCK_SIGNATURE;
+#else
+  return m_checksum == checksum();
+#endif
 }
 
 /**
@@ -178,13 +385,21 @@ inline constexpr bool BlockHeader::is_valid() const {
  * @returns Pointer to the BlockHeader for the given user memory.
  */
 inline BlockHeader* BlockHeader::get_header(const void* user_data) {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   return reinterpret_cast<BlockHeader*>(
       reinterpret_cast<uintptr_t>(user_data) -
       align::get_aligned_size(sizeof(BlockHeader), alignof(BlockHeader)));
+#else
+  return reinterpret_cast<BlockHeader*>(
+      reinterpret_cast<uintptr_t>(user_data) - sizeof(BlockHeader));
+#endif
 }
 
 /**
  * @brief Records the caller details and data type in the header.
+ *
+ * NOTE: The site is interned on the first call from each call site that has a
+ * CallSiteCache; later calls reuse the cached ID.
  * 
  * @param caller_details A CallerDetails object containing caller details.
  * @param user_data Pointer to new object that already has a header.
@@ -192,38 +407,38 @@ inline BlockHeader* BlockHeader::get_header(const void* user_data) {
  * @return false When the header is NOT valid OR call details HAVE alread been set.
  */
 template <typename T>
-inline constexpr bool
-BlockHeader::set_caller_details(const CallerDetails& caller_details,
-                                const T* user_data) {
-  return get_header(reinterpret_cast<const void*>(user_data))
-      ->set_caller_details(caller_details.file_name(),
-                           caller_details.line(),
-                           get_type_name<T>());
+inline bool BlockHeader::set_caller_details(const CallerDetails& caller_details,
+                                            const T* user_data) {
+  auto header = get_header(reinterpret_cast<const void*>(user_data));
+  if (!header->is_valid())
+    return false; // Not a BlockHeader.
+
+  auto cache = caller_details.site_cache();
+  auto site = cache ? cache->id() : UNKNOWN_SITE;
+  if (site == UNKNOWN_SITE) {
+    site = CallSiteRegistry::instance().intern(CallSite{
+        get_type_name<T>(), caller_details.file_name(), caller_details.line()});
+    if (cache) {
+      cache->id(site);
+    }
+  }
+
+  return header->set_site(site);
 }
 
 /**
- * @brief Sets the __FILE__, __LINE__, and data type of the allocation into the header.
+ * @brief Sets the call site of the allocation into the header, through the
+ * pool tracking it, which moves the block's stats to the new site.
  * 
- * @param file_name __FILE__ at the allocation call site.
- * @param line __LINE__ at the allocation call site.
- * @param type_name Name of the data type allocated.
+ * @param site ID of the allocation call site.
  * @return true When the header is valid and call details haven't been set yet.
  * @return false When the header is NOT valid OR call details HAVE alread been set.
  */
-inline constexpr bool BlockHeader::set_caller_details(const char* file_name,
-                                                      int line,
-                                                      const char* type_name) {
+inline bool BlockHeader::set_site(site_id_t site) {
   if (!is_valid())
     return false; // Not a BlockHeader.
 
-  if (m_file_name || m_line || m_type_name)
-    return false;  // Already set
-
-  m_file_name = file_name;
-  m_line = line;
-  m_type_name = type_name;
-
-  return true;
+  return PoolRegistry::set_site(m_pool, this, site);
 }
 
 
@@ -238,8 +453,7 @@ inline constexpr bool BlockHeader::set_caller_details(const char* file_name,
  * @return T* Pointer to the input object.
  */
 template <typename T>
-inline constexpr T* operator*(const CallerDetails& caller_details,
-                              T* user_data) {
+inline T* operator*(const CallerDetails& caller_details, T* user_data) {
   BlockHeader::set_caller_details<T>(caller_details, user_data);
   return user_data;
 }
@@ -0,0 +1,180 @@
+/**
+ * @file block_index.h
+ * @brief Side index of tracked blocks, for headers without list links.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace allok8or {
+namespace diagnostic {
+
+/**
+ * @brief Index of the blocks a tracking pool holds, kept beside them rather
+ * than linked through their headers.
+ *
+ * Entries are packed in one array, in no particular order, and each block
+ * records its slot (TBlock::index()), so adding and removing are O(1):
+ * removing moves the last entry into the hole. Each entry also holds the
+ * block's allocation time. The array is allocated on the first add, doubled
+ * when full, and never shrinks.
+ *
+ * NOTE: Holds a reference to the allocator, which must outlive it.
+ *
+ * @tparam TBlock Type of the block headers; must have index() and
+ * index(uint32_t).
+ * @tparam TAllocator Type of the allocator for the entry array.
+ */
+template <typename TBlock, typename TAllocator>
+class BlockIndex {
+public:
+  struct Entry {
+    TBlock* block;
+    uint64_t timestamp; // Allocation time; see timestamp_ns().
+  };
+
+  static const size_t DEFAULT_CAPACITY = 64;
+  static const uint32_t NO_INDEX = UINT32_MAX; // Of blocks not indexed.
+
+  explicit BlockIndex(Allocator<TAllocator>& allocator);
+  ~BlockIndex();
+
+  // No copies; the entries belong to this index.
+  BlockIndex(const BlockIndex&) = delete;
+  BlockIndex& operator=(const BlockIndex&) = delete;
+
+  bool add(TBlock* block, uint64_t timestamp);
+  bool remove(TBlock* block, uint64_t& timestamp);
+  bool contains(const TBlock* block) const;
+
+  const Entry* begin() const { return m_entries; }
+  const Entry* end() const { return m_entries + m_size; }
+
+  size_t size() const { return m_size; }
+  size_t capacity() const { return m_capacity; }
+
+private:
+  bool grow();
+
+  const Allocator<TAllocator>& allocator_base() const { return m_allocator; }
+
+  TAllocator& m_allocator;
+  Entry* m_entries;
+  size_t m_capacity;
+  size_t m_size;
+};
+
+template <typename TBlock, typename TAllocator>
+const size_t BlockIndex<TBlock, TAllocator>::DEFAULT_CAPACITY;
+template <typename TBlock, typename TAllocator>
+const uint32_t BlockIndex<TBlock, TAllocator>::NO_INDEX;
+
+/**
+ * @brief Ctor; allocates nothing until the first add.
+ *
+ * @param allocator Allocator for the entry array.
+ */
+template <typename TBlock, typename TAllocator>
+BlockIndex<TBlock, TAllocator>::BlockIndex(Allocator<TAllocator>& allocator)
+    : m_allocator(static_cast<TAllocator&>(allocator)),
+      m_entries(nullptr),
+      m_capacity(0),
+      m_size(0) {}
+
+template <typename TBlock, typename TAllocator>
+BlockIndex<TBlock, TAllocator>::~BlockIndex() {
+  if (m_entries) {
+    allocator_base().deallocate(
+        m_entries, m_capacity * sizeof(Entry), alignof(Entry));
+  }
+}
+
+/**
+ * @brief Adds a block at the end, and records its slot in it.
+ *
+ * @return false If the array is full and can't grow; the block isn't added.
+ */
+template <typename TBlock, typename TAllocator>
+bool BlockIndex<TBlock, TAllocator>::add(TBlock* block, uint64_t timestamp) {
+  if (m_size == m_capacity && !grow()) {
+    return false;
+  }
+
+  m_entries[m_size] = Entry{block, timestamp};
+  block->index(static_cast<uint32_t>(m_size));
+  ++m_size;
+  return true;
+}
+
+/**
+ * @brief Removes a block, moving the last entry into its slot.
+ *
+ * @param timestamp Set to the block's allocation time.
+ * @return false If the block isn't in this index.
+ */
+template <typename TBlock, typename TAllocator>
+bool BlockIndex<TBlock, TAllocator>::remove(TBlock* block,
+                                            uint64_t& timestamp) {
+  if (!contains(block)) {
+    return false;
+  }
+
+  const auto index = block->index();
+  timestamp = m_entries[index].timestamp;
+
+  const auto& last = m_entries[--m_size];
+  if (index != m_size) {
+    m_entries[index] = last;
+    last.block->index(index);
+  }
+  block->index(NO_INDEX);
+  return true;
+}
+
+/**
+ * @brief Returns true if the block is in this index; one compare, no search.
+ */
+template <typename TBlock, typename TAllocator>
+bool BlockIndex<TBlock, TAllocator>::contains(const TBlock* block) const {
+  const auto index = block->index();
+  return index < m_size && m_entries[index].block == block;
+}
+
+/**
+ * @brief Doubles the entry array.
+ *
+ * @return false If the new array couldn't be allocated, or its slots wouldn't
+ * fit in 32 bits; the index is unchanged.
+ */
+template <typename TBlock, typename TAllocator>
+bool BlockIndex<TBlock, TAllocator>::grow() {
+  const size_t new_capacity = m_capacity ? m_capacity * 2 : DEFAULT_CAPACITY;
+  if (new_capacity > NO_INDEX) {
+    return false;
+  }
+
+  auto new_entries = static_cast<Entry*>(
+      allocator_base().allocate(new_capacity * sizeof(Entry), alignof(Entry)));
+  if (!new_entries) {
+    return false;
+  }
+
+  if (m_entries) {
+    std::memcpy(new_entries, m_entries, m_size * sizeof(Entry));
+    allocator_base().deallocate(
+        m_entries, m_capacity * sizeof(Entry), alignof(Entry));
+  }
+  m_entries = new_entries;
+  m_capacity = new_capacity;
+  return true;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
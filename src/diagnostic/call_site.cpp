@@ -0,0 +1,120 @@
+/**
+ * @file call_site.cpp
+ * @brief Registry that interns allocation call sites as dense integer IDs.
+ *
+ */
+
+// My header
+#include "call_site.h"
+
+// Library headers
+#include <cassert>
+#include <new>
+#include <type_traits>
+
+namespace allok8or {
+namespace diagnostic {
+
+const size_t CallSiteRegistry::SITES_PER_CHUNK;
+const size_t CallSiteRegistry::MAX_CHUNKS;
+const size_t CallSiteRegistry::MAX_SITES;
+
+// Static init.
+PassThroughAllocator CallSiteRegistry::m_backing_allocator;
+
+/**
+ * CallSiteRegistry ctor
+ *
+ * Interns the unknown site, so that it gets ID 0.
+ */
+CallSiteRegistry::CallSiteRegistry()
+    : m_ids(m_backing_allocator), m_num_sites(0) {
+  for (auto& chunk : m_chunks) {
+    chunk.store(nullptr, std::memory_order_relaxed);
+  }
+
+  const auto id = intern(CallSite{nullptr, nullptr, 0});
+  assert(id == UNKNOWN_SITE);
+  (void)id;
+}
+
+/**
+ * @brief Returns the registry.
+ *
+ * NOTE: Never destroyed, and never allocates through operator new, so that it
+ * can be used from allocators that replace it, and during static destruction.
+ */
+CallSiteRegistry& CallSiteRegistry::instance() {
+  static typename std::aligned_storage<sizeof(CallSiteRegistry),
+                                       alignof(CallSiteRegistry)>::type storage;
+  static auto registry = new (&storage) CallSiteRegistry();
+  return *registry;
+}
+
+/**
+ * @brief Returns the ID of a site, assigning the next one if it's new.
+ *
+ * @return site_id_t The site's ID, or UNKNOWN_SITE if the registry is full.
+ */
+site_id_t CallSiteRegistry::intern(const CallSite& site) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto existing = m_ids.find(site);
+  if (existing) {
+    return *existing;
+  }
+
+  const auto index = m_num_sites.load(std::memory_order_relaxed);
+  if (index == MAX_SITES) {
+    return UNKNOWN_SITE;
+  }
+
+  auto& chunk_ref = m_chunks[index / SITES_PER_CHUNK];
+  auto chunk = chunk_ref.load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = static_cast<CallSite*>(m_backing_allocator.allocate(
+        SITES_PER_CHUNK * sizeof(CallSite), alignof(CallSite)));
+    if (!chunk) {
+      return UNKNOWN_SITE;
+    }
+    chunk_ref.store(chunk, std::memory_order_release);
+  }
+
+  const auto id = static_cast<site_id_t>(index);
+  chunk[index % SITES_PER_CHUNK] = site;
+  m_ids[site] = id;
+  m_num_sites.store(index + 1, std::memory_order_release);
+  return id;
+}
+
+/**
+ * @brief Looks up the ID of a site, without assigning one.
+ *
+ * @param site The site to look up.
+ * @param id [OUT] The site's ID, if found.
+ * @return true If the site has an ID.
+ */
+bool CallSiteRegistry::find(const CallSite& site, site_id_t& id) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto existing = m_ids.find(site);
+  if (existing) {
+    id = *existing;
+  }
+  return existing != nullptr;
+}
+
+/**
+ * @brief Returns the site with the given ID; the unknown site for IDs that
+ * haven't been assigned.
+ */
+const CallSite& CallSiteRegistry::site(site_id_t id) const {
+  if (id >= num_sites()) {
+    id = UNKNOWN_SITE;
+  }
+  auto chunk = m_chunks[id / SITES_PER_CHUNK].load(std::memory_order_acquire);
+  return chunk[id % SITES_PER_CHUNK];
+}
+
+} // namespace diagnostic
+} // namespace allok8or
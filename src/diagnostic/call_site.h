@@ -0,0 +1,137 @@
+/**
+ * @file call_site.h
+ * @brief Registry that interns allocation call sites as dense integer IDs.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../pass_through.h"
+#include "flat_map.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace allok8or {
+namespace diagnostic {
+
+typedef uint32_t site_id_t;
+typedef uint32_t stack_id_t;
+
+// ID of the site with no details: null type and file, line 0, no stack.
+const site_id_t UNKNOWN_SITE = 0;
+
+// ID of the empty stack; see StackTable.
+const stack_id_t NO_STACK = 0;
+
+/**
+ * @brief Where an allocation came from: the type allocated, and the source
+ * file and line of the call; or, for allocations without those, the captured
+ * stack.
+ */
+struct CallSite {
+  const char* type_name;
+  const char* file_name;
+  int line;
+  stack_id_t stack; // NO_STACK unless captured; see StackTable.
+
+  // Mixes each field in turn, so keys differing in any field spread evenly.
+  struct hash {
+    size_t operator()(const CallSite& k) const {
+      auto h = mix_hash(reinterpret_cast<uintptr_t>(k.type_name));
+      h = mix_hash(h ^ reinterpret_cast<uintptr_t>(k.file_name));
+      h = mix_hash(h ^ static_cast<uint64_t>(k.line));
+      h = mix_hash(h ^ k.stack);
+      return static_cast<size_t>(h);
+    }
+  };
+
+  struct equal_to {
+    constexpr size_t operator()(const CallSite& lhs,
+                                const CallSite& rhs) const {
+      return (&lhs == &rhs) ||
+             (lhs.type_name == rhs.type_name &&
+              lhs.file_name == rhs.file_name && lhs.line == rhs.line &&
+              lhs.stack == rhs.stack);
+    }
+  };
+};
+
+/**
+ * @brief Assigns each distinct CallSite a small integer ID, once, so that
+ * headers and stats can refer to sites by ID instead of by three fields.
+ *
+ * IDs are dense, starting with UNKNOWN_SITE, so they can index arrays. Sites
+ * are never removed.
+ *
+ * intern() takes a lock, and is meant to run once per site (see
+ * CallSiteCache). site() is lock-free.
+ *
+ * NOTE: Sites are compared by pointer, so their strings must be string
+ * literals or otherwise outlive the registry (e.g. __FILE__).
+ */
+class CallSiteRegistry {
+public:
+  static const size_t SITES_PER_CHUNK = 1024;
+  static const size_t MAX_CHUNKS = 256;
+  static const size_t MAX_SITES = SITES_PER_CHUNK * MAX_CHUNKS;
+
+  // No copies; there is only the one.
+  CallSiteRegistry(const CallSiteRegistry&) = delete;
+  CallSiteRegistry& operator=(const CallSiteRegistry&) = delete;
+
+  static CallSiteRegistry& instance();
+
+  site_id_t intern(const CallSite& site);
+  bool find(const CallSite& site, site_id_t& id) const;
+
+  const CallSite& site(site_id_t id) const;
+  size_t num_sites() const {
+    return m_num_sites.load(std::memory_order_acquire);
+  }
+
+private:
+  CallSiteRegistry();
+
+  using IdMap = FlatMap<CallSite,
+                        site_id_t,
+                        CallSite::hash,
+                        CallSite::equal_to,
+                        PassThroughAllocator>;
+
+  // Stateless, so static is safe.
+  static PassThroughAllocator m_backing_allocator;
+
+  mutable std::mutex m_mutex; // Guards m_ids, and adding sites.
+  IdMap m_ids;
+  std::atomic<CallSite*> m_chunks[MAX_CHUNKS];
+  std::atomic<size_t> m_num_sites;
+};
+
+/**
+ * @brief Remembers the ID of one call site after its first allocation.
+ *
+ * The `new` macro in diagnostic/new.h gives every call site a function-local
+ * static CallSiteCache, so only the first allocation from a site goes to the
+ * registry.
+ */
+class CallSiteCache {
+public:
+  constexpr CallSiteCache() : m_id(UNKNOWN_SITE) {}
+
+  // No copies; identifies one call site.
+  CallSiteCache(const CallSiteCache&) = delete;
+  CallSiteCache& operator=(const CallSiteCache&) = delete;
+
+  site_id_t id() const { return m_id.load(std::memory_order_relaxed); }
+  void id(site_id_t val) { m_id.store(val, std::memory_order_relaxed); }
+
+private:
+  std::atomic<site_id_t> m_id;
+};
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -0,0 +1,366 @@
+/**
+ * @file flat_map.h
+ * @brief Open-addressing hash map for small, trivially copyable entries.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../allocator.h"
+#include "../logging.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace allok8or {
+namespace diagnostic {
+
+/**
+ * @brief Mixes the bits of a 64-bit value (the splitmix64 finalizer), so that
+ * nearby inputs land far apart.
+ */
+inline uint64_t mix_hash(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+/**
+ * @brief Hash map that stores its entries inline in one array, probing
+ * linearly from the hashed slot.
+ *
+ * Lookups touch consecutive slots, and there's no allocation per entry; the
+ * array is allocated up front and doubled when it's 3/4 full. Erasing shifts
+ * later entries back, so there are no tombstones; the array never shrinks.
+ *
+ * Iteration visits entries as std::pair<TKey, TValue>, in no particular order.
+ *
+ * NOTE: Holds a reference to the allocator, which must outlive it.
+ *
+ * @tparam TKey Type of the keys; trivially copyable.
+ * @tparam TValue Type of the values; trivially copyable and
+ * default-constructible.
+ * @tparam THash Hash function object for TKey; should mix its bits well, since
+ * the low bits pick the slot.
+ * @tparam TEqual Equality function object for TKey.
+ * @tparam TAllocator Type of the allocator for the slot array.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+class FlatMap {
+  static_assert(std::is_trivially_copyable<TKey>::value &&
+                    std::is_trivially_copyable<TValue>::value,
+                "FlatMap entries must be trivially copyable");
+
+public:
+  using key_type = TKey;
+  using mapped_type = TValue;
+  using value_type = std::pair<TKey, TValue>;
+
+  static const size_t DEFAULT_CAPACITY = 64;
+
+  class const_iterator;
+
+  explicit FlatMap(Allocator<TAllocator>& allocator,
+                   size_t capacity = DEFAULT_CAPACITY);
+  ~FlatMap();
+
+  // No copies; the slots belong to this map.
+  FlatMap(const FlatMap&) = delete;
+  FlatMap& operator=(const FlatMap&) = delete;
+
+  TValue& operator[](const TKey& key);
+  const TValue* find(const TKey& key) const;
+  bool erase(const TKey& key);
+
+  const_iterator begin() const { return const_iterator(m_slots, m_capacity); }
+  const_iterator end() const {
+    return const_iterator(m_slots + m_capacity, 0);
+  }
+
+  size_t size() const { return m_size; }
+  size_t capacity() const { return m_capacity; }
+
+private:
+  struct Slot {
+    value_type entry;
+    bool occupied;
+  };
+
+  Slot* find_slot(const TKey& key) const;
+  bool grow();
+  Slot* allocate_slots(size_t capacity) const;
+
+  const Allocator<TAllocator>& allocator_base() const { return m_allocator; }
+
+  TAllocator& m_allocator;
+  Slot* m_slots;
+  size_t m_capacity; // Always a power of 2.
+  size_t m_size;
+  TValue m_overflow; // Returned if the map is full and can't grow.
+};
+
+/**
+ * @brief Visits the occupied slots of a FlatMap.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+class FlatMap<TKey, TValue, THash, TEqual, TAllocator>::const_iterator {
+public:
+  const_iterator(const Slot* slot, size_t remaining)
+      : m_slot(slot), m_end(slot + remaining) {
+    skip_empty();
+  }
+
+  const value_type& operator*() const { return m_slot->entry; }
+  const value_type* operator->() const { return &m_slot->entry; }
+
+  const_iterator& operator++() {
+    ++m_slot;
+    skip_empty();
+    return *this;
+  }
+
+  bool operator==(const const_iterator& other) const {
+    return m_slot == other.m_slot;
+  }
+  bool operator!=(const const_iterator& other) const {
+    return m_slot != other.m_slot;
+  }
+
+private:
+  void skip_empty() {
+    while (m_slot != m_end && !m_slot->occupied) {
+      ++m_slot;
+    }
+  }
+
+  const Slot* m_slot;
+  const Slot* m_end;
+};
+
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+const size_t FlatMap<TKey, TValue, THash, TEqual, TAllocator>::DEFAULT_CAPACITY;
+
+/**
+ * @brief Ctor; allocates room for capacity entries.
+ *
+ * @param allocator Allocator for the slot array.
+ * @param capacity Initial number of slots; rounded up to a power of 2.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+FlatMap<TKey, TValue, THash, TEqual, TAllocator>::FlatMap(
+    Allocator<TAllocator>& allocator, size_t capacity)
+    : m_allocator(static_cast<TAllocator&>(allocator)),
+      m_slots(nullptr),
+      m_capacity(1),
+      m_size(0),
+      m_overflow() {
+  while (m_capacity < capacity) {
+    m_capacity <<= 1;
+  }
+  m_slots = allocate_slots(m_capacity);
+  if (!m_slots) {
+    m_capacity = 0;
+  }
+}
+
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+FlatMap<TKey, TValue, THash, TEqual, TAllocator>::~FlatMap() {
+  if (m_slots) {
+    allocator_base().deallocate(
+        m_slots, m_capacity * sizeof(Slot), alignof(Slot));
+  }
+}
+
+/**
+ * @brief Returns the value for a key, inserting a default-constructed one if
+ * the key is new. One probe sequence either way.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+TValue& FlatMap<TKey, TValue, THash, TEqual, TAllocator>::
+operator[](const TKey& key) {
+  // Keeps at least one slot empty, so that probing always terminates.
+  if ((m_size + 1) * 4 > m_capacity * 3 && !grow() &&
+      m_size + 1 >= m_capacity) {
+    LOG_ERROR("FlatMap is full and can't grow; the entry is not kept.");
+    return m_overflow;
+  }
+
+  auto slot = find_slot(key);
+  if (!slot->occupied) {
+    new (&slot->entry) value_type(key, TValue());
+    slot->occupied = true;
+    ++m_size;
+  }
+  return slot->entry.second;
+}
+
+/**
+ * @brief Returns the value for a key, or nullptr if there is none.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+const TValue*
+FlatMap<TKey, TValue, THash, TEqual, TAllocator>::find(const TKey& key) const {
+  if (!m_capacity) {
+    return nullptr;
+  }
+
+  auto slot = find_slot(key);
+  return slot->occupied ? &slot->entry.second : nullptr;
+}
+
+/**
+ * @brief Removes the entry for a key, moving back any entries that probed past
+ * it so that their probe sequences stay unbroken.
+ *
+ * @return true If the key was in the map.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+bool FlatMap<TKey, TValue, THash, TEqual, TAllocator>::erase(const TKey& key) {
+  if (!m_capacity) {
+    return false;
+  }
+
+  auto slot = find_slot(key);
+  if (!slot->occupied) {
+    return false;
+  }
+
+  const size_t mask = m_capacity - 1;
+  size_t hole = static_cast<size_t>(slot - m_slots);
+  for (size_t index = (hole + 1) & mask; m_slots[index].occupied;
+       index = (index + 1) & mask) {
+    // An entry may fill the hole only if the hole is between its home slot
+    // and where it is now.
+    const size_t home = THash()(m_slots[index].entry.first) & mask;
+    if (((index - home) & mask) >= ((index - hole) & mask)) {
+      m_slots[hole].entry = m_slots[index].entry;
+      hole = index;
+    }
+  }
+
+  m_slots[hole].occupied = false;
+  --m_size;
+  return true;
+}
+
+/**
+ * @brief Returns the slot holding key, or the empty slot where it belongs.
+ *
+ * NOTE: Requires at least one empty slot.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+typename FlatMap<TKey, TValue, THash, TEqual, TAllocator>::Slot*
+FlatMap<TKey, TValue, THash, TEqual, TAllocator>::find_slot(
+    const TKey& key) const {
+  const size_t mask = m_capacity - 1;
+  size_t index = THash()(key) & mask;
+  while (m_slots[index].occupied &&
+         !TEqual()(m_slots[index].entry.first, key)) {
+    index = (index + 1) & mask;
+  }
+  return &m_slots[index];
+}
+
+/**
+ * @brief Doubles the slot array and re-inserts every entry.
+ *
+ * @return false If the new array couldn't be allocated; the map is unchanged.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+bool FlatMap<TKey, TValue, THash, TEqual, TAllocator>::grow() {
+  const size_t new_capacity = m_capacity ? m_capacity * 2 : DEFAULT_CAPACITY;
+  auto new_slots = allocate_slots(new_capacity);
+  if (!new_slots) {
+    return false;
+  }
+
+  auto old_slots = m_slots;
+  const auto old_capacity = m_capacity;
+  m_slots = new_slots;
+  m_capacity = new_capacity;
+
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old_slots[i].occupied) {
+      auto slot = find_slot(old_slots[i].entry.first);
+      new (&slot->entry) value_type(old_slots[i].entry);
+      slot->occupied = true;
+    }
+  }
+
+  if (old_slots) {
+    allocator_base().deallocate(
+        old_slots, old_capacity * sizeof(Slot), alignof(Slot));
+  }
+  return true;
+}
+
+/**
+ * @brief Allocates an array of empty slots.
+ */
+template <typename TKey,
+          typename TValue,
+          typename THash,
+          typename TEqual,
+          typename TAllocator>
+typename FlatMap<TKey, TValue, THash, TEqual, TAllocator>::Slot*
+FlatMap<TKey, TValue, THash, TEqual, TAllocator>::allocate_slots(
+    size_t capacity) const {
+  auto slots = static_cast<Slot*>(
+      allocator_base().allocate(capacity * sizeof(Slot), alignof(Slot)));
+  if (slots) {
+    for (size_t i = 0; i < capacity; ++i) {
+      slots[i].occupied = false;
+    }
+  }
+  return slots;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -0,0 +1,241 @@
+/**
+ * @file heap_snapshot.cpp
+ * @brief Point-in-time copies of the live heap per call site, and the growth
+ * between two of them.
+ *
+ */
+
+// My header
+#include "heap_snapshot.h"
+
+// Project headers
+#include "allocation_stats.h"
+#include "util.h"
+
+// Library headers
+#include <algorithm>
+#include <cassert>
+#include <new>
+
+namespace allok8or {
+namespace diagnostic {
+
+//
+// HeapSnapshot Implementation
+//
+
+// Static init.
+const LiveStats LiveStats::null_stats;
+PassThroughAllocator HeapSnapshot::m_backing_allocator;
+
+/**
+ * HeapSnapshot ctor
+ *
+ * Empty, and timestamped now; see add().
+ */
+HeapSnapshot::HeapSnapshot()
+    : m_timestamp(timestamp_ns()), m_sites(nullptr), m_capacity(0) {}
+
+HeapSnapshot::~HeapSnapshot() { release(); }
+
+HeapSnapshot::HeapSnapshot(HeapSnapshot&& other)
+    : m_timestamp(other.m_timestamp),
+      m_sites(other.m_sites),
+      m_capacity(other.m_capacity),
+      m_total(other.m_total) {
+  other.m_sites = nullptr;
+  other.m_capacity = 0;
+  other.m_total = LiveStats();
+}
+
+HeapSnapshot& HeapSnapshot::operator=(HeapSnapshot&& other) {
+  if (this != &other) {
+    release();
+    m_timestamp = other.m_timestamp;
+    m_sites = other.m_sites;
+    m_capacity = other.m_capacity;
+    m_total = other.m_total;
+    other.m_sites = nullptr;
+    other.m_capacity = 0;
+    other.m_total = LiveStats();
+  }
+  return *this;
+}
+
+/**
+ * @brief Adds the live blocks of every site recorded by a tracker.
+ *
+ * NOTE: The tracker must not change meanwhile; lock it, if it's shared.
+ */
+void HeapSnapshot::add(const AllocationStatsTracker& tracker) {
+  const auto& stats = tracker.stats();
+  for (auto it = stats.begin(); it != stats.end(); ++it) {
+    const auto& site_stats = (*it).second;
+    add(it.site(), site_stats.net_allocations(), site_stats.net_bytes());
+  }
+}
+
+/**
+ * @brief Adds live blocks to those of one site.
+ */
+void HeapSnapshot::add(site_id_t site, llong_t allocations, llong_t bytes) {
+  if (!allocations && !bytes) {
+    return;
+  }
+  if (site >= m_capacity && !grow(site)) {
+    return;
+  }
+
+  m_sites[site].allocations += allocations;
+  m_sites[site].bytes += bytes;
+  m_total.allocations += allocations;
+  m_total.bytes += bytes;
+}
+
+/**
+ * @brief Grows the array to hold site, and every site interned so far.
+ *
+ * @return false If the new array couldn't be allocated; the site is dropped.
+ */
+bool HeapSnapshot::grow(site_id_t site) {
+  auto new_capacity = CallSiteRegistry::instance().num_sites();
+  if (new_capacity <= site) {
+    new_capacity = static_cast<size_t>(site) + 1;
+  }
+
+  auto new_sites = static_cast<LiveStats*>(m_backing_allocator.allocate(
+      new_capacity * sizeof(LiveStats), alignof(LiveStats)));
+  assert(new_sites);
+  if (!new_sites) {
+    return false;
+  }
+
+  for (size_t i = 0; i < new_capacity; ++i) {
+    new (&new_sites[i]) LiveStats(i < m_capacity ? m_sites[i] : LiveStats());
+  }
+
+  release();
+  m_sites = new_sites;
+  m_capacity = new_capacity;
+  return true;
+}
+
+void HeapSnapshot::release() {
+  if (m_sites) {
+    m_backing_allocator.deallocate(m_sites);
+    m_sites = nullptr;
+  }
+}
+
+//
+// HeapDiff Implementation
+//
+
+// Static init.
+PassThroughAllocator HeapDiff::m_backing_allocator;
+
+HeapDiff::HeapDiff() : m_sites(nullptr), m_size(0), m_elapsed_ns(0) {}
+
+HeapDiff::~HeapDiff() { release(); }
+
+HeapDiff::HeapDiff(HeapDiff&& other)
+    : m_sites(other.m_sites),
+      m_size(other.m_size),
+      m_elapsed_ns(other.m_elapsed_ns) {
+  other.m_sites = nullptr;
+  other.m_size = 0;
+}
+
+HeapDiff& HeapDiff::operator=(HeapDiff&& other) {
+  if (this != &other) {
+    release();
+    m_sites = other.m_sites;
+    m_size = other.m_size;
+    m_elapsed_ns = other.m_elapsed_ns;
+    other.m_sites = nullptr;
+    other.m_size = 0;
+  }
+  return *this;
+}
+
+void HeapDiff::release() {
+  if (m_sites) {
+    m_backing_allocator.deallocate(m_sites);
+    m_sites = nullptr;
+  }
+}
+
+namespace {
+
+bool grew(const LiveStats& before, const LiveStats& after) {
+  return after.bytes > before.bytes || after.allocations > before.allocations;
+}
+
+} // namespace
+
+/**
+ * @brief Finds the call sites whose live blocks or bytes grew between two
+ * snapshots.
+ *
+ * Costs O(sites) to compare, plus sorting the sites that grew.
+ *
+ * @param before The earlier snapshot.
+ * @param after The later snapshot.
+ * @return HeapDiff The sites that grew, largest growth in bytes first; ties
+ * by growth in blocks, then by site ID.
+ */
+HeapDiff diff(const HeapSnapshot& before, const HeapSnapshot& after) {
+  HeapDiff result;
+  result.m_elapsed_ns = after.timestamp() > before.timestamp()
+                            ? after.timestamp() - before.timestamp()
+                            : 0;
+
+  const auto num_sites = std::max(before.num_sites(), after.num_sites());
+
+  // Counts first, so that the array is allocated once.
+  size_t num_grown = 0;
+  for (size_t i = 0; i < num_sites; ++i) {
+    const auto site = static_cast<site_id_t>(i);
+    if (grew(before.live(site), after.live(site))) {
+      ++num_grown;
+    }
+  }
+  if (!num_grown) {
+    return result;
+  }
+
+  result.m_sites =
+      static_cast<SiteGrowth*>(HeapDiff::m_backing_allocator.allocate(
+          num_grown * sizeof(SiteGrowth), alignof(SiteGrowth)));
+  assert(result.m_sites);
+  if (!result.m_sites) {
+    return result;
+  }
+
+  for (size_t i = 0; i < num_sites; ++i) {
+    const auto site = static_cast<site_id_t>(i);
+    const auto& old_stats = before.live(site);
+    const auto& new_stats = after.live(site);
+    if (grew(old_stats, new_stats)) {
+      result.m_sites[result.m_size++] =
+          SiteGrowth{site,
+                     new_stats.allocations - old_stats.allocations,
+                     new_stats.bytes - old_stats.bytes};
+    }
+  }
+
+  std::sort(result.m_sites,
+            result.m_sites + result.m_size,
+            [](const SiteGrowth& lhs, const SiteGrowth& rhs) {
+              if (lhs.bytes != rhs.bytes)
+                return lhs.bytes > rhs.bytes;
+              if (lhs.allocations != rhs.allocations)
+                return lhs.allocations > rhs.allocations;
+              return lhs.site < rhs.site;
+            });
+
+  return result;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
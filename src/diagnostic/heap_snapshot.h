@@ -0,0 +1,130 @@
+/**
+ * @file heap_snapshot.h
+ * @brief Point-in-time copies of the live heap per call site, and the growth
+ * between two of them.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../pass_through.h"
+#include "../types.h"
+#include "call_site.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdint>
+
+namespace allok8or {
+namespace diagnostic {
+
+class AllocationStatsTracker;
+
+/**
+ * @brief Blocks from one call site that are still allocated.
+ */
+struct LiveStats {
+  static const LiveStats null_stats;
+
+  llong_t allocations = 0;
+  llong_t bytes = 0;
+};
+
+/**
+ * @brief Copy of the live blocks and bytes of each call site, taken at one
+ * time; later allocations don't change it.
+ *
+ * Taking one copies two counts per site from the stats trackers, so it costs
+ * O(sites), however many blocks are live. Compare two with diff() to find
+ * the sites that are growing.
+ *
+ * NOTE: Stored with PassThroughAllocator, like the trackers, so that taking
+ * one never calls operator new.
+ */
+class HeapSnapshot {
+public:
+  HeapSnapshot();
+  ~HeapSnapshot();
+
+  // Moves only; copies would copy every site.
+  HeapSnapshot(HeapSnapshot&& other);
+  HeapSnapshot& operator=(HeapSnapshot&& other);
+  HeapSnapshot(const HeapSnapshot&) = delete;
+  HeapSnapshot& operator=(const HeapSnapshot&) = delete;
+
+  void add(const AllocationStatsTracker& tracker);
+  void add(site_id_t site, llong_t allocations, llong_t bytes);
+
+  const LiveStats& live(site_id_t site) const {
+    return site < m_capacity ? m_sites[site] : LiveStats::null_stats;
+  }
+
+  // Accessors
+  uint64_t timestamp() const { return m_timestamp; }
+  size_t num_sites() const { return m_capacity; } // Highest site ID + 1.
+  llong_t live_allocations() const { return m_total.allocations; }
+  llong_t live_bytes() const { return m_total.bytes; }
+
+private:
+  bool grow(site_id_t site);
+  void release();
+
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+
+  uint64_t m_timestamp; // timestamp_ns() when taken.
+  LiveStats* m_sites;   // Indexed by site ID.
+  size_t m_capacity;
+  LiveStats m_total;
+};
+
+/**
+ * @brief Change in the live blocks and bytes of one call site.
+ */
+struct SiteGrowth {
+  site_id_t site;
+  llong_t allocations;
+  llong_t bytes;
+};
+
+/**
+ * @brief The call sites that grew between two snapshots, largest growth in
+ * bytes first.
+ */
+class HeapDiff {
+public:
+  HeapDiff();
+  ~HeapDiff();
+
+  // Moves only; the array belongs to this diff.
+  HeapDiff(HeapDiff&& other);
+  HeapDiff& operator=(HeapDiff&& other);
+  HeapDiff(const HeapDiff&) = delete;
+  HeapDiff& operator=(const HeapDiff&) = delete;
+
+  const SiteGrowth* begin() const { return m_sites; }
+  const SiteGrowth* end() const { return m_sites + m_size; }
+  const SiteGrowth& operator[](size_t index) const { return m_sites[index]; }
+
+  // Accessors
+  size_t size() const { return m_size; }
+  bool empty() const { return !m_size; }
+  uint64_t elapsed_ns() const { return m_elapsed_ns; }
+
+private:
+  friend HeapDiff diff(const HeapSnapshot& before, const HeapSnapshot& after);
+
+  void release();
+
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+
+  SiteGrowth* m_sites;
+  size_t m_size;
+  uint64_t m_elapsed_ns; // Between the snapshots.
+};
+
+HeapDiff diff(const HeapSnapshot& before, const HeapSnapshot& after);
+
+} // namespace diagnostic
+} // namespace allok8or
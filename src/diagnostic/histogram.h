@@ -0,0 +1,85 @@
+/**
+ * @file histogram.h
+ * @brief Fixed-size histograms with power-of-2 buckets.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../types.h"
+
+// Library headers
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace allok8or {
+namespace diagnostic {
+
+/**
+ * @brief Returns the number of bits needed to represent value; 0 for 0.
+ */
+inline size_t bit_width(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return value ? 64 - static_cast<size_t>(__builtin_clzll(value)) : 0;
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  return _BitScanReverse64(&index, value) ? index + 1 : 0;
+#else
+  size_t width = 0;
+  for (; value; value >>= 1) {
+    ++width;
+  }
+  return width;
+#endif
+}
+
+/**
+ * @brief Counts values in power-of-2 buckets: bucket 0 holds 0, and bucket b
+ * holds [2^(b-1), 2^b). The last bucket also holds everything larger.
+ *
+ * Recording is a bit scan, a min and an increment; no loops.
+ *
+ * @tparam N Number of buckets.
+ */
+template <size_t N>
+struct Log2Histogram {
+  static const size_t NUM_BUCKETS = N;
+
+  static size_t bucket(uint64_t value) {
+    const auto width = bit_width(value);
+    return width < N - 1 ? width : N - 1;
+  }
+
+  // Smallest value counted in a bucket.
+  static uint64_t lower_bound(size_t bucket) {
+    return bucket ? uint64_t(1) << (bucket - 1) : 0;
+  }
+
+  void record(uint64_t value) { ++counts[bucket(value)]; }
+
+  void merge(const Log2Histogram& other) {
+    for (size_t i = 0; i < N; ++i) {
+      counts[i] += other.counts[i];
+    }
+  }
+
+  llong_t total() const {
+    llong_t sum = 0;
+    for (auto count : counts) {
+      sum += count;
+    }
+    return sum;
+  }
+
+  llong_t counts[N] = {};
+};
+
+template <size_t N>
+const size_t Log2Histogram<N>::NUM_BUCKETS;
+
+} // namespace diagnostic
+} // namespace allok8or
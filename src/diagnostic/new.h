@@ -12,6 +12,14 @@
  * Credit for this technique of "stamping" allocated memory with the caller's
  * details goes to: http://www.almostinfinite.com/memtrack.html, Copyright (c)
  * 2002, 2008 Curtis Bartley.
+ *
+ * Each use gets its own function-local static CallSiteCache (from the lambda),
+ * so the call site is interned only on its first allocation.
  * 
  */
-#define new allok8or::diagnostic::CallerDetails(__FILE__, __LINE__) * new
\ No newline at end of file
+#define new                                                                    \
+  allok8or::diagnostic::CallerDetails(                                         \
+      __FILE__, __LINE__, []() -> allok8or::diagnostic::CallSiteCache* {       \
+        static allok8or::diagnostic::CallSiteCache site_cache;                 \
+        return &site_cache;                                                    \
+      }()) * new
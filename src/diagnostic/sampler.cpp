@@ -0,0 +1,354 @@
+/**
+ * @file sampler.cpp
+ * @brief Statistical sampling of allocations, by bytes allocated.
+ *
+ */
+
+// My header
+#include "sampler.h"
+
+// Project headers
+#include "allocation_stats.h"
+
+// Library headers
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <new>
+
+namespace allok8or {
+namespace diagnostic {
+
+//
+// AllocationSampler Implementation
+//
+
+// Static init.
+const size_t AllocationSampler::DEFAULT_SAMPLE_INTERVAL;
+std::atomic<size_t>
+    AllocationSampler::s_sample_interval(DEFAULT_SAMPLE_INTERVAL);
+
+/**
+ * @brief Called when the count runs out: draws the next gap, and reports
+ * whether this allocation is sampled.
+ *
+ * NOTE: On a thread's first allocation there is no gap yet; that allocation
+ * starts the first one.
+ */
+bool AllocationSampler::take_sample(size_t size) {
+  if (!m_rng_state) {
+    m_rng_state = mix_hash(reinterpret_cast<uintptr_t>(this)) | 1;
+    m_bytes_until_sample = next_gap() - static_cast<ptrdiff_t>(size);
+    if (m_bytes_until_sample >= 0) {
+      return false;
+    }
+  }
+
+  m_bytes_until_sample = next_gap();
+  return true;
+}
+
+/**
+ * @brief Returns the number of bytes until the next sample, drawn from an
+ * exponential distribution with mean sample_interval().
+ */
+ptrdiff_t AllocationSampler::next_gap() {
+  // xorshift64*
+  m_rng_state ^= m_rng_state >> 12;
+  m_rng_state ^= m_rng_state << 25;
+  m_rng_state ^= m_rng_state >> 27;
+  const auto bits = m_rng_state * 0x2545f4914f6cdd1dULL;
+
+  // Uniform in (0, 1], so the log is finite.
+  const auto uniform = std::ldexp(static_cast<double>(bits >> 11) + 1.0, -53);
+  const auto gap =
+      -std::log(uniform) * static_cast<double>(sample_interval());
+
+  // Leaves room to subtract a size without overflowing.
+  const auto max_gap =
+      static_cast<double>(std::numeric_limits<ptrdiff_t>::max() / 2);
+  return static_cast<ptrdiff_t>(gap < max_gap ? gap : max_gap);
+}
+
+//
+// Extrapolation
+//
+
+namespace {
+
+/**
+ * @brief Returns the inverse of the chance that an allocation of the mean
+ * size was sampled.
+ */
+double sample_weight(llong_t count, llong_t bytes, size_t sample_interval) {
+  if (count <= 0 || !sample_interval) {
+    return 1.0;
+  }
+
+  const auto mean_size = static_cast<double>(bytes) / count;
+  const auto probability =
+      -std::expm1(-mean_size / static_cast<double>(sample_interval));
+  return probability > 0.0 ? 1.0 / probability : 1.0;
+}
+
+llong_t scale(llong_t value, double weight) {
+  return static_cast<llong_t>(std::llround(value * weight));
+}
+
+template <size_t N>
+void scale(Log2Histogram<N>& estimate,
+           const Log2Histogram<N>& sampled,
+           double weight) {
+  for (size_t i = 0; i < N; ++i) {
+    estimate.counts[i] = scale(sampled.counts[i], weight);
+  }
+}
+
+} // namespace
+
+StatsPtr extrapolate_stats(const AllocationStatsTracker& sampled,
+                           size_t sample_interval) {
+  StatsPtr estimates(new AllocationStatsTracker());
+
+  const auto& stats = sampled.stats();
+  for (auto it = stats.begin(); it != stats.end(); ++it) {
+    const auto& site_stats = (*it).second;
+    const auto alloc_weight = sample_weight(
+        site_stats.allocations, site_stats.bytes_allocated, sample_interval);
+    const auto dealloc_weight = sample_weight(site_stats.deallocations,
+                                              site_stats.bytes_deallocated,
+                                              sample_interval);
+
+    AllocationStats estimate;
+    estimate.allocations = scale(site_stats.allocations, alloc_weight);
+    estimate.bytes_allocated = scale(site_stats.bytes_allocated, alloc_weight);
+    estimate.deallocations = scale(site_stats.deallocations, dealloc_weight);
+    estimate.bytes_deallocated =
+        scale(site_stats.bytes_deallocated, dealloc_weight);
+    scale(estimate.sizes, site_stats.sizes, alloc_weight);
+    scale(estimate.lifetimes, site_stats.lifetimes, dealloc_weight);
+    estimates->merge(it.site(), estimate);
+  }
+
+  return estimates;
+}
+
+//
+// SampledBlockTable Implementation
+//
+
+// Static init.
+const size_t SampledBlockTable::INITIAL_CAPACITY;
+const uintptr_t SampledBlockTable::EMPTY_SLOT;
+const uintptr_t SampledBlockTable::ERASED_SLOT;
+PassThroughAllocator SampledBlockTable::m_backing_allocator;
+
+/**
+ * SampledBlockTable ctor
+ *
+ * NOTE: Allocates nothing until the first insert.
+ */
+SampledBlockTable::SampledBlockTable()
+    : m_table(nullptr), m_sequence(0), m_size(0), m_erased(0) {}
+
+/**
+ * SampledBlockTable dtor
+ */
+SampledBlockTable::~SampledBlockTable() {
+  auto table = m_table.load(std::memory_order_relaxed);
+  while (table) {
+    auto previous = table->previous;
+    m_backing_allocator.deallocate(table->slots);
+    m_backing_allocator.deallocate(table);
+    table = previous;
+  }
+}
+
+/**
+ * @brief Records a sampled block.
+ *
+ * @return true If recorded.
+ * @return false If the set already holds it, or is full and can't grow.
+ */
+bool SampledBlockTable::insert(const void* user_data) {
+  const auto address = reinterpret_cast<uintptr_t>(user_data);
+  assert(address != EMPTY_SLOT && address != ERASED_SLOT);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto table = m_table.load(std::memory_order_relaxed);
+  if (table && find(*table, address)) {
+    return false;
+  }
+
+  if (!table || (m_size + m_erased + 1) * 4 > table->capacity * 3) {
+    if (!make_room()) {
+      return false;
+    }
+    table = m_table.load(std::memory_order_relaxed);
+  }
+
+  // Reuses the first erased slot on the probe path, if any.
+  auto slot = first_slot(*table, address);
+  for (;;) {
+    auto& entry = table->slots[slot];
+    const auto value = entry.load(std::memory_order_relaxed);
+    if (value == EMPTY_SLOT || value == ERASED_SLOT) {
+      if (value == ERASED_SLOT) {
+        --m_erased;
+      }
+      entry.store(address, std::memory_order_release);
+      ++m_size;
+      return true;
+    }
+    slot = (slot + 1) & (table->capacity - 1);
+  }
+}
+
+/**
+ * @brief Returns the number of sampled blocks.
+ */
+size_t SampledBlockTable::size() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_size;
+}
+
+/**
+ * @brief Stores a block address in the first empty slot of its probe path.
+ *
+ * NOTE: Only for tables no reader can see yet, or while the sequence is odd.
+ */
+void SampledBlockTable::place(Table& table, uintptr_t address) {
+  auto slot = first_slot(table, address);
+  while (table.slots[slot].load(std::memory_order_relaxed) != EMPTY_SLOT) {
+    slot = (slot + 1) & (table.capacity - 1);
+  }
+  table.slots[slot].store(address, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Allocates a table of empty slots.
+ *
+ * @return Table* The table, or nullptr if out of memory.
+ */
+SampledBlockTable::Table* SampledBlockTable::create_table(size_t capacity) {
+  auto table = static_cast<Table*>(
+      m_backing_allocator.allocate(sizeof(Table), alignof(Table)));
+  auto slots = static_cast<std::atomic<uintptr_t>*>(
+      m_backing_allocator.allocate(capacity * sizeof(std::atomic<uintptr_t>),
+                                   alignof(std::atomic<uintptr_t>)));
+  if (!table || !slots) {
+    if (table) {
+      m_backing_allocator.deallocate(table);
+    }
+    if (slots) {
+      m_backing_allocator.deallocate(slots);
+    }
+    return nullptr;
+  }
+
+  for (size_t i = 0; i < capacity; ++i) {
+    new (&slots[i]) std::atomic<uintptr_t>(EMPTY_SLOT);
+  }
+  return new (table) Table{slots, capacity, nullptr};
+}
+
+/**
+ * @brief Makes room for one more block: creates the first table, doubles the
+ * table if it's half full of blocks, or else clears the erased slots.
+ *
+ * NOTE: Requires the lock.
+ *
+ * @return false If out of memory; the table is unchanged.
+ */
+bool SampledBlockTable::make_room() {
+  auto table = m_table.load(std::memory_order_relaxed);
+  if (!table) {
+    table = create_table(INITIAL_CAPACITY);
+    if (!table) {
+      return false;
+    }
+    m_table.store(table, std::memory_order_release);
+    return true;
+  }
+
+  if ((m_size + 1) * 2 > table->capacity) {
+    return grow();
+  }
+  return clear_erased();
+}
+
+/**
+ * @brief Moves the blocks to a table twice the size, and publishes it.
+ *
+ * NOTE: Requires the lock.
+ */
+bool SampledBlockTable::grow() {
+  auto old_table = m_table.load(std::memory_order_relaxed);
+  auto table = create_table(old_table->capacity * 2);
+  if (!table) {
+    return false;
+  }
+
+  for (size_t i = 0; i < old_table->capacity; ++i) {
+    const auto address = old_table->slots[i].load(std::memory_order_relaxed);
+    if (address != EMPTY_SLOT && address != ERASED_SLOT) {
+      place(*table, address);
+    }
+  }
+
+  table->previous = old_table;
+  m_table.store(table, std::memory_order_release);
+  m_erased = 0;
+  return true;
+}
+
+/**
+ * @brief Rebuilds the table in place without its erased slots. Readers that
+ * overlap it see the sequence change, and probe again.
+ *
+ * NOTE: Requires the lock.
+ */
+bool SampledBlockTable::clear_erased() {
+  auto table = m_table.load(std::memory_order_relaxed);
+
+  uintptr_t* blocks = nullptr;
+  if (m_size) {
+    blocks = static_cast<uintptr_t*>(m_backing_allocator.allocate(
+        m_size * sizeof(uintptr_t), alignof(uintptr_t)));
+    if (!blocks) {
+      return false;
+    }
+  }
+
+  size_t num_blocks = 0;
+  for (size_t i = 0; i < table->capacity; ++i) {
+    const auto address = table->slots[i].load(std::memory_order_relaxed);
+    if (address != EMPTY_SLOT && address != ERASED_SLOT) {
+      blocks[num_blocks++] = address;
+    }
+  }
+  assert(num_blocks == m_size);
+
+  const auto sequence = m_sequence.load(std::memory_order_relaxed);
+  m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  for (size_t i = 0; i < table->capacity; ++i) {
+    table->slots[i].store(EMPTY_SLOT, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < num_blocks; ++i) {
+    place(*table, blocks[i]);
+  }
+
+  m_sequence.store(sequence + 2, std::memory_order_release);
+  m_erased = 0;
+
+  if (blocks) {
+    m_backing_allocator.deallocate(blocks);
+  }
+  return true;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
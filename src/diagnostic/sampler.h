@@ -0,0 +1,244 @@
+/**
+ * @file sampler.h
+ * @brief Statistical sampling of allocations, by bytes allocated.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../pass_through.h"
+#include "flat_map.h"
+#include "tracking_pool.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace allok8or {
+namespace diagnostic {
+
+class AllocationStatsTracker;
+
+/**
+ * @brief Picks which allocations to sample: on average one every
+ * sample_interval() bytes, at gaps drawn from an exponential distribution (the
+ * continuous form of the geometric distribution).
+ *
+ * An allocation of size bytes is sampled with probability
+ * 1 - exp(-size / sample_interval()), whatever came before it, so sampled
+ * counts can be scaled back up to estimates of the real totals; see
+ * extrapolate_stats().
+ *
+ * Each thread has its own sampler (see local()), so sampling needs no
+ * synchronization. The interval is process-wide.
+ */
+class AllocationSampler {
+public:
+  static const size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;
+
+  // No copies; one per thread.
+  AllocationSampler(const AllocationSampler&) = delete;
+  AllocationSampler& operator=(const AllocationSampler&) = delete;
+
+  static AllocationSampler& local();
+
+  static size_t sample_interval() {
+    return s_sample_interval.load(std::memory_order_relaxed);
+  }
+  static void sample_interval(size_t val) {
+    s_sample_interval.store(val, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Starts a new gap on the next allocation, e.g. after the interval
+   * changes.
+   */
+  void reset() {
+    m_bytes_until_sample = 0;
+    m_rng_state = 0;
+  }
+
+  /**
+   * @brief Counts size bytes towards the next sample.
+   *
+   * @return true If this allocation is to be sampled.
+   */
+  bool sample(size_t size) {
+    m_bytes_until_sample -= static_cast<ptrdiff_t>(size);
+    return m_bytes_until_sample < 0 && take_sample(size);
+  }
+
+private:
+  constexpr AllocationSampler() : m_bytes_until_sample(0), m_rng_state(0) {}
+
+  bool take_sample(size_t size);
+  ptrdiff_t next_gap();
+
+  static std::atomic<size_t> s_sample_interval;
+
+  ptrdiff_t m_bytes_until_sample;
+  uint64_t m_rng_state; // 0 until the first gap is drawn.
+};
+
+/**
+ * @brief Returns the calling thread's sampler.
+ *
+ * NOTE: Constant-initialized, so the thread_local costs no guard check.
+ */
+inline AllocationSampler& AllocationSampler::local() {
+  static thread_local AllocationSampler sampler;
+  return sampler;
+}
+
+/**
+ * @brief Scales sampled stats up to estimates of the real totals.
+ *
+ * Each site's allocations are weighted by 1 / (1 - exp(-mean size /
+ * sample_interval)), the inverse of the chance that an allocation of the
+ * site's mean size was sampled; likewise its deallocations. Histograms are
+ * scaled along with the counts. Exact for sites whose allocations are all one
+ * size, as with sites that allocate one type.
+ *
+ * @param sampled Stats of the sampled allocations only.
+ * @param sample_interval The interval the samples were taken at.
+ * @return StatsPtr A new tracker holding the estimates.
+ */
+StatsPtr extrapolate_stats(
+    const AllocationStatsTracker& sampled,
+    size_t sample_interval = AllocationSampler::sample_interval());
+
+/**
+ * @brief Side table recording which blocks were sampled, so that sampled
+ * blocks alone need a header.
+ *
+ * An open-addressing set of block addresses, probed with atomic loads and no
+ * lock, so the common case (freeing an unsampled block) never contends,
+ * however many sampled blocks are live. Only inserting and erasing sampled
+ * blocks take the lock.
+ *
+ * The table doubles when half full. Old tables are kept until the set is
+ * destroyed, for readers that may still be probing them; each is half the size
+ * of the next, so together they're smaller than the current one. Erased slots
+ * are cleared in place, under a sequence count that readers retry on.
+ *
+ * NOTE: Thread-safe.
+ */
+class SampledBlockTable {
+public:
+  static const size_t INITIAL_CAPACITY = 1024; // Must be a power of 2.
+
+  SampledBlockTable();
+  ~SampledBlockTable();
+
+  // No copies; the table belongs to its allocator.
+  SampledBlockTable(const SampledBlockTable&) = delete;
+  SampledBlockTable& operator=(const SampledBlockTable&) = delete;
+
+  bool insert(const void* user_data);
+  bool erase(const void* user_data);
+  bool contains(const void* user_data) const;
+
+  size_t size() const;
+
+private:
+  static const uintptr_t EMPTY_SLOT = 0;
+  static const uintptr_t ERASED_SLOT = 1; // Never a block address.
+
+  struct Table {
+    std::atomic<uintptr_t>* slots;
+    size_t capacity; // A power of 2.
+    Table* previous; // Retired, but kept for readers.
+  };
+
+  static size_t first_slot(const Table& table, uintptr_t address) {
+    return static_cast<size_t>(mix_hash(address)) & (table.capacity - 1);
+  }
+
+  static std::atomic<uintptr_t>* find(const Table& table, uintptr_t address);
+  static void place(Table& table, uintptr_t address);
+
+  Table* create_table(size_t capacity);
+  bool make_room();
+  bool grow();
+  bool clear_erased();
+
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+
+  std::atomic<Table*> m_table;
+  std::atomic<size_t> m_sequence; // Odd while erased slots are being cleared.
+  mutable std::mutex m_mutex; // Guards changes to the table.
+  size_t m_size;
+  size_t m_erased; // Slots marked erased; they still lengthen probes.
+};
+
+/**
+ * @brief Returns the slot holding a block address, or nullptr if none does.
+ */
+inline std::atomic<uintptr_t>*
+SampledBlockTable::find(const Table& table, uintptr_t address) {
+  auto slot = first_slot(table, address);
+  for (size_t i = 0; i < table.capacity; ++i) {
+    auto& entry = table.slots[slot];
+    const auto value = entry.load(std::memory_order_acquire);
+    if (value == address) {
+      return &entry;
+    }
+    if (value == EMPTY_SLOT) {
+      return nullptr;
+    }
+    slot = (slot + 1) & (table.capacity - 1);
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Returns true if the block was sampled; lock-free.
+ */
+inline bool SampledBlockTable::contains(const void* user_data) const {
+  const auto address = reinterpret_cast<uintptr_t>(user_data);
+  if (address == EMPTY_SLOT || address == ERASED_SLOT) {
+    return false;
+  }
+
+  for (;;) {
+    const auto sequence = m_sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      continue;
+    }
+
+    auto table = m_table.load(std::memory_order_acquire);
+    const bool found = table && find(*table, address);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+      return found;
+    }
+  }
+}
+
+/**
+ * @brief Removes a block, if it was sampled. Takes the lock only if it was.
+ *
+ * @return true If the block was sampled.
+ */
+inline bool SampledBlockTable::erase(const void* user_data) {
+  if (!contains(user_data)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto entry = find(*m_table.load(std::memory_order_relaxed),
+                    reinterpret_cast<uintptr_t>(user_data));
+  if (!entry) {
+    return false;
+  }
+  entry->store(ERASED_SLOT, std::memory_order_release);
+  --m_size;
+  ++m_erased;
+  return true;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
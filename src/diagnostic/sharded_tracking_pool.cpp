@@ -0,0 +1,163 @@
+/**
+ * @file sharded_tracking_pool.cpp
+ * @brief Thread-safe tracking of allocations, sharded by thread.
+ *
+ */
+
+// My header
+#include "sharded_tracking_pool.h"
+
+// Project headers
+#include "allocation_stats.h"
+#include "block_header.h"
+#include "util.h"
+
+// Library headers
+#include <atomic>
+#include <cassert>
+
+namespace allok8or {
+namespace diagnostic {
+
+/**
+ * ShardedTrackingPool ctor
+ */
+ShardedTrackingPool::ShardedTrackingPool() {}
+
+/**
+ * ShardedTrackingPool dtor
+ *
+ * The shards log any leaks.
+ */
+ShardedTrackingPool::~ShardedTrackingPool() {}
+
+/**
+ * @brief Adds a memory block (with header) to the calling thread's shard.
+ *
+ * @param block Pointer to the block to add.
+ * @return true when block added.
+ * @return false when failed to add block.
+ */
+bool ShardedTrackingPool::add(BlockHeader* block) {
+  assert(block);
+  if (!block)
+    return false;
+
+  const auto index = local_shard();
+  auto& shard = m_shards[index];
+  block->shard(index);
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.pool.add(block);
+}
+
+/**
+ * @brief Removes a memory block (with header) from the shard that added it,
+ * whichever thread frees it.
+ *
+ * @param block Pointer to the block to remove.
+ * @return true when block removed; the caller may release it.
+ * @return false when failed to remove block.
+ */
+bool ShardedTrackingPool::remove(BlockHeader* block) {
+  assert(block);
+  if (!block || block->shard() >= NUM_TRACKING_SHARDS)
+    return false;
+
+  // Before locking, so time spent waiting isn't counted as lifetime.
+  const auto freed_at = timestamp_ns();
+
+  auto& shard = m_shards[block->shard()];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.pool.remove(block, freed_at);
+}
+
+/**
+ * @brief Sets the call site of a block, in the shard that added it.
+ *
+ * @param block Pointer to the block.
+ * @param site ID of the call site.
+ * @return true when the site was set.
+ * @return false when the block isn't tracked, or already has caller details.
+ */
+bool ShardedTrackingPool::set_site(BlockHeader* block, site_id_t site) {
+  assert(block);
+  if (!block || block->shard() >= NUM_TRACKING_SHARDS)
+    return false;
+
+  auto& shard = m_shards[block->shard()];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.pool.set_site(block, site);
+}
+
+/**
+ * @brief Returns the number of blocks tracked by all shards.
+ */
+llong_t ShardedTrackingPool::num_blocks() const {
+  llong_t total = 0;
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.pool.num_blocks();
+  }
+  return total;
+}
+
+/**
+ * @brief Returns the number of bytes tracked by all shards.
+ */
+llong_t ShardedTrackingPool::num_bytes() const {
+  llong_t total = 0;
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.pool.num_bytes();
+  }
+  return total;
+}
+
+/**
+ * @brief Merges the stats of all shards.
+ *
+ * NOTE: Shards are locked one at a time, so this is a consistent view of each
+ * shard, but not of all shards at one instant.
+ *
+ * @return StatsPtr A new tracker holding the merged stats.
+ */
+StatsPtr ShardedTrackingPool::snapshot() const {
+  StatsPtr stats(new AllocationStatsTracker());
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats->merge(shard.pool.tracker());
+  }
+  return stats;
+}
+
+/**
+ * @brief Copies the live blocks and bytes of each call site, from all shards.
+ *
+ * Each shard is locked only while its sites are copied, which costs O(sites),
+ * so allocation stalls briefly, one shard at a time. Cheaper than snapshot(),
+ * which merges every stat.
+ *
+ * NOTE: Like snapshot(), consistent for each shard, but not across shards.
+ */
+HeapSnapshot ShardedTrackingPool::heap_snapshot() const {
+  HeapSnapshot snapshot;
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    snapshot.add(shard.pool.tracker());
+  }
+  return snapshot;
+}
+
+/**
+ * @brief Returns the calling thread's shard.
+ */
+size_t ShardedTrackingPool::local_shard() {
+  static std::atomic<size_t> next_index(0);
+  static thread_local size_t index =
+      next_index.fetch_add(1, std::memory_order_relaxed) % NUM_TRACKING_SHARDS;
+  return index;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
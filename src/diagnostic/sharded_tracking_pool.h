@@ -0,0 +1,66 @@
+/**
+ * @file sharded_tracking_pool.h
+ * @brief Thread-safe tracking of allocations, sharded by thread.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../types.h"
+#include "tracking_pool.h"
+
+// Library headers
+#include <cstddef>
+#include <mutex>
+
+namespace allok8or {
+namespace diagnostic {
+
+class BlockHeader;
+
+// Number of shards; threads beyond this share shards.
+const size_t NUM_TRACKING_SHARDS = 64;
+
+/**
+ * @brief Thread-safe counterpart of AllocationTrackingPool.
+ *
+ * Each thread tracks its blocks in its own shard (an AllocationTrackingPool
+ * with its own stats), so threads don't contend on one lock. A block freed by
+ * a thread other than its owner is removed from the owning shard under that
+ * shard's lock, so it's released at once, even if the owner has exited.
+ * Reporting merges all shards.
+ */
+class ShardedTrackingPool {
+public:
+  ShardedTrackingPool();
+  ~ShardedTrackingPool();
+
+  // No copies; share when appropriate.
+  ShardedTrackingPool(const ShardedTrackingPool&) = delete;
+  ShardedTrackingPool& operator=(const ShardedTrackingPool&) = delete;
+
+  bool add(BlockHeader* block);
+  bool remove(BlockHeader* block);
+  bool set_site(BlockHeader* block, site_id_t site);
+
+  llong_t num_blocks() const;
+  llong_t num_bytes() const;
+
+  StatsPtr snapshot() const;
+  HeapSnapshot heap_snapshot() const;
+
+private:
+  struct alignas(64) Shard {
+    // Uncontended unless threads share it, free each other's blocks, or
+    // reporting.
+    std::mutex mutex;
+    AllocationTrackingPool pool;
+  };
+
+  static size_t local_shard();
+
+  mutable Shard m_shards[NUM_TRACKING_SHARDS];
+};
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -0,0 +1,408 @@
+/**
+ * @file stack_table.cpp
+ * @brief Capture of call stacks, and a table that stores each distinct stack
+ * once.
+ *
+ */
+
+// My header
+#include "stack_table.h"
+
+// Project headers
+#include "../portability.h"
+
+// Library headers
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <execinfo.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#endif
+
+#if defined(ALLOK8OR_FRAME_POINTERS) && defined(__linux__) &&                  \
+    (defined(__x86_64__) || defined(__aarch64__))
+#include <pthread.h>
+#define ALLOK8OR_WALK_FRAME_POINTERS 1
+#endif
+
+namespace allok8or {
+namespace diagnostic {
+
+//
+// Stack capture
+//
+
+namespace {
+
+#if defined(ALLOK8OR_WALK_FRAME_POINTERS)
+/**
+ * @brief Returns the highest address of the calling thread's stack, or 0 if
+ * it's unknown.
+ */
+uintptr_t stack_end() {
+  static thread_local uintptr_t end = 0;
+  if (!end) {
+    pthread_attr_t attr;
+    if (!pthread_getattr_np(pthread_self(), &attr)) {
+      void* stack_addr;
+      size_t stack_size;
+      if (!pthread_attr_getstack(&attr, &stack_addr, &stack_size)) {
+        end = reinterpret_cast<uintptr_t>(stack_addr) + stack_size;
+      }
+      pthread_attr_destroy(&attr);
+    }
+  }
+  return end;
+}
+
+/**
+ * @brief Follows the chain of saved frame pointers, each stored just below
+ * its frame's return address.
+ *
+ * Stops at the first frame pointer that isn't aligned, isn't above the last
+ * one, or isn't in the thread's stack.
+ */
+ALK8_NOINLINE size_t
+walk_frame_pointers(void** frames, size_t max_depth, size_t skip) {
+  const auto end = stack_end();
+  auto frame = static_cast<uintptr_t*>(__builtin_frame_address(0));
+
+  size_t depth = 0;
+  while (depth < max_depth) {
+    const auto address = reinterpret_cast<uintptr_t>(frame);
+    if (address % sizeof(uintptr_t) ||
+        address + 2 * sizeof(uintptr_t) > end) {
+      break;
+    }
+
+    const auto next = reinterpret_cast<uintptr_t*>(frame[0]);
+    const auto return_address = reinterpret_cast<void*>(frame[1]);
+    if (!return_address) {
+      break;
+    }
+
+    if (skip) {
+      --skip;
+    } else {
+      frames[depth++] = return_address;
+    }
+
+    if (reinterpret_cast<uintptr_t>(next) <= address) {
+      break;
+    }
+    frame = next;
+  }
+  return depth;
+}
+#endif
+
+} // namespace
+
+ALK8_NOINLINE size_t
+capture_stack(void** frames, size_t max_depth, size_t skip) {
+#if defined(ALLOK8OR_WALK_FRAME_POINTERS)
+  // The walk starts in walk_frame_pointers(), called from here.
+  auto depth = walk_frame_pointers(frames, max_depth, skip + 1);
+  if (depth) {
+    return depth;
+  }
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+  // backtrace() starts in this function.
+  void* all_frames[MAX_STACK_DEPTH * 2];
+  const auto wanted = max_depth + skip + 1 < MAX_STACK_DEPTH * 2
+                          ? max_depth + skip + 1
+                          : MAX_STACK_DEPTH * 2;
+  const auto captured =
+      static_cast<size_t>(backtrace(all_frames, static_cast<int>(wanted)));
+  if (captured <= skip + 1) {
+    return 0;
+  }
+
+  const auto count = captured - skip - 1 < max_depth ? captured - skip - 1
+                                                     : max_depth;
+  std::memcpy(frames, all_frames + skip + 1, count * sizeof(void*));
+  return count;
+#else
+  (void)frames;
+  (void)max_depth;
+  (void)skip;
+  return 0;
+#endif
+}
+
+//
+// StackTable Implementation
+//
+
+const size_t StackTable::STACKS_PER_CHUNK;
+const size_t StackTable::MAX_CHUNKS;
+const size_t StackTable::MAX_STACKS;
+const size_t StackTable::FRAMES_PER_CHUNK;
+
+// Static init.
+PassThroughAllocator StackTable::m_backing_allocator;
+
+bool StackTable::StackKey::equal_to::operator()(const StackKey& lhs,
+                                                const StackKey& rhs) const {
+  return lhs.hash == rhs.hash && lhs.depth == rhs.depth &&
+         (!lhs.depth ||
+          !std::memcmp(lhs.frames, rhs.frames, lhs.depth * sizeof(void*)));
+}
+
+/**
+ * StackTable ctor
+ *
+ * Interns the empty stack, so that it gets ID 0.
+ */
+StackTable::StackTable()
+    : m_ids(m_backing_allocator),
+      m_num_stacks(0),
+      m_free_frames(nullptr),
+      m_num_free_frames(0) {
+  for (auto& chunk : m_chunks) {
+    chunk.store(nullptr, std::memory_order_relaxed);
+  }
+
+  const auto id = intern(nullptr, 0);
+  assert(id == NO_STACK);
+  (void)id;
+}
+
+/**
+ * @brief Returns the table.
+ *
+ * NOTE: Never destroyed, and never allocates through operator new, so that it
+ * can be used from allocators that replace it, and during static destruction.
+ */
+StackTable& StackTable::instance() {
+  static typename std::aligned_storage<sizeof(StackTable),
+                                       alignof(StackTable)>::type storage;
+  static auto table = new (&storage) StackTable();
+  return *table;
+}
+
+/**
+ * @brief Returns the ID of a stack, storing it if it's new.
+ *
+ * @param frames Return addresses, innermost first; copied if stored.
+ * @param depth Number of frames; at most MAX_STACK_DEPTH are kept.
+ * @return stack_id_t The stack's ID, or NO_STACK if the table is full.
+ */
+stack_id_t StackTable::intern(void* const* frames, size_t depth) {
+  if (depth > MAX_STACK_DEPTH) {
+    depth = MAX_STACK_DEPTH;
+  }
+  const StackKey key{hash(frames, depth), frames, depth};
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto existing = m_ids.find(key);
+  if (existing) {
+    return *existing;
+  }
+
+  const auto index = m_num_stacks.load(std::memory_order_relaxed);
+  if (index == MAX_STACKS) {
+    return NO_STACK;
+  }
+
+  auto& chunk_ref = m_chunks[index / STACKS_PER_CHUNK];
+  auto chunk = chunk_ref.load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = static_cast<Stack*>(m_backing_allocator.allocate(
+        STACKS_PER_CHUNK * sizeof(Stack), alignof(Stack)));
+    if (!chunk) {
+      return NO_STACK;
+    }
+    chunk_ref.store(chunk, std::memory_order_release);
+  }
+
+  auto stored = store_frames(frames, depth);
+  if (depth && !stored) {
+    return NO_STACK;
+  }
+
+  const auto id = static_cast<stack_id_t>(index);
+  chunk[index % STACKS_PER_CHUNK] = Stack{stored, depth};
+  m_ids[StackKey{key.hash, stored, depth}] = id;
+  m_num_stacks.store(index + 1, std::memory_order_release);
+  return id;
+}
+
+/**
+ * @brief Captures the calling thread's stack, and returns its ID.
+ *
+ * @param skip Number of innermost frames to leave out, besides this one.
+ */
+stack_id_t StackTable::capture(size_t skip) {
+  void* frames[MAX_STACK_DEPTH];
+  const auto depth = capture_stack(frames, MAX_STACK_DEPTH, skip + 1);
+  return intern(frames, depth);
+}
+
+/**
+ * @brief Returns the stack with the given ID; the empty stack for IDs that
+ * haven't been assigned.
+ */
+StackTable::Stack StackTable::stack(stack_id_t id) const {
+  if (id >= num_stacks()) {
+    id = NO_STACK;
+  }
+  auto chunk = m_chunks[id / STACKS_PER_CHUNK].load(std::memory_order_acquire);
+  return chunk[id % STACKS_PER_CHUNK];
+}
+
+/**
+ * @brief Writes one line per frame of a stack: its number, and the symbol
+ * (demangled where possible) or address.
+ *
+ * NOTE: Looks up symbols, so it's slow and allocates; for reporting only.
+ */
+void StackTable::symbolize(stack_id_t id, std::ostream& output) const {
+  const auto entry = stack(id);
+
+#if defined(__linux__) || defined(__APPLE__)
+  auto symbols =
+      backtrace_symbols(entry.frames, static_cast<int>(entry.depth));
+#endif
+
+  for (size_t i = 0; i < entry.depth; ++i) {
+    output << "  #" << i << " ";
+
+#if defined(__linux__) || defined(__APPLE__)
+    if (!symbols) {
+      output << entry.frames[i] << "\n";
+      continue;
+    }
+
+    // glibc: "module(mangled+offset) [address]"
+    const char* symbol = symbols[i];
+    const char* begin = std::strchr(symbol, '(');
+    const char* end = begin ? std::strchr(begin, '+') : nullptr;
+    char* demangled = nullptr;
+#if defined(__GNUC__) || defined(__clang__)
+    if (begin && end && end > begin + 1) {
+      std::string mangled(begin + 1, end);
+      int status = 0;
+      demangled =
+          abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    }
+#endif
+    if (demangled) {
+      output << demangled << " " << entry.frames[i];
+      std::free(demangled);
+    } else {
+      output << symbol;
+    }
+#else
+    output << entry.frames[i];
+#endif
+
+    output << "\n";
+  }
+
+#if defined(__linux__) || defined(__APPLE__)
+  std::free(symbols);
+#endif
+}
+
+/**
+ * @brief Mixes the frames of a stack into one hash.
+ */
+uint64_t StackTable::hash(void* const* frames, size_t depth) {
+  uint64_t h = depth;
+  for (size_t i = 0; i < depth; ++i) {
+    h = mix_hash(h ^ reinterpret_cast<uintptr_t>(frames[i]));
+  }
+  return h;
+}
+
+/**
+ * @brief Copies frames into the table's storage.
+ *
+ * NOTE: Requires the mutex.
+ *
+ * @return void* const* The stored copy, or nullptr if out of memory (or the
+ * stack is empty).
+ */
+void* const* StackTable::store_frames(void* const* frames, size_t depth) {
+  if (!depth) {
+    return nullptr;
+  }
+
+  if (depth > m_num_free_frames) {
+    m_free_frames = static_cast<void**>(m_backing_allocator.allocate(
+        FRAMES_PER_CHUNK * sizeof(void*), alignof(void*)));
+    if (!m_free_frames) {
+      m_num_free_frames = 0;
+      return nullptr;
+    }
+    m_num_free_frames = FRAMES_PER_CHUNK;
+  }
+
+  auto stored = m_free_frames;
+  std::memcpy(stored, frames, depth * sizeof(void*));
+  m_free_frames += depth;
+  m_num_free_frames -= depth;
+  return stored;
+}
+
+//
+// Stack sites
+//
+
+namespace {
+
+const size_t STACK_SITE_CACHE_SIZE = 256; // Must be a power of 2.
+
+// A stack seen by this thread, and its site; empty while stack is NO_STACK.
+struct StackSiteCacheEntry {
+  uint64_t hash;
+  stack_id_t stack;
+  site_id_t site;
+};
+
+// Direct-mapped by stack hash. Plain data, so it needs no TLS constructor or
+// destructor, and allocates nothing.
+thread_local StackSiteCacheEntry t_stack_sites[STACK_SITE_CACHE_SIZE];
+
+} // namespace
+
+ALK8_NOINLINE site_id_t capture_stack_site(size_t skip) {
+  void* frames[MAX_STACK_DEPTH];
+  const auto depth = capture_stack(frames, MAX_STACK_DEPTH, skip + 1);
+  const auto hash = StackTable::hash(frames, depth);
+
+  // Compares the stored frames too, in case two stacks share a hash.
+  auto& table = StackTable::instance();
+  auto& cached = t_stack_sites[hash & (STACK_SITE_CACHE_SIZE - 1)];
+  if (cached.stack != NO_STACK && cached.hash == hash) {
+    const auto stack = table.stack(cached.stack);
+    if (stack.depth == depth &&
+        !std::memcmp(stack.frames, frames, depth * sizeof(void*))) {
+      return cached.site;
+    }
+  }
+
+  const auto stack = table.intern(frames, depth);
+  const auto site = CallSiteRegistry::instance().intern(
+      CallSite{nullptr, nullptr, 0, stack});
+  if (stack != NO_STACK && site != UNKNOWN_SITE) {
+    cached = StackSiteCacheEntry{hash, stack, site};
+  }
+  return site;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
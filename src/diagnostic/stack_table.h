@@ -0,0 +1,139 @@
+/**
+ * @file stack_table.h
+ * @brief Capture of call stacks, and a table that stores each distinct stack
+ * once.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../pass_through.h"
+#include "call_site.h"
+#include "flat_map.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+
+namespace allok8or {
+namespace diagnostic {
+
+// Frames kept per stack; deeper stacks are cut off.
+const size_t MAX_STACK_DEPTH = 32;
+
+/**
+ * @brief Captures the return addresses of the calling thread's stack,
+ * innermost first.
+ *
+ * Walks frame pointers when built with ALLOK8OR_FRAME_POINTERS (which also
+ * keeps them in allok8or's own code); that's a few loads per frame. Otherwise,
+ * or if the walk finds no frames, uses backtrace(), which reads the unwind
+ * tables and is much slower.
+ *
+ * NOTE: With ALLOK8OR_FRAME_POINTERS, code built without frame pointers ends
+ * the walk early, or adds spurious frames. The walk never leaves the thread's
+ * stack, so it can't fault.
+ *
+ * @param frames [OUT] Array to fill with return addresses.
+ * @param max_depth Size of the frames array.
+ * @param skip Number of innermost frames to leave out, besides this one.
+ * @return size_t Number of frames captured.
+ */
+size_t capture_stack(void** frames, size_t max_depth, size_t skip = 0);
+
+/**
+ * @brief Stores each distinct stack once (hash-consing), identified by a small
+ * integer ID, so that headers and stats can refer to a stack by its ID.
+ *
+ * IDs are dense, starting with NO_STACK for the empty stack. Stacks are never
+ * removed. Symbols are looked up only when reporting; see symbolize().
+ *
+ * intern() takes a lock. stack() is lock-free.
+ */
+class StackTable {
+public:
+  static const size_t STACKS_PER_CHUNK = 4096;
+  static const size_t MAX_CHUNKS = 256;
+  static const size_t MAX_STACKS = STACKS_PER_CHUNK * MAX_CHUNKS;
+  static const size_t FRAMES_PER_CHUNK = 16 * 1024;
+
+  // A stored stack; its frames are owned by the table.
+  struct Stack {
+    void* const* frames;
+    size_t depth;
+  };
+
+  // No copies; there is only the one.
+  StackTable(const StackTable&) = delete;
+  StackTable& operator=(const StackTable&) = delete;
+
+  static StackTable& instance();
+
+  stack_id_t intern(void* const* frames, size_t depth);
+  stack_id_t capture(size_t skip = 0);
+
+  Stack stack(stack_id_t id) const;
+  size_t num_stacks() const {
+    return m_num_stacks.load(std::memory_order_acquire);
+  }
+
+  void symbolize(stack_id_t id, std::ostream& output) const;
+
+  static uint64_t hash(void* const* frames, size_t depth);
+
+private:
+  StackTable();
+
+  // Refers to frames in the table, or to the caller's while looking up.
+  struct StackKey {
+    uint64_t hash;
+    void* const* frames;
+    size_t depth;
+
+    struct hash_fn {
+      size_t operator()(const StackKey& k) const {
+        return static_cast<size_t>(k.hash);
+      }
+    };
+
+    struct equal_to {
+      bool operator()(const StackKey& lhs, const StackKey& rhs) const;
+    };
+  };
+
+  using IdMap = FlatMap<StackKey,
+                        stack_id_t,
+                        StackKey::hash_fn,
+                        StackKey::equal_to,
+                        PassThroughAllocator>;
+
+  void* const* store_frames(void* const* frames, size_t depth);
+
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+
+  mutable std::mutex m_mutex; // Guards m_ids, m_free_frames, and adding stacks.
+  IdMap m_ids;
+  std::atomic<Stack*> m_chunks[MAX_CHUNKS];
+  std::atomic<size_t> m_num_stacks;
+
+  void** m_free_frames; // Rest of the current frames chunk.
+  size_t m_num_free_frames;
+};
+
+/**
+ * @brief Captures the calling thread's stack, and returns the ID of the call
+ * site for it: no type, file or line, just the stack.
+ *
+ * Each thread caches the sites of the stacks it has seen, so only a new stack
+ * takes the StackTable and CallSiteRegistry locks.
+ *
+ * @param skip Number of innermost frames to leave out, besides this one.
+ */
+site_id_t capture_stack_site(size_t skip = 0);
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -0,0 +1,535 @@
+/**
+ * @file trace.cpp
+ * @brief Binary trace of allocation events: the file format, and the writer
+ * that buffers events per thread and writes them in the background.
+ *
+ */
+
+// My header
+#include "trace.h"
+
+// Project headers
+#include "../logging.h"
+
+// Library headers
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#ifdef _MSC_VER
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace allok8or {
+namespace diagnostic {
+
+namespace {
+
+// Buffers per writev().
+#if defined(IOV_MAX)
+const size_t MAX_IOVECS = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+const size_t MAX_IOVECS = 1024;
+#endif
+
+// Set once the thread has released its buffers, on exit; it records no more.
+thread_local bool t_exited = false;
+
+size_t round_up_pow2(size_t value) {
+  size_t pow2 = 2;
+  while (pow2 < value) {
+    pow2 *= 2;
+  }
+  return pow2;
+}
+
+/**
+ * @brief Writes the header at the start of the file.
+ */
+bool write_header(int fd, const TraceFileHeader& header) {
+#ifdef _MSC_VER
+  return _lseeki64(fd, 0, SEEK_SET) == 0 &&
+         _write(fd, &header, sizeof(header)) == sizeof(header);
+#else
+  return pwrite(fd, &header, sizeof(header), 0) ==
+         static_cast<ssize_t>(sizeof(header));
+#endif
+}
+
+} // namespace
+
+//
+// TraceWriter Implementation
+//
+
+// Static init.
+const size_t TraceWriter::DEFAULT_EVENTS_PER_THREAD;
+const int TraceWriter::FLUSH_INTERVAL_MS;
+PassThroughAllocator TraceWriter::m_backing_allocator;
+std::atomic<uint64_t> TraceWriter::s_next_writer_id(1);
+
+/**
+ * TraceWriter ctor
+ *
+ * Creates (or truncates) the file, writes a provisional header, and starts
+ * the flushing thread.
+ *
+ * NOTE: Logs an error if the file can't be created; events are then dropped.
+ *
+ * @param path Path of the trace file.
+ * @param events_per_thread Capacity of each thread's buffer; rounded up to a
+ * power of 2.
+ */
+TraceWriter::TraceWriter(const char* path, size_t events_per_thread)
+    : m_id(s_next_writer_id.fetch_add(1, std::memory_order_relaxed)),
+      m_events_per_thread(round_up_pow2(events_per_thread)),
+      m_fd(-1),
+      m_buffers(nullptr),
+      m_next_live(nullptr),
+      m_num_written(0),
+      m_num_dropped(0),
+      m_start_ticks(trace_ticks()),
+      m_start_ns(timestamp_ns()),
+      m_stopping(false) {
+  {
+    auto& writers = live_writers();
+    std::lock_guard<std::mutex> lock(writers.mutex);
+    m_next_live = writers.head;
+    writers.head = this;
+  }
+
+#ifdef _MSC_VER
+  m_fd = _open(path,
+               _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+               _S_IREAD | _S_IWRITE);
+#else
+  m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+  if (m_fd < 0) {
+    LOG_ERROR("Failed to create allocation trace [%s].", path);
+    return;
+  }
+
+  TraceFileHeader header = {};
+  std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.event_size = sizeof(TraceEvent);
+  if (!write_all(&header, sizeof(header))) {
+    LOG_ERROR("Failed to write allocation trace [%s].", path);
+    close();
+    return;
+  }
+
+  m_thread = std::thread([this] { run(); });
+}
+
+/**
+ * TraceWriter dtor
+ *
+ * Stops the flushing thread, writes the remaining events, and completes the
+ * header.
+ */
+TraceWriter::~TraceWriter() {
+  {
+    // First, so that exiting threads leave this writer alone.
+    auto& writers = live_writers();
+    std::lock_guard<std::mutex> lock(writers.mutex);
+    auto link = &writers.head;
+    while (*link != this) {
+      link = &(*link)->m_next_live;
+    }
+    *link = m_next_live;
+  }
+
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_wake_mutex);
+      m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+  }
+
+  if (is_open()) {
+    flush();
+
+    const auto elapsed_ns = static_cast<double>(timestamp_ns() - m_start_ns);
+    const auto elapsed_ticks =
+        static_cast<double>(trace_ticks() - m_start_ticks);
+
+    TraceFileHeader header = {};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(TraceEvent);
+    header.ticks_per_second =
+        elapsed_ns > 0 ? static_cast<uint64_t>(elapsed_ticks * 1e9 / elapsed_ns)
+                       : 0;
+    header.num_events = num_written();
+    if (!write_header(m_fd, header)) {
+      LOG_ERROR("Failed to complete allocation trace header.");
+    }
+    close();
+  }
+
+  auto buffer = m_buffers.load(std::memory_order_acquire);
+  while (buffer) {
+    auto next = buffer->next;
+    m_backing_allocator.deallocate(buffer->events);
+    buffer->~ThreadBuffer();
+    m_backing_allocator.deallocate(buffer);
+    buffer = next;
+  }
+}
+
+/**
+ * @brief Writes every event recorded so far (by any thread) to the file.
+ */
+void TraceWriter::flush() {
+  std::lock_guard<std::mutex> lock(m_flush_mutex);
+  flush_buffers();
+}
+
+/**
+ * @brief Returns the number of buffers, whether threads are using them or
+ * they're free.
+ */
+size_t TraceWriter::num_buffers() const {
+  size_t count = 0;
+  for (auto buffer = m_buffers.load(std::memory_order_acquire); buffer;
+       buffer = buffer->next) {
+    ++count;
+  }
+  return count;
+}
+
+/**
+ * @brief Returns the calling thread's cache of the buffer it used last.
+ *
+ * NOTE: Constant-initialized, so the thread_local costs no guard check.
+ */
+TraceWriter::LocalBuffer& TraceWriter::local() {
+  static thread_local LocalBuffer cached = {0, nullptr};
+  return cached;
+}
+
+/**
+ * @brief Returns the writers not yet destroyed, for threads releasing their
+ * buffers as they exit.
+ *
+ * NOTE: Never destroyed, as threads may exit during static destruction.
+ */
+TraceWriter::WriterList& TraceWriter::live_writers() {
+  static typename std::aligned_storage<sizeof(WriterList),
+                                       alignof(WriterList)>::type storage;
+  static auto writers = new (&storage) WriterList{};
+  return *writers;
+}
+
+/**
+ * @brief Releases the exiting thread's buffers in every live writer, and
+ * stops it recording; it may yet free memory in other thread_local dtors.
+ */
+TraceWriter::ThreadExit::~ThreadExit() {
+  if (!armed) {
+    return;
+  }
+
+  const auto thread = trace_thread();
+  auto& writers = live_writers();
+  std::lock_guard<std::mutex> lock(writers.mutex);
+  for (auto writer = writers.head; writer; writer = writer->m_next_live) {
+    writer->release_buffers(thread);
+  }
+  local() = LocalBuffer{0, nullptr};
+  t_exited = true;
+}
+
+/**
+ * @brief Finds the calling thread's buffer in this writer, taking a free one
+ * or adding one if it has none; then caches it.
+ *
+ * NOTE: Only a thread alternating between writers finds its own buffer.
+ *
+ * @return ThreadBuffer* The buffer, or nullptr if the file isn't open, the
+ * thread is exiting, or the buffer can't be allocated.
+ */
+TraceWriter::ThreadBuffer* TraceWriter::find_or_add_buffer() {
+  if (!is_open() || t_exited) {
+    return nullptr;
+  }
+
+  // Constructed here, not on the recording path, as it has a dtor.
+  static thread_local ThreadExit thread_exit;
+  thread_exit.armed = true;
+
+  const auto thread = trace_thread();
+  auto buffer = m_buffers.load(std::memory_order_acquire);
+  while (buffer &&
+         buffer->owner.load(std::memory_order_relaxed) != thread + 1) {
+    buffer = buffer->next;
+  }
+
+  if (!buffer) {
+    buffer = claim_buffer(thread);
+  }
+
+  if (!buffer) {
+    auto memory = m_backing_allocator.allocate(sizeof(ThreadBuffer),
+                                               alignof(ThreadBuffer));
+    auto events = static_cast<TraceEvent*>(m_backing_allocator.allocate(
+        m_events_per_thread * sizeof(TraceEvent), alignof(TraceEvent)));
+    if (!memory || !events) {
+      m_backing_allocator.deallocate(memory);
+      m_backing_allocator.deallocate(events);
+      return nullptr;
+    }
+    std::memset(events, 0, m_events_per_thread * sizeof(TraceEvent));
+
+    buffer = new (memory) ThreadBuffer();
+    buffer->events = events;
+    buffer->capacity = m_events_per_thread;
+    buffer->thread = thread;
+    buffer->owner.store(thread + 1, std::memory_order_relaxed);
+    buffer->head.store(0, std::memory_order_relaxed);
+    buffer->cached_tail = 0;
+    buffer->tail.store(0, std::memory_order_relaxed);
+
+    auto head = m_buffers.load(std::memory_order_relaxed);
+    do {
+      buffer->next = head;
+    } while (!m_buffers.compare_exchange_weak(
+        head, buffer, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  auto& cached = local();
+  cached.writer_id = m_id;
+  cached.buffer = buffer;
+  return buffer;
+}
+
+/**
+ * @brief Takes a buffer freed by an exited thread, if there is one.
+ *
+ * NOTE: Events the last owner left are flushed already, or soon; they keep its
+ * thread number, and the new owner's follow them.
+ */
+TraceWriter::ThreadBuffer* TraceWriter::claim_buffer(uint32_t thread) {
+  for (auto buffer = m_buffers.load(std::memory_order_acquire); buffer;
+       buffer = buffer->next) {
+    uint32_t free = 0;
+    if (buffer->owner.load(std::memory_order_relaxed) == free &&
+        buffer->owner.compare_exchange_strong(free,
+                                              thread + 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+      buffer->thread = thread;
+      buffer->cached_tail = buffer->tail.load(std::memory_order_acquire);
+      return buffer;
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Flushes and frees the buffer of an exiting thread, for another
+ * thread to take.
+ */
+void TraceWriter::release_buffers(uint32_t thread) {
+  for (auto buffer = m_buffers.load(std::memory_order_acquire); buffer;
+       buffer = buffer->next) {
+    if (buffer->owner.load(std::memory_order_relaxed) == thread + 1) {
+      flush();
+      buffer->owner.store(0, std::memory_order_release);
+    }
+  }
+}
+
+/**
+ * @brief Called when the calling thread's buffer seems full: flushes, or
+ * waits for the flush in progress, until there's room.
+ *
+ * @return false If there'll be no room, because the file isn't open.
+ */
+bool TraceWriter::wait_for_space(ThreadBuffer& buffer) {
+  const auto head = buffer.head.load(std::memory_order_relaxed);
+  for (;;) {
+    buffer.cached_tail = buffer.tail.load(std::memory_order_acquire);
+    if (head - buffer.cached_tail < buffer.capacity) {
+      return true;
+    }
+    if (!is_open()) {
+      return false;
+    }
+
+    // Flushing always frees space, even if the write fails.
+    if (m_flush_mutex.try_lock()) {
+      flush_buffers();
+      m_flush_mutex.unlock();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/**
+ * @brief Body of the flushing thread: drains the buffers until stopped.
+ */
+void TraceWriter::run() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_wake_mutex);
+      m_wake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+      if (m_stopping) {
+        return;
+      }
+    }
+    flush();
+  }
+}
+
+/**
+ * @brief Writes the events in every buffer, up to MAX_IOVECS slices per
+ * writev(), then frees their space.
+ *
+ * NOTE: Requires m_flush_mutex.
+ */
+void TraceWriter::flush_buffers() {
+  if (!is_open()) {
+    return;
+  }
+
+  for (auto buffer = m_buffers.load(std::memory_order_acquire); buffer;) {
+    struct Slice {
+      ThreadBuffer* buffer;
+      uint64_t head;
+    } slices[MAX_IOVECS / 2];
+#ifdef _MSC_VER
+    struct iovec {
+      void* iov_base;
+      size_t iov_len;
+    };
+#endif
+    iovec iovecs[MAX_IOVECS];
+    size_t num_slices = 0;
+    size_t num_iovecs = 0;
+    size_t bytes = 0;
+
+    // Each buffer's events are one or two slices, as they may wrap around.
+    for (; buffer && num_slices < MAX_IOVECS / 2; buffer = buffer->next) {
+      const auto tail = buffer->tail.load(std::memory_order_relaxed);
+      const auto head = buffer->head.load(std::memory_order_acquire);
+      if (head == tail) {
+        continue;
+      }
+
+      const auto mask = buffer->capacity - 1;
+      const auto first = static_cast<size_t>(tail & mask);
+      const auto count = static_cast<size_t>(head - tail);
+      const auto first_count =
+          count < buffer->capacity - first ? count : buffer->capacity - first;
+
+      iovecs[num_iovecs].iov_base = &buffer->events[first];
+      iovecs[num_iovecs++].iov_len = first_count * sizeof(TraceEvent);
+      if (first_count < count) {
+        iovecs[num_iovecs].iov_base = &buffer->events[0];
+        iovecs[num_iovecs++].iov_len =
+            (count - first_count) * sizeof(TraceEvent);
+      }
+      bytes += count * sizeof(TraceEvent);
+      slices[num_slices++] = Slice{buffer, head};
+    }
+
+    if (!num_slices) {
+      break;
+    }
+
+#ifdef _MSC_VER
+    bool written = true;
+    for (size_t i = 0; i < num_iovecs && written; ++i) {
+      written = write_all(iovecs[i].iov_base, iovecs[i].iov_len);
+    }
+#else
+    bool written = true;
+    auto iov = iovecs;
+    auto iov_count = num_iovecs;
+    auto remaining = bytes;
+    while (remaining) {
+      const auto result = writev(m_fd, iov, static_cast<int>(iov_count));
+      if (result < 0) {
+        written = false;
+        break;
+      }
+
+      // Skips what was written, after a partial write.
+      auto done = static_cast<size_t>(result);
+      remaining -= done;
+      while (iov_count && done >= iov->iov_len) {
+        done -= iov->iov_len;
+        ++iov;
+        --iov_count;
+      }
+      if (done) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+        iov->iov_len -= done;
+      }
+    }
+#endif
+
+    // Frees the space either way, so that recording threads never stall on
+    // a failed file.
+    for (size_t i = 0; i < num_slices; ++i) {
+      auto& slice = slices[i];
+      const auto count =
+          slice.head - slice.buffer->tail.load(std::memory_order_relaxed);
+      if (written) {
+        m_num_written.fetch_add(count, std::memory_order_release);
+      } else {
+        m_num_dropped.fetch_add(count, std::memory_order_relaxed);
+      }
+      slice.buffer->tail.store(slice.head, std::memory_order_release);
+    }
+    if (!written) {
+      LOG_ERROR("Failed to write allocation trace; dropped events.");
+    }
+  }
+}
+
+/**
+ * @brief Writes all of data, retrying partial writes.
+ */
+bool TraceWriter::write_all(const void* data, size_t size) {
+  auto bytes = static_cast<const char*>(data);
+  while (size) {
+#ifdef _MSC_VER
+    const auto result = _write(m_fd, bytes, static_cast<unsigned>(size));
+#else
+    const auto result = write(m_fd, bytes, size);
+#endif
+    if (result <= 0) {
+      return false;
+    }
+    bytes += result;
+    size -= static_cast<size_t>(result);
+  }
+  return true;
+}
+
+void TraceWriter::close() {
+#ifdef _MSC_VER
+  _close(m_fd);
+#else
+  ::close(m_fd);
+#endif
+  m_fd = -1;
+}
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -0,0 +1,285 @@
+/**
+ * @file trace.h
+ * @brief Binary trace of allocation events: the file format, and the writer
+ * that buffers events per thread and writes them in the background.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "../pass_through.h"
+#include "../portability.h"
+#include "call_site.h"
+#include "util.h"
+
+// Library headers
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace allok8or {
+namespace diagnostic {
+
+//
+// File format
+//
+// A TraceFileHeader, then TraceEvents, in native byte order. Each thread's
+// events are in the order it made them; threads' events are interleaved in
+// batches, so order across threads is by timestamp.
+//
+
+const uint32_t TRACE_VERSION = 1;
+
+enum TraceEventType : uint8_t {
+  TRACE_ALLOCATE = 1,
+  TRACE_DEALLOCATE = 2,
+};
+
+struct TraceFileHeader {
+  char magic[8];             // "ALK8TRC"
+  uint32_t version;          // TRACE_VERSION
+  uint32_t event_size;       // sizeof(TraceEvent)
+  uint64_t ticks_per_second; // Of event timestamps; 0 if unknown.
+  uint64_t num_events;       // 0 if the trace wasn't closed.
+};
+
+struct TraceEvent {
+  uint64_t timestamp; // trace_ticks()
+  uint64_t pointer;
+  uint64_t size;      // 0 for unsized deallocations.
+  uint32_t alignment; // Likewise.
+  uint32_t thread;    // trace_thread() of the thread that made the call.
+  site_id_t site;     // UNKNOWN_SITE unless stacks are captured.
+  uint8_t type;       // TraceEventType
+  uint8_t reserved[3];
+};
+
+static_assert(sizeof(TraceFileHeader) == 32, "Trace header layout changed");
+static_assert(sizeof(TraceEvent) == 40, "Trace event layout changed");
+
+const char TRACE_MAGIC[8] = "ALK8TRC";
+
+/**
+ * @brief Returns a cheap monotonic tick count, for event timestamps: the
+ * time-stamp counter on x86-64, the virtual counter on AArch64, or else
+ * nanoseconds.
+ *
+ * NOTE: Assumes an invariant TSC, synchronized across cores, as on any recent
+ * x86-64.
+ */
+inline uint64_t trace_ticks() {
+#if defined(_MSC_VER) && defined(_M_X64)
+  return __rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+  return __rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return timestamp_ns();
+#endif
+}
+
+/**
+ * @brief Returns the calling thread's number in traces; threads are numbered
+ * from 0 in the order they first record an event.
+ */
+inline uint32_t trace_thread() {
+  static std::atomic<uint32_t> next_thread(0);
+  static thread_local uint32_t thread =
+      next_thread.fetch_add(1, std::memory_order_relaxed);
+  return thread;
+}
+
+/**
+ * @brief Writes allocation events to a trace file.
+ *
+ * Each thread records into its own single-producer ring buffer, with no locks
+ * or atomic read-modify-writes: a tick count, a 40-byte store and a release
+ * store. A background thread drains all the buffers every FLUSH_INTERVAL_MS
+ * (or sooner, once a buffer is half full) with one writev() per batch.
+ *
+ * A thread whose buffer is full flushes it itself (or waits for the flush in
+ * progress) rather than dropping events, so traces stay complete enough to
+ * replay. Events are dropped only if the file isn't open, or a buffer can't be
+ * allocated.
+ *
+ * NOTE: Buffers are allocated with PassThroughAllocator, so recording never
+ * calls operator new. A thread that exits flushes its buffers and frees them
+ * for new threads to reuse, so a writer has about as many buffers as threads
+ * that ran at once.
+ * NOTE: Thread-safe, but must not be destroyed while other threads record.
+ */
+class TraceWriter {
+public:
+  static const size_t DEFAULT_EVENTS_PER_THREAD = 16 * 1024;
+  static const int FLUSH_INTERVAL_MS = 10;
+
+  TraceWriter(const char* path,
+              size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+  ~TraceWriter();
+
+  // No copies; the file belongs to this writer.
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  void record(TraceEventType type,
+              const void* pointer,
+              size_t size,
+              size_t alignment,
+              site_id_t site);
+
+  void flush();
+
+  // Accessors
+  bool is_open() const { return m_fd >= 0; }
+  uint64_t num_written() const {
+    return m_num_written.load(std::memory_order_acquire);
+  }
+  uint64_t num_dropped() const {
+    return m_num_dropped.load(std::memory_order_relaxed);
+  }
+  size_t num_buffers() const; // In use or free.
+
+private:
+  // One thread's events; positions increase monotonically, and the slot is
+  // position % capacity.
+  struct ThreadBuffer {
+    TraceEvent* events;
+    size_t capacity; // A power of 2.
+    uint32_t thread; // Of the owner, for its events.
+    ThreadBuffer* next; // In m_buffers.
+
+    // trace_thread() + 1 of the owning thread, or 0 while free.
+    std::atomic<uint32_t> owner;
+
+    // Written by the owning thread only.
+    alignas(ALK8_CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+    uint64_t cached_tail; // Last tail seen, to spare reading it per event.
+
+    // Written by the flushing thread only.
+    alignas(ALK8_CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+  };
+
+  // The writer whose buffer a thread used last, and that buffer.
+  struct LocalBuffer {
+    uint64_t writer_id;
+    ThreadBuffer* buffer;
+  };
+
+  // Releases the thread's buffers in every writer when it exits.
+  struct ThreadExit {
+    bool armed = false;
+    ~ThreadExit();
+  };
+
+  // Writers not yet destroyed.
+  struct WriterList {
+    std::mutex mutex;
+    TraceWriter* head;
+  };
+
+  static LocalBuffer& local();
+  static WriterList& live_writers();
+
+  ThreadBuffer* local_buffer();
+  ThreadBuffer* find_or_add_buffer();
+  ThreadBuffer* claim_buffer(uint32_t thread);
+  void release_buffers(uint32_t thread);
+  bool wait_for_space(ThreadBuffer& buffer);
+
+  void run();
+  void flush_buffers();
+  bool write_all(const void* data, size_t size);
+  void close();
+
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+  static std::atomic<uint64_t> s_next_writer_id;
+
+  const uint64_t m_id; // Never reused, unlike addresses.
+  const size_t m_events_per_thread;
+  int m_fd;
+
+  std::atomic<ThreadBuffer*> m_buffers; // Pushed at the head; never removed.
+  TraceWriter* m_next_live; // In live_writers().
+  std::atomic<uint64_t> m_num_written;
+  std::atomic<uint64_t> m_num_dropped;
+
+  const uint64_t m_start_ticks; // For calibrating ticks_per_second.
+  const uint64_t m_start_ns;
+
+  std::mutex m_flush_mutex; // Held while draining buffers and writing.
+  std::mutex m_wake_mutex;  // Guards m_stopping, for m_wake.
+  std::condition_variable m_wake;
+  bool m_stopping;
+  std::thread m_thread;
+};
+
+/**
+ * @brief Returns the calling thread's cached buffer of this writer, finding
+ * or adding one on a miss.
+ */
+inline TraceWriter::ThreadBuffer* TraceWriter::local_buffer() {
+  auto& cached = local();
+  if (cached.writer_id == m_id) {
+    return cached.buffer;
+  }
+  return find_or_add_buffer();
+}
+
+/**
+ * @brief Appends an event to the calling thread's buffer.
+ *
+ * @param type Allocation or deallocation.
+ * @param pointer Block allocated or deallocated.
+ * @param size Size of the block, or 0 if unknown.
+ * @param alignment Alignment of the block, or 0 if unknown.
+ * @param site Call site of the allocation.
+ */
+inline void TraceWriter::record(TraceEventType type,
+                                const void* pointer,
+                                size_t size,
+                                size_t alignment,
+                                site_id_t site) {
+  auto buffer = local_buffer();
+  if (!buffer) {
+    m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const auto head = buffer->head.load(std::memory_order_relaxed);
+  if (head - buffer->cached_tail == buffer->capacity &&
+      !wait_for_space(*buffer)) {
+    m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto& event = buffer->events[head & (buffer->capacity - 1)];
+  event.timestamp = trace_ticks();
+  event.pointer = reinterpret_cast<uintptr_t>(pointer);
+  event.size = size;
+  event.alignment = static_cast<uint32_t>(alignment);
+  event.thread = buffer->thread;
+  event.site = site;
+  event.type = type;
+  buffer->head.store(head + 1, std::memory_order_release);
+
+  // Wakes the flusher early once the buffer is half full.
+  if (!((head + 1) & (buffer->capacity / 2 - 1))) {
+    m_wake.notify_one();
+  }
+}
+
+} // namespace diagnostic
+} // namespace allok8or
@@ -24,12 +24,21 @@ namespace diagnostic {
 // AllocationTrackingPool Implementation
 //
 
+#ifndef ALLOK8OR_FULL_BLOCK_HEADER
+// Static init.
+PassThroughAllocator AllocationTrackingPool::m_backing_allocator;
+#endif
+
 /**
  * AllocationTrackingPool ctor
  */
 AllocationTrackingPool::AllocationTrackingPool()
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     : m_head(nullptr),
       m_tail(nullptr),
+#else
+    : m_blocks(m_backing_allocator),
+#endif
       m_num_blocks(0),
       m_num_bytes(0),
       m_stats(std::make_unique<AllocationStatsTracker>()) {}
@@ -40,7 +49,11 @@ AllocationTrackingPool::AllocationTrackingPool()
  * Logs an error if any are still in use at shutdown.
  */
 AllocationTrackingPool::~AllocationTrackingPool() {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   if (m_num_blocks || m_head || m_tail) {
+#else
+  if (m_num_blocks || m_blocks.size()) {
+#endif
     LOG_ERROR("Detected memory leaks when deleting AllocationTrackingPool "
               "[%d]; leaking [%d] bytes.",
               m_num_blocks,
@@ -64,6 +77,7 @@ bool AllocationTrackingPool::add(BlockHeader* block) {
   if (in_list(block))
     return false;
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   // We only add to the head...
   if (m_head) {
     block->next(m_head);
@@ -75,33 +89,50 @@ bool AllocationTrackingPool::add(BlockHeader* block) {
   if (!m_tail) {
     m_tail = block;
   }
+#else
+  if (!m_blocks.add(block, timestamp_ns()))
+    return false;
+#endif
 
   m_num_blocks++;
   m_num_bytes += block->user_data_size();
 
-  m_stats->track_allocation(block->type_name(),
-                    block->file_name(),
-                    block->line(),
-                    block->user_data_size());
+  m_stats->track_allocation(block->site(), block->user_data_size());
   return true;
 }
 
 /**
- * @brief Removes a memory block (with header) from the internal list.
+ * @brief Removes a memory block (with header) from the internal list, freed
+ * now.
  *
  * @param block Pointer to the block to remove.
  * @return true when block removed.
  * @return false when failed to remove block.
  */
 bool AllocationTrackingPool::remove(BlockHeader* block) {
+  return remove(block, timestamp_ns());
+}
+
+/**
+ * @brief Removes a memory block (with header) from the internal list.
+ *
+ * @param block Pointer to the block to remove.
+ * @param freed_at When the block was freed (see timestamp_ns()), for its
+ * lifetime; taken by the caller, so that waiting for a lock doesn't count.
+ * @return true when block removed.
+ * @return false when failed to remove block.
+ */
+bool AllocationTrackingPool::remove(BlockHeader* block, uint64_t freed_at) {
   assert(block);
   assert(in_list(block));
-  assert(m_head);
 
   if (!block)
     return false;
   if (!in_list(block))
     return false;
+
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  assert(m_head);
   if (!m_head)
     return false;
 
@@ -130,24 +161,73 @@ bool AllocationTrackingPool::remove(BlockHeader* block) {
   block->prev(nullptr);
   block->next(nullptr);
 
+  const auto allocated_at = block->timestamp();
+#else
+  uint64_t allocated_at;
+  if (!m_blocks.remove(block, allocated_at))
+    return false;
+#endif
+
   m_num_blocks--;
   m_num_bytes -= block->user_data_size();
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   if (m_num_blocks == 0) {
     m_head = nullptr;
     m_tail = nullptr;
   }
+#endif
+
+  m_stats->track_deallocation(block->site(),
+                              block->user_data_size(),
+                              freed_at - allocated_at);
 
-  m_stats->track_deallocation(block->type_name(),
-                      block->file_name(),
-                      block->line(),
-                      block->user_data_size());
+  return true;
+}
+
+/**
+ * @brief Sets the call site of a tracked block, moving its allocation to the
+ * new site's stats.
+ *
+ * NOTE: Caller details replace an unknown site or a captured stack, but not
+ * other caller details.
+ *
+ * @param block Pointer to the block.
+ * @param site ID of the call site.
+ * @return true when the site was set.
+ * @return false when the block isn't tracked, or already has caller details.
+ */
+bool AllocationTrackingPool::set_site(BlockHeader* block, site_id_t site) {
+  assert(block);
+  if (!block)
+    return false;
+  if (!in_list(block))
+    return false;
+
+  const auto old_site = block->site();
+  if (old_site != UNKNOWN_SITE &&
+      CallSiteRegistry::instance().site(old_site).file_name)
+    return false;
 
+  block->site(site);
+  m_stats->move_allocation(old_site, site, block->user_data_size());
   return true;
 }
 
+/**
+ * @brief Copies the live blocks and bytes of each call site; see
+ * AllocationStatsTracker::snapshot().
+ */
+HeapSnapshot AllocationTrackingPool::heap_snapshot() const {
+  return m_stats->snapshot();
+}
+
 bool AllocationTrackingPool::in_list(BlockHeader* block) const {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   return (m_head == block || m_tail == block || block->next() || block->prev());
+#else
+  return m_blocks.contains(block);
+#endif
 }
 
 
@@ -6,9 +6,13 @@
 #pragma once
 
 // Project headers
+#include "../pass_through.h"
 #include "../types.h"
+#include "block_index.h"
+#include "heap_snapshot.h"
 
 // Library headers
+#include <cstdint>
 #include <memory>
 
 namespace allok8or {
@@ -20,11 +24,13 @@ class AllocationStatsTracker;
 typedef std::unique_ptr<AllocationStatsTracker> StatsPtr;
 
 /**
- * Manages the linked list of headers and generates metrics from them.
+ * Manages the list of headers and generates metrics from them.
  * 
  * TODO: RENAME TO DiagnosticBlockPool (or similar)
  *
- * NOTE: Blocks are added only to the head of the doubly-linked list.
+ * NOTE: With the full header layout, blocks are linked into a doubly-linked
+ * list, added only at its head. With the compact layout, they're listed in a
+ * BlockIndex, which also holds their allocation times.
  */
 class AllocationTrackingPool {
 public:
@@ -37,18 +43,33 @@ public:
 
   bool add(BlockHeader* block);
   bool remove(BlockHeader* block);
+  bool remove(BlockHeader* block, uint64_t freed_at);
+  bool set_site(BlockHeader* block, site_id_t site);
   bool in_list(BlockHeader* block) const;
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   const BlockHeader* head() const { return m_head; }
   const BlockHeader* tail() const { return m_tail; }
+#else
+  typedef BlockIndex<BlockHeader, PassThroughAllocator> BlockIndexT;
+  const BlockIndexT& blocks() const { return m_blocks; }
+#endif
 
   llong_t num_blocks() const { return m_num_blocks; }
   llong_t num_bytes() const { return m_num_bytes; }
 
   const AllocationStatsTracker& tracker() const { return *m_stats; }
+  HeapSnapshot heap_snapshot() const;
 
 private:
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   BlockHeader* m_head;
   BlockHeader* m_tail;
+#else
+  static PassThroughAllocator
+      m_backing_allocator; // stateless, so static is safe.
+
+  BlockIndexT m_blocks;
+#endif
   llong_t m_num_blocks;
   llong_t m_num_bytes;
 
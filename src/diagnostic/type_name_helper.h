@@ -121,15 +121,15 @@ constexpr void TypeNameHelper<T>::get_type_name(const char (&func_string)[N],
   start += prefix_size;
 }
 
-#elif defined(__clang__)
+#elif defined(__clang__) || defined(__GNUC__)
 // Clang/GCC implementation: relies on parsing T from the trailing annotation of
 // __PRETTY_FUNCTION__.
 
 /**
  * @brief Parse the type out of the func_string.
  *
- * NOTE: We want `<typename>` from: `[T = <typename>]`, at the end of
- * __PRETTY_FUNCTION__.
+ * NOTE: We want `<typename>` from: `[T = <typename>]` (Clang) or
+ * `[with T = <typename>]` (GCC), at the end of __PRETTY_FUNCTION__.
  *
  * @tparam T Class template param from which to extract the type name.
  * @tparam N Array size template param from which to deduce the string length.
@@ -157,8 +157,8 @@ constexpr void TypeNameHelper<T>::get_type_name(const char (&func_string)[N],
   start += 2; // skip '=' and ' '
 }
 
-#elif (__GNUC__)
-// TODO, and others
+#else
+// TODO: others
 #endif
 
 /**
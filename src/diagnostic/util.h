@@ -8,6 +8,8 @@
 // Project headers
 
 // Library headers
+#include <chrono>
+#include <cstdint>
 
 namespace allok8or {
 namespace diagnostic {
@@ -18,21 +20,39 @@ namespace diagnostic {
  * 2002, 2008 Curtis Bartley.
  */
 
+class CallSiteCache;
+
 /**
  * Data structure for capturing information about a function's caller.
+ *
+ * NOTE: The optional CallSiteCache saves interning the site on every call.
  */
 class CallerDetails {
 public:
-  constexpr CallerDetails(const char* file_name, int line)
-      : m_file_name(file_name), m_line(line) {}
+  constexpr CallerDetails(const char* file_name,
+                          int line,
+                          CallSiteCache* site_cache = nullptr)
+      : m_file_name(file_name), m_line(line), m_site_cache(site_cache) {}
 
   constexpr const char* file_name() const { return m_file_name; }
   constexpr int line() const { return m_line; }
+  constexpr CallSiteCache* site_cache() const { return m_site_cache; }
 
 private:
   const char* m_file_name;
   const int m_line;
+  CallSiteCache* m_site_cache;
 };
 
+/**
+ * @brief Returns a monotonic time in nanoseconds, for timing block lifetimes.
+ */
+inline uint64_t timestamp_ns() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
 } // namespace diagnostic
 } // namespace allok8or
\ No newline at end of file
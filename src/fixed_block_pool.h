@@ -32,6 +32,7 @@ public:
 
   bool add(TFixedBlock* block);
   bool remove(TFixedBlock* block);
+  TFixedBlock* get();
   bool in_list(TFixedBlock* block) const;
   const TFixedBlock* head() const { return m_head; }
   const TFixedBlock* tail() const { return m_tail; }
@@ -162,6 +163,21 @@ bool FixedBlockPool<TFixedBlock>::remove(TFixedBlock* block) {
   return true;
 }
 
+/**
+ * @brief Removes the memory block at the head of the internal list.
+ *
+ * @return TFixedBlock* The removed block, or nullptr if the list is empty.
+ */
+template <typename TFixedBlock>
+TFixedBlock* FixedBlockPool<TFixedBlock>::get() {
+  auto block = m_head;
+  if (block) {
+    remove(block);
+  }
+
+  return block;
+}
+
 template <typename TFixedBlock>
 bool FixedBlockPool<TFixedBlock>::in_list(TFixedBlock* block) const {
   return (m_head == block || m_tail == block || block->next() || block->prev());
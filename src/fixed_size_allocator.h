@@ -18,11 +18,11 @@ namespace allok8or {
  * @tparam TSize Size of the blocks this allocator creates.
  * @tparam TAlign Memory alignment of the blocks this allocator creates.
  */
-template <typename TImpl>
+template <typename TImpl, size_t TSize, size_t TAlign>
 class FixedSizeAllocator {
 public:
-  const static size_t block_size = TImpl::TSize;
-  const static size_t alignment = TImpl::TAlign;
+  const static size_t block_size = TSize;
+  const static size_t alignment = TAlign;
 
   constexpr void* allocate() const { return impl().allocate(); }
   constexpr void deallocate(void* data) const { impl().deallocate(data); }
@@ -37,28 +37,28 @@ private:
     return *static_cast<const TImpl*>(this);
   }
 
-  template <typename F_TImpl>
+  template <typename F_TImpl, size_t F_TSize, size_t F_TAlign>
   friend constexpr bool
-  operator==(const FixedSizeAllocator<F_TImpl>& lhs,
-             const FixedSizeAllocator<F_TImpl>& rhs);
+  operator==(const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& lhs,
+             const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& rhs);
 
-  template <typename F_TImpl>
+  template <typename F_TImpl, size_t F_TSize, size_t F_TAlign>
   friend constexpr bool
-  operator!=(const FixedSizeAllocator<F_TImpl>& lhs,
-             const FixedSizeAllocator<F_TImpl>& rhs);
+  operator!=(const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& lhs,
+             const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& rhs);
 };
 
-template <typename F_TImpl>
+template <typename F_TImpl, size_t F_TSize, size_t F_TAlign>
 inline constexpr bool
-operator==(const FixedSizeAllocator<F_TImpl>& lhs,
-           const FixedSizeAllocator<F_TImpl>& rhs) {
+operator==(const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& lhs,
+           const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& rhs) {
   return lhs.impl() == rhs.impl();
 }
 
-template <typename F_TImpl>
+template <typename F_TImpl, size_t F_TSize, size_t F_TAlign>
 inline constexpr bool
-operator!=(const FixedSizeAllocator<F_TImpl>& lhs,
-           const FixedSizeAllocator<F_TImpl>& rhs) {
+operator!=(const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& lhs,
+           const FixedSizeAllocator<F_TImpl, F_TSize, F_TAlign>& rhs) {
   return lhs.impl() != rhs.impl();
 }
 
@@ -24,7 +24,9 @@ template <typename TTargetAllocator,
           size_t TAlign = alignof(std::max_align_t)>
 struct FixedSizeAllocatorAdapter
     : public FixedSizeAllocator<
-          FixedSizeAllocatorAdapter<TTargetAllocator, TSize, TAlign>> {
+          FixedSizeAllocatorAdapter<TTargetAllocator, TSize, TAlign>,
+          TSize,
+          TAlign> {
 
   constexpr explicit FixedSizeAllocatorAdapter(
       const TTargetAllocator& allocator)
@@ -36,7 +38,10 @@ struct FixedSizeAllocatorAdapter
   constexpr void deallocate(void* data) const { m_allocator.deallocate(data); }
 
 private:
-  using base = FixedSizeAllocatorAdapter<TTargetAllocator, TSize, TAlign>;
+  using base = FixedSizeAllocator<
+      FixedSizeAllocatorAdapter<TTargetAllocator, TSize, TAlign>,
+      TSize,
+      TAlign>;
 
   const TTargetAllocator& m_allocator;
 };
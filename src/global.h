@@ -7,8 +7,13 @@
 
 // Project headers
 #include "allocator.h"
+#include "context.h"
 
 // Library headers
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
 
 namespace allok8or {
 namespace global {
@@ -16,7 +21,12 @@ namespace global {
 /**
  * @brief Non-singleton implementation of global instance.
  *
- * TODO: Thread safety.
+ * The instance pointer is atomic, so init() and cleanup() may race with
+ * allocations on other threads; the allocator itself must be thread safe if
+ * used from several threads.
+ *
+ * A ScopedAllocatorContext on the calling thread takes precedence over the
+ * global instance.
  *
  * NOTE: Because sometimes you really *do* need a global!
  *
@@ -28,16 +38,24 @@ class GlobalAllocator {
   ~GlobalAllocator() = delete;
 
 public:
-  constexpr static void init(Allocator<TAllocator>* allocator);
-  constexpr static void cleanup();
+  static void init(Allocator<TAllocator>* allocator);
+  static void cleanup();
+
+  static void* allocate(size_t size);
+  static void* allocate(size_t size, size_t alignment);
+  static void* reallocate(void* data,
+                          size_t old_size,
+                          size_t new_size,
+                          size_t alignment);
+  static void deallocate(void* data);
+  static void deallocate(void* data, size_t size, size_t alignment);
 
-  constexpr static void* allocate(size_t size);
-  constexpr static void* allocate(size_t size, size_t alignment);
-  constexpr static void deallocate(void* data);
+  static const TAllocator* get() {
+    return m_allocator.load(std::memory_order_acquire);
+  }
 
-  constexpr static const TAllocator* get() { return m_allocator; }
 private:
-  static TAllocator* m_allocator;
+  static std::atomic<TAllocator*> m_allocator;
 };
 
 /**
@@ -46,21 +64,21 @@ private:
  * @tparam TAllocator Type of the allocator implementation class.
  */
 template <typename TAllocator>
-TAllocator* GlobalAllocator<TAllocator>::m_allocator = nullptr;
+std::atomic<TAllocator*> GlobalAllocator<TAllocator>::m_allocator{nullptr};
 
 
 /**
  * @brief Initialize the static instance of the global allocator.
  *
  * NOTE: Currently caller must manage the memory.
- * TODO: Thread safety.
  *
  * @tparam TAllocator Implementation type passed to Allocator<typename T>
  * @param allocator Pointer to the allocator instance to be used globally.
  */
 template <typename TAllocator>
-inline constexpr void GlobalAllocator<TAllocator>::init(Allocator<TAllocator>* allocator) {
-  m_allocator = static_cast<TAllocator*>(allocator);
+inline void GlobalAllocator<TAllocator>::init(Allocator<TAllocator>* allocator) {
+  m_allocator.store(static_cast<TAllocator*>(allocator),
+                    std::memory_order_release);
 }
 
 /**
@@ -69,8 +87,8 @@ inline constexpr void GlobalAllocator<TAllocator>::init(Allocator<TAllocator>* a
  * @tparam TAllocator Implementation type passed to Allocator<typename T>
  */
 template <typename TAllocator>
-inline constexpr void GlobalAllocator<TAllocator>::cleanup() {
-  m_allocator = nullptr;
+inline void GlobalAllocator<TAllocator>::cleanup() {
+  m_allocator.store(nullptr, std::memory_order_release);
 }
 
 /**
@@ -83,8 +101,12 @@ inline constexpr void GlobalAllocator<TAllocator>::cleanup() {
  * @return void* Pointer to the allocated block of memory.
  */
 template <typename TAllocator>
-inline constexpr void* GlobalAllocator<TAllocator>::allocate(size_t size) {
-  return m_allocator->allocate(size);
+inline void* GlobalAllocator<TAllocator>::allocate(size_t size) {
+  if (auto context = current_allocator_context()) {
+    return context->allocate(
+        context->allocator, size, alignof(std::max_align_t));
+  }
+  return get()->allocate(size);
 }
 
 /**
@@ -98,8 +120,41 @@ inline constexpr void* GlobalAllocator<TAllocator>::allocate(size_t size) {
  * @return void* Pointer to the allocated block of memory.
  */
 template <typename TAllocator>
-inline constexpr void* GlobalAllocator<TAllocator>::allocate(size_t size, size_t alignment) {
-  return m_allocator->allocate(size, alignment);
+inline void* GlobalAllocator<TAllocator>::allocate(size_t size, size_t alignment) {
+  if (auto context = current_allocator_context()) {
+    return context->allocate(context->allocator, size, alignment);
+  }
+  return get()->allocate(size, alignment);
+}
+
+/**
+ * @brief Resize a block of memory using the global allocator.
+ *
+ * @tparam TAllocator Implementation type passed to Allocator<typename T>
+ * @param data Pointer to the memory block to resize; may be nullptr.
+ * @param old_size Size of the memory block as originally requested.
+ * @param new_size Requested new size of the memory block.
+ * @param alignment Alignment of the memory block.
+ * @return void* Pointer to the resized block of memory.
+ */
+template <typename TAllocator>
+inline void* GlobalAllocator<TAllocator>::reallocate(
+    void* data, size_t old_size, size_t new_size, size_t alignment) {
+  if (auto context = current_allocator_context()) {
+    if (!data || context_owns(context, data)) {
+      return context->reallocate(
+          context->allocator, data, old_size, new_size, alignment);
+    }
+
+    // Moves a block allocated outside the context into it.
+    auto new_data = context->allocate(context->allocator, new_size, alignment);
+    if (new_data) {
+      std::memcpy(new_data, data, std::min(old_size, new_size));
+      deallocate(data, old_size, alignment);
+    }
+    return new_data;
+  }
+  return get()->reallocate(data, old_size, new_size, alignment);
 }
 
 /**
@@ -113,8 +168,33 @@ inline constexpr void* GlobalAllocator<TAllocator>::allocate(size_t size, size_t
  * @param data Pointer to the memory block to deallocate.
  */
 template <typename TAllocator>
-inline constexpr void GlobalAllocator<TAllocator>::deallocate(void* data) {
-  return m_allocator->deallocate(data);
+inline void GlobalAllocator<TAllocator>::deallocate(void* data) {
+  if (auto context = owning_allocator_context(data)) {
+    return context->deallocate(
+        context->allocator, data, 0, alignof(std::max_align_t));
+  }
+  return get()->deallocate(data);
+}
+
+/**
+ * @brief Deallocate the memory via the given pointer using the global
+ * allocator, passing along the size and alignment it was allocated with.
+ *
+ * NOTE: Deallocated memory *must* have been allocated by the same allocator.
+ *
+ * @tparam TAllocator Implementation type passed to Allocator<typename T>
+ * @param data Pointer to the memory block to deallocate.
+ * @param size Size of the memory block as originally requested.
+ * @param alignment Alignment of the memory block as originally requested.
+ */
+template <typename TAllocator>
+inline void GlobalAllocator<TAllocator>::deallocate(
+    void* data, size_t size, size_t alignment) {
+  if (auto context = owning_allocator_context(data)) {
+    return context->deallocate(context->allocator, data, size, alignment);
+  }
+  return static_cast<const Allocator<TAllocator>*>(get())
+      ->deallocate(data, size, alignment);
 }
 
 } // namespace global
@@ -0,0 +1,470 @@
+/**
+ * @file global_new.cpp
+ * @brief Replacements for all global operator new/delete variants, routed
+ * through the calling thread's ScopedAllocatorContext if it has one, and
+ * set_new_route() otherwise.
+ *
+ * NOTE: Built only into the allok8or-new object library, never allok8or-core;
+ * replacing operator new is a decision for the final executable.
+ *
+ */
+
+// My header
+#include "global_new.h"
+
+// Project headers
+#include "context.h"
+#include "memory.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+
+// Bytes of static memory for allocations made before a route is set, and
+// after it is retired.
+#ifndef ALK8_NEW_BOOTSTRAP_SIZE
+#define ALK8_NEW_BOOTSTRAP_SIZE (64 * 1024)
+#endif
+
+// Number of system heap blocks that can be live at once, once the bootstrap
+// buffer is used up before a route is set. Past that, memory comes from system
+// heap chunks that are never freed.
+#ifndef ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS
+#define ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS 4096
+#endif
+
+namespace allok8or {
+namespace global {
+
+namespace {
+
+const size_t default_new_alignment = alignof(std::max_align_t);
+
+alignas(std::max_align_t) char s_bootstrap[ALK8_NEW_BOOTSTRAP_SIZE];
+std::atomic<size_t> s_bootstrap_used{0};
+
+/**
+ * Carves memory out of the bootstrap buffer, or returns nullptr if it's full.
+ */
+void* bootstrap_allocate(size_t size, size_t alignment) {
+  const auto base = reinterpret_cast<uintptr_t>(s_bootstrap);
+
+  auto used = s_bootstrap_used.load(std::memory_order_relaxed);
+  for (;;) {
+    auto start = ((base + used + alignment - 1) & ~(alignment - 1)) - base;
+    if (start > ALK8_NEW_BOOTSTRAP_SIZE ||
+        ALK8_NEW_BOOTSTRAP_SIZE - start < size) {
+      return nullptr;
+    }
+
+    if (s_bootstrap_used.compare_exchange_weak(
+            used, start + size, std::memory_order_relaxed)) {
+      return s_bootstrap + start;
+    }
+  }
+}
+
+bool in_bootstrap(const void* data) {
+  auto address = static_cast<const char*>(data);
+  return address >= s_bootstrap && address < s_bootstrap + sizeof(s_bootstrap);
+}
+
+//
+// System heap blocks allocated before a route is set, once the bootstrap
+// buffer is full. Their addresses are kept in a lock-free open-addressing set,
+// so that deleting them frees them to the system heap, whatever the route.
+// Adding (rare) is serialized by a spin lock, so that the removal markers can
+// be cleared once the set is empty; lookups never take it.
+//
+
+const uintptr_t EMPTY_SLOT = 0;
+const uintptr_t REMOVED_SLOT = 1; // Never a block address.
+
+std::atomic<uintptr_t> s_heap_blocks[ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS];
+std::atomic<size_t> s_num_heap_blocks{0};
+
+// Bounds of the addresses added since the set was last empty, so that most
+// lookups are decided without probing.
+std::atomic<uintptr_t> s_heap_blocks_min{UINTPTR_MAX};
+std::atomic<uintptr_t> s_heap_blocks_max{0};
+
+std::atomic_flag s_heap_blocks_lock = ATOMIC_FLAG_INIT;
+
+/**
+ * Holds s_heap_blocks_lock for the duration of a scope.
+ */
+class HeapBlocksLock {
+public:
+  HeapBlocksLock() {
+    while (s_heap_blocks_lock.test_and_set(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  ~HeapBlocksLock() { s_heap_blocks_lock.clear(std::memory_order_release); }
+
+  HeapBlocksLock(const HeapBlocksLock&) = delete;
+  HeapBlocksLock& operator=(const HeapBlocksLock&) = delete;
+};
+
+size_t heap_block_slot(uintptr_t address) {
+  return static_cast<size_t>((address >> 4) * 0x9e3779b97f4a7c15ull >> 32) %
+         ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS;
+}
+
+/**
+ * Adds a block to the set; returns false if the set is full.
+ */
+bool add_heap_block(const void* data) {
+  const auto address = reinterpret_cast<uintptr_t>(data);
+  HeapBlocksLock lock;
+
+  // Counted first, so that the set is never seen empty (and cleared) while a
+  // block is being added.
+  s_num_heap_blocks.fetch_add(1, std::memory_order_acq_rel);
+  if (address < s_heap_blocks_min.load(std::memory_order_relaxed)) {
+    s_heap_blocks_min.store(address, std::memory_order_release);
+  }
+  if (address > s_heap_blocks_max.load(std::memory_order_relaxed)) {
+    s_heap_blocks_max.store(address, std::memory_order_release);
+  }
+
+  auto slot = heap_block_slot(address);
+  for (size_t i = 0; i < ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS; ++i) {
+    auto& entry = s_heap_blocks[slot];
+    auto value = entry.load(std::memory_order_relaxed);
+    if (value == EMPTY_SLOT || value == REMOVED_SLOT) {
+      entry.store(address, std::memory_order_release);
+      return true;
+    }
+    slot = (slot + 1) % ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS;
+  }
+
+  s_num_heap_blocks.fetch_sub(1, std::memory_order_relaxed);
+  return false;
+}
+
+/**
+ * Clears the removal markers, once the set is empty, so that lookups stop at
+ * the first empty slot again.
+ */
+void reset_heap_blocks() {
+  HeapBlocksLock lock;
+  if (s_num_heap_blocks.load(std::memory_order_acquire)) {
+    return; // Added to since.
+  }
+
+  for (auto& entry : s_heap_blocks) {
+    entry.store(EMPTY_SLOT, std::memory_order_relaxed);
+  }
+  s_heap_blocks_min.store(UINTPTR_MAX, std::memory_order_relaxed);
+  s_heap_blocks_max.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Removes a block from the set; returns false if it isn't in it.
+ */
+bool remove_heap_block(const void* data) {
+  const auto address = reinterpret_cast<uintptr_t>(data);
+  if (address < s_heap_blocks_min.load(std::memory_order_acquire) ||
+      address > s_heap_blocks_max.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  auto slot = heap_block_slot(address);
+  for (size_t i = 0; i < ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS; ++i) {
+    auto& entry = s_heap_blocks[slot];
+    auto value = entry.load(std::memory_order_acquire);
+    if (value == EMPTY_SLOT) {
+      return false;
+    }
+    if (value == address) {
+      entry.store(REMOVED_SLOT, std::memory_order_relaxed);
+      if (s_num_heap_blocks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        reset_heap_blocks();
+      }
+      return true;
+    }
+    slot = (slot + 1) % ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS;
+  }
+  return false;
+}
+
+//
+// System heap chunks carved up, never freed, once the set above is full.
+// Deleting memory in them is a no-op, as for the bootstrap buffer.
+//
+
+struct OverflowChunk {
+  OverflowChunk* next;
+  char* end;
+  char* top; // Next free byte.
+};
+
+std::atomic<OverflowChunk*> s_overflow_chunks{nullptr};
+
+/**
+ * Carves memory out of the latest overflow chunk, adding a chunk if it's full.
+ * Called with s_heap_blocks_lock held.
+ */
+void* overflow_allocate(size_t size, size_t alignment) {
+  auto align_up = [alignment](char* address) {
+    return reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(address) + alignment - 1) &
+        ~(alignment - 1));
+  };
+
+  auto chunk = s_overflow_chunks.load(std::memory_order_relaxed);
+  if (chunk) {
+    auto start = align_up(chunk->top);
+    if (start <= chunk->end &&
+        static_cast<size_t>(chunk->end - start) >= size) {
+      chunk->top = start + size;
+      return start;
+    }
+  }
+
+  auto chunk_size = sizeof(OverflowChunk) + alignment + size;
+  if (chunk_size < ALK8_NEW_BOOTSTRAP_SIZE) {
+    chunk_size = ALK8_NEW_BOOTSTRAP_SIZE;
+  }
+  auto memory = memory::aligned_malloc(chunk_size, alignof(OverflowChunk));
+  if (!memory) {
+    return nullptr;
+  }
+
+  auto new_chunk = static_cast<OverflowChunk*>(memory);
+  new_chunk->next = chunk;
+  new_chunk->end = static_cast<char*>(memory) + chunk_size;
+  auto start = align_up(reinterpret_cast<char*>(new_chunk + 1));
+  new_chunk->top = start + size;
+  s_overflow_chunks.store(new_chunk, std::memory_order_release);
+  return start;
+}
+
+bool in_overflow(const void* data) {
+  auto address = static_cast<const char*>(data);
+  for (auto chunk = s_overflow_chunks.load(std::memory_order_acquire); chunk;
+       chunk = chunk->next) {
+    if (address > reinterpret_cast<const char*>(chunk) &&
+        address < chunk->end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Route before set_new_route() is first called: the bootstrap buffer, then
+ * the system heap.
+ */
+void* initial_allocate(size_t size, size_t alignment) {
+  if (auto memory = bootstrap_allocate(size, alignment)) {
+    return memory;
+  }
+
+  auto memory = memory::aligned_malloc(size, alignment);
+  if (memory && !add_heap_block(memory)) {
+    // Too many to track; from memory that's never freed instead.
+    memory::aligned_free(memory);
+    HeapBlocksLock lock;
+    return overflow_allocate(size, alignment);
+  }
+  return memory;
+}
+
+/**
+ * Route after set_new_route(nullptr). The routed allocator may be gone, so
+ * nothing is ever freed.
+ */
+void* retired_allocate(size_t size, size_t alignment) {
+  auto memory = bootstrap_allocate(size, alignment);
+  return memory ? memory : memory::aligned_malloc(size, alignment);
+}
+
+void ignore_deallocate(void*, size_t, size_t) {}
+
+const NewRoute s_initial_route = {&initial_allocate, &ignore_deallocate};
+const NewRoute s_retired_route = {&retired_allocate, &ignore_deallocate};
+
+// Constant-initialized, so it's valid before any static constructor runs.
+std::atomic<const NewRoute*> s_route{&s_initial_route};
+
+void* route_allocate(size_t size, size_t alignment) {
+  if (auto context = current_allocator_context()) {
+    return context->allocate(context->allocator, size, alignment);
+  }
+  return s_route.load(std::memory_order_acquire)->allocate(size, alignment);
+}
+
+void route_deallocate(void* data, size_t size, size_t alignment) {
+  if (!data || in_bootstrap(data)) {
+    return;
+  }
+  if (s_num_heap_blocks.load(std::memory_order_acquire) &&
+      remove_heap_block(data)) {
+    return memory::aligned_free(data);
+  }
+  if (s_overflow_chunks.load(std::memory_order_relaxed) && in_overflow(data)) {
+    return;
+  }
+  if (auto context = owning_allocator_context(data)) {
+    return context->deallocate(context->allocator, data, size, alignment);
+  }
+  s_route.load(std::memory_order_acquire)->deallocate(data, size, alignment);
+}
+
+/**
+ * Allocates via the route, calling the new handler on failure as the standard
+ * requires.
+ */
+void* new_or_throw(size_t size, size_t alignment) {
+  if (!size) {
+    size = 1;
+  }
+
+  for (;;) {
+    auto memory = route_allocate(size, alignment);
+    if (memory) {
+      return memory;
+    }
+
+    auto handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void* new_or_null(size_t size, size_t alignment) noexcept {
+  try {
+    return new_or_throw(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+} // namespace
+
+void set_new_route(const NewRoute* route) {
+  s_route.store(route ? route : &s_retired_route, std::memory_order_release);
+}
+
+size_t new_bootstrap_size_used() {
+  return s_bootstrap_used.load(std::memory_order_relaxed);
+}
+
+size_t new_bootstrap_heap_blocks() {
+  return s_num_heap_blocks.load(std::memory_order_relaxed);
+}
+
+} // namespace global
+} // namespace allok8or
+
+using allok8or::global::default_new_alignment;
+using allok8or::global::new_or_null;
+using allok8or::global::new_or_throw;
+using allok8or::global::route_deallocate;
+
+//
+// Replaceable allocation functions
+//
+
+void* operator new(std::size_t size) {
+  return new_or_throw(size, default_new_alignment);
+}
+
+void* operator new[](std::size_t size) {
+  return new_or_throw(size, default_new_alignment);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return new_or_null(size, default_new_alignment);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return new_or_null(size, default_new_alignment);
+}
+
+void operator delete(void* data) noexcept {
+  route_deallocate(data, 0, default_new_alignment);
+}
+
+void operator delete[](void* data) noexcept {
+  route_deallocate(data, 0, default_new_alignment);
+}
+
+void operator delete(void* data, const std::nothrow_t&) noexcept {
+  route_deallocate(data, 0, default_new_alignment);
+}
+
+void operator delete[](void* data, const std::nothrow_t&) noexcept {
+  route_deallocate(data, 0, default_new_alignment);
+}
+
+void operator delete(void* data, std::size_t size) noexcept {
+  route_deallocate(data, size, default_new_alignment);
+}
+
+void operator delete[](void* data, std::size_t size) noexcept {
+  route_deallocate(data, size, default_new_alignment);
+}
+
+#if defined(__cpp_aligned_new)
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return new_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return new_or_throw(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return new_or_null(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return new_or_null(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* data, std::align_val_t alignment) noexcept {
+  route_deallocate(data, 0, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* data, std::align_val_t alignment) noexcept {
+  route_deallocate(data, 0, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* data,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  route_deallocate(data, 0, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* data,
+                       std::align_val_t alignment,
+                       const std::nothrow_t&) noexcept {
+  route_deallocate(data, 0, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* data,
+                     std::size_t size,
+                     std::align_val_t alignment) noexcept {
+  route_deallocate(data, size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* data,
+                       std::size_t size,
+                       std::align_val_t alignment) noexcept {
+  route_deallocate(data, size, static_cast<std::size_t>(alignment));
+}
+
+#endif // __cpp_aligned_new
@@ -0,0 +1,123 @@
+/**
+ * @file global_new.h
+ * @brief Header for routing the global operator new/delete into an allocator.
+ *
+ * The replacement operators themselves are in the allok8or-new target (an
+ * object library; add $<TARGET_OBJECTS:allok8or-new> to the executable's
+ * sources). Without it, new and delete are untouched and nothing in this header
+ * should be called.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+#include "global.h"
+
+// Library headers
+#include <cstddef>
+
+namespace allok8or {
+namespace global {
+
+/**
+ * @brief Entry points that the replacement operator new/delete call into.
+ *
+ * allocate() returns nullptr when out of memory; operator new turns that into
+ * std::bad_alloc. deallocate() is passed a size of 0 when the caller didn't
+ * provide one (unsized operator delete).
+ */
+struct NewRoute {
+  void* (*allocate)(size_t size, size_t alignment);
+  void (*deallocate)(void* data, size_t size, size_t alignment);
+};
+
+/**
+ * @brief Routes operator new/delete to the given entry points.
+ *
+ * Until a route is set, operator new is served from a fixed bootstrap buffer
+ * (see ALK8_NEW_BOOTSTRAP_SIZE), so that allocations made during static
+ * initialization never need the routed allocator; deleting bootstrap memory
+ * is a no-op, whichever route is set by then. Once the buffer is full, it's
+ * served from the system heap instead, and deleting that memory frees it
+ * there; past ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS live blocks, from system heap
+ * chunks that are never freed, like the bootstrap buffer.
+ *
+ * Passing nullptr retires the route, for use before the allocator goes away
+ * (e.g. at the end of main). After that, operator delete is a no-op and
+ * operator new uses what is left of the bootstrap buffer, then the system heap,
+ * so static destructors can run safely. The memory involved is leaked.
+ *
+ * NOTE: Memory allocated through one route must not be deleted through
+ * another; set the route once, before any allocations that outlive it.
+ *
+ * @param route Entry points to use; must outlive the route. nullptr to retire.
+ */
+void set_new_route(const NewRoute* route);
+
+/**
+ * @brief Returns the number of bytes of the bootstrap buffer used so far.
+ */
+size_t new_bootstrap_size_used();
+
+/**
+ * @brief Returns the number of live system heap blocks allocated before a
+ * route was set, once the bootstrap buffer was full.
+ */
+size_t new_bootstrap_heap_blocks();
+
+/**
+ * @brief NewRoute into GlobalAllocator<TAllocator>.
+ *
+ * @tparam TAllocator Type of the allocator implementation class.
+ */
+template <typename TAllocator>
+struct GlobalAllocatorNewRoute {
+  static void* allocate(size_t size, size_t alignment) {
+    return GlobalAllocator<TAllocator>::allocate(size, alignment);
+  }
+
+  static void deallocate(void* data, size_t size, size_t alignment) {
+    if (size) {
+      GlobalAllocator<TAllocator>::deallocate(data, size, alignment);
+    } else {
+      GlobalAllocator<TAllocator>::deallocate(data);
+    }
+  }
+
+  static constexpr NewRoute route = {&allocate, &deallocate};
+};
+
+template <typename TAllocator>
+constexpr NewRoute GlobalAllocatorNewRoute<TAllocator>::route;
+
+/**
+ * @brief Makes the given allocator the global allocator, and routes operator
+ * new/delete into it.
+ *
+ * NOTE: The allocator must be thread safe if new is used from several threads.
+ *
+ * @tparam TAllocator Type of the allocator implementation class.
+ * @param allocator The allocator to use; must stay alive until
+ * retire_global_new() is called.
+ */
+template <typename TAllocator>
+inline void install_global_new(Allocator<TAllocator>* allocator) {
+  GlobalAllocator<TAllocator>::init(allocator);
+  set_new_route(&GlobalAllocatorNewRoute<TAllocator>::route);
+}
+
+/**
+ * @brief Stops routing operator new/delete into the global allocator; see
+ * set_new_route().
+ *
+ * @tparam TAllocator Type of the allocator implementation class.
+ */
+template <typename TAllocator>
+inline void retire_global_new() {
+  set_new_route(nullptr);
+  GlobalAllocator<TAllocator>::cleanup();
+}
+
+} // namespace global
+} // namespace allok8or
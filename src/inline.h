@@ -0,0 +1,231 @@
+/**
+ * @file inline.h
+ * @brief Header for an allocator that serves allocations from an embedded
+ * buffer, falling back to another allocator once the buffer is exhausted.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "align.h"
+#include "allocator.h"
+#include "std_allocator_adapter.h"
+
+// Library headers
+#include <cassert>
+#include <cstddef>
+
+namespace allok8or {
+
+/**
+ * @brief Allocator with an N-byte inline buffer, for small containers that
+ * should not touch the heap in the common case.
+ *
+ * Allocations are carved linearly from the buffer. Once it's exhausted,
+ * allocations go to the fallback allocator. Memory in the buffer is reused
+ * only when the most recent allocation is deallocated (stack order), or when
+ * the allocator is reset; that's enough for typical container growth.
+ *
+ * Use with StdAllocatorAdapter (see ShortAllocator) in the style of Howard
+ * Hinnant's short_alloc: the InlineAllocator is the arena, usually a local
+ * variable next to the container, and the adapter is the handle.
+ *
+ * NOTE: This allocator cannot be copied or moved; it must be shared.
+ *
+ * @tparam N Size of the inline buffer in bytes.
+ * @tparam TFallbackAllocator Type of the allocator used when the buffer is
+ * exhausted; must be an allok8or::Allocator-derived class.
+ */
+template <size_t N, typename TFallbackAllocator>
+class InlineAllocator
+    : public Allocator<InlineAllocator<N, TFallbackAllocator>> {
+public:
+  explicit InlineAllocator(Allocator<TFallbackAllocator>& fallback);
+  ~InlineAllocator() {}
+
+  // No copies; containers hold pointers into the buffer.
+  InlineAllocator(const InlineAllocator&) = delete;
+  InlineAllocator& operator=(const InlineAllocator&) = delete;
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t size, size_t alignment) const;
+  bool try_expand_in_place(void* user_data, size_t new_size) const;
+
+  bool owns(const void* user_data) const;
+  void reset() const;
+
+  // Accessors
+  static constexpr size_t capacity() { return N; }
+  size_t used() const { return static_cast<size_t>(m_cursor - m_buffer); }
+  TFallbackAllocator& fallback() const { return m_fallback; }
+
+private:
+  alignas(std::max_align_t) char m_buffer[N];
+
+  // mutable required because all Allocator<T>-derived classes must have
+  // const API.
+  mutable char* m_cursor;
+  mutable char* m_last; // Most recent inline allocation, if still known.
+
+  TFallbackAllocator& m_fallback;
+};
+
+/**
+ * @brief StdAllocatorAdapter over an InlineAllocator: a short_alloc-style
+ * handle to an inline arena.
+ *
+ * Example:
+ * @code
+ *   InlineAllocator<256, PassThroughAllocator> arena(pass_through);
+ *   std::vector<int, ShortAllocator<int, 256, PassThroughAllocator>> v(
+ *       ShortAllocator<int, 256, PassThroughAllocator>(arena));
+ *   v.reserve(16); // No heap allocation.
+ * @endcode
+ */
+template <typename T, size_t N, typename TFallbackAllocator>
+using ShortAllocator =
+    StdAllocatorAdapter<T, InlineAllocator<N, TFallbackAllocator>>;
+
+template <size_t N, typename TFallbackAllocator>
+bool operator==(const InlineAllocator<N, TFallbackAllocator>& lhs,
+                const InlineAllocator<N, TFallbackAllocator>& rhs) {
+  return &lhs == &rhs;
+}
+
+template <size_t N, typename TFallbackAllocator>
+bool operator!=(const InlineAllocator<N, TFallbackAllocator>& lhs,
+                const InlineAllocator<N, TFallbackAllocator>& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Constructor
+ *
+ * @tparam N Size of the inline buffer in bytes.
+ * @tparam TFallbackAllocator Type of the fallback allocator.
+ * @param fallback Allocator used once the inline buffer is exhausted.
+ */
+template <size_t N, typename TFallbackAllocator>
+InlineAllocator<N, TFallbackAllocator>::InlineAllocator(
+    Allocator<TFallbackAllocator>& fallback)
+    : m_cursor(m_buffer),
+      m_last(nullptr),
+      m_fallback(static_cast<TFallbackAllocator&>(fallback)) {}
+
+/**
+ * @brief Allocates from the inline buffer if there is room, otherwise from the
+ * fallback allocator.
+ *
+ * @param size The number of bytes to allocate.
+ * @param alignment Alignment of the returned memory; must be a power of 2.
+ * @return void* Pointer to the allocated memory.
+ */
+template <size_t N, typename TFallbackAllocator>
+void* InlineAllocator<N, TFallbackAllocator>::allocate(
+    size_t size, size_t alignment) const {
+  auto start =
+      static_cast<char*>(align::get_next_aligned_address(m_cursor, alignment));
+  if (start <= m_buffer + N &&
+      static_cast<size_t>(m_buffer + N - start) >= size) {
+    m_cursor = start + size;
+    m_last = start;
+    return start;
+  }
+
+  return m_fallback.allocate(size, alignment);
+}
+
+/**
+ * @brief Deallocates memory. Inline memory is reclaimed only if it is the most
+ * recent allocation; fallback memory is returned to the fallback allocator.
+ *
+ * @param user_data Pointer to the memory to deallocate.
+ */
+template <size_t N, typename TFallbackAllocator>
+void InlineAllocator<N, TFallbackAllocator>::deallocate(void* user_data) const {
+  if (!owns(user_data)) {
+    m_fallback.deallocate(user_data);
+    return;
+  }
+
+  if (user_data == m_last) {
+    m_cursor = m_last;
+    m_last = nullptr;
+  }
+}
+
+/**
+ * @brief Deallocates memory whose size is known. Inline memory is reclaimed if
+ * it ends at the current position in the buffer (stack order).
+ *
+ * @param user_data Pointer to the memory to deallocate.
+ * @param size Size of the memory as originally requested.
+ * @param alignment Alignment of the memory as originally requested.
+ */
+template <size_t N, typename TFallbackAllocator>
+void InlineAllocator<N, TFallbackAllocator>::deallocate(
+    void* user_data, size_t size, size_t alignment) const {
+  if (!owns(user_data)) {
+    static_cast<Allocator<TFallbackAllocator>&>(m_fallback)
+        .deallocate(user_data, size, alignment);
+    return;
+  }
+
+  auto block = static_cast<char*>(user_data);
+  if (block + size == m_cursor) {
+    m_cursor = block;
+    m_last = nullptr;
+  }
+}
+
+/**
+ * @brief Grows or shrinks the most recent inline allocation without moving it,
+ * if the buffer has room. Fallback memory is left to the fallback allocator.
+ *
+ * @param user_data Block to resize.
+ * @param new_size Requested new size of the block.
+ * @return true If the block was resized.
+ * @return false Otherwise.
+ */
+template <size_t N, typename TFallbackAllocator>
+bool InlineAllocator<N, TFallbackAllocator>::try_expand_in_place(
+    void* user_data, size_t new_size) const {
+  if (!owns(user_data)) {
+    return static_cast<Allocator<TFallbackAllocator>&>(m_fallback)
+        .try_expand_in_place(user_data, new_size);
+  }
+
+  auto block = static_cast<char*>(user_data);
+  if (block != m_last || static_cast<size_t>(m_buffer + N - block) < new_size) {
+    return false;
+  }
+
+  m_cursor = block + new_size;
+  return true;
+}
+
+/**
+ * @brief Returns true if the memory is in the inline buffer.
+ */
+template <size_t N, typename TFallbackAllocator>
+bool InlineAllocator<N, TFallbackAllocator>::owns(const void* user_data) const {
+  auto data = static_cast<const char*>(user_data);
+  return data >= m_buffer && data < m_buffer + N;
+}
+
+/**
+ * @brief Makes the whole inline buffer available again.
+ *
+ * NOTE: Any inline memory still in use becomes invalid. Fallback memory is not
+ * affected.
+ */
+template <size_t N, typename TFallbackAllocator>
+void InlineAllocator<N, TFallbackAllocator>::reset() const {
+  m_cursor = const_cast<char*>(m_buffer);
+  m_last = nullptr;
+}
+
+} // namespace allok8or
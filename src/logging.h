@@ -62,31 +62,6 @@ private:
   static int s_level;
 };
 
-//
-// Static inits.
-//
-LogFunc Logger::s_log_callback = nullptr;
-int Logger::s_level = Logger::invalid;
-
-/**
- * @brief Set the callback function.
- *
- * NOTE: Call this with (nullptr) if already set and you want to change it.
- * NOTE: Not thread safe.
- *
- * @param log_func Function pointer to set as the log callback.
- * @return true If callback is not already set.
- * @return false If callback is already set.
- */
-bool Logger::register_callback(LogFunc log_func) {
-  if (!s_log_callback || log_func == nullptr) {
-    s_log_callback = log_func;
-    return true;
-  }
-
-  return false;
-}
-
 /**
  * @brief Call the log callback if it is set.
  *
@@ -8,18 +8,33 @@
 
 #ifdef _MSC_VER
 #include <malloc.h>
+#include <windows.h>
 #else
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 namespace allok8or {
 namespace memory {
 
+/**
+ * Allocate memory with the given alignment from the system heap.
+ *
+ * NOTE: For alignments that malloc guarantees anyway, this is plain malloc,
+ * which is faster than posix_memalign and accepts alignments smaller than
+ * sizeof(void*). Must be freed with aligned_free.
+ */
 void* aligned_malloc(size_t size, size_t align) {
   void* memory;
 #ifdef _MSC_VER
   memory = _aligned_malloc(size, align);
 #else
+  if (align <= alignof(max_align_t)) {
+    return malloc(size);
+  }
+
   if (posix_memalign(&memory, align, size)) {
     memory = nullptr;
   }
@@ -27,6 +42,33 @@ void* aligned_malloc(size_t size, size_t align) {
   return memory;
 }
 
+/**
+ * Resize memory allocated by aligned_malloc, preserving its contents.
+ *
+ * NOTE: For alignments that malloc guarantees anyway, this is plain realloc,
+ * which can grow in place (and uses mremap for large mmap'd blocks on glibc).
+ */
+void* aligned_realloc(void* memory,
+                      size_t old_size,
+                      size_t new_size,
+                      size_t align) {
+#ifdef _MSC_VER
+  (void)old_size;
+  return _aligned_realloc(memory, new_size, align);
+#else
+  if (align <= alignof(max_align_t)) {
+    return realloc(memory, new_size);
+  }
+
+  void* new_memory = aligned_malloc(new_size, align);
+  if (new_memory && memory) {
+    memcpy(new_memory, memory, old_size < new_size ? old_size : new_size);
+    free(memory);
+  }
+  return new_memory;
+#endif
+}
+
 void aligned_free(void* memory) {
 #ifdef _MSC_VER
   _aligned_free(memory);
@@ -34,5 +76,49 @@ void aligned_free(void* memory) {
   free(memory);
 #endif
 }
+/**
+ * Returns the granularity of map_pages.
+ */
+size_t system_page_size() {
+#ifdef _MSC_VER
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+#else
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+/**
+ * Map zeroed pages directly from the OS, bypassing the heap.
+ *
+ * NOTE: Never calls malloc, so it's safe to use from inside a malloc
+ * implementation.
+ */
+void* map_pages(size_t size) {
+#ifdef _MSC_VER
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* memory = mmap(
+      nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return memory == MAP_FAILED ? nullptr : memory;
+#endif
+}
+
+/**
+ * Return pages from map_pages to the OS.
+ *
+ * NOTE: On POSIX any page-aligned sub-range may be unmapped; on Windows only
+ * whole mappings, with the size ignored.
+ */
+void unmap_pages(void* memory, size_t size) {
+#ifdef _MSC_VER
+  (void)size;
+  VirtualFree(memory, 0, MEM_RELEASE);
+#else
+  munmap(memory, size);
+#endif
+}
+
 } // namespace memory
 } // namespace allok8or
@@ -13,8 +13,13 @@ namespace allok8or {
 namespace memory {
 
 void* aligned_malloc(size_t size, size_t align);
+void* aligned_realloc(void* ptr, size_t old_size, size_t new_size, size_t align);
 void aligned_free(void *ptr);
 
+size_t system_page_size();
+void* map_pages(size_t size);
+void unmap_pages(void* ptr, size_t size);
+
 }
 
 }
\ No newline at end of file
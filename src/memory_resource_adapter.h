@@ -0,0 +1,98 @@
+/**
+ * @file memory_resource_adapter.h
+ * @brief Adapter to expose allok8or::Allocator<T> as std::pmr::memory_resource.
+ *
+ * NOTE: Requires C++17; link against the optional allok8or-pmr target.
+ */
+#pragma once
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "memory_resource_adapter.h requires C++17; link against allok8or-pmr."
+#endif
+
+// Project headers
+#include "allocator.h"
+
+// Library headers
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+
+namespace allok8or {
+
+/**
+ * @brief Adapter class to expose allok8or::Allocator as a polymorphic memory
+ * resource, for use with std::pmr containers.
+ *
+ * Size and alignment are passed through to the backing allocator on both
+ * allocation and deallocation.
+ *
+ * NOTE: The backing allocator is held by reference and must outlive the
+ * adapter.
+ *
+ * @tparam TAllocator Type of the backing allocator; must be an
+ * allok8or::Allocator-derived class.
+ */
+template <typename TAllocator>
+class MemoryResourceAdapter : public std::pmr::memory_resource {
+public:
+  using allocator_type = TAllocator;
+
+  MemoryResourceAdapter() = delete;
+
+  /**
+   * @brief Ctor that takes the backing allocator.
+   *
+   * @param allocator Allocator instance to be used as the backing allocator.
+   */
+  explicit MemoryResourceAdapter(Allocator<allocator_type>& allocator) noexcept
+      : m_allocator(static_cast<allocator_type&>(allocator)) {}
+
+  allocator_type& allocator() const noexcept { return m_allocator; }
+
+private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void* memory = base().allocate(bytes, alignment);
+    if (!memory) {
+      throw std::bad_alloc();
+    }
+    return memory;
+  }
+
+  void do_deallocate(void* memory,
+                     std::size_t bytes,
+                     std::size_t alignment) override {
+    base().deallocate(memory, bytes, alignment);
+  }
+
+  /**
+   * @brief Resources are equal if they are the same object, or adapters of
+   * equal allocators. Stateless allocators are always equal, so adapters of the
+   * same type need no further comparison.
+   */
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    if (this == &other) {
+      return true;
+    }
+
+    if (typeid(other) != typeid(*this)) {
+      return false;
+    }
+
+    if (std::is_empty<allocator_type>::value) {
+      return true;
+    }
+
+    return static_cast<const MemoryResourceAdapter&>(other).m_allocator ==
+           m_allocator;
+  }
+
+  Allocator<allocator_type>& base() const { return m_allocator; }
+
+  allocator_type& m_allocator;
+};
+
+} // namespace allok8or
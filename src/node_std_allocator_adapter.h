@@ -0,0 +1,275 @@
+/**
+ * @file node_std_allocator_adapter.h
+ * @brief Adaptor to expose allok8or::Allocator<T> as std::allocator, serving
+ * single-node allocations from fixed-size pools.
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+#include "block_allocator.h"
+#include "page.h"
+
+// Library headers
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace allok8or {
+
+/**
+ * @brief Set of BlockAllocators, one per node size and alignment, shared by all
+ * NodeStdAllocatorAdapters created from it.
+ *
+ * Pools are created on demand (the first time a node of a given size is
+ * allocated) and live until the set is destroyed. Node types with the same size
+ * and alignment share a pool.
+ *
+ * NOTE: This class cannot be copied; it must be shared.
+ * TODO: Not thread safe.
+ *
+ * @tparam TBackingAllocator Type of the allocator used for array allocations,
+ * and for the pools themselves.
+ */
+template <typename TBackingAllocator>
+class NodePoolSet {
+public:
+  NodePoolSet(Allocator<TBackingAllocator>& allocator,
+              PageAllocator& page_allocator);
+  ~NodePoolSet();
+
+  // No copies; share this when appropriate.
+  NodePoolSet(const NodePoolSet&) = delete;
+  NodePoolSet& operator=(const NodePoolSet&) = delete;
+
+  template <size_t TSize, size_t TAlign>
+  BlockAllocator<TSize, TAlign>* pool() const;
+
+  // Accessors
+  Allocator<TBackingAllocator>& allocator() const { return m_allocator; }
+  PageAllocator& page_allocator() const { return m_page_allocator; }
+  size_t num_pools() const;
+
+private:
+  struct PoolEntry {
+    size_t size;
+    size_t alignment;
+    void* pool;
+    void (*destroy)(void* pool);
+    PoolEntry* next;
+  };
+
+  template <typename TPool>
+  static void destroy(void* pool) {
+    static_cast<TPool*>(pool)->~TPool();
+  }
+
+  TBackingAllocator& m_allocator;
+  PageAllocator& m_page_allocator;
+
+  // mutable because pools are created on demand through a const API.
+  mutable PoolEntry* m_pools;
+};
+
+/**
+ * @brief Constructor.
+ *
+ * @param allocator Allocator for array allocations and pool bookkeeping.
+ * @param page_allocator Allocator that supplies the pages for the pools.
+ */
+template <typename TBackingAllocator>
+NodePoolSet<TBackingAllocator>::NodePoolSet(
+    Allocator<TBackingAllocator>& allocator, PageAllocator& page_allocator)
+    : m_allocator(static_cast<TBackingAllocator&>(allocator)),
+      m_page_allocator(page_allocator),
+      m_pools(nullptr) {}
+
+/**
+ * @brief Destructor. Destroys all pools, returning their pages.
+ */
+template <typename TBackingAllocator>
+NodePoolSet<TBackingAllocator>::~NodePoolSet() {
+  while (m_pools) {
+    auto entry = m_pools;
+    m_pools = entry->next;
+
+    entry->destroy(entry->pool);
+    m_allocator.deallocate(entry->pool);
+    m_allocator.deallocate(entry);
+  }
+}
+
+/**
+ * @brief Returns the pool for blocks of the given size and alignment, creating
+ * it if necessary.
+ *
+ * @tparam TSize Size of the blocks.
+ * @tparam TAlign Alignment of the blocks.
+ * @return BlockAllocator<TSize, TAlign>* The pool, or nullptr if out of memory.
+ */
+template <typename TBackingAllocator>
+template <size_t TSize, size_t TAlign>
+BlockAllocator<TSize, TAlign>* NodePoolSet<TBackingAllocator>::pool() const {
+  using PoolT = BlockAllocator<TSize, TAlign>;
+
+  for (auto entry = m_pools; entry; entry = entry->next) {
+    if (entry->size == TSize && entry->alignment == TAlign) {
+      return static_cast<PoolT*>(entry->pool);
+    }
+  }
+
+  auto entry = static_cast<PoolEntry*>(
+      m_allocator.allocate(sizeof(PoolEntry), alignof(std::max_align_t)));
+  auto memory =
+      m_allocator.allocate(sizeof(PoolT), alignof(std::max_align_t));
+  if (!entry || !memory) {
+    // Not every backing allocator accepts nullptr.
+    if (entry) {
+      m_allocator.deallocate(entry);
+    }
+    if (memory) {
+      m_allocator.deallocate(memory);
+    }
+    return nullptr;
+  }
+
+  entry->size = TSize;
+  entry->alignment = TAlign;
+  entry->pool = ::new (memory) PoolT(m_page_allocator);
+  entry->destroy = &destroy<PoolT>;
+  entry->next = m_pools;
+  m_pools = entry;
+
+  return static_cast<PoolT*>(entry->pool);
+}
+
+/**
+ * @brief Returns the number of pools created so far.
+ */
+template <typename TBackingAllocator>
+size_t NodePoolSet<TBackingAllocator>::num_pools() const {
+  size_t count = 0;
+  for (auto entry = m_pools; entry; entry = entry->next) {
+    ++count;
+  }
+  return count;
+}
+
+/**
+ * @brief Adapter class to expose allok8or::Allocator as std::allocator, for
+ * node-based containers (std::map, std::list, std::unordered_map, ...).
+ *
+ * Allocations of a single object are served from a BlockAllocator sized for
+ * value_type; node-based containers rebind to their node type, so each node
+ * comes from a pool instead of the general allocator. Allocations of more than
+ * one object (e.g. hash table buckets) go to the backing allocator.
+ *
+ * NOTE: The NodePoolSet is *shared* on copy/move and rebind.
+ * NOTE: Array allocations use alignof(T), like StdAllocatorAdapter.
+ *
+ * @tparam T Type of data to be allocated/deallocated.
+ * @tparam TBackingAllocator Type of the backing allocator of the NodePoolSet.
+ * NOTE: Must have const API.
+ */
+template <typename T, typename TBackingAllocator>
+class NodeStdAllocatorAdapter {
+public:
+  using value_type = T;
+  using backing_allocator_type = TBackingAllocator;
+  using pool_type = BlockAllocator<sizeof(T), alignof(T)>;
+
+  template <typename U>
+  struct rebind {
+    using other = NodeStdAllocatorAdapter<U, TBackingAllocator>;
+  };
+
+  // We can't guarantee that backing allocators will be default-constructible.
+  NodeStdAllocatorAdapter() = delete;
+
+  /**
+   * @brief Ctor that takes the set of pools to allocate nodes from.
+   *
+   * @param pools Pools for single-node allocations.
+   */
+  explicit NodeStdAllocatorAdapter(
+      NodePoolSet<backing_allocator_type>& pools) noexcept
+      : m_pools(&pools), m_pool(nullptr) {}
+
+  template <typename U>
+  NodeStdAllocatorAdapter(
+      const NodeStdAllocatorAdapter<U, backing_allocator_type>& other) noexcept
+      : m_pools(&other.pools()), m_pool(nullptr) {}
+
+  value_type* allocate(std::size_t count) {
+    void* user_data = nullptr;
+    if (count == 1) {
+      auto node_pool = pool();
+      user_data = node_pool ? node_pool->allocate() : nullptr;
+    } else {
+      user_data = allocator().allocate(count * sizeof(value_type),
+                                       alignof(value_type));
+    }
+
+    if (!user_data) {
+      throw std::bad_alloc();
+    }
+    return static_cast<value_type*>(user_data);
+  }
+
+  void deallocate(value_type* user_data, std::size_t count) noexcept {
+    if (count == 1) {
+      pool()->deallocate(user_data);
+    } else {
+      allocator().deallocate(user_data,
+                             count * sizeof(value_type),
+                             alignof(value_type));
+    }
+  }
+
+  NodePoolSet<backing_allocator_type>& pools() const { return *m_pools; }
+  Allocator<backing_allocator_type>& allocator() const {
+    return m_pools->allocator();
+  }
+
+  // See
+  // https://foonathan.net/blog/2015/10/05/allocatorawarecontainer-propagation-pitfalls.html
+  using propagate_on_container_copy_assignment =
+      std::true_type; // for consistency
+  using propagate_on_container_move_assignment =
+      std::true_type; // to avoid the pessimization
+  using propagate_on_container_swap =
+      std::true_type; // to avoid the undefined behavior
+
+  // Pools are per NodePoolSet, so adapters are never interchangeable by type.
+  using is_always_equal = std::false_type;
+
+private:
+  // The pool is looked up on first use rather than on rebind; containers
+  // rebind freely, often to types they never allocate.
+  pool_type* pool() {
+    if (!m_pool) {
+      m_pool = m_pools->template pool<sizeof(T), alignof(T)>();
+    }
+    return m_pool;
+  }
+
+  // Pointer rather than reference, so that containers can assign adapters.
+  NodePoolSet<backing_allocator_type>* m_pools;
+  pool_type* m_pool;
+};
+
+template <typename T, typename U, typename TBackingAllocator>
+bool operator==(
+    NodeStdAllocatorAdapter<T, TBackingAllocator> const& lhs,
+    NodeStdAllocatorAdapter<U, TBackingAllocator> const& rhs) noexcept {
+  return &lhs.pools() == &rhs.pools();
+}
+
+template <typename T, typename TBackingAllocator, typename U>
+bool operator!=(
+    NodeStdAllocatorAdapter<T, TBackingAllocator> const& lhs,
+    NodeStdAllocatorAdapter<U, TBackingAllocator> const& rhs) noexcept {
+  return !(lhs == rhs);
+}
+
+} // namespace allok8or
@@ -105,6 +105,17 @@ void PageAllocator::deallocate(void* page) {
   add_page(header);
 }
 
+/**
+ * Returns the number of bytes of user data guaranteed to be available in each
+ * page, after the page header and alignment padding.
+ */
+size_t PageAllocator::user_data_size() {
+  const size_t worst_case_offset = sizeof(PageHeader) + m_alignment - 1;
+  assert(m_page_size > worst_case_offset);
+
+  return m_page_size - worst_case_offset;
+}
+
 /**
  * Returns the aligned starting address of the given page's user data given the
  * page header address.
@@ -35,6 +35,7 @@ public:
   int cleanup();
 
   size_t page_size();
+  size_t user_data_size();
   int num_pages();
   int num_free_pages();
 
@@ -16,6 +16,16 @@ void* PassThroughAllocator::allocate(
   return memory::aligned_malloc(bytes, alignment);
 }
 
+/**
+ * Resize memory from the system heap, in place if the heap allows it.
+ */
+void* PassThroughAllocator::reallocate(void* memory,
+                                       size_t old_size,
+                                       size_t new_size,
+                                       size_t alignment) const {
+  return memory::aligned_realloc(memory, old_size, new_size, alignment);
+}
+
 /**
  * Returns memory to the system heap.
  */
@@ -25,6 +25,10 @@ public:
 
   // Public API
   void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
   void deallocate(void* user_data) const;
 };
 
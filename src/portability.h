@@ -21,4 +21,14 @@
   #define ALK8_PRETTY_FUNCTION __PRETTY_FUNCTION__
 #elif defined(__GNUC__)
   #define ALK8_PRETTY_FUNCTION __PRETTY_FUNCTION__
-#endif
\ No newline at end of file
+#endif
+
+// Keeps a function out of line, e.g. so that it has its own stack frame.
+#if defined(_MSC_VER)
+  #define ALK8_NOINLINE __declspec(noinline)
+#else
+  #define ALK8_NOINLINE __attribute__((noinline))
+#endif
+
+// Assumed size of a cache line, for keeping independently written data apart.
+#define ALK8_CACHE_LINE_SIZE 64
@@ -0,0 +1,225 @@
+/**
+ * @file preload.cpp
+ * @brief malloc family replacements for liballok8or_preload.so, backed by a
+ * SizeClassAllocator with per-thread caches.
+ *
+ * Usage: LD_PRELOAD=/path/to/liballok8or_preload.so some_program
+ *
+ * The allocator is constant-initialized and maps its memory straight from the
+ * OS, so these functions work from the first call the dynamic loader or libc
+ * makes, before any static constructor runs. Nothing here calls dlsym or
+ * forwards to the libc allocator, so there is no recursion through dlsym's own
+ * use of calloc.
+ *
+ * NOTE: Built only into the allok8or-preload shared library, never
+ * allok8or-core.
+ *
+ */
+
+// Project headers
+#include "size_class.h"
+
+// Library headers
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define ALK8_EXPORT extern "C" __attribute__((visibility("default")))
+
+using allok8or::SizeClassAllocator;
+
+namespace {
+
+SizeClassAllocator s_allocator;
+
+// Per-thread state; initial-exec so that access never allocates.
+enum ThreadState { UNREGISTERED = 0, REGISTERING, REGISTERED, EXITED };
+
+__thread SizeClassAllocator::ThreadCache t_cache
+    __attribute__((tls_model("initial-exec")));
+__thread int t_state __attribute__((tls_model("initial-exec")));
+
+// The key whose destructor flushes a thread's cache when it exits.
+enum KeyState { KEY_NONE = 0, KEY_CREATING, KEY_CREATED };
+std::atomic<int> s_key_state{KEY_NONE};
+pthread_key_t s_key;
+
+void on_thread_exit(void*) {
+  s_allocator.flush(t_cache);
+  t_state = EXITED;
+}
+
+bool create_key() {
+  int state = s_key_state.load(std::memory_order_acquire);
+  while (state != KEY_CREATED) {
+    int expected = KEY_NONE;
+    if (s_key_state.compare_exchange_strong(expected, KEY_CREATING)) {
+      if (pthread_key_create(&s_key, &on_thread_exit)) {
+        s_key_state.store(KEY_NONE, std::memory_order_release);
+        return false;
+      }
+      s_key_state.store(KEY_CREATED, std::memory_order_release);
+      return true;
+    }
+    sched_yield();
+    state = s_key_state.load(std::memory_order_acquire);
+  }
+  return true;
+}
+
+/**
+ * Returns the calling thread's cache, or nullptr if the central bins must be
+ * used: while the cache is being registered (pthread_setspecific may itself
+ * call calloc) and after the thread's cache has been flushed on exit.
+ */
+SizeClassAllocator::ThreadCache* thread_cache() {
+  if (t_state == REGISTERED) {
+    return &t_cache;
+  }
+  if (t_state != UNREGISTERED) {
+    return nullptr;
+  }
+
+  t_state = REGISTERING;
+  if (!create_key() || pthread_setspecific(s_key, &t_cache)) {
+    // No way to flush on exit; don't cache.
+    t_state = EXITED;
+    return nullptr;
+  }
+  t_state = REGISTERED;
+  return &t_cache;
+}
+
+inline bool is_power_of_2(size_t value) {
+  return value && !(value & (value - 1));
+}
+
+void* allocate(size_t size, size_t alignment) {
+  auto cache = thread_cache();
+  void* memory = cache ? s_allocator.allocate(*cache, size, alignment)
+                       : s_allocator.allocate(size, alignment);
+  if (!memory) {
+    errno = ENOMEM;
+  }
+  return memory;
+}
+
+} // namespace
+
+ALK8_EXPORT void* malloc(size_t size) noexcept {
+  return allocate(size, SizeClassAllocator::MIN_ALIGNMENT);
+}
+
+ALK8_EXPORT void free(void* memory) noexcept {
+  if (!memory) {
+    return;
+  }
+
+  auto cache = thread_cache();
+  if (cache) {
+    s_allocator.deallocate(*cache, memory);
+  } else {
+    s_allocator.deallocate(memory);
+  }
+}
+
+ALK8_EXPORT void* calloc(size_t count, size_t size) noexcept {
+  if (size && count > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+
+  auto memory = allocate(count * size, SizeClassAllocator::MIN_ALIGNMENT);
+  if (memory) {
+    memset(memory, 0, count * size);
+  }
+  return memory;
+}
+
+ALK8_EXPORT void* realloc(void* memory, size_t size) noexcept {
+  if (memory && !size) {
+    free(memory);
+    return nullptr;
+  }
+
+  auto cache = thread_cache();
+  void* resized =
+      cache ? s_allocator.reallocate(*cache, memory, size)
+            : s_allocator.reallocate(memory,
+                                     s_allocator.usable_size(memory),
+                                     size,
+                                     SizeClassAllocator::MIN_ALIGNMENT);
+  if (!resized) {
+    errno = ENOMEM;
+  }
+  return resized;
+}
+
+ALK8_EXPORT void* reallocarray(void* memory, size_t count, size_t size) noexcept {
+  if (size && count > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(memory, count * size);
+}
+
+ALK8_EXPORT void* memalign(size_t alignment, size_t size) noexcept {
+  if (!is_power_of_2(alignment)) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return allocate(size, alignment);
+}
+
+ALK8_EXPORT void* aligned_alloc(size_t alignment, size_t size) noexcept {
+  return memalign(alignment, size);
+}
+
+ALK8_EXPORT int posix_memalign(void** result,
+                               size_t alignment,
+                               size_t size) noexcept {
+  if (!is_power_of_2(alignment) || alignment % sizeof(void*)) {
+    return EINVAL;
+  }
+
+  auto cache = thread_cache();
+  void* memory = cache ? s_allocator.allocate(*cache, size, alignment)
+                       : s_allocator.allocate(size, alignment);
+  if (!memory) {
+    return ENOMEM;
+  }
+
+  *result = memory;
+  return 0;
+}
+
+ALK8_EXPORT void* valloc(size_t size) noexcept {
+  return allocate(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+}
+
+ALK8_EXPORT void* pvalloc(size_t size) noexcept {
+  const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return allocate((size + page_size - 1) & ~(page_size - 1), page_size);
+}
+
+ALK8_EXPORT size_t malloc_usable_size(void* memory) noexcept {
+  return s_allocator.usable_size(memory);
+}
+
+/**
+ * Returns the calling thread's cached blocks to the central bins, then empty
+ * slabs and cached large spans to the OS. Returns 1 if any memory was
+ * returned, else 0.
+ *
+ * NOTE: Other threads' cached blocks keep their slabs.
+ */
+ALK8_EXPORT int malloc_trim(size_t) noexcept {
+  if (t_state == REGISTERED) {
+    s_allocator.flush(t_cache);
+  }
+  return s_allocator.trim() ? 1 : 0;
+}
@@ -0,0 +1,316 @@
+/**
+ * @file ring.h
+ * @brief Header for a ring-buffer allocator for FIFO-lifetime allocations.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "align.h"
+#include "allocator.h"
+#include "page.h"
+#include "portability.h"
+
+// Library headers
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace allok8or {
+namespace ring {
+
+/**
+ * @brief Wait policy: allocate() returns nullptr if the ring is full.
+ */
+struct NonBlocking {
+  static bool wait() { return false; }
+};
+
+/**
+ * @brief Wait policy: allocate() yields until the consumer frees enough space.
+ *
+ * NOTE: Only useful when another thread deallocates; a single thread that
+ * fills the ring and then blocks will wait forever.
+ */
+struct Blocking {
+  static bool wait() {
+    std::this_thread::yield();
+    return true;
+  }
+};
+
+} // namespace ring
+
+/**
+ * @brief Allocator for data that is freed in (roughly) the order it was
+ * allocated, such as log and message staging buffers.
+ *
+ * Allocates from the head of a fixed region (one page from a PageAllocator)
+ * and frees from the tail. A block freed out of order is only marked free; the
+ * tail advances past it once every block before it has been freed too. There
+ * is no fragmentation: the ring is always one contiguous used span.
+ *
+ * Safe for one producer thread (allocate) and one consumer thread
+ * (deallocate) at a time; a single thread may also do both.
+ *
+ * NOTE: This allocator cannot be copied; it must be shared.
+ *
+ * @tparam TWaitPolicy What allocate() does when the ring is full:
+ * ring::NonBlocking or ring::Blocking.
+ */
+template <typename TWaitPolicy = ring::NonBlocking>
+class RingAllocator : public Allocator<RingAllocator<TWaitPolicy>> {
+public:
+  explicit RingAllocator(PageAllocator& page_allocator);
+  ~RingAllocator();
+
+  // No copies; share this when appropriate.
+  RingAllocator(const RingAllocator&) = delete;
+  RingAllocator& operator=(const RingAllocator&) = delete;
+
+  // Public API
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const;
+  void deallocate(void* user_data) const;
+
+  // Accessors
+  size_t capacity() const { return m_capacity; }
+  size_t used() const {
+    return m_head.value.load(std::memory_order_acquire) -
+           m_tail.value.load(std::memory_order_acquire);
+  }
+
+private:
+  // Every block starts with this header, on a granularity boundary.
+  struct Block {
+    size_t span; // Bytes from this header to the next one.
+    std::atomic<size_t> state;
+  };
+
+  static const size_t GRANULARITY = alignof(std::max_align_t);
+  static const size_t HEADER_SIZE = GRANULARITY;
+  static_assert(sizeof(Block) <= HEADER_SIZE, "Block header too large");
+
+  // Keeps the producer's and consumer's offsets on separate cache lines.
+  struct Offset {
+    std::atomic<size_t> value;
+    char padding[ALK8_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+  };
+
+  static const size_t USED = 1;
+  static const size_t FREE = 2;
+
+  Block* block_at(size_t position) const {
+    return reinterpret_cast<Block*>(m_region + position);
+  }
+
+  size_t padding(size_t position, size_t alignment) const;
+  void write_block(size_t position, size_t span, size_t state) const;
+  void reclaim() const;
+
+  PageAllocator& m_page_allocator;
+  char* m_region;
+  size_t m_capacity;
+
+  // Offsets increase monotonically; the position in the region is
+  // offset % capacity.
+  mutable Offset m_head; // Written by the producer only.
+  mutable Offset m_tail; // Written by the consumer, or by the producer when
+                         // the ring is empty.
+};
+
+template <typename TWaitPolicy>
+bool operator==(const RingAllocator<TWaitPolicy>& lhs,
+                const RingAllocator<TWaitPolicy>& rhs) {
+  return &lhs == &rhs;
+}
+
+template <typename TWaitPolicy>
+bool operator!=(const RingAllocator<TWaitPolicy>& lhs,
+                const RingAllocator<TWaitPolicy>& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * @brief Constructor. Borrows one page from the PageAllocator for the ring.
+ *
+ * @tparam TWaitPolicy What allocate() does when the ring is full.
+ * @param page_allocator Source of the ring's memory. Its pages must be aligned
+ * to at least alignof(std::max_align_t).
+ */
+template <typename TWaitPolicy>
+RingAllocator<TWaitPolicy>::RingAllocator(PageAllocator& page_allocator)
+    : m_page_allocator(page_allocator),
+      m_region(static_cast<char*>(page_allocator.allocate())),
+      m_capacity(0) {
+  m_head.value.store(0, std::memory_order_relaxed);
+  m_tail.value.store(0, std::memory_order_relaxed);
+
+  if (m_region) {
+    assert(reinterpret_cast<uintptr_t>(m_region) % GRANULARITY == 0);
+    m_capacity = page_allocator.user_data_size() / GRANULARITY * GRANULARITY;
+  }
+}
+
+/**
+ * @brief Destructor. Returns the ring's page to the PageAllocator.
+ *
+ * NOTE: Blocks still in use are simply discarded.
+ */
+template <typename TWaitPolicy>
+RingAllocator<TWaitPolicy>::~RingAllocator() {
+  if (m_region) {
+    m_page_allocator.deallocate(m_region);
+  }
+}
+
+/**
+ * @brief Allocates a block at the head of the ring.
+ *
+ * If the block doesn't fit before the end of the region, the remainder is
+ * skipped and the block starts over at the beginning; if the ring is empty,
+ * both offsets move there instead.
+ *
+ * NOTE: Producer side.
+ *
+ * @tparam TWaitPolicy What to do when the ring is full.
+ * @param size The number of bytes to allocate.
+ * @param alignment Alignment of the returned memory; must be a power of 2.
+ * @return void* Pointer to the allocated memory, or nullptr if the ring is
+ * full (non-blocking) or the block can never fit.
+ */
+template <typename TWaitPolicy>
+void* RingAllocator<TWaitPolicy>::allocate(size_t size,
+                                           size_t alignment) const {
+  assert(alignment && !(alignment & (alignment - 1)));
+
+  if (!m_capacity) {
+    return nullptr;
+  }
+
+  const size_t span =
+      HEADER_SIZE + ((size + GRANULARITY - 1) & ~(GRANULARITY - 1));
+  size_t head = m_head.value.load(std::memory_order_relaxed);
+  size_t position = head % m_capacity;
+
+  size_t skip = 0;
+  size_t block_position = position;
+  size_t pad = padding(block_position, alignment);
+  if (pad + span > m_capacity - position) {
+    skip = m_capacity - position;
+    block_position = 0;
+    pad = padding(block_position, alignment);
+  }
+
+  if (pad + span > m_capacity) {
+    return nullptr;
+  }
+
+  // An empty ring starts over at the beginning of the region rather than
+  // skipping to it, so any block that fits the capacity fits. The consumer
+  // has nothing to free then, so moving its tail too is safe.
+  if (skip && head == m_tail.value.load(std::memory_order_acquire)) {
+    head += skip;
+    m_head.value.store(head, std::memory_order_release);
+    m_tail.value.store(head, std::memory_order_release);
+    position = 0;
+    skip = 0;
+  }
+
+  const size_t needed = skip + pad + span;
+  while (needed >
+         m_capacity - (head - m_tail.value.load(std::memory_order_acquire))) {
+    if (!TWaitPolicy::wait()) {
+      return nullptr;
+    }
+  }
+
+  if (skip) {
+    write_block(position, skip, FREE);
+  }
+  if (pad) {
+    write_block(block_position, pad, FREE);
+  }
+  write_block(block_position + pad, span, USED);
+
+  m_head.value.store(head + needed, std::memory_order_release);
+
+  return m_region + block_position + pad + HEADER_SIZE;
+}
+
+/**
+ * @brief Marks a block free, and advances the tail past every free block at
+ * the tail of the ring.
+ *
+ * NOTE: Consumer side.
+ *
+ * @tparam TWaitPolicy What allocate() does when the ring is full.
+ * @param user_data Pointer to memory returned by allocate().
+ */
+template <typename TWaitPolicy>
+void RingAllocator<TWaitPolicy>::deallocate(void* user_data) const {
+  assert(user_data >= m_region && user_data < m_region + m_capacity);
+
+  Block* block = reinterpret_cast<Block*>(static_cast<char*>(user_data) -
+                                          HEADER_SIZE);
+  assert(block->state.load(std::memory_order_relaxed) == USED);
+  block->state.store(FREE, std::memory_order_release);
+
+  reclaim();
+}
+
+/**
+ * @brief Returns the number of bytes of padding (a multiple of the
+ * granularity) needed before a block at the given position so that its user
+ * data has the given alignment.
+ */
+template <typename TWaitPolicy>
+size_t RingAllocator<TWaitPolicy>::padding(size_t position,
+                                           size_t alignment) const {
+  if (alignment <= GRANULARITY) {
+    return 0;
+  }
+
+  auto user_data = m_region + position + HEADER_SIZE;
+  auto aligned = static_cast<char*>(
+      align::get_next_aligned_address(user_data, alignment));
+  return static_cast<size_t>(aligned - user_data);
+}
+
+/**
+ * @brief Writes a block header.
+ */
+template <typename TWaitPolicy>
+void RingAllocator<TWaitPolicy>::write_block(size_t position,
+                                             size_t span,
+                                             size_t state) const {
+  assert(position % GRANULARITY == 0 && span % GRANULARITY == 0);
+  assert(position + span <= m_capacity);
+
+  Block* block = block_at(position);
+  block->span = span;
+  block->state.store(state, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Advances the tail past all free blocks at the tail of the ring.
+ */
+template <typename TWaitPolicy>
+void RingAllocator<TWaitPolicy>::reclaim() const {
+  size_t tail = m_tail.value.load(std::memory_order_relaxed);
+  const size_t head = m_head.value.load(std::memory_order_acquire);
+
+  while (tail != head) {
+    Block* block = block_at(tail % m_capacity);
+    if (block->state.load(std::memory_order_acquire) != FREE) {
+      break;
+    }
+    tail += block->span;
+  }
+
+  m_tail.value.store(tail, std::memory_order_release);
+}
+
+} // namespace allok8or
@@ -0,0 +1,875 @@
+// My header
+#include "size_class.h"
+
+// Project headers
+#include "memory.h"
+
+// Library headers
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace allok8or {
+
+namespace size_class {
+
+void SpinLock::lock() {
+  while (m_flag.test_and_set(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+/**
+ * Holds a SpinLock for the duration of a scope.
+ */
+class LockGuard {
+public:
+  explicit LockGuard(SpinLock& lock) : m_lock(lock) { m_lock.lock(); }
+  ~LockGuard() { m_lock.unlock(); }
+
+  LockGuard(const LockGuard&) = delete;
+  LockGuard& operator=(const LockGuard&) = delete;
+
+private:
+  SpinLock& m_lock;
+};
+
+} // namespace size_class
+
+using size_class::FreeBlock;
+using size_class::LockGuard;
+
+namespace {
+
+const uint32_t CHUNK_MAGIC = 0xA110C8ED;
+const uint32_t LARGE_CLASS = 0xFFFFFFFF;
+
+// Offset of the first block (or large user data) from its header.
+const size_t HEADER_SPACE = 64;
+
+// Larger alignments always take the large path, which wastes less.
+const size_t MAX_SMALL_ALIGNMENT = 4096;
+
+inline uintptr_t round_up(uintptr_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+}
+
+inline size_t page_round_up(size_t size) {
+  return round_up(size, memory::system_page_size());
+}
+
+/**
+ * Returns the index of the smallest large size class that fits `size`; four
+ * classes per power of two above 32 KiB.
+ *
+ * NOTE: `size` must not exceed MAX_CACHED_LARGE_SIZE.
+ */
+size_t large_class_index(size_t size) {
+  assert(size <= SizeClassAllocator::MAX_CACHED_LARGE_SIZE);
+  if (size <= (size_t(1) << 15)) {
+    return 0;
+  }
+
+  // size is in (2^log2, 2^(log2 + 1)].
+  size_t log2 = 0;
+  for (auto value = size - 1; value >>= 1;) {
+    ++log2;
+  }
+  const size_t shift = log2 - 2;
+  return (log2 - 15) * 4 + ((size - 1) >> shift) - 4;
+}
+
+/**
+ * Returns the mapping size of the given large size class.
+ */
+size_t large_class_size(size_t index) {
+  assert(index < SizeClassAllocator::NUM_LARGE_CLASSES);
+  const size_t log2 = 15 + index / 4;
+  return page_round_up((size_t(1) << log2) +
+                       (index % 4 + 1) * (size_t(1) << (log2 - 2)));
+}
+
+/**
+ * Returns the size to map for a large block spanning `size` bytes, header
+ * included: its class's size if it's cacheable, else whole pages.
+ */
+size_t large_map_size(size_t size) {
+  return size <= SizeClassAllocator::MAX_CACHED_LARGE_SIZE
+             ? large_class_size(large_class_index(size))
+             : page_round_up(size);
+}
+
+/**
+ * Maps at least `size` bytes starting at a CHUNK_SIZE-aligned address. The
+ * whole mapping is returned via map_start/map_size, for unmapping later.
+ */
+char* map_chunk_aligned(size_t size, void** map_start, size_t* map_size) {
+  const size_t chunk = SizeClassAllocator::CHUNK_SIZE;
+  size = page_round_up(size);
+
+  const size_t length = size + chunk;
+  auto memory = static_cast<char*>(memory::map_pages(length));
+  if (!memory) {
+    return nullptr;
+  }
+
+  auto base = reinterpret_cast<char*>(
+      round_up(reinterpret_cast<uintptr_t>(memory), chunk));
+
+#if defined(_MSC_VER)
+  // Windows can only release whole mappings; keep the slack.
+  *map_start = memory;
+  *map_size = length;
+#else
+  if (base != memory) {
+    memory::unmap_pages(memory, static_cast<size_t>(base - memory));
+  }
+  auto tail = base + size;
+  if (tail != memory + length) {
+    memory::unmap_pages(tail, static_cast<size_t>(memory + length - tail));
+  }
+  *map_start = base;
+  *map_size = size;
+#endif
+
+  return base;
+}
+
+} // namespace
+
+/**
+ * @brief Header at the CHUNK_SIZE-aligned address just below every user
+ * pointer.
+ */
+struct SizeClassAllocator::ChunkHeader {
+  uint32_t magic;
+  uint32_t size_class; // LARGE_CLASS for large allocations.
+  size_t block_size;   // Usable size of each block, or of the large block.
+  char* data;          // First block, or the large block.
+  size_t alignment;    // Alignment of a large block.
+  void* map_start;
+  size_t map_size;
+  ChunkHeader* next; // Next slab in the same bin, or span in the cache.
+  size_t num_used;   // Blocks of a slab out of its bin, e.g. in thread caches.
+};
+
+static_assert(sizeof(SizeClassAllocator::ThreadCache) ==
+                  SizeClassAllocator::NUM_SIZE_CLASSES *
+                      sizeof(SizeClassAllocator::ThreadCache::Bin),
+              "ThreadCache must stay a plain array of bins");
+
+//
+// Size classes
+//
+
+/**
+ * @brief Returns the index of the smallest size class that fits `size`.
+ *
+ * NOTE: `size` must not exceed MAX_SMALL_SIZE.
+ */
+size_t SizeClassAllocator::size_class_index(size_t size) {
+  assert(size <= MAX_SMALL_SIZE);
+  if (size <= 128) {
+    return size ? (size + 15) / 16 - 1 : 0;
+  }
+
+  // Four classes per power of two: size is in (2^log2, 2^(log2 + 1)].
+  size_t log2 = 0;
+  for (auto value = size - 1; value >>= 1;) {
+    ++log2;
+  }
+  const size_t shift = log2 - 2;
+  return 8 + (log2 - 7) * 4 + ((size - 1) >> shift) - 4;
+}
+
+/**
+ * @brief Returns the block size of the given size class.
+ */
+size_t SizeClassAllocator::size_class_size(size_t index) {
+  assert(index < NUM_SIZE_CLASSES);
+  if (index < 8) {
+    return (index + 1) * 16;
+  }
+
+  const size_t step = index - 8;
+  const size_t log2 = 7 + step / 4;
+  return (size_t(1) << log2) + (step % 4 + 1) * (size_t(1) << (log2 - 2));
+}
+
+/**
+ * @brief Number of blocks a thread cache moves to or from a bin at a time.
+ */
+size_t SizeClassAllocator::batch_size(size_t index) {
+  const size_t count = (64 * 1024) / size_class_size(index);
+  return count < 4 ? 4 : (count > 64 ? 64 : count);
+}
+
+//
+// Headers
+//
+
+SizeClassAllocator::ChunkHeader*
+SizeClassAllocator::get_header(const void* user_data) {
+  auto header = reinterpret_cast<ChunkHeader*>(
+      (reinterpret_cast<uintptr_t>(user_data) - 1) & ~(CHUNK_SIZE - 1));
+  assert(header->magic == CHUNK_MAGIC);
+  return header;
+}
+
+/**
+ * @brief Returns the start of the block containing user_data (which differs
+ * only for over-aligned small allocations).
+ */
+void* SizeClassAllocator::block_start(const ChunkHeader* header,
+                                      const void* user_data) {
+  const auto offset = static_cast<size_t>(
+      static_cast<const char*>(user_data) - header->data);
+  return header->data + offset - offset % header->block_size;
+}
+
+/**
+ * @brief Returns the number of bytes usable at user_data; at least the size
+ * requested.
+ */
+size_t SizeClassAllocator::usable_size(const void* user_data) const {
+  if (!user_data) {
+    return 0;
+  }
+
+  auto header = get_header(user_data);
+  auto block = static_cast<const char*>(block_start(header, user_data));
+  return header->block_size -
+         static_cast<size_t>(static_cast<const char*>(user_data) - block);
+}
+
+//
+// Public API
+//
+
+/**
+ * @brief Allocates from the central bins (or a mapping of its own, for large
+ * sizes).
+ *
+ * @param size The number of bytes to allocate.
+ * @param alignment Alignment of the returned memory; must be a power of 2.
+ * @return void* Pointer to the allocated memory, or nullptr if out of memory.
+ */
+void* SizeClassAllocator::allocate(size_t size, size_t alignment) const {
+  if (alignment < MIN_ALIGNMENT) {
+    alignment = MIN_ALIGNMENT;
+  }
+
+  // Over-aligned small requests take a block with room to align within it.
+  const size_t padded = size + alignment - MIN_ALIGNMENT;
+  if (size > MAX_SMALL_SIZE || padded > MAX_SMALL_SIZE ||
+      alignment > MAX_SMALL_ALIGNMENT) {
+    return allocate_large(size, alignment);
+  }
+
+  auto block = allocate_small(size_class_index(padded));
+  if (!block) {
+    return nullptr;
+  }
+  return reinterpret_cast<void*>(
+      round_up(reinterpret_cast<uintptr_t>(block), alignment));
+}
+
+/**
+ * @brief Allocates count blocks of the same size, taking each size class's
+ * lock once per batch rather than once per block.
+ *
+ * @param blocks Receives the blocks; must have room for count pointers.
+ * @return size_t Number of blocks allocated; less than count only if out of
+ * memory.
+ */
+size_t SizeClassAllocator::allocate_bulk(size_t size,
+                                         size_t alignment,
+                                         void** blocks,
+                                         size_t count) const {
+  if (alignment < MIN_ALIGNMENT) {
+    alignment = MIN_ALIGNMENT;
+  }
+
+  size_t allocated = 0;
+  const size_t padded = size + alignment - MIN_ALIGNMENT;
+  if (size > MAX_SMALL_SIZE || padded > MAX_SMALL_SIZE ||
+      alignment > MAX_SMALL_ALIGNMENT) {
+    while (allocated < count) {
+      auto memory = allocate_large(size, alignment);
+      if (!memory) {
+        break;
+      }
+      blocks[allocated++] = memory;
+    }
+    return allocated;
+  }
+
+  const size_t index = size_class_index(padded);
+  while (allocated < count) {
+    FreeBlock* head = nullptr;
+    if (!refill(index, &head, count - allocated)) {
+      break;
+    }
+
+    for (; head; head = head->next) {
+      blocks[allocated++] = reinterpret_cast<void*>(
+          round_up(reinterpret_cast<uintptr_t>(head), alignment));
+    }
+  }
+  return allocated;
+}
+
+/**
+ * @brief Resizes a block, in place if it has room (or, for large blocks, if
+ * the OS can grow the mapping).
+ */
+void* SizeClassAllocator::reallocate(void* user_data,
+                                     size_t old_size,
+                                     size_t new_size,
+                                     size_t alignment) const {
+  (void)old_size;
+  if (!user_data) {
+    return allocate(new_size, alignment);
+  }
+
+  auto header = get_header(user_data);
+  if (header->size_class == LARGE_CLASS) {
+    return reallocate_large(header, user_data, new_size);
+  }
+
+  const size_t available = usable_size(user_data);
+  if (new_size <= available) {
+    return user_data;
+  }
+
+  auto memory = allocate(new_size, alignment);
+  if (memory) {
+    memcpy(memory, user_data, available);
+    deallocate(user_data);
+  }
+  return memory;
+}
+
+/**
+ * @brief Returns a block to its central bin (or its mapping to the OS).
+ */
+void SizeClassAllocator::deallocate(void* user_data) const {
+  if (!user_data) {
+    return;
+  }
+
+  auto header = get_header(user_data);
+  if (header->size_class == LARGE_CLASS) {
+    deallocate_large(header);
+    return;
+  }
+
+  deallocate_small(header->size_class,
+                   static_cast<FreeBlock*>(block_start(header, user_data)));
+}
+
+//
+// Thread-cached API
+//
+
+/**
+ * @brief Allocates from the thread cache, refilling it from the central bin
+ * when empty.
+ *
+ * @param cache The calling thread's cache.
+ * @param size The number of bytes to allocate.
+ * @param alignment Alignment of the returned memory; must be a power of 2.
+ * @return void* Pointer to the allocated memory, or nullptr if out of memory.
+ */
+void* SizeClassAllocator::allocate(ThreadCache& cache,
+                                   size_t size,
+                                   size_t alignment) const {
+  if (alignment < MIN_ALIGNMENT) {
+    alignment = MIN_ALIGNMENT;
+  }
+
+  const size_t padded = size + alignment - MIN_ALIGNMENT;
+  if (size > MAX_SMALL_SIZE || padded > MAX_SMALL_SIZE ||
+      alignment > MAX_SMALL_ALIGNMENT) {
+    return allocate_large(size, alignment);
+  }
+
+  const size_t index = size_class_index(padded);
+  auto& bin = cache.bins[index];
+  if (!bin.head) {
+    bin.count += refill(index, &bin.head, batch_size(index));
+    if (!bin.head) {
+      return nullptr;
+    }
+  }
+
+  auto block = bin.head;
+  bin.head = block->next;
+  --bin.count;
+
+  return reinterpret_cast<void*>(
+      round_up(reinterpret_cast<uintptr_t>(block), alignment));
+}
+
+/**
+ * @brief Resizes a block, using the thread cache if it has to move.
+ */
+void* SizeClassAllocator::reallocate(ThreadCache& cache,
+                                     void* user_data,
+                                     size_t new_size,
+                                     size_t alignment) const {
+  if (!user_data) {
+    return allocate(cache, new_size, alignment);
+  }
+
+  auto header = get_header(user_data);
+  if (header->size_class == LARGE_CLASS) {
+    return reallocate_large(header, user_data, new_size);
+  }
+
+  const size_t available = usable_size(user_data);
+  if (new_size <= available) {
+    return user_data;
+  }
+
+  auto memory = allocate(cache, new_size, alignment);
+  if (memory) {
+    memcpy(memory, user_data, available);
+    deallocate(cache, user_data);
+  }
+  return memory;
+}
+
+/**
+ * @brief Returns a block to the thread cache, passing a batch on to the
+ * central bin when the cache holds too many.
+ */
+void SizeClassAllocator::deallocate(ThreadCache& cache, void* user_data) const {
+  if (!user_data) {
+    return;
+  }
+
+  auto header = get_header(user_data);
+  if (header->size_class == LARGE_CLASS) {
+    deallocate_large(header);
+    return;
+  }
+
+  const size_t index = header->size_class;
+  auto block = static_cast<FreeBlock*>(block_start(header, user_data));
+  auto& bin = cache.bins[index];
+  block->next = bin.head;
+  bin.head = block;
+  ++bin.count;
+
+  const size_t batch = batch_size(index);
+  if (bin.count > 2 * batch) {
+    auto head = bin.head;
+    auto tail = head;
+    for (size_t ix = 1; ix < batch; ++ix) {
+      tail = tail->next;
+    }
+    bin.head = tail->next;
+    bin.count -= batch;
+    release(index, head, tail, batch);
+  }
+}
+
+/**
+ * @brief Returns everything in the thread cache to the central bins. Call
+ * before the thread exits.
+ */
+void SizeClassAllocator::flush(ThreadCache& cache) const {
+  for (size_t index = 0; index < NUM_SIZE_CLASSES; ++index) {
+    auto& bin = cache.bins[index];
+    if (!bin.head) {
+      continue;
+    }
+
+    auto tail = bin.head;
+    while (tail->next) {
+      tail = tail->next;
+    }
+    release(index, bin.head, tail, bin.count);
+
+    bin.head = nullptr;
+    bin.count = 0;
+  }
+}
+
+/**
+ * @brief Returns the slabs with no blocks in use, and the cached large spans,
+ * to the OS.
+ *
+ * NOTE: Blocks in thread caches count as in use; flush() them first.
+ *
+ * @return size_t Number of bytes returned.
+ */
+size_t SizeClassAllocator::trim() const {
+  size_t released = 0;
+  for (auto& bin : m_bins) {
+    LockGuard guard(bin.lock);
+
+    // Unlink the free blocks of empty slabs...
+    for (auto link = &bin.free; *link;) {
+      if (get_header(*link)->num_used == 0) {
+        *link = (*link)->next;
+      } else {
+        link = &(*link)->next;
+      }
+    }
+
+    // ... then unmap the slabs.
+    for (auto link = &bin.slabs; *link;) {
+      auto slab = *link;
+      if (slab->num_used) {
+        link = &slab->next;
+        continue;
+      }
+
+      if (bin.cursor != bin.end && get_header(bin.cursor) == slab) {
+        bin.cursor = nullptr;
+        bin.end = nullptr;
+      }
+      *link = slab->next;
+      released += slab->map_size;
+      memory::unmap_pages(slab->map_start, slab->map_size);
+    }
+  }
+
+  return released + release_large_cache();
+}
+
+/**
+ * @brief Returns all slabs, and the cached large spans, to the OS.
+ *
+ * NOTE: All small blocks become invalid, including those in thread caches;
+ * large blocks in use are unaffected.
+ */
+void SizeClassAllocator::release() const {
+  for (auto& bin : m_bins) {
+    LockGuard guard(bin.lock);
+    while (bin.slabs) {
+      auto slab = bin.slabs;
+      bin.slabs = slab->next;
+      memory::unmap_pages(slab->map_start, slab->map_size);
+    }
+    bin.free = nullptr;
+    bin.cursor = nullptr;
+    bin.end = nullptr;
+  }
+  release_large_cache();
+}
+
+//
+// Small blocks
+//
+
+FreeBlock* SizeClassAllocator::allocate_small(size_t index) const {
+  FreeBlock* block = nullptr;
+  refill(index, &block, 1);
+  return block;
+}
+
+void SizeClassAllocator::deallocate_small(size_t index,
+                                          FreeBlock* block) const {
+  block->next = nullptr;
+  release(index, block, block, 1);
+}
+
+/**
+ * @brief Moves up to `count` blocks from the central bin onto the given list,
+ * carving a new slab if the bin is empty.
+ *
+ * @return size_t Number of blocks moved; 0 only if out of memory.
+ */
+size_t SizeClassAllocator::refill(size_t index,
+                                  FreeBlock** head,
+                                  size_t count) const {
+  auto& bin = m_bins[index];
+  LockGuard guard(bin.lock);
+
+  size_t moved = 0;
+  while (moved < count && bin.free) {
+    auto block = bin.free;
+    bin.free = block->next;
+    block->next = *head;
+    *head = block;
+    ++get_header(block)->num_used;
+    ++moved;
+  }
+
+  if (moved == 0 && bin.cursor == bin.end && !add_slab(bin, index)) {
+    return 0;
+  }
+
+  const size_t block_size = size_class_size(index);
+  const size_t moved_from_free = moved;
+  while (moved < count && bin.cursor != bin.end) {
+    auto block = reinterpret_cast<FreeBlock*>(bin.cursor);
+    bin.cursor += block_size;
+    block->next = *head;
+    *head = block;
+    ++moved;
+  }
+  if (moved != moved_from_free) {
+    // All carved from the current slab.
+    get_header(*head)->num_used += moved - moved_from_free;
+  }
+
+  return moved;
+}
+
+/**
+ * @brief Pushes a linked list of blocks onto the central bin.
+ */
+void SizeClassAllocator::release(size_t index,
+                                 FreeBlock* head,
+                                 FreeBlock* tail,
+                                 size_t count) const {
+  (void)count;
+  auto& bin = m_bins[index];
+  LockGuard guard(bin.lock);
+  for (auto block = head;; block = block->next) {
+    --get_header(block)->num_used;
+    if (block == tail) {
+      break;
+    }
+  }
+  tail->next = bin.free;
+  bin.free = head;
+}
+
+/**
+ * @brief Maps a new slab and makes it the bin's current one.
+ *
+ * NOTE: Called with the bin locked.
+ */
+bool SizeClassAllocator::add_slab(Bin& bin, size_t index) const {
+  static_assert(sizeof(ChunkHeader) <= HEADER_SPACE,
+                "ChunkHeader must fit below the first block");
+
+  void* map_start = nullptr;
+  size_t map_size = 0;
+  auto base = map_chunk_aligned(CHUNK_SIZE, &map_start, &map_size);
+  if (!base) {
+    return false;
+  }
+
+  const size_t block_size = size_class_size(index);
+  const size_t num_blocks = (CHUNK_SIZE - HEADER_SPACE) / block_size;
+
+  auto header = reinterpret_cast<ChunkHeader*>(base);
+  header->magic = CHUNK_MAGIC;
+  header->size_class = static_cast<uint32_t>(index);
+  header->block_size = block_size;
+  header->data = base + HEADER_SPACE;
+  header->alignment = MIN_ALIGNMENT;
+  header->map_start = map_start;
+  header->map_size = map_size;
+  header->next = bin.slabs;
+  header->num_used = 0;
+  bin.slabs = header;
+
+  bin.cursor = header->data;
+  bin.end = header->data + num_blocks * block_size;
+  return true;
+}
+
+//
+// Large blocks
+//
+
+/**
+ * @brief Takes a cached span of the right size class, or maps a block of its
+ * own. The header sits at the CHUNK_SIZE boundary just below the user pointer;
+ * for alignments of a chunk or more that takes a whole chunk of padding.
+ */
+void* SizeClassAllocator::allocate_large(size_t size,
+                                         size_t alignment) const {
+  const size_t offset =
+      alignment > CHUNK_SIZE ? alignment : round_up(HEADER_SPACE, alignment);
+  if (size > SIZE_MAX - offset - CHUNK_SIZE) {
+    return nullptr;
+  }
+
+  if (alignment <= CHUNK_SIZE && offset + size <= MAX_CACHED_LARGE_SIZE) {
+    // Spans start on a chunk boundary, so any fits any such alignment.
+    const size_t index = large_class_index(offset + size);
+    ChunkHeader* header = nullptr;
+    {
+      LockGuard guard(m_large_cache.lock);
+      header = m_large_cache.spans[index];
+      if (header) {
+        m_large_cache.spans[index] = header->next;
+        m_large_cache.num_bytes -= header->map_size;
+      }
+    }
+
+    if (header) {
+      auto user_data = reinterpret_cast<char*>(header) + offset;
+      header->block_size = header->map_size - offset;
+      header->data = user_data;
+      header->alignment = alignment;
+      header->next = nullptr;
+      return user_data;
+    }
+  }
+
+  void* map_start = nullptr;
+  size_t map_size = 0;
+  auto base = map_chunk_aligned(
+      alignment > CHUNK_SIZE ? offset + size : large_map_size(offset + size),
+      &map_start,
+      &map_size);
+  if (!base) {
+    return nullptr;
+  }
+
+  auto user_data = alignment > CHUNK_SIZE
+                       ? reinterpret_cast<char*>(round_up(
+                             reinterpret_cast<uintptr_t>(base) + CHUNK_SIZE,
+                             alignment))
+                       : base + offset;
+  auto header = reinterpret_cast<ChunkHeader*>(
+      (reinterpret_cast<uintptr_t>(user_data) - 1) & ~(CHUNK_SIZE - 1));
+  header->magic = CHUNK_MAGIC;
+  header->size_class = LARGE_CLASS;
+  header->block_size =
+      static_cast<size_t>(static_cast<char*>(map_start) + map_size - user_data);
+  header->data = user_data;
+  header->alignment = alignment;
+  header->map_start = map_start;
+  header->map_size = map_size;
+  header->next = nullptr;
+  header->num_used = 0;
+
+  return user_data;
+}
+
+/**
+ * @brief Resizes a large block. On Linux the pages are moved with mremap
+ * rather than copied.
+ */
+void* SizeClassAllocator::reallocate_large(ChunkHeader* header,
+                                           void* user_data,
+                                           size_t new_size) const {
+  if (new_size <= header->block_size) {
+    return user_data;
+  }
+
+#if defined(__linux__)
+  // Only the common layout (header at the start of the mapping) can move.
+  if (header->map_start == header) {
+    const size_t offset =
+        static_cast<size_t>(static_cast<char*>(user_data) -
+                            reinterpret_cast<char*>(header));
+    if (new_size > SIZE_MAX - offset - CHUNK_SIZE) {
+      return nullptr;
+    }
+    const size_t new_map_size = large_map_size(offset + new_size);
+
+    // Grow in place if the next pages are free...
+    auto moved = mremap(header->map_start, header->map_size, new_map_size, 0);
+    if (moved == MAP_FAILED) {
+      // ... otherwise move the pages to a new chunk-aligned address.
+      const size_t length = new_map_size + CHUNK_SIZE;
+      auto reserved = static_cast<char*>(
+          mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (reserved == MAP_FAILED) {
+        return nullptr;
+      }
+
+      auto target = reinterpret_cast<char*>(
+          round_up(reinterpret_cast<uintptr_t>(reserved), CHUNK_SIZE));
+      moved = mremap(header->map_start,
+                     header->map_size,
+                     new_map_size,
+                     MREMAP_MAYMOVE | MREMAP_FIXED,
+                     target);
+      if (moved == MAP_FAILED) {
+        munmap(reserved, length);
+        return nullptr;
+      }
+
+      if (target != reserved) {
+        munmap(reserved, static_cast<size_t>(target - reserved));
+      }
+      auto tail = target + new_map_size;
+      if (tail != reserved + length) {
+        munmap(tail, static_cast<size_t>(reserved + length - tail));
+      }
+    }
+
+    header = static_cast<ChunkHeader*>(moved);
+    header->map_start = moved;
+    header->map_size = new_map_size;
+    header->data = static_cast<char*>(moved) + offset;
+    header->block_size = new_map_size - offset;
+    return header->data;
+  }
+#endif
+
+  auto memory = allocate_large(new_size, header->alignment);
+  if (memory) {
+    memcpy(memory, user_data, header->block_size);
+    deallocate_large(header);
+  }
+  return memory;
+}
+
+/**
+ * @brief Caches a span of a large size class for reuse, if there's room;
+ * otherwise returns it to the OS.
+ */
+void SizeClassAllocator::deallocate_large(ChunkHeader* header) const {
+  const auto map_size = header->map_size;
+  if (header->map_start == header && map_size <= MAX_CACHED_LARGE_SIZE) {
+    const size_t index = large_class_index(map_size);
+    if (large_class_size(index) == map_size) {
+      LockGuard guard(m_large_cache.lock);
+      if (m_large_cache.num_bytes + map_size <= LARGE_CACHE_CAPACITY) {
+        header->next = m_large_cache.spans[index];
+        m_large_cache.spans[index] = header;
+        m_large_cache.num_bytes += map_size;
+        return;
+      }
+    }
+  }
+
+  memory::unmap_pages(header->map_start, map_size);
+}
+
+/**
+ * @brief Returns the cached large spans to the OS.
+ *
+ * @return size_t Number of bytes returned.
+ */
+size_t SizeClassAllocator::release_large_cache() const {
+  ChunkHeader* spans[NUM_LARGE_CLASSES];
+  size_t released = 0;
+  {
+    LockGuard guard(m_large_cache.lock);
+    for (size_t index = 0; index < NUM_LARGE_CLASSES; ++index) {
+      spans[index] = m_large_cache.spans[index];
+      m_large_cache.spans[index] = nullptr;
+    }
+    released = m_large_cache.num_bytes;
+    m_large_cache.num_bytes = 0;
+  }
+
+  for (auto span : spans) {
+    while (span) {
+      auto next = span->next;
+      memory::unmap_pages(span->map_start, span->map_size);
+      span = next;
+    }
+  }
+  return released;
+}
+
+} // namespace allok8or
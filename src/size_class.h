@@ -0,0 +1,192 @@
+/**
+ * @file size_class.h
+ * @brief Header for a general purpose allocator that rounds requests up to a
+ * fixed set of size classes, with optional per-thread caches.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+
+// Library headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace allok8or {
+
+namespace size_class {
+
+/**
+ * @brief Minimal lock for the central bins; never allocates or sleeps in the
+ * kernel, so it's usable from inside malloc.
+ */
+class SpinLock {
+public:
+  void lock();
+  void unlock() { m_flag.clear(std::memory_order_release); }
+
+private:
+  std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+};
+
+// Singly-linked free list entry, stored in the free block itself.
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+} // namespace size_class
+
+/**
+ * @brief General purpose allocator, in the style of tcmalloc/jemalloc.
+ *
+ * Requests up to MAX_SMALL_SIZE are rounded up to one of NUM_SIZE_CLASSES
+ * sizes (16-byte steps up to 128, then four steps per power of two) and carved
+ * from CHUNK_SIZE slabs mapped directly from the OS. Larger requests get a
+ * mapping of their own, which is resized with mremap where available. Those up
+ * to MAX_CACHED_LARGE_SIZE are rounded up to NUM_LARGE_CLASSES sizes (four per
+ * power of two) and, when freed, cached for reuse, up to LARGE_CACHE_CAPACITY
+ * bytes in all.
+ *
+ * Every slab and large mapping starts with a header at a CHUNK_SIZE-aligned
+ * address just below the user pointer, so deallocate() and usable_size() need
+ * no size from the caller, and no lookup table.
+ *
+ * Each size class has a central bin (free list plus the unused tail of its
+ * current slab) guarded by a spin lock. The ThreadCache overloads put a
+ * per-thread free list in front of the bins: allocation and deallocation are
+ * then a push/pop with no synchronization, and the bins are visited once per
+ * batch of blocks.
+ *
+ * The constructor is constexpr and the destructor trivial, so a static
+ * instance is usable before (and after) any static constructor runs; that's
+ * what the allok8or-preload library relies on.
+ *
+ * NOTE: Slabs are only returned to the OS by trim() (once empty) and
+ * release().
+ * NOTE: Never calls malloc.
+ */
+class SizeClassAllocator : public Allocator<SizeClassAllocator> {
+public:
+  static const size_t CHUNK_SIZE = 256 * 1024;
+  static const size_t MAX_SMALL_SIZE = 32 * 1024;
+  static const size_t NUM_SIZE_CLASSES = 40;
+  static const size_t MIN_ALIGNMENT = 16;
+  static const size_t MAX_CACHED_LARGE_SIZE = 4 * 1024 * 1024;
+  static const size_t NUM_LARGE_CLASSES = 28;
+  static const size_t LARGE_CACHE_CAPACITY = 64 * 1024 * 1024;
+
+  /**
+   * @brief Per-thread cache of free blocks. Zero-initialized state is valid,
+   * so it can live in thread_local storage without a constructor.
+   */
+  struct ThreadCache {
+    struct Bin {
+      size_class::FreeBlock* head;
+      size_t count;
+    };
+    Bin bins[NUM_SIZE_CLASSES];
+  };
+
+  constexpr SizeClassAllocator() : m_bins(), m_large_cache() {}
+
+  // No copies; share this when appropriate.
+  SizeClassAllocator(const SizeClassAllocator&) = delete;
+  SizeClassAllocator& operator=(const SizeClassAllocator&) = delete;
+
+  // Public API
+  void* allocate(size_t size, size_t alignment = MIN_ALIGNMENT) const;
+  void* reallocate(void* user_data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const;
+  void deallocate(void* user_data) const;
+  size_t usable_size(const void* user_data) const;
+  size_t allocate_bulk(size_t size,
+                       size_t alignment,
+                       void** blocks,
+                       size_t count) const;
+
+  // Thread-cached API
+  void* allocate(ThreadCache& cache,
+                 size_t size,
+                 size_t alignment = MIN_ALIGNMENT) const;
+  void* reallocate(ThreadCache& cache,
+                   void* user_data,
+                   size_t new_size,
+                   size_t alignment = MIN_ALIGNMENT) const;
+  void deallocate(ThreadCache& cache, void* user_data) const;
+  void flush(ThreadCache& cache) const;
+
+  size_t trim() const;
+  void release() const;
+
+  // Size class helpers
+  static size_t size_class_index(size_t size);
+  static size_t size_class_size(size_t index);
+
+private:
+  struct ChunkHeader;
+
+  struct Bin {
+    size_class::SpinLock lock;
+    size_class::FreeBlock* free = nullptr;
+    char* cursor = nullptr;
+    char* end = nullptr;
+    ChunkHeader* slabs = nullptr;
+  };
+
+  // Freed large spans, by size class; see MAX_CACHED_LARGE_SIZE.
+  struct LargeCache {
+    size_class::SpinLock lock;
+    ChunkHeader* spans[NUM_LARGE_CLASSES] = {};
+    size_t num_bytes = 0;
+  };
+
+  static ChunkHeader* get_header(const void* user_data);
+  static void* block_start(const ChunkHeader* header, const void* user_data);
+  static size_t batch_size(size_t index);
+
+  void* allocate_large(size_t size, size_t alignment) const;
+  void* reallocate_large(ChunkHeader* header,
+                         void* user_data,
+                         size_t new_size) const;
+  void deallocate_large(ChunkHeader* header) const;
+  size_t release_large_cache() const;
+
+  size_class::FreeBlock* allocate_small(size_t index) const;
+  void deallocate_small(size_t index, size_class::FreeBlock* block) const;
+  size_t refill(size_t index,
+                size_class::FreeBlock** head,
+                size_t count) const;
+  void release(size_t index,
+               size_class::FreeBlock* head,
+               size_class::FreeBlock* tail,
+               size_t count) const;
+  bool add_slab(Bin& bin, size_t index) const;
+
+  // mutable required because all Allocator<T>-derived classes must have
+  // const API.
+  mutable Bin m_bins[NUM_SIZE_CLASSES];
+  mutable LargeCache m_large_cache;
+};
+
+/**
+ * @brief Equality test. SizeClassAllocators are unique, so equal only to
+ * themselves.
+ */
+inline bool operator==(const SizeClassAllocator& lhs,
+                       const SizeClassAllocator& rhs) {
+  return &lhs == &rhs;
+}
+
+/**
+ * @brief Inequality test.
+ */
+inline bool operator!=(const SizeClassAllocator& lhs,
+                       const SizeClassAllocator& rhs) {
+  return !(lhs == rhs);
+}
+
+} // namespace allok8or
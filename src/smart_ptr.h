@@ -0,0 +1,174 @@
+/**
+ * @file smart_ptr.h
+ * @brief Helpers for creating std::unique_ptr and std::shared_ptr objects with
+ * allok8or allocators.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+#include "std_allocator_adapter.h"
+
+// Library headers
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace allok8or {
+
+namespace detail {
+
+/**
+ * @brief Access to an allocator from a deleter: a reference in general, but
+ * nothing at all for stateless allocators, which are default-constructed on
+ * use.
+ */
+template <typename TAllocator,
+          bool = std::is_empty<TAllocator>::value &&
+                 std::is_default_constructible<TAllocator>::value>
+class AllocatorHandle {
+public:
+  explicit AllocatorHandle(Allocator<TAllocator>& allocator) noexcept
+      : m_allocator(&static_cast<TAllocator&>(allocator)) {}
+
+  const Allocator<TAllocator>& get() const noexcept { return *m_allocator; }
+
+private:
+  TAllocator* m_allocator; // Pointer, so that deleters stay assignable.
+};
+
+template <typename TAllocator>
+class AllocatorHandle<TAllocator, true> {
+public:
+  AllocatorHandle() noexcept = default;
+  explicit AllocatorHandle(Allocator<TAllocator>&) noexcept {}
+
+  TAllocator get() const noexcept { return TAllocator(); }
+};
+
+} // namespace detail
+
+/**
+ * @brief Deleter for std::unique_ptr that destroys the object and returns its
+ * memory to an allok8or allocator.
+ *
+ * Empty for stateless allocators (e.g. PassThroughAllocator), so a
+ * std::unique_ptr using it is the size of a raw pointer.
+ *
+ * @tparam T Type of the object to delete.
+ * @tparam TAllocator Type of the allocator that provided its memory.
+ */
+template <typename T, typename TAllocator>
+class AllocatorDeleter : private detail::AllocatorHandle<TAllocator> {
+  static_assert(!std::is_array<T>::value,
+                "AllocatorDeleter does not support arrays");
+
+public:
+  // Only for stateless allocators; lets std::unique_ptr default-construct.
+  AllocatorDeleter() noexcept = default;
+
+  explicit AllocatorDeleter(Allocator<TAllocator>& allocator) noexcept
+      : detail::AllocatorHandle<TAllocator>(allocator) {}
+
+  void operator()(T* object) const noexcept {
+    object->~T();
+    const Allocator<TAllocator>& allocator = this->get();
+    allocator.deallocate(object, sizeof(T), alignof(T));
+  }
+};
+
+/**
+ * @brief std::unique_ptr that deletes through an allok8or allocator.
+ */
+template <typename T, typename TAllocator>
+using UniquePtr = std::unique_ptr<T, AllocatorDeleter<T, TAllocator>>;
+
+/**
+ * @brief Allocates and constructs an object with an allok8or allocator.
+ *
+ * Example:
+ * @code
+ *   Arena arena(pages);
+ *   auto widget = allocate_unique<Widget>(arena, "name", 42);
+ * @endcode
+ *
+ * @throw std::bad_alloc If the allocator returns nullptr. Anything thrown by
+ * T's constructor propagates, after the memory is returned.
+ *
+ * @tparam T Type of the object to create.
+ * @tparam TAllocator Type of the allocator.
+ * @param allocator The allocator for the object's memory; must outlive it.
+ * @param args Arguments for T's constructor.
+ * @return UniquePtr<T, TAllocator> Owner of the new object.
+ */
+template <typename T, typename TAllocator, typename... Args>
+UniquePtr<T, TAllocator> allocate_unique(Allocator<TAllocator>& allocator,
+                                         Args&&... args) {
+  static_assert(!std::is_array<T>::value,
+                "allocate_unique does not support arrays");
+
+  auto memory = allocator.allocate(sizeof(T), alignof(T));
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+
+  T* object;
+  try {
+    object = new (memory) T(std::forward<Args>(args)...);
+  } catch (...) {
+    allocator.deallocate(memory, sizeof(T), alignof(T));
+    throw;
+  }
+
+  return UniquePtr<T, TAllocator>(object,
+                                  AllocatorDeleter<T, TAllocator>(allocator));
+}
+
+/**
+ * @brief Allocates and constructs an object with the backing allocator of a
+ * StdAllocatorAdapter.
+ */
+template <typename T, typename U, typename TAllocator, typename... Args>
+UniquePtr<T, TAllocator>
+allocate_unique(const StdAllocatorAdapter<U, TAllocator>& adapter,
+                Args&&... args) {
+  return allocate_unique<T>(adapter.allocator(), std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Creates a shared object with an allok8or allocator.
+ *
+ * The control block and the object share one allocation (see
+ * std::allocate_shared), and the deleter is not type-erased through
+ * std::function.
+ *
+ * @throw std::bad_alloc If the allocator returns nullptr.
+ *
+ * @tparam T Type of the object to create.
+ * @tparam TAllocator Type of the allocator.
+ * @param allocator The allocator for the object's memory; must outlive every
+ * std::shared_ptr and std::weak_ptr to it.
+ * @param args Arguments for T's constructor.
+ * @return std::shared_ptr<T> Owner of the new object.
+ */
+template <typename T, typename TAllocator, typename... Args>
+std::shared_ptr<T> allocate_shared(Allocator<TAllocator>& allocator,
+                                   Args&&... args) {
+  return std::allocate_shared<T>(StdAllocatorAdapter<T, TAllocator>(allocator),
+                                 std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Creates a shared object with a StdAllocatorAdapter.
+ */
+template <typename T, typename U, typename TAllocator, typename... Args>
+std::shared_ptr<T>
+allocate_shared(const StdAllocatorAdapter<U, TAllocator>& adapter,
+                Args&&... args) {
+  return std::allocate_shared<T>(StdAllocatorAdapter<T, TAllocator>(adapter),
+                                 std::forward<Args>(args)...);
+}
+
+} // namespace allok8or
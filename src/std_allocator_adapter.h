@@ -8,6 +8,9 @@
 #include "allocator.h"
 
 // Library headers
+#include <algorithm>
+#include <cstddef>
+#include <new>
 #include <type_traits>
 
 namespace allok8or {
@@ -19,6 +22,8 @@ namespace allok8or {
  *
  * NOTE: Backing allocator is *shared* on copy/move, and is assumed to be unique
  * for all istances of StdAllocatorAdapter with a given TBackingAllocator.
+ * NOTE: Memory is requested with alignof(T), so over-aligned types (e.g.
+ * alignas(64) counters) are honored.
  *
  * @tparam T Type of data to be allocated/deallocated.
  * @tparam TBackingAllocator Type of the backing allocator to be passed to
@@ -66,11 +71,12 @@ public:
 
   value_type* allocate(std::size_t count) {
     return static_cast<value_type*>(
-        m_allocator.allocate(count * sizeof(value_type)));
+        m_allocator.allocate(count * sizeof(value_type), alignof(value_type)));
   }
 
-  void deallocate(value_type* user_data, std::size_t) noexcept {
-    m_allocator.deallocate(user_data);
+  void deallocate(value_type* user_data, std::size_t count) noexcept {
+    allocator().deallocate(
+        user_data, count * sizeof(value_type), alignof(value_type));
   }
 
   Allocator<backing_allocator_type>& allocator() { return m_allocator; }
@@ -105,7 +111,8 @@ public:
   using propagate_on_container_swap =
       std::true_type; // to avoid the undefined behavior
 
-  // using is_always_equal = std::is_empty<allocator>;
+  // Adapters over a stateless backing allocator are interchangeable.
+  using is_always_equal = std::is_empty<backing_allocator_type>;
 
 private:
   backing_allocator_type& m_allocator;
@@ -123,4 +130,101 @@ bool operator!=(StdAllocatorAdapter<T, TBackingAllocator> const& lhs,
   return !(lhs == rhs);
 }
 
+/**
+ * @brief StdAllocatorAdapter that aligns every allocation to at least TAlign
+ * bytes, e.g. for std::vector of float or int data processed with SIMD loads.
+ *
+ * Example:
+ * @code
+ *   using Avx512Allocator =
+ *       AlignedStdAllocatorAdapter<float, PassThroughAllocator, 64>;
+ *   std::vector<float, Avx512Allocator> data(Avx512Allocator(pass_through));
+ * @endcode
+ *
+ * NOTE: Backing allocator is *shared* on copy/move, as for StdAllocatorAdapter.
+ *
+ * @tparam T Type of data to be allocated/deallocated.
+ * @tparam TBackingAllocator Type of the backing allocator. NOTE: Must have
+ * const API.
+ * @tparam TAlign Minimum alignment of each allocation; a power of two. The
+ * larger of TAlign and alignof(T) is used.
+ */
+template <typename T, typename TBackingAllocator, size_t TAlign>
+class AlignedStdAllocatorAdapter {
+  static_assert(TAlign && !(TAlign & (TAlign - 1)),
+                "AlignedStdAllocatorAdapter alignment must be a power of two");
+
+public:
+  using value_type = T;
+  using backing_allocator_type = TBackingAllocator;
+
+  static constexpr size_t alignment() {
+    return std::max(TAlign, alignof(value_type));
+  }
+
+  // Needed because of the non-type template parameter.
+  template <typename U>
+  struct rebind {
+    using other = AlignedStdAllocatorAdapter<U, TBackingAllocator, TAlign>;
+  };
+
+  // We can't guarantee that backing allocators will be default-constructible.
+  AlignedStdAllocatorAdapter() = delete;
+
+  /**
+   * @brief Ctor that takes a TBackingAllocator argument.
+   *
+   * @param allocator Allocator instance to be used as the backing allocator.
+   */
+  explicit AlignedStdAllocatorAdapter(
+      Allocator<backing_allocator_type>& allocator) noexcept
+      : m_allocator(static_cast<backing_allocator_type&>(allocator)) {}
+
+  template <typename U>
+  AlignedStdAllocatorAdapter(
+      const AlignedStdAllocatorAdapter<U, backing_allocator_type, TAlign>&
+          other) noexcept
+      : m_allocator(static_cast<backing_allocator_type&>(other.allocator())) {}
+
+  value_type* allocate(std::size_t count) {
+    auto user_data =
+        m_allocator.allocate(count * sizeof(value_type), alignment());
+    if (!user_data) {
+      throw std::bad_alloc();
+    }
+    return static_cast<value_type*>(user_data);
+  }
+
+  void deallocate(value_type* user_data, std::size_t count) noexcept {
+    allocator().deallocate(user_data, count * sizeof(value_type), alignment());
+  }
+
+  Allocator<backing_allocator_type>& allocator() const { return m_allocator; }
+
+  // See StdAllocatorAdapter.
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  using is_always_equal = std::is_empty<backing_allocator_type>;
+
+private:
+  backing_allocator_type& m_allocator;
+};
+
+template <typename T, typename U, typename TBackingAllocator, size_t TAlign>
+bool operator==(
+    AlignedStdAllocatorAdapter<T, TBackingAllocator, TAlign> const& lhs,
+    AlignedStdAllocatorAdapter<U, TBackingAllocator, TAlign> const&
+        rhs) noexcept {
+  return lhs.allocator() == rhs.allocator();
+}
+
+template <typename T, typename U, typename TBackingAllocator, size_t TAlign>
+bool operator!=(
+    AlignedStdAllocatorAdapter<T, TBackingAllocator, TAlign> const& lhs,
+    AlignedStdAllocatorAdapter<U, TBackingAllocator, TAlign> const&
+        rhs) noexcept {
+  return !(lhs == rhs);
+}
+
 } // namespace allok8or
@@ -0,0 +1,180 @@
+/**
+ * @file trace_recorder.h
+ * @brief Header file for the AllocationTraceRecorder, which records a binary
+ * trace of allocations for replay and tuning.
+ *
+ */
+#pragma once
+
+// Project headers
+#include "allocator.h"
+#include "diagnostic/stack_table.h"
+#include "diagnostic/trace.h"
+
+// Library headers
+#include <cstddef>
+
+namespace allok8or {
+
+/**
+ * @brief An allocator that records each allocation and deallocation made
+ * through it to a trace file (see diagnostic/trace.h), for replay by
+ * allok8or-replay.
+ *
+ * Like DiagnosticAllocator, it doesn't manage memory itself; the allocator
+ * passed in as a ctor argument does that. Events are buffered per thread and
+ * written by a background thread; see diagnostic::TraceWriter.
+ *
+ * Optionally captures each allocation's call stack (see capture_stacks()), and
+ * records its call site ID; much slower, so off by default.
+ *
+ * NOTE: This allocator cannot be copied; it must be shared.
+ * NOTE: Thread-safe if the backing allocator is.
+ *
+ * @tparam TBackingAllocator Type of the backing allocator; must be an
+ * allok8or::Allocator-derived class.
+ */
+template <typename TBackingAllocator>
+class AllocationTraceRecorder
+    : public Allocator<AllocationTraceRecorder<TBackingAllocator>> {
+public:
+  AllocationTraceRecorder(
+      Allocator<TBackingAllocator>& allocator,
+      const char* path,
+      size_t events_per_thread =
+          diagnostic::TraceWriter::DEFAULT_EVENTS_PER_THREAD);
+  ~AllocationTraceRecorder(){};
+
+  // No copies; share this when appropriate.
+  AllocationTraceRecorder(const AllocationTraceRecorder&) = delete;
+  AllocationTraceRecorder& operator=(const AllocationTraceRecorder&) = delete;
+
+  void* allocate(size_t size) const;
+  void* allocate(size_t size, size_t alignment) const;
+  void deallocate(void* data) const;
+  void deallocate(void* data, size_t size, size_t alignment) const;
+
+  const diagnostic::TraceWriter& Writer() const { return m_writer; }
+  void flush() const { m_writer.flush(); }
+
+  // Off by default; set before allocating from other threads.
+  bool capture_stacks() const { return m_capture_stacks; }
+  void capture_stacks(bool val) { m_capture_stacks = val; }
+
+private:
+  const Allocator<TBackingAllocator>& allocator_base() const {
+    return m_allocator;
+  }
+
+  TBackingAllocator& m_allocator;
+  bool m_capture_stacks;
+  mutable diagnostic::TraceWriter
+      m_writer; // mutable required because all Allocator<T>-derived classes
+                // must have const API.
+};
+
+template <typename TBackingAllocator>
+constexpr bool
+operator==(const AllocationTraceRecorder<TBackingAllocator>& lhs,
+           const AllocationTraceRecorder<TBackingAllocator>& rhs) {
+  return &lhs == &rhs;
+}
+
+template <typename TBackingAllocator>
+constexpr bool
+operator!=(const AllocationTraceRecorder<TBackingAllocator>& lhs,
+           const AllocationTraceRecorder<TBackingAllocator>& rhs) {
+  return !(&lhs == &rhs);
+}
+
+/**
+ * @brief Constructor
+ *
+ * NOTE: Logs an error if the trace file can't be created; allocations then
+ * go to the backing allocator unrecorded.
+ *
+ * @tparam TBackingAllocator Type of the backing allocator.
+ * @param allocator The backing allocator to actually allocate/deallocate heap
+ * @param path Path of the trace file; created, or truncated.
+ * @param events_per_thread Capacity of each thread's event buffer.
+ */
+template <typename TBackingAllocator>
+AllocationTraceRecorder<TBackingAllocator>::AllocationTraceRecorder(
+    Allocator<TBackingAllocator>& allocator,
+    const char* path,
+    size_t events_per_thread)
+    : m_allocator(static_cast<TBackingAllocator&>(allocator)),
+      m_capture_stacks(false),
+      m_writer(path, events_per_thread) {}
+
+/**
+ * @brief Gets memory from the backing allocator using default alignment, and
+ * records the allocation.
+ */
+template <typename TBackingAllocator>
+void* AllocationTraceRecorder<TBackingAllocator>::allocate(size_t size) const {
+  return allocate(size, alignof(std::max_align_t));
+}
+
+/**
+ * @brief Gets memory from the backing allocator, and records the allocation.
+ *
+ * NOTE: Failed allocations aren't recorded.
+ *
+ * @param size The size of the memory requested by the caller.
+ * @param alignment The alignment requested by the caller.
+ * @return void* Pointer to the memory, or nullptr.
+ */
+template <typename TBackingAllocator>
+void* AllocationTraceRecorder<TBackingAllocator>::allocate(
+    size_t size, size_t alignment) const {
+  auto data = allocator_base().allocate(size, alignment);
+  if (data) {
+    const auto site = m_capture_stacks ? diagnostic::capture_stack_site()
+                                        : diagnostic::UNKNOWN_SITE;
+    m_writer.record(diagnostic::TRACE_ALLOCATE, data, size, alignment, site);
+  }
+  return data;
+}
+
+/**
+ * @brief Records the deallocation, then releases memory back to the backing
+ * allocator.
+ *
+ * NOTE: Recorded first, so that its timestamp precedes any reuse of the block.
+ */
+template <typename TBackingAllocator>
+void AllocationTraceRecorder<TBackingAllocator>::deallocate(void* data) const {
+  if (!data) {
+    return;
+  }
+
+  m_writer.record(
+      diagnostic::TRACE_DEALLOCATE, data, 0, 0, diagnostic::UNKNOWN_SITE);
+  allocator_base().deallocate(data);
+}
+
+/**
+ * @brief Records the sized deallocation, then releases memory back to the
+ * backing allocator.
+ *
+ * @param data Block to deallocate.
+ * @param size Size of the block as originally requested.
+ * @param alignment Alignment of the block as originally requested.
+ */
+template <typename TBackingAllocator>
+void AllocationTraceRecorder<TBackingAllocator>::deallocate(
+    void* data, size_t size, size_t alignment) const {
+  if (!data) {
+    return;
+  }
+
+  m_writer.record(diagnostic::TRACE_DEALLOCATE,
+                  data,
+                  size,
+                  alignment,
+                  diagnostic::UNKNOWN_SITE);
+  allocator_base().deallocate(data, size, alignment);
+}
+
+} // namespace allok8or
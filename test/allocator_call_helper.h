@@ -34,3 +34,36 @@ template <typename TAlloc>
 void call_deallocate(allok8or::Allocator<TAlloc>& a, void* data) {
   a.deallocate(data);
 }
+
+/**
+ * @brief Wrapper to call through base class interface.
+ */
+template <typename TAlloc>
+void call_deallocate(allok8or::Allocator<TAlloc>& a,
+                     void* data,
+                     size_t size,
+                     size_t alignment) {
+  a.deallocate(data, size, alignment);
+}
+
+/**
+ * @brief Wrapper to call through base class interface.
+ */
+template <typename TAlloc>
+void* call_reallocate(allok8or::Allocator<TAlloc>& a,
+                      void* data,
+                      size_t old_size,
+                      size_t new_size,
+                      size_t alignment) {
+  return a.reallocate(data, old_size, new_size, alignment);
+}
+
+/**
+ * @brief Wrapper to call through base class interface.
+ */
+template <typename TAlloc>
+bool call_try_expand_in_place(allok8or::Allocator<TAlloc>& a,
+                              void* data,
+                              size_t new_size) {
+  return a.try_expand_in_place(data, new_size);
+}
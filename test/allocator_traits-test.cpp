@@ -0,0 +1,194 @@
+/**
+ * @file allocator_traits-test.cpp
+ * @brief Unit tests of the AllocatorTraits class.
+ */
+
+// My header
+#include "allocator_traits.h"
+
+// Project headers
+#include "allocator.h"
+#include "arena.h"
+#include "composite/bucketizer.h"
+#include "composite/fallback.h"
+#include "composite/segregator.h"
+#include "inline.h"
+#include "page.h"
+#include "pass_through.h"
+#include "size_class.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstring>
+
+using namespace allok8or;
+
+/**
+ * @brief Allocator with every optional capability, recording which were used.
+ */
+class CapableAllocator : public Allocator<CapableAllocator> {
+public:
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const {
+    return m_allocator.allocate(size, alignment);
+  }
+
+  void* reallocate(void* data,
+                   size_t old_size,
+                   size_t new_size,
+                   size_t alignment) const {
+    ++reallocations;
+    return m_allocator.reallocate(data, old_size, new_size, alignment);
+  }
+
+  void deallocate(void* data) const { m_allocator.deallocate(data); }
+
+  void deallocate(void* data, size_t, size_t) const {
+    ++sized_deallocations;
+    m_allocator.deallocate(data);
+  }
+
+  bool owns(const void*) const { return true; }
+
+  void deallocate_all() const { ++deallocate_alls; }
+
+  size_t allocate_bulk(size_t size,
+                       size_t alignment,
+                       void** blocks,
+                       size_t count) const {
+    ++bulk_allocations;
+    for (size_t i = 0; i < count; ++i) {
+      blocks[i] = allocate(size, alignment);
+    }
+    return count;
+  }
+
+  size_t usable_size(const void*) const { return 1024; }
+
+  mutable int reallocations = 0;
+  mutable int sized_deallocations = 0;
+  mutable int deallocate_alls = 0;
+  mutable int bulk_allocations = 0;
+
+private:
+  PassThroughAllocator m_allocator;
+};
+
+using Capable = AllocatorTraits<CapableAllocator>;
+using Basic = AllocatorTraits<PassThroughAllocator>;
+
+TEST_CASE("detection") {
+  CHECK(Capable::has_owns::value);
+  CHECK(Capable::has_reallocate::value);
+  CHECK(Capable::has_sized_deallocate::value);
+  CHECK(Capable::has_deallocate_all::value);
+  CHECK(Capable::has_allocate_bulk::value);
+  CHECK(Capable::has_usable_size::value);
+  CHECK_FALSE(Capable::has_try_expand_in_place::value);
+
+  CHECK_FALSE(Basic::has_owns::value);
+  CHECK(Basic::has_reallocate::value);
+  CHECK_FALSE(Basic::has_sized_deallocate::value);
+  CHECK_FALSE(Basic::has_deallocate_all::value);
+  CHECK_FALSE(Basic::has_allocate_bulk::value);
+  CHECK_FALSE(Basic::has_usable_size::value);
+
+  // Capabilities of the library's own allocators.
+  CHECK(AllocatorTraits<InlineAllocator<64, PassThroughAllocator>>::has_owns::
+            value);
+  CHECK(AllocatorTraits<Arena>::has_deallocate_all::value);
+  CHECK(AllocatorTraits<Arena>::has_try_expand_in_place::value);
+  CHECK_FALSE(AllocatorTraits<Arena>::has_reallocate::value);
+  CHECK(AllocatorTraits<SizeClassAllocator>::has_allocate_bulk::value);
+  CHECK(AllocatorTraits<SizeClassAllocator>::has_usable_size::value);
+}
+
+TEST_CASE("native") {
+  CapableAllocator allocator;
+  void* blocks[4];
+
+  CHECK_EQ(Capable::allocate_bulk(allocator, 16, 16, blocks, 4), 4);
+  CHECK_EQ(allocator.bulk_allocations, 1);
+  CHECK_EQ(Capable::usable_size(allocator, blocks[0], 16), 1024);
+
+  blocks[0] = Capable::reallocate(allocator, blocks[0], 16, 32, 16);
+  CHECK_EQ(allocator.reallocations, 1);
+
+  for (auto block : blocks) {
+    Capable::deallocate(allocator, block, 16, 16);
+  }
+  CHECK_EQ(allocator.sized_deallocations, 4);
+
+  CHECK(Capable::deallocate_all(allocator));
+  CHECK_EQ(allocator.deallocate_alls, 1);
+}
+
+TEST_CASE("fallbacks") {
+  PassThroughAllocator allocator;
+  void* blocks[4];
+
+  CHECK_EQ(Basic::allocate_bulk(allocator, 16, 16, blocks, 4), 4);
+  CHECK_EQ(Basic::usable_size(allocator, blocks[0], 16), 16);
+  CHECK_FALSE(Basic::try_expand_in_place(allocator, blocks[0], 32));
+  CHECK_FALSE(Basic::deallocate_all(allocator));
+
+  for (auto block : blocks) {
+    Basic::deallocate(allocator, block, 16, 16);
+  }
+}
+
+TEST_CASE("reallocate_fallback") {
+  PageAllocator pages(4096);
+  Arena arena(pages);
+
+  // Arena has no reallocate(); the last block grows in place.
+  auto memory = static_cast<char*>(arena.allocate(16));
+  std::strcpy(memory, "arena");
+  CHECK_EQ(AllocatorTraits<Arena>::reallocate(arena, memory, 16, 64, 16),
+           memory);
+
+  // Any other block is copied.
+  arena.allocate(16);
+  auto moved = static_cast<char*>(
+      AllocatorTraits<Arena>::reallocate(arena, memory, 64, 128, 16));
+  CHECK_NE(moved, memory);
+  CHECK_EQ(std::strcmp(moved, "arena"), 0);
+
+  CHECK(AllocatorTraits<Arena>::deallocate_all(arena));
+  CHECK_EQ(arena.num_pages(), 0);
+}
+
+TEST_CASE("composite_detection") {
+  using Inline = InlineAllocator<64, PassThroughAllocator>;
+
+  // Composites declare owns() and deallocate_all() only if every part has it.
+  CHECK(AllocatorTraits<Segregator<64, Inline, Inline>>::has_owns::value);
+  CHECK_FALSE(AllocatorTraits<
+              Segregator<64, Inline, PassThroughAllocator>>::has_owns::value);
+  CHECK(AllocatorTraits<
+        Segregator<64, Arena, Arena>>::has_deallocate_all::value);
+  CHECK_FALSE(AllocatorTraits<
+              Segregator<64, Arena, Inline>>::has_deallocate_all::value);
+
+  CHECK(AllocatorTraits<FallbackAllocator<Inline, Inline>>::has_owns::value);
+  CHECK_FALSE(AllocatorTraits<
+              FallbackAllocator<Inline, PassThroughAllocator>>::has_owns::value);
+  CHECK(AllocatorTraits<
+        FallbackAllocator<Arena, Arena>>::has_deallocate_all::value);
+  CHECK_FALSE(AllocatorTraits<
+              FallbackAllocator<Inline, Arena>>::has_deallocate_all::value);
+
+  CHECK(AllocatorTraits<Bucketizer<Arena, 1, 64, 16>>::has_owns::value);
+  CHECK(AllocatorTraits<
+        Bucketizer<Arena, 1, 64, 16>>::has_deallocate_all::value);
+  CHECK_FALSE(AllocatorTraits<
+              Bucketizer<PassThroughAllocator, 1, 64, 16>>::has_owns::value);
+  CHECK_FALSE(AllocatorTraits<Bucketizer<PassThroughAllocator, 1, 64, 16>>::
+                  has_deallocate_all::value);
+
+  // So the traits fall back rather than failing to compile.
+  PassThroughAllocator heap;
+  Inline local(heap);
+  Segregator<64, Inline, PassThroughAllocator> segregator(local, heap);
+  CHECK_FALSE(AllocatorTraits<decltype(segregator)>::deallocate_all(segregator));
+}
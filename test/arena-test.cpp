@@ -0,0 +1,319 @@
+/**
+ * @file arena-test.cpp
+ * @brief Unit tests of the Arena class.
+ */
+
+// My header
+#include "arena.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "page.h"
+#include "std_allocator_adapter.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace allok8or;
+
+static const size_t DEFAULT_PAGE_SIZE = 1024;
+
+// Test data type that records the order of destruction.
+class Tracked {
+public:
+  Tracked(std::vector<int>& log, int id) : m_log(log), m_id(id) {}
+  ~Tracked() { m_log.push_back(m_id); }
+
+private:
+  std::vector<int>& m_log;
+  int m_id;
+};
+
+TEST_CASE("create_arena") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+
+  CHECK_EQ(arena.num_pages(), 0);
+  CHECK_EQ(arena.parent(), nullptr);
+  CHECK_EQ(arena.num_children(), 0);
+  CHECK_EQ(pages.num_pages(), 0);
+}
+
+TEST_CASE("allocate") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+
+  SUBCASE("default_alignment") {
+    auto memory = call_allocate(arena, 24);
+    CHECK_NE(memory, nullptr);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % alignof(std::max_align_t),
+             0);
+    CHECK_EQ(arena.num_pages(), 1);
+  }
+
+  SUBCASE("aligned") {
+    call_allocate(arena, 1, 1);
+    auto memory = call_allocate(arena, 8, 64);
+    CHECK_NE(memory, nullptr);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 64, 0);
+  }
+
+  SUBCASE("sequential_allocations_share_page") {
+    auto first = static_cast<char*>(call_allocate(arena, 16, 16));
+    auto second = static_cast<char*>(call_allocate(arena, 16, 16));
+    CHECK_EQ(second, first + 16);
+    CHECK_EQ(arena.num_pages(), 1);
+  }
+
+  SUBCASE("spills_to_new_page") {
+    for (int i = 0; i < 4; ++i) {
+      CHECK_NE(call_allocate(arena, DEFAULT_PAGE_SIZE / 3), nullptr);
+    }
+    CHECK_EQ(arena.num_pages(), 2);
+    CHECK_EQ(pages.num_pages(), 2);
+  }
+
+  SUBCASE("larger_than_page") {
+    auto memory =
+        static_cast<char*>(call_allocate(arena, DEFAULT_PAGE_SIZE * 4));
+    REQUIRE_NE(memory, nullptr);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % alignof(std::max_align_t),
+             0);
+    std::memset(memory, 0xab, DEFAULT_PAGE_SIZE * 4);
+    CHECK(arena.owns(memory + DEFAULT_PAGE_SIZE * 4 - 1));
+    CHECK_EQ(arena.num_pages(), 0);
+    CHECK_EQ(arena.num_large_runs(), 1);
+
+    auto aligned = call_allocate(arena, DEFAULT_PAGE_SIZE, 256);
+    REQUIRE_NE(aligned, nullptr);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(aligned) % 256, 0);
+    CHECK_EQ(arena.num_large_runs(), 2);
+
+    // Small allocations still come from pages.
+    CHECK_NE(call_allocate(arena, 16), nullptr);
+    CHECK_EQ(arena.num_pages(), 1);
+
+    arena.release();
+    CHECK_EQ(arena.num_large_runs(), 0);
+    CHECK_FALSE(arena.owns(memory));
+  }
+}
+
+TEST_CASE("owns") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+  Arena child(&arena);
+
+  auto first = call_allocate(arena, DEFAULT_PAGE_SIZE / 2);
+  auto second = call_allocate(arena, DEFAULT_PAGE_SIZE / 2);
+  auto child_memory = call_allocate(child, 16);
+  int other = 0;
+
+  CHECK(arena.owns(first));
+  CHECK(arena.owns(second));
+  CHECK_FALSE(arena.owns(child_memory));
+  CHECK_FALSE(arena.owns(&other));
+  CHECK(child.owns(child_memory));
+
+  arena.release();
+  CHECK_FALSE(arena.owns(first));
+}
+
+TEST_CASE("owns_many_pages") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+  Arena other(pages);
+
+  std::vector<char*> blocks;
+  std::vector<char*> other_blocks;
+  for (int i = 0; i < 500; ++i) {
+    blocks.push_back(
+        static_cast<char*>(call_allocate(arena, DEFAULT_PAGE_SIZE / 2)));
+    other_blocks.push_back(
+        static_cast<char*>(call_allocate(other, DEFAULT_PAGE_SIZE / 2)));
+  }
+  CHECK_EQ(arena.num_pages(), 500);
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    CHECK(arena.owns(blocks[i]));
+    CHECK(arena.owns(blocks[i] + DEFAULT_PAGE_SIZE / 2 - 1));
+    CHECK_FALSE(arena.owns(other_blocks[i]));
+    CHECK(other.owns(other_blocks[i]));
+  }
+
+  arena.release();
+  for (auto block : blocks) {
+    CHECK_FALSE(arena.owns(block));
+  }
+}
+
+TEST_CASE("release_returns_pages") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+
+  for (int i = 0; i < 8; ++i) {
+    call_allocate(arena, DEFAULT_PAGE_SIZE / 2);
+  }
+  CHECK_EQ(arena.num_pages(), 8);
+  CHECK_EQ(pages.num_free_pages(), 0);
+
+  arena.release();
+  CHECK_EQ(arena.num_pages(), 0);
+  CHECK_EQ(pages.num_free_pages(), 8);
+
+  // Arena is reusable, and reuses the free pages.
+  CHECK_NE(call_allocate(arena, 32), nullptr);
+  CHECK_EQ(pages.num_pages(), 8);
+  CHECK_EQ(pages.num_free_pages(), 7);
+}
+
+TEST_CASE("destructors") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  std::vector<int> log;
+
+  SUBCASE("run_in_reverse_order") {
+    {
+      Arena arena(pages);
+      arena.create<Tracked>(log, 1);
+      arena.create<Tracked>(log, 2);
+      arena.create<Tracked>(log, 3);
+      CHECK(log.empty());
+    }
+    CHECK_EQ(log, std::vector<int>{3, 2, 1});
+  }
+
+  SUBCASE("register_destructor") {
+    Arena arena(pages);
+    auto object = static_cast<int*>(call_allocate(arena, sizeof(int)));
+    *object = 42;
+
+    static int destroyed = 0;
+    destroyed = 0;
+    CHECK(arena.register_destructor(
+        object, [](void* data) { destroyed = *static_cast<int*>(data); }));
+
+    arena.release();
+    CHECK_EQ(destroyed, 42);
+  }
+
+  SUBCASE("trivial_types_not_registered") {
+    Arena arena(pages);
+    auto value = arena.create<double>(4.2);
+    CHECK_EQ(*value, 4.2);
+
+    // Only the double itself was allocated: no destructor record.
+    auto next = static_cast<char*>(call_allocate(arena, 1, 1));
+    CHECK_EQ(next, reinterpret_cast<char*>(value) + sizeof(double));
+  }
+}
+
+TEST_CASE("child_arena") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena parent(pages);
+
+  SUBCASE("borrows_parent_pages") {
+    Arena child(&parent);
+    CHECK_EQ(child.parent(), &parent);
+    CHECK_EQ(&child.page_allocator(), &pages);
+    CHECK_EQ(parent.num_children(), 1);
+
+    call_allocate(child, 32);
+    CHECK_EQ(child.num_pages(), 1);
+    CHECK_EQ(parent.num_pages(), 0);
+    CHECK_EQ(pages.num_pages(), 1);
+  }
+
+  SUBCASE("returns_pages_on_destroy") {
+    call_allocate(parent, 32);
+    {
+      Arena child(&parent);
+      call_allocate(child, DEFAULT_PAGE_SIZE / 2);
+      call_allocate(child, DEFAULT_PAGE_SIZE / 2);
+      CHECK_EQ(pages.num_pages(), 3);
+    }
+    CHECK_EQ(parent.num_children(), 0);
+    CHECK_EQ(parent.num_pages(), 1);
+    CHECK_EQ(pages.num_free_pages(), 2);
+  }
+
+  SUBCASE("parent_release_releases_descendants") {
+    std::vector<int> log;
+    Arena child(&parent);
+    Arena grandchild(&child);
+    Arena sibling(&parent);
+
+    parent.create<Tracked>(log, 1);
+    child.create<Tracked>(log, 2);
+    grandchild.create<Tracked>(log, 3);
+    sibling.create<Tracked>(log, 4);
+    CHECK_EQ(pages.num_pages(), 4);
+
+    parent.release();
+
+    // Descendants first, then the parent's own objects.
+    CHECK_EQ(log.size(), 4);
+    CHECK_EQ(log.back(), 1);
+    CHECK_EQ(pages.num_free_pages(), 4);
+
+    CHECK_EQ(parent.num_children(), 0);
+    CHECK_EQ(child.parent(), nullptr);
+    CHECK_EQ(grandchild.parent(), nullptr);
+    CHECK_EQ(sibling.parent(), nullptr);
+  }
+}
+
+TEST_CASE("std_allocator_adapter") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+
+  StdAllocatorAdapter<int, Arena> allocator(arena);
+  std::vector<int, StdAllocatorAdapter<int, Arena>> numbers(allocator);
+  for (int i = 0; i < 100; ++i) {
+    numbers.push_back(i);
+  }
+
+  CHECK_EQ(numbers.size(), 100);
+  CHECK_EQ(numbers[99], 99);
+  CHECK_GT(arena.num_pages(), 0);
+
+  // Grows past a page.
+  for (int i = 100; i < 10000; ++i) {
+    numbers.push_back(i);
+  }
+  CHECK_EQ(numbers[9999], 9999);
+  CHECK_GT(arena.num_large_runs(), 0);
+}
+
+TEST_CASE("reallocate") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  Arena arena(pages);
+
+  SUBCASE("last_allocation_grows_in_place") {
+    auto memory = call_allocate(arena, 32);
+    CHECK(call_try_expand_in_place(arena, memory, 256));
+    CHECK_EQ(call_reallocate(arena, memory, 256, 512, 16), memory);
+
+    // Following allocations come after the expanded block.
+    auto next = static_cast<char*>(call_allocate(arena, 1, 1));
+    CHECK_EQ(next, static_cast<char*>(memory) + 512);
+  }
+
+  SUBCASE("earlier_allocation_is_copied") {
+    auto memory = static_cast<char*>(call_allocate(arena, 4));
+    std::memcpy(memory, "abc", 4);
+    call_allocate(arena, 4);
+
+    CHECK_FALSE(call_try_expand_in_place(arena, memory, 8));
+    auto moved = static_cast<char*>(call_reallocate(arena, memory, 4, 8, 16));
+    CHECK_NE(moved, memory);
+    CHECK_EQ(std::strcmp(moved, "abc"), 0);
+  }
+
+  SUBCASE("page_too_small") {
+    auto memory = call_allocate(arena, 32);
+    CHECK_FALSE(call_try_expand_in_place(arena, memory, DEFAULT_PAGE_SIZE));
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ * @file block_allocator-test.cpp
+ * @brief Unit tests of the BlockAllocator class.
+ */
+
+// My header
+#include "block_allocator.h"
+
+// Project headers
+#include "page.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <set>
+#include <vector>
+
+using namespace allok8or;
+
+TEST_CASE_TEMPLATE("allocate_and_deallocate",
+                   T,
+                   BlockAllocator<8, 8>,
+                   BlockAllocator<24, 8>,
+                   BlockAllocator<48, 16>,
+                   BlockAllocator<100, 64>) {
+  PageAllocator pages(4096);
+
+  SUBCASE("blocks_are_aligned_and_distinct") {
+    T allocator(pages);
+
+    std::set<void*> blocks;
+    for (int i = 0; i < 200; ++i) {
+      auto block = allocator.allocate();
+      REQUIRE(block);
+      CHECK_EQ(reinterpret_cast<uintptr_t>(block) % T::alignment, 0);
+      blocks.insert(block);
+    }
+
+    CHECK_EQ(blocks.size(), 200);
+    CHECK_EQ(allocator.num_allocated(), 200);
+    CHECK_GT(allocator.num_pages(), 1);
+
+    for (auto block : blocks) {
+      allocator.deallocate(block);
+    }
+    CHECK_EQ(allocator.num_allocated(), 0);
+  }
+
+  SUBCASE("blocks_are_reused") {
+    T allocator(pages);
+
+    auto block = allocator.allocate();
+    auto num_free = allocator.num_free();
+    allocator.deallocate(block);
+
+    CHECK_EQ(allocator.num_free(), num_free + 1);
+    CHECK_EQ(allocator.allocate(), block);
+    CHECK_EQ(allocator.num_pages(), 1);
+
+    allocator.deallocate(block);
+  }
+
+  SUBCASE("pages_returned_on_destruction") {
+    {
+      T allocator(pages);
+      std::vector<void*> blocks;
+      for (int i = 0; i < 200; ++i) {
+        blocks.push_back(allocator.allocate());
+      }
+      for (auto block : blocks) {
+        allocator.deallocate(block);
+      }
+    }
+
+    CHECK_EQ(pages.num_pages(), pages.num_free_pages());
+  }
+}
+
+TEST_CASE("no_pages_until_first_allocation") {
+  PageAllocator pages(4096);
+  BlockAllocator<32, 8> allocator(pages);
+
+  CHECK_EQ(allocator.num_pages(), 0);
+  CHECK_EQ(pages.num_pages(), 0);
+
+  auto block = allocator.allocate();
+  CHECK_EQ(allocator.num_pages(), 1);
+  allocator.deallocate(block);
+}
+
+TEST_CASE("block_larger_than_page") {
+  PageAllocator pages(4096);
+  BlockAllocator<8192, 8> allocator(pages);
+
+  CHECK_EQ(nullptr, allocator.allocate());
+  CHECK_EQ(allocator.num_pages(), 0);
+  CHECK_EQ(pages.num_pages(), pages.num_free_pages());
+}
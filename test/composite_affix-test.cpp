@@ -0,0 +1,101 @@
+/**
+ * @file composite_affix-test.cpp
+ * @brief Unit tests of the AffixAllocator class.
+ */
+
+// My header
+#include "composite/affix.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "mock_allocator.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+
+using namespace allok8or;
+
+struct Guard {
+  uint32_t value = 0xdeadbeef;
+};
+
+struct Header {
+  size_t size;
+  uint32_t tag;
+};
+
+TEST_CASE("affix_prefix_and_suffix") {
+  size_t requested_size = 0;
+  test::MockAllocator inner([&](size_t size, size_t) { requested_size = size; });
+  AffixAllocator<test::MockAllocator, Guard, Guard> allocator(inner);
+
+  auto memory = call_allocate(allocator, 100);
+  REQUIRE_NE(memory, nullptr);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % alignof(std::max_align_t), 0);
+  CHECK_GE(requested_size, 100 + 2 * sizeof(Guard));
+
+  CHECK_EQ(allocator.prefix(memory).value, 0xdeadbeef);
+  CHECK_EQ(allocator.suffix(memory, 100).value, 0xdeadbeef);
+
+  // The user memory doesn't overlap the affixes.
+  std::memset(memory, 0, 100);
+  CHECK_EQ(allocator.prefix(memory).value, 0xdeadbeef);
+  CHECK_EQ(allocator.suffix(memory, 100).value, 0xdeadbeef);
+
+  call_deallocate(allocator, memory);
+}
+
+TEST_CASE("affix_prefix_only") {
+  void* inner_block = nullptr;
+  void* inner_deallocated = nullptr;
+  test::MockAllocator inner(nullptr, [&](void* data) { inner_deallocated = data; });
+  AffixAllocator<test::MockAllocator, Header> allocator(inner);
+  CHECK_EQ(decltype(allocator)::SUFFIX_SIZE, 0);
+
+  auto memory = call_allocate(allocator, 24);
+  allocator.prefix(memory).size = 24;
+  allocator.prefix(memory).tag = 7;
+  inner_block = static_cast<char*>(memory) - sizeof(Header);
+
+  call_deallocate(allocator, memory);
+  CHECK_LE(inner_deallocated, inner_block);
+}
+
+TEST_CASE("affix_over_aligned") {
+  size_t requested_alignment = 0;
+  size_t deallocated_alignment = 0;
+  test::MockAllocator inner(
+      [&](size_t, size_t alignment) { requested_alignment = alignment; },
+      nullptr,
+      [&](void*, size_t, size_t alignment) {
+        deallocated_alignment = alignment;
+      });
+  AffixAllocator<test::MockAllocator, Guard, Guard> allocator(inner);
+
+  auto memory = call_allocate(allocator, 100, 128);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 128, 0);
+  CHECK_EQ(requested_alignment, 128);
+  CHECK_EQ(allocator.prefix(memory).value, 0xdeadbeef);
+
+  call_deallocate(allocator, memory, 100, 128);
+  CHECK_EQ(deallocated_alignment, 128);
+}
+
+TEST_CASE("affix_reallocate") {
+  test::MockAllocator inner;
+  AffixAllocator<test::MockAllocator, Header, Guard> allocator(inner);
+
+  auto memory = static_cast<char*>(call_allocate(allocator, 16));
+  allocator.prefix(memory).tag = 42;
+  memory[0] = 'z';
+
+  auto resized = static_cast<char*>(
+      call_reallocate(allocator, memory, 16, 1000, alignof(std::max_align_t)));
+  REQUIRE_NE(resized, nullptr);
+  CHECK_EQ(allocator.prefix(resized).tag, 42);
+  CHECK_EQ(resized[0], 'z');
+  CHECK_EQ(allocator.suffix(resized, 1000).value, 0xdeadbeef);
+
+  call_deallocate(allocator, resized, 1000, alignof(std::max_align_t));
+}
@@ -0,0 +1,81 @@
+/**
+ * @file composite_bucketizer-test.cpp
+ * @brief Unit tests of the Bucketizer class.
+ */
+
+// My header
+#include "composite/bucketizer.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "inline.h"
+#include "mock_allocator.h"
+
+// Library headers
+#include "doctest.h"
+
+using namespace allok8or;
+
+using Bucket = InlineAllocator<512, test::MockAllocator>;
+using TestAllocator = Bucketizer<Bucket, 1, 128, 32>;
+
+TEST_CASE("bucketizer_sizes") {
+  CHECK_EQ(TestAllocator::NUM_BUCKETS, 4);
+  CHECK_EQ(TestAllocator::bucket_index(1), 0);
+  CHECK_EQ(TestAllocator::bucket_index(32), 0);
+  CHECK_EQ(TestAllocator::bucket_index(33), 1);
+  CHECK_EQ(TestAllocator::bucket_index(128), 3);
+  CHECK_EQ(TestAllocator::bucket_size(0), 32);
+  CHECK_EQ(TestAllocator::bucket_size(3), 128);
+  CHECK_FALSE(TestAllocator::in_range(0));
+  CHECK_FALSE(TestAllocator::in_range(129));
+}
+
+TEST_CASE("bucketizer_allocate") {
+  test::MockAllocator heap;
+  TestAllocator allocator(heap);
+
+  auto a = call_allocate(allocator, 10);
+  auto b = call_allocate(allocator, 40);
+  auto c = call_allocate(allocator, 128);
+  CHECK(allocator.bucket(0).owns(a));
+  CHECK(allocator.bucket(1).owns(b));
+  CHECK(allocator.bucket(3).owns(c));
+
+  // Each bucket hands out blocks of its own (largest) size.
+  CHECK_EQ(allocator.bucket(0).used(), 32);
+  CHECK_EQ(allocator.bucket(1).used(), 64);
+
+  CHECK_EQ(call_allocate(allocator, 0), nullptr);
+  CHECK_EQ(call_allocate(allocator, 129), nullptr);
+
+  call_deallocate(allocator, c, 128, alignof(std::max_align_t));
+  call_deallocate(allocator, b);
+  call_deallocate(allocator, a);
+  CHECK_EQ(allocator.bucket(0).used(), 0);
+  CHECK_EQ(allocator.bucket(1).used(), 0);
+  CHECK_EQ(allocator.bucket(3).used(), 0);
+}
+
+TEST_CASE("bucketizer_reallocate") {
+  test::MockAllocator heap;
+  TestAllocator allocator(heap);
+
+  auto memory = static_cast<char*>(call_allocate(allocator, 20));
+  memory[0] = 'q';
+
+  // Same bucket: no move.
+  CHECK_EQ(call_reallocate(allocator, memory, 20, 30, alignof(std::max_align_t)),
+           memory);
+  CHECK(call_try_expand_in_place(allocator, memory, 32));
+  CHECK_FALSE(call_try_expand_in_place(allocator, memory, 33));
+
+  auto moved = static_cast<char*>(
+      call_reallocate(allocator, memory, 30, 100, alignof(std::max_align_t)));
+  REQUIRE_NE(moved, nullptr);
+  CHECK(allocator.bucket(3).owns(moved));
+  CHECK_EQ(moved[0], 'q');
+  CHECK_EQ(allocator.bucket(0).used(), 0);
+
+  call_deallocate(allocator, moved, 100, alignof(std::max_align_t));
+}
@@ -0,0 +1,138 @@
+/**
+ * @file composite_fallback-test.cpp
+ * @brief Unit tests of the FallbackAllocator class.
+ */
+
+// My header
+#include "composite/fallback.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "mock_allocator.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+
+using namespace allok8or;
+
+/**
+ * @brief Bump allocator over a small buffer, which fails once the buffer is
+ * full; a primary that can run out.
+ */
+class BufferAllocator : public Allocator<BufferAllocator> {
+public:
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const {
+    auto offset = (m_used + alignment - 1) & ~(alignment - 1);
+    if (offset + size > sizeof(m_buffer)) {
+      return nullptr;
+    }
+    m_used = offset + size;
+    ++allocations;
+    return m_buffer + offset;
+  }
+
+  void deallocate(void*) const { ++deallocations; }
+
+  bool owns(const void* data) const {
+    auto bytes = static_cast<const char*>(data);
+    return bytes >= m_buffer && bytes < m_buffer + sizeof(m_buffer);
+  }
+
+  mutable int allocations = 0;
+  mutable int deallocations = 0;
+
+private:
+  alignas(std::max_align_t) mutable char m_buffer[128];
+  mutable size_t m_used = 0;
+};
+
+using TestAllocator = FallbackAllocator<BufferAllocator, test::MockAllocator>;
+
+TEST_CASE("fallback_allocate") {
+  int fallback_allocations = 0;
+  BufferAllocator primary;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_allocations; });
+  TestAllocator allocator(primary, fallback);
+
+  auto first = call_allocate(allocator, 64);
+  CHECK(primary.owns(first));
+  CHECK_EQ(fallback_allocations, 0);
+
+  auto second = call_allocate(allocator, 128, 32);
+  CHECK_FALSE(primary.owns(second));
+  CHECK_EQ(reinterpret_cast<uintptr_t>(second) % 32, 0);
+  CHECK_EQ(fallback_allocations, 1);
+
+  call_deallocate(allocator, second);
+  call_deallocate(allocator, first);
+}
+
+TEST_CASE("fallback_deallocate_by_owner") {
+  int fallback_deallocations = 0;
+  int fallback_sized_deallocations = 0;
+  BufferAllocator primary;
+  test::MockAllocator fallback(
+      nullptr,
+      [&](void*) { ++fallback_deallocations; },
+      [&](void*, size_t, size_t) { ++fallback_sized_deallocations; });
+  TestAllocator allocator(primary, fallback);
+
+  auto in_primary = call_allocate(allocator, 32);
+  auto in_fallback = call_allocate(allocator, 256);
+
+  call_deallocate(allocator, in_primary);
+  CHECK_EQ(primary.deallocations, 1);
+  CHECK_EQ(fallback_deallocations, 0);
+
+  call_deallocate(allocator, in_fallback, 256, alignof(std::max_align_t));
+  CHECK_EQ(primary.deallocations, 1);
+  CHECK_EQ(fallback_sized_deallocations, 1);
+}
+
+TEST_CASE("fallback_reallocate_moves_to_fallback") {
+  int fallback_allocations = 0;
+  BufferAllocator primary;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_allocations; });
+  TestAllocator allocator(primary, fallback);
+
+  auto memory = static_cast<char*>(call_allocate(allocator, 16));
+  memory[0] = 'x';
+  memory[15] = 'y';
+
+  auto resized = static_cast<char*>(
+      call_reallocate(allocator, memory, 16, 512, alignof(std::max_align_t)));
+  REQUIRE_NE(resized, nullptr);
+  CHECK_FALSE(primary.owns(resized));
+  CHECK_EQ(resized[0], 'x');
+  CHECK_EQ(resized[15], 'y');
+  CHECK_EQ(fallback_allocations, 1);
+  CHECK_EQ(primary.deallocations, 1);
+
+  call_deallocate(allocator, resized);
+}
+
+TEST_CASE("fallback_nested") {
+  BufferAllocator first;
+  BufferAllocator second;
+  test::MockAllocator heap;
+
+  // Both primaries have owns(), so the inner composite has one too.
+  using Inner = FallbackAllocator<BufferAllocator, BufferAllocator>;
+  Inner inner(first, second);
+  FallbackAllocator<Inner, test::MockAllocator> allocator(inner, heap);
+
+  auto a = call_allocate(allocator, 100);
+  auto b = call_allocate(allocator, 100);
+  auto c = call_allocate(allocator, 100);
+  CHECK(first.owns(a));
+  CHECK(second.owns(b));
+  CHECK_FALSE(inner.owns(c));
+
+  call_deallocate(allocator, c);
+  call_deallocate(allocator, b);
+  call_deallocate(allocator, a);
+  CHECK_EQ(first.deallocations, 1);
+  CHECK_EQ(second.deallocations, 1);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file composite_segregator-test.cpp
+ * @brief Unit tests of the Segregator class.
+ */
+
+// My header
+#include "composite/segregator.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "arena.h"
+#include "inline.h"
+#include "mock_allocator.h"
+#include "page.h"
+
+// Library headers
+#include "doctest.h"
+
+using namespace allok8or;
+
+using Small = InlineAllocator<1024, test::MockAllocator>;
+using TestAllocator = Segregator<64, Small, test::MockAllocator>;
+
+TEST_CASE("segregator_allocate") {
+  int large_allocations = 0;
+  test::MockAllocator heap;
+  test::MockAllocator large([&](size_t, size_t) { ++large_allocations; });
+  Small small(heap);
+  TestAllocator allocator(small, large);
+
+  auto at_threshold = call_allocate(allocator, 64);
+  CHECK(small.owns(at_threshold));
+  CHECK_EQ(large_allocations, 0);
+
+  auto above = call_allocate(allocator, 65);
+  CHECK_FALSE(small.owns(above));
+  CHECK_EQ(large_allocations, 1);
+
+  call_deallocate(allocator, above, 65, alignof(std::max_align_t));
+  call_deallocate(allocator, at_threshold, 64, alignof(std::max_align_t));
+}
+
+TEST_CASE("segregator_deallocate") {
+  int large_deallocations = 0;
+  int large_sized_deallocations = 0;
+  test::MockAllocator heap;
+  test::MockAllocator large(
+      nullptr,
+      [&](void*) { ++large_deallocations; },
+      [&](void*, size_t, size_t) { ++large_sized_deallocations; });
+  Small small(heap);
+  TestAllocator allocator(small, large);
+
+  SUBCASE("sized") {
+    auto memory = call_allocate(allocator, 100);
+    call_deallocate(allocator, memory, 100, alignof(std::max_align_t));
+    CHECK_EQ(large_sized_deallocations, 1);
+  }
+
+  SUBCASE("unsized") {
+    auto small_memory = call_allocate(allocator, 16);
+    auto large_memory = call_allocate(allocator, 100);
+    call_deallocate(allocator, small_memory);
+    CHECK_EQ(large_deallocations, 0);
+    call_deallocate(allocator, large_memory);
+    CHECK_EQ(large_deallocations, 1);
+  }
+}
+
+TEST_CASE("segregator_reallocate_across_threshold") {
+  int large_allocations = 0;
+  test::MockAllocator heap;
+  test::MockAllocator large([&](size_t, size_t) { ++large_allocations; });
+  Small small(heap);
+  TestAllocator allocator(small, large);
+
+  auto memory = static_cast<char*>(call_allocate(allocator, 32));
+  memory[0] = 'a';
+  memory[31] = 'b';
+
+  // Stays small; the inline allocator grows its last block in place.
+  auto grown = static_cast<char*>(
+      call_reallocate(allocator, memory, 32, 64, alignof(std::max_align_t)));
+  CHECK_EQ(grown, memory);
+
+  auto moved = static_cast<char*>(
+      call_reallocate(allocator, grown, 64, 200, alignof(std::max_align_t)));
+  REQUIRE_NE(moved, nullptr);
+  CHECK_FALSE(small.owns(moved));
+  CHECK_EQ(moved[0], 'a');
+  CHECK_EQ(moved[31], 'b');
+  CHECK_EQ(large_allocations, 1);
+
+  call_deallocate(allocator, moved, 200, alignof(std::max_align_t));
+}
+
+TEST_CASE("segregator_try_expand_in_place_keeps_side") {
+  test::MockAllocator heap;
+  PageAllocator pages(1024);
+  Arena large(pages);
+  Small small(heap);
+  Segregator<64, Small, Arena> allocator(small, large);
+
+  auto small_memory = call_allocate(allocator, 32);
+  CHECK(call_try_expand_in_place(allocator, small_memory, 64));
+  CHECK_FALSE(call_try_expand_in_place(allocator, small_memory, 65));
+
+  // The arena could resize either way; the segregator mustn't let it.
+  auto large_memory = call_allocate(allocator, 100);
+  CHECK(call_try_expand_in_place(allocator, large_memory, 200));
+  CHECK_FALSE(call_try_expand_in_place(allocator, large_memory, 64));
+  CHECK_FALSE(call_try_expand_in_place(allocator, large_memory, 32));
+}
@@ -0,0 +1,152 @@
+/**
+ * @file context-test.cpp
+ * @brief Unit tests of the ScopedAllocatorContext class.
+ *
+ */
+// My header
+#include "context.h"
+
+// Project headers
+#include "arena.h"
+#include "global.h"
+#include "mock_allocator.h"
+#include "page.h"
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <thread>
+
+using namespace allok8or;
+
+using Global = global::GlobalAllocator<PassThroughAllocator>;
+using MockGlobal = global::GlobalAllocator<test::MockAllocator>;
+
+TEST_CASE("scoped_allocator_context") {
+  size_t allocated = 0;
+  size_t deallocated = 0;
+  size_t deallocated_sized = 0;
+  test::MockAllocator allocator(
+      [&](size_t, size_t) { ++allocated; },
+      [&](void*) { ++deallocated; },
+      [&](void*, size_t, size_t) { ++deallocated_sized; });
+
+  PassThroughAllocator global_allocator;
+  Global::init(&global_allocator);
+
+  SUBCASE("push_and_pop") {
+    CHECK_EQ(current_allocator_context(), nullptr);
+    {
+      ScopedAllocatorContext context(allocator, owns_every_block);
+      CHECK_EQ(current_allocator_context(), &context.context());
+      CHECK_EQ(current_allocator_context()->allocator, &allocator);
+    }
+    CHECK_EQ(current_allocator_context(), nullptr);
+  }
+
+  SUBCASE("nesting") {
+    test::MockAllocator inner_allocator;
+
+    ScopedAllocatorContext outer(allocator, owns_every_block);
+    {
+      ScopedAllocatorContext inner(inner_allocator, owns_every_block);
+      CHECK_EQ(current_allocator_context()->allocator, &inner_allocator);
+      CHECK_EQ(current_allocator_context()->previous, &outer.context());
+    }
+    CHECK_EQ(current_allocator_context(), &outer.context());
+  }
+
+  SUBCASE("redirects_global_allocator") {
+    ScopedAllocatorContext context(allocator, owns_every_block);
+
+    auto memory = Global::allocate(64);
+    CHECK_NE(memory, nullptr);
+    CHECK_EQ(allocated, 1);
+    Global::deallocate(memory);
+    CHECK_EQ(deallocated, 1);
+
+    memory = Global::allocate(64, 32);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 32, 0);
+    CHECK_EQ(allocated, 2);
+    Global::deallocate(memory, 64, 32);
+    CHECK_EQ(deallocated_sized, 1);
+  }
+
+  SUBCASE("redirects_reallocate") {
+    ScopedAllocatorContext context(allocator, owns_every_block);
+
+    auto memory = static_cast<char*>(Global::allocate(16, 8));
+    memory[0] = 'a';
+    memory = static_cast<char*>(Global::reallocate(memory, 16, 256, 8));
+    REQUIRE_NE(memory, nullptr);
+    CHECK_EQ(memory[0], 'a');
+    CHECK_EQ(allocated, 2);
+
+    Global::deallocate(memory, 256, 8);
+  }
+
+  SUBCASE("global_allocator_after_scope") {
+    { ScopedAllocatorContext context(allocator, owns_every_block); }
+
+    auto memory = Global::allocate(64);
+    Global::deallocate(memory);
+    CHECK_EQ(allocated, 0);
+    CHECK_EQ(deallocated, 0);
+  }
+
+  SUBCASE("per_thread") {
+    ScopedAllocatorContext context(allocator, owns_every_block);
+
+    const AllocatorContext* other_context = &context.context();
+    std::thread other([&] { other_context = current_allocator_context(); });
+    other.join();
+    CHECK_EQ(other_context, nullptr);
+  }
+
+  Global::cleanup();
+}
+
+TEST_CASE("free_outside_memory_in_context") {
+  size_t deallocated = 0;
+  size_t deallocated_sized = 0;
+  test::MockAllocator global_allocator(
+      nullptr,
+      [&](void*) { ++deallocated; },
+      [&](void*, size_t, size_t) { ++deallocated_sized; });
+  MockGlobal::init(&global_allocator);
+
+  PageAllocator pages(1024);
+  Arena arena(pages);
+
+  auto before = MockGlobal::allocate(64);
+  auto before_sized = MockGlobal::allocate(64, 32);
+  {
+    ScopedAllocatorContext context(arena);
+
+    // Allocated before the context: back to the global allocator.
+    MockGlobal::deallocate(before);
+    CHECK_EQ(deallocated, 1);
+    MockGlobal::deallocate(before_sized, 64, 32);
+    CHECK_EQ(deallocated_sized, 1);
+
+    // Allocated in the context: to the arena.
+    auto inside = MockGlobal::allocate(64);
+    CHECK(arena.owns(inside));
+    auto count = deallocated;
+    MockGlobal::deallocate(inside);
+    CHECK_EQ(deallocated, count);
+  }
+
+  SUBCASE("reallocate_moves_into_context") {
+    auto outside = static_cast<char*>(MockGlobal::allocate(16, 8));
+    outside[0] = 'a';
+    ScopedAllocatorContext context(arena);
+
+    auto moved = static_cast<char*>(MockGlobal::reallocate(outside, 16, 64, 8));
+    CHECK(arena.owns(moved));
+    CHECK_EQ(moved[0], 'a');
+    CHECK_EQ(deallocated_sized, 2);
+  }
+
+  MockGlobal::cleanup();
+}
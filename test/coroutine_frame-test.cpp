@@ -0,0 +1,152 @@
+/**
+ * @file coroutine_frame-test.cpp
+ * @brief Unit tests of PooledCoroutineFrame and FramePools.
+ *
+ * NOTE: C++20 only.
+ */
+
+// My header
+#include "coroutine_frame.h"
+
+// Library headers
+#include "doctest.h"
+#include <coroutine>
+#include <exception>
+#include <thread>
+#include <utility>
+
+using namespace allok8or;
+using coroutine::FramePools;
+
+/**
+ * @brief Lazily started coroutine returning an int, whose frame comes from
+ * the pools.
+ */
+struct Task {
+  struct promise_type : PooledCoroutineFrame {
+    int value = 0;
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void return_value(int result) { value = result; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+  Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  bool await_ready() { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  int await_resume() { return handle.promise().value; }
+
+  int run() {
+    handle.resume();
+    return handle.promise().value;
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+Task leaf(int value) { co_return value; }
+
+Task chain(int depth) {
+  if (!depth) {
+    co_return co_await leaf(0);
+  }
+  co_return co_await chain(depth - 1) + 1;
+}
+
+Task large_frame() {
+  char buffer[4 * coroutine::MAX_POOLED_FRAME_SIZE] = {};
+  co_await leaf(0);
+  co_return buffer[0];
+}
+
+TEST_CASE("frames_are_pooled") {
+  auto& pools = FramePools::local();
+  const auto before = pools.num_allocated();
+
+  {
+    auto task = leaf(7);
+    CHECK_EQ(pools.num_allocated(), before + 1);
+    CHECK_EQ(task.run(), 7);
+  }
+  CHECK_EQ(pools.num_allocated(), before);
+}
+
+TEST_CASE("frames_are_recycled") {
+  void* first = nullptr;
+  {
+    auto task = leaf(1);
+    first = &task.handle.promise();
+  }
+
+  auto task = leaf(2);
+  CHECK_EQ(static_cast<void*>(&task.handle.promise()), first);
+}
+
+TEST_CASE("chained_await") {
+  auto& pools = FramePools::local();
+  const auto before = pools.num_allocated();
+
+  auto task = chain(10);
+  CHECK_EQ(task.run(), 10);
+  CHECK_EQ(pools.num_allocated(), before + 1);
+}
+
+TEST_CASE("large_frames_use_the_heap") {
+  auto& pools = FramePools::local();
+  const auto before = pools.num_allocated();
+
+  auto task = large_frame();
+  CHECK_EQ(pools.num_allocated(), before);
+  CHECK_EQ(task.run(), 0);
+}
+
+TEST_CASE("destroyed_on_another_thread") {
+  auto& pools = FramePools::local();
+  const auto before = pools.num_allocated();
+
+  auto task = leaf(3);
+  std::thread other([moved = std::move(task)]() mutable { moved.run(); });
+  other.join();
+
+  // Still counted until this thread drains its remote frees.
+  CHECK_EQ(pools.num_allocated(), before + 1);
+
+  auto next = leaf(4);
+  CHECK_EQ(pools.num_allocated(), before + 1);
+}
+
+TEST_CASE("pools_are_adopted_by_new_threads") {
+  FramePools* first = nullptr;
+  std::thread([&] { first = &FramePools::local(); }).join();
+
+  FramePools* second = nullptr;
+  std::thread([&] { second = &FramePools::local(); }).join();
+
+  CHECK_EQ(first, second);
+}
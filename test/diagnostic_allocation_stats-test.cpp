@@ -11,6 +11,8 @@
 
 // Library headers.
 #include "doctest.h"
+#include <set>
+#include <vector>
 
 using namespace allok8or;
 
@@ -56,6 +58,20 @@ TEST_CASE("different_keys_hash_unequal") {
   CHECK_NE(h1, h2);
 }
 
+TEST_CASE("keys_spread_over_slots") {
+  // Type and line moving together used to collide with the old hash.
+  const char types[512] = {};
+  const size_t mask = 1023;
+  std::set<size_t> slots;
+  for (int i = 0; i < 512; ++i) {
+    diagnostic::AllocationStatsKey key{&types[i], "foo.cpp", i};
+    slots.insert(diagnostic::AllocationStatsKey::hash()(key) & mask);
+  }
+
+  // Random placement would fill about 400 of 1024 slots with 512 keys.
+  CHECK_GT(slots.size(), 350);
+}
+
 //
 // AllocationStats tests
 //
@@ -207,3 +223,77 @@ TEST_CASE("track_allocations") {
   }
 
 }
+
+TEST_CASE("track_histograms") {
+  diagnostic::AllocationStatsTracker tracker;
+  diagnostic::AllocationStatsKey foo{"Foo", "foo.h", 42};
+  diagnostic::site_id_t site =
+      diagnostic::CallSiteRegistry::instance().intern(foo);
+  using Stats = diagnostic::AllocationStats;
+
+  SUBCASE("sizes") {
+    tracker.track_allocation(site, 48);
+    tracker.track_allocation(site, 48);
+    tracker.track_allocation(site, 4096);
+
+    const auto& sizes = tracker.stats(site).sizes;
+    CHECK_EQ(3, sizes.total());
+    CHECK_EQ(2, sizes.counts[Stats::SizeHistogram::bucket(48)]);
+    CHECK_EQ(1, sizes.counts[Stats::SizeHistogram::bucket(4096)]);
+  }
+
+  SUBCASE("lifetimes") {
+    tracker.track_allocation(site, 48);
+    tracker.track_allocation(site, 48);
+    tracker.track_deallocation(site, 48, 1500);
+    tracker.track_deallocation(site, 48); // Untimed
+
+    const auto& stats = tracker.stats(site);
+    CHECK_EQ(2, stats.deallocations);
+    CHECK_EQ(1, stats.lifetimes.total());
+    CHECK_EQ(1, stats.lifetimes.counts[Stats::LifetimeHistogram::bucket(1500)]);
+  }
+
+  SUBCASE("merged") {
+    diagnostic::AllocationStatsTracker other;
+    tracker.track_allocation(site, 48);
+    other.track_allocation(site, 48);
+    other.track_deallocation(site, 48, 1500);
+
+    tracker.merge(other);
+    const auto& stats = tracker.stats(site);
+    CHECK_EQ(2, stats.sizes.counts[Stats::SizeHistogram::bucket(48)]);
+    CHECK_EQ(1, stats.lifetimes.total());
+  }
+}
+
+TEST_CASE("sparse_sites") {
+  diagnostic::AllocationStatsTracker tracker;
+  const diagnostic::site_id_t low = 3;
+  const diagnostic::site_id_t high = 100000;
+
+  // Nothing is kept for sites without events.
+  CHECK_EQ(nullptr, tracker.stats().find(low));
+  CHECK_EQ(0, tracker.stats().size());
+
+  tracker.track_allocation(high, 64);
+  tracker.track_allocation(low, 32);
+  tracker.track_deallocation(high, 64, 100);
+
+  CHECK_EQ(2, tracker.stats().size());
+  CHECK_EQ(nullptr, tracker.stats().find(high - 1));
+  CHECK_EQ(1, tracker.stats(high).deallocations);
+  CHECK_EQ(32, tracker.stats(low).bytes_allocated);
+
+  // Visited in ID order, skipping the sites in between.
+  std::vector<diagnostic::site_id_t> sites;
+  for (auto it = tracker.stats().begin(); it != tracker.stats().end(); ++it) {
+    sites.push_back(it.site());
+  }
+  CHECK_EQ(std::vector<diagnostic::site_id_t>{low, high}, sites);
+
+  diagnostic::AllocationStatsTracker merged;
+  merged.merge(tracker);
+  CHECK_EQ(2, merged.stats().size());
+  CHECK_EQ(1, merged.stats(high).lifetimes.total());
+}
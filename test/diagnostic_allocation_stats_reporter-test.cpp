@@ -212,3 +212,36 @@ TEST_CASE("allocation_stats_csv_reporter") {
                   "No expected values found in output.");
   }
 }
+
+TEST_CASE("allocation_histogram_csv_reporter") {
+  diagnostic::AllocationStatsTracker tracker;
+  diagnostic::AllocationHistogramCsvReporter reporter;
+  std::stringstream output;
+
+  diagnostic::AllocationStatsKey foo{"Foo", "foo.h", 42};
+  auto site = diagnostic::CallSiteRegistry::instance().intern(foo);
+
+  SUBCASE("allocate_none") {
+    reporter.report_stats(tracker.stats(), output);
+    auto result = output.str();
+
+    CHECK_EQ(1, count_lines(result));
+    CHECK(check_regex(result, "TypeName,File,Line,Histogram,Bucket Min,Count"));
+  }
+
+  SUBCASE("sizes_and_lifetimes") {
+    tracker.track_allocation(site, 48);
+    tracker.track_allocation(site, 48);
+    tracker.track_allocation(site, 4096);
+    tracker.track_deallocation(site, 48, 1500);
+
+    reporter.report_stats(tracker.stats(), output);
+    auto result = output.str();
+
+    // Header + two size buckets + one lifetime bucket.
+    CHECK_EQ(4, count_lines(result));
+    CHECK(check_regex(result, "Foo,foo.h,42,Size,32,2"));
+    CHECK(check_regex(result, "Foo,foo.h,42,Size,4096,1"));
+    CHECK(check_regex(result, "Foo,foo.h,42,Lifetime,1024,1"));
+  }
+}
@@ -11,12 +11,18 @@
 #include "align.h"
 #include "allocator.h"
 #include "allocator_call_helper.h"
+#include "diagnostic/allocation_stats.h"
+#include "mock_allocator.h"
 #include "pass_through.h"
 
 // Library headers
 #include "doctest.h"
 #include <array>
+#include <atomic>
+#include <cstring>
 #include <memory>
+#include <thread>
+#include <vector>
 
 using namespace allok8or;
 
@@ -282,4 +288,356 @@ TEST_CASE("compare_equal") {
 
 
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("reallocate") {
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  // DiagnosticAllocator has no reallocate of its own, so this exercises the
+  // generic allocate-copy-deallocate fallback.
+  auto memory = static_cast<int*>(call_allocate(allocator, sizeof(int) * 4));
+  for (int i = 0; i < 4; ++i) {
+    memory[i] = i;
+  }
+
+  auto resized = static_cast<int*>(call_reallocate(allocator,
+                                                   memory,
+                                                   sizeof(int) * 4,
+                                                   sizeof(int) * 64,
+                                                   alignof(std::max_align_t)));
+  CHECK_NE(resized, nullptr);
+  for (int i = 0; i < 4; ++i) {
+    CHECK_EQ(resized[i], i);
+  }
+
+  CHECK_EQ(1, allocator.Tracker().num_blocks());
+  CHECK_EQ(
+      align::get_aligned_size(sizeof(int) * 64, alignof(std::max_align_t)),
+      allocator.Tracker().num_bytes());
+
+  call_deallocate(allocator, resized);
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
+
+TEST_CASE("deallocate_sized") {
+  size_t deallocated_size = 0;
+  auto on_deallocate_sized = [&](void*, size_t size, size_t) {
+    deallocated_size = size;
+  };
+
+  test::MockAllocator mock(nullptr, nullptr, on_deallocate_sized);
+  DiagnosticAllocator<test::MockAllocator> allocator(mock);
+
+  auto memory = call_allocate(allocator, 100, alignof(std::max_align_t));
+  call_deallocate(allocator, memory, 100, alignof(std::max_align_t));
+
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+  // The backing allocator sees the whole block, header included.
+  CHECK_GT(deallocated_size, 100);
+}
+
+/**
+ * @brief Tracking pool that can't record any more blocks.
+ */
+class FullTrackingPool : public diagnostic::AllocationTrackingPool {
+public:
+  bool add(diagnostic::BlockHeader*) { return false; }
+};
+
+TEST_CASE("tracking_pool_full") {
+  void* deallocated = nullptr;
+  auto on_deallocate = [&](void* memory) { deallocated = memory; };
+
+  test::MockAllocator mock(nullptr, on_deallocate);
+  DiagnosticAllocator<test::MockAllocator, FullTrackingPool> allocator(mock);
+
+  CHECK_EQ(nullptr, call_allocate(allocator, 100, alignof(std::max_align_t)));
+  // The block was handed back rather than leaked.
+  CHECK_NE(nullptr, deallocated);
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
+
+TEST_CASE("lifetimes") {
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  auto memory = call_allocate(allocator, 100);
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
+  auto header = diagnostic::BlockHeader::get_header(memory);
+  CHECK_LE(header->timestamp(), diagnostic::timestamp_ns());
+#else
+  // The compact header's allocation time is in the pool's side index.
+  const auto& blocks = allocator.Tracker().blocks();
+  REQUIRE_EQ(1, blocks.size());
+  CHECK_LE(blocks.begin()->timestamp, diagnostic::timestamp_ns());
+#endif
+  call_deallocate(allocator, memory);
+
+  diagnostic::AllocationStatsKey key{nullptr, nullptr, 0};
+  const auto& stats = allocator.Tracker().tracker().stats(key);
+  CHECK_EQ(stats.deallocations, stats.lifetimes.total());
+  CHECK_EQ(stats.allocations, stats.sizes.total());
+}
+
+TEST_CASE("sharded_allocate_deallocate") {
+  PassThroughAllocator pass_through;
+  ShardedDiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  auto memory1 = call_allocate(allocator, 100, alignof(std::max_align_t));
+  auto memory2 = call_allocate(allocator, 200, alignof(std::max_align_t));
+  CHECK_EQ(2, allocator.Tracker().num_blocks());
+
+  call_deallocate(allocator, memory1);
+  call_deallocate(allocator, memory2, 200, alignof(std::max_align_t));
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+  CHECK_EQ(0, allocator.Tracker().num_bytes());
+}
+
+TEST_CASE("sharded_foreign_pointers") {
+  int released = 0;
+  auto on_deallocate = [&](void*) { ++released; };
+
+  test::MockAllocator mock(nullptr, on_deallocate);
+  ShardedDiagnosticAllocator<test::MockAllocator> allocator(mock);
+
+  alignas(std::max_align_t) unsigned char buffer[256];
+
+  SUBCASE("no_header") {
+    memset(buffer, 0xff, sizeof(buffer));
+    call_deallocate(allocator, buffer + 128);
+    call_deallocate(allocator, buffer + 128, 64, alignof(std::max_align_t));
+    CHECK_EQ(0, released);
+  }
+
+  SUBCASE("shard_out_of_range") {
+    auto header = diagnostic::BlockHeader::create(
+        buffer, 64, alignof(std::max_align_t));
+    REQUIRE(header);
+    header->shard(diagnostic::NUM_TRACKING_SHARDS + 1);
+    diagnostic::ShardedTrackingPool pool;
+    CHECK_FALSE(pool.remove(header));
+    call_deallocate(allocator, header->user_data());
+    CHECK_EQ(0, released);
+  }
+}
+
+TEST_CASE("sharded_threads") {
+  std::atomic<int> released(0);
+  auto on_deallocate = [&](void*) { ++released; };
+
+  test::MockAllocator mock(nullptr, on_deallocate);
+  ShardedDiagnosticAllocator<test::MockAllocator> allocator(mock);
+
+  const int num_threads = 8;
+  const int blocks_per_thread = 1000;
+
+  SUBCASE("same_thread_frees") {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&] {
+        for (int i = 0; i < blocks_per_thread; ++i) {
+          call_deallocate(allocator, call_allocate(allocator, 64));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    CHECK_EQ(0, allocator.Tracker().num_blocks());
+    CHECK_EQ(num_threads * blocks_per_thread, released.load());
+  }
+
+  SUBCASE("cross_thread_frees") {
+    std::vector<std::vector<void*>> blocks(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t] {
+        for (int i = 0; i < blocks_per_thread; ++i) {
+          blocks[t].push_back(call_allocate(allocator, 64));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    CHECK_EQ(num_threads * blocks_per_thread, allocator.Tracker().num_blocks());
+
+    // Every block freed by a thread that didn't allocate it.
+    threads.clear();
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t] {
+        for (auto block : blocks[(t + 1) % num_threads]) {
+          call_deallocate(allocator, block, 64, alignof(std::max_align_t));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // Released at once, though the allocating threads have exited.
+    CHECK_EQ(num_threads * blocks_per_thread, released.load());
+    CHECK_EQ(0, allocator.Tracker().num_blocks());
+  }
+}
+
+TEST_CASE("sharded_snapshot") {
+  PassThroughAllocator pass_through;
+  ShardedDiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  const int num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&] {
+      auto memory = call_allocate(allocator, 64);
+      call_deallocate(allocator, memory);
+      call_allocate(allocator, 64); // Leaked, and tracked.
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto snapshot = allocator.Tracker().snapshot();
+  diagnostic::AllocationStatsKey key{nullptr, nullptr, 0};
+  const auto& stats = snapshot->stats(key);
+  CHECK_EQ(2 * num_threads, stats.allocations);
+  CHECK_EQ(num_threads, stats.deallocations);
+  CHECK_EQ(num_threads, stats.net_allocations());
+  CHECK_EQ(num_threads, allocator.Tracker().num_blocks());
+}
+
+/**
+ * @brief Sets the sample interval for one test, and restores the default.
+ */
+class ScopedSampleInterval {
+public:
+  explicit ScopedSampleInterval(size_t interval) {
+    diagnostic::AllocationSampler::sample_interval(interval);
+    diagnostic::AllocationSampler::local().reset();
+  }
+  ~ScopedSampleInterval() {
+    diagnostic::AllocationSampler::sample_interval(
+        diagnostic::AllocationSampler::DEFAULT_SAMPLE_INTERVAL);
+    diagnostic::AllocationSampler::local().reset();
+  }
+};
+
+TEST_CASE("sampling_all") {
+  ScopedSampleInterval interval(0);
+  PassThroughAllocator pass_through;
+  SamplingDiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  auto memory1 = call_allocate(allocator, 100, alignof(std::max_align_t));
+  auto memory2 = call_allocate(allocator, 200, alignof(std::max_align_t));
+  CHECK_EQ(2, allocator.num_sampled());
+  CHECK_EQ(2, allocator.Tracker().num_blocks());
+  CHECK_EQ(memory1, diagnostic::BlockHeader::get_header(memory1)->user_data());
+
+  call_deallocate(allocator, memory1);
+  call_deallocate(allocator, memory2, 200, alignof(std::max_align_t));
+  CHECK_EQ(0, allocator.num_sampled());
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
+
+TEST_CASE("sampling_none") {
+  ScopedSampleInterval interval(size_t(1) << 40);
+
+  size_t allocated_size = 0;
+  size_t deallocated_size = 0;
+  auto on_allocate = [&](size_t size, size_t) { allocated_size = size; };
+  auto on_deallocate_sized = [&](void*, size_t size, size_t) {
+    deallocated_size = size;
+  };
+  test::MockAllocator mock(on_allocate, nullptr, on_deallocate_sized);
+  SamplingDiagnosticAllocator<test::MockAllocator> allocator(mock);
+
+  auto memory = call_allocate(allocator, 100, alignof(std::max_align_t));
+  CHECK_EQ(0, allocator.num_sampled());
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+  // No header; the backing allocator sees just the requested size.
+  CHECK_EQ(100, allocated_size);
+
+  call_deallocate(allocator, memory, 100, alignof(std::max_align_t));
+  CHECK_EQ(100, deallocated_size);
+}
+
+/**
+ * @brief Allocator that is always out of memory.
+ */
+class ExhaustedAllocator : public Allocator<ExhaustedAllocator> {
+public:
+  void* allocate(size_t, size_t = alignof(std::max_align_t)) const {
+    return nullptr;
+  }
+  void deallocate(void*) const {}
+};
+
+TEST_CASE("sampling_out_of_memory") {
+  ScopedSampleInterval interval(0);
+  ExhaustedAllocator exhausted;
+  SamplingDiagnosticAllocator<ExhaustedAllocator> allocator(exhausted);
+
+  CHECK_EQ(nullptr, call_allocate(allocator, 100, alignof(std::max_align_t)));
+  CHECK_EQ(0, allocator.num_sampled());
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
+
+TEST_CASE("sampling_estimates") {
+  const size_t sample_interval = 4096;
+  const size_t size = 64;
+  const int count = 100000;
+  ScopedSampleInterval interval(sample_interval);
+  PassThroughAllocator pass_through;
+  SamplingDiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  std::vector<void*> blocks;
+  for (int i = 0; i < count; ++i) {
+    blocks.push_back(call_allocate(allocator, size));
+  }
+  CHECK_GT(allocator.num_sampled(), 0);
+  CHECK_LT(allocator.num_sampled(), count / 10);
+  CHECK_EQ(allocator.num_sampled(), allocator.Tracker().num_blocks());
+
+  auto estimates = diagnostic::extrapolate_stats(
+      allocator.Tracker().tracker(), sample_interval);
+  diagnostic::AllocationStatsKey key{nullptr, nullptr, 0};
+  const auto& stats = estimates->stats(key);
+  CHECK_GT(stats.allocations, count * 0.9);
+  CHECK_LT(stats.allocations, count * 1.1);
+
+  for (auto block : blocks) {
+    call_deallocate(allocator, block, size, alignof(std::max_align_t));
+  }
+  CHECK_EQ(0, allocator.num_sampled());
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
+
+TEST_CASE("sampling_sharded_threads") {
+  ScopedSampleInterval interval(1024);
+  PassThroughAllocator pass_through;
+  SamplingDiagnosticAllocator<PassThroughAllocator,
+                              diagnostic::ShardedTrackingPool>
+      allocator(pass_through);
+
+  const int num_threads = 4;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 10000; ++i) {
+        call_deallocate(allocator, call_allocate(allocator, 64));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  CHECK_EQ(0, allocator.num_sampled());
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+  auto snapshot = allocator.Tracker().snapshot();
+  diagnostic::AllocationStatsKey key{nullptr, nullptr, 0};
+  CHECK_GT(snapshot->stats(key).allocations, 0);
+}
@@ -9,9 +9,12 @@
 
 // Project headers
 #include "align.h"
+#include "diagnostic.h"
+#include "pass_through.h"
 
 // Library headers
 #include "doctest.h"
+#include <algorithm>
 #include <memory>
 #include <regex>
 #include <string>
@@ -76,8 +79,9 @@ const size_t AllocationTrackerFixture<T>::aligned_user_data_size =
     align::get_aligned_size(user_data_size, user_data_alignment);
 template <typename T>
 const size_t AllocationTrackerFixture<T>::aligned_header_size =
-    align::get_aligned_size(sizeof(diagnostic::BlockHeader),
-                            alignof(diagnostic::BlockHeader));
+    diagnostic::BlockHeader::block_size(aligned_user_data_size,
+                                        user_data_alignment) -
+    aligned_user_data_size;
 
 TEST_CASE_TEMPLATE_DEFINE("block_header", T, test_id) {
   using FixtureT = AllocationTrackerFixture<T>;
@@ -91,10 +95,21 @@ TEST_CASE_TEMPLATE_DEFINE("block_header", T, test_id) {
   const auto header = diagnostic::BlockHeader::create(
       memory, FixtureT::user_data_size, FixtureT::user_data_alignment);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
   SUBCASE("linked_list") {
     CHECK_EQ(nullptr, header->next());
     CHECK_EQ(nullptr, header->prev());
   }
+#else
+  SUBCASE("compact") {
+    CHECK_EQ(16, sizeof(diagnostic::BlockHeader));
+    CHECK(header->is_valid());
+
+    // Changing a field the checksum covers invalidates the header.
+    memset(header, 0xff, sizeof(uint32_t) * 2);
+    CHECK_FALSE(header->is_valid());
+  }
+#endif
 
   SUBCASE("accessors") {
     CHECK_EQ(FixtureT::user_data_size, header->user_data_size());
@@ -102,10 +117,19 @@ TEST_CASE_TEMPLATE_DEFINE("block_header", T, test_id) {
   }
 
   SUBCASE("addresses") {
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(reinterpret_cast<void*>(memory), reinterpret_cast<void*>(header));
     CHECK_EQ(reinterpret_cast<void*>(reinterpret_cast<byte_t*>(header) +
                                      FixtureT::aligned_header_size),
              header->user_data());
+#else
+    // The header ends where the user data starts.
+    CHECK_EQ(reinterpret_cast<void*>(reinterpret_cast<byte_t*>(header) +
+                                     sizeof(diagnostic::BlockHeader)),
+             header->user_data());
+    CHECK_EQ(0, FixtureT::aligned_header_size % FixtureT::user_data_alignment);
+#endif
+    CHECK_EQ(reinterpret_cast<void*>(memory), header->block_start());
     CHECK_EQ(reinterpret_cast<void*>(memory + FixtureT::aligned_header_size),
              header->user_data());
     CHECK_EQ(user_data_start, header->user_data());
@@ -151,6 +175,13 @@ TEST_CASE_TEMPLATE_INSTANTIATE(test_id,
                                AllocationParams<1024 * 1024 * 10, 64>,
                                AllocationParams<1024 * 1024 * 10, 128>);
 
+#ifndef ALLOK8OR_FULL_BLOCK_HEADER
+TEST_CASE("compact_non_power_of_2_alignment") {
+  alignas(64) byte_t memory[256];
+  CHECK_EQ(nullptr, diagnostic::BlockHeader::create(memory, 16, 24));
+}
+#endif
+
 // Test data type used below
 template <typename T>
 class FooBarT {
@@ -167,12 +198,15 @@ TEST_CASE("set_caller_details") {
   auto memory = fixture.create_buffer(FixtureT::aligned_user_data_size +
                                       FixtureT::aligned_header_size);
 
-  SUBCASE("success_when_using_valid_header") {
-    const auto header = diagnostic::BlockHeader::create(
-        memory, FixtureT::user_data_size, FixtureT::user_data_alignment);
+  // Only blocks tracked by an allocator's pool can be stamped.
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
 
+  SUBCASE("success_when_using_valid_header") {
     // Placement new to create instance.
-    auto foobar = new (header->user_data()) IntFooBarT();
+    auto foobar = new (allocator.allocate(sizeof(IntFooBarT),
+                                          alignof(IntFooBarT))) IntFooBarT();
+    const auto header = diagnostic::BlockHeader::get_header(foobar);
 
     auto file = __FILE__;
     auto line =
@@ -189,6 +223,8 @@ TEST_CASE("set_caller_details") {
     std::regex re(pat);
 
     CHECK_MESSAGE(std::regex_search(std::string(header->type_name()), re), pat);
+
+    allocator.deallocate(foobar);
   }
 
   SUBCASE("error_when_using_invalid_header") {
@@ -207,12 +243,30 @@ TEST_CASE("set_caller_details") {
     CHECK_MESSAGE(!ok, "set_caller_details did not fail when it should have.");
   }
 
-  SUBCASE("error_when_call_details_already_set") {
+  SUBCASE("untouched_when_header_untracked") {
+    // A header that passes the check, as any memory might by chance, but is
+    // in no allocator's pool.
+    auto untracked = fixture.create_buffer(diagnostic::BlockHeader::block_size(
+        sizeof(IntFooBarT), alignof(IntFooBarT)));
     const auto header = diagnostic::BlockHeader::create(
-        memory, FixtureT::user_data_size, FixtureT::user_data_alignment);
+        untracked, sizeof(IntFooBarT), alignof(IntFooBarT));
+    REQUIRE(header->is_valid());
 
     // Placement new to create instance.
     auto foobar = new (header->user_data()) IntFooBarT();
+    const std::vector<byte_t> before(
+        untracked, untracked + header->block_size());
+
+    auto details = diagnostic::CallerDetails(__FILE__, __LINE__);
+    auto ok = diagnostic::BlockHeader::set_caller_details(details, foobar);
+    CHECK_MESSAGE(!ok, "set_caller_details did not fail when it should have.");
+    CHECK(std::equal(before.begin(), before.end(), untracked));
+  }
+
+  SUBCASE("error_when_call_details_already_set") {
+    // Placement new to create instance.
+    auto foobar = new (allocator.allocate(sizeof(IntFooBarT),
+                                          alignof(IntFooBarT))) IntFooBarT();
 
     auto file = __FILE__;
     auto line =
@@ -221,11 +275,48 @@ TEST_CASE("set_caller_details") {
 
     // First time.
     auto ok = diagnostic::BlockHeader::set_caller_details(details, foobar);
+    CHECK(ok);
 
     // Call details already set
     ok = diagnostic::BlockHeader::set_caller_details(details, foobar);
  
     CHECK_MESSAGE(!ok, "set_caller_details did not fail when it should have.");
+
+    allocator.deallocate(foobar);
+  }
+
+}
+
+TEST_CASE("pool_registry") {
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+  auto user_data = allocator.allocate(sizeof(int), alignof(int));
+  const auto header = diagnostic::BlockHeader::get_header(user_data);
+  REQUIRE_NE(diagnostic::NO_POOL, header->pool());
+
+  // Fill the registry; pools beyond it get NO_POOL.
+  const diagnostic::PoolRegistry::Entry entry{nullptr, nullptr};
+  std::vector<diagnostic::pool_id_t> ids;
+  for (size_t i = 0; i < diagnostic::PoolRegistry::MAX_POOLS; ++i) {
+    const auto id = diagnostic::PoolRegistry::add(&entry);
+    if (id == diagnostic::NO_POOL) {
+      break;
+    }
+    ids.push_back(id);
   }
+  CHECK_EQ(diagnostic::NO_POOL, diagnostic::PoolRegistry::add(&entry));
+
+  // Blocks of registered pools can still be stamped.
+  auto details = diagnostic::CallerDetails(__FILE__, __LINE__);
+  CHECK(diagnostic::BlockHeader::set_caller_details(
+      details, static_cast<int*>(user_data)));
 
-}
\ No newline at end of file
+  for (auto id : ids) {
+    diagnostic::PoolRegistry::remove(id);
+  }
+  const auto id = diagnostic::PoolRegistry::add(&entry);
+  CHECK_NE(diagnostic::NO_POOL, id);
+  diagnostic::PoolRegistry::remove(id);
+
+  allocator.deallocate(user_data);
+}
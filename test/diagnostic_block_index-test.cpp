@@ -0,0 +1,125 @@
+/**
+ * @file diagnostic_block_index-test.cpp
+ * @brief Unit tests of the BlockIndex class.
+ *
+ */
+
+// My header
+#include "diagnostic/block_index.h"
+
+// Project headers
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace allok8or;
+
+namespace {
+
+// Stands in for a BlockHeader; only the slot is needed.
+struct Block {
+  uint32_t index() const { return m_index; }
+  void index(uint32_t val) { m_index = val; }
+
+  uint32_t m_index = UINT32_MAX;
+};
+
+using Index = diagnostic::BlockIndex<Block, PassThroughAllocator>;
+
+} // namespace
+
+TEST_CASE("create") {
+  PassThroughAllocator pass_through;
+  Index index(pass_through);
+
+  CHECK_EQ(0, index.size());
+  CHECK_EQ(0, index.capacity()); // Nothing allocated yet.
+  CHECK(index.begin() == index.end());
+
+  Block block;
+  CHECK_FALSE(index.contains(&block));
+}
+
+TEST_CASE("add_remove") {
+  PassThroughAllocator pass_through;
+  Index index(pass_through);
+
+  Block blocks[3];
+  for (uint32_t i = 0; i < 3; ++i) {
+    CHECK(index.add(&blocks[i], 100 + i));
+    CHECK_EQ(i, blocks[i].index());
+  }
+  CHECK_EQ(3, index.size());
+  CHECK_EQ(Index::DEFAULT_CAPACITY, index.capacity());
+
+  SUBCASE("remove_moves_last_into_hole") {
+    uint64_t timestamp = 0;
+    CHECK(index.remove(&blocks[0], timestamp));
+    CHECK_EQ(100, timestamp);
+    CHECK_EQ(Index::NO_INDEX, blocks[0].index());
+    CHECK_FALSE(index.contains(&blocks[0]));
+
+    CHECK_EQ(2, index.size());
+    CHECK_EQ(0, blocks[2].index());
+    CHECK_EQ(&blocks[2], index.begin()->block);
+    CHECK_EQ(102, index.begin()->timestamp);
+    CHECK(index.contains(&blocks[1]));
+    CHECK(index.contains(&blocks[2]));
+  }
+
+  SUBCASE("remove_last") {
+    uint64_t timestamp = 0;
+    CHECK(index.remove(&blocks[2], timestamp));
+    CHECK_EQ(102, timestamp);
+    CHECK_EQ(2, index.size());
+    CHECK_EQ(0, blocks[0].index());
+    CHECK_EQ(1, blocks[1].index());
+  }
+
+  SUBCASE("remove_twice") {
+    uint64_t timestamp = 0;
+    CHECK(index.remove(&blocks[1], timestamp));
+    CHECK_FALSE(index.remove(&blocks[1], timestamp));
+    CHECK_EQ(2, index.size());
+  }
+
+  SUBCASE("stale_slot") {
+    // A block claiming a slot another block holds isn't indexed.
+    Block other;
+    other.index(1);
+    CHECK_FALSE(index.contains(&other));
+  }
+}
+
+TEST_CASE("grow") {
+  PassThroughAllocator pass_through;
+  Index index(pass_through);
+
+  const size_t count = Index::DEFAULT_CAPACITY * 4 + 1;
+  std::vector<Block> blocks(count);
+  for (size_t i = 0; i < count; ++i) {
+    REQUIRE(index.add(&blocks[i], i));
+  }
+  CHECK_EQ(count, index.size());
+  CHECK_EQ(Index::DEFAULT_CAPACITY * 8, index.capacity());
+
+  // Entries survive growing, and every block is still found.
+  for (size_t i = 0; i < count; ++i) {
+    CHECK(index.contains(&blocks[i]));
+  }
+
+  for (size_t i = 0; i < count; i += 2) {
+    uint64_t timestamp = 0;
+    CHECK(index.remove(&blocks[i], timestamp));
+    CHECK_EQ(i, timestamp);
+  }
+  CHECK_EQ(count / 2, index.size());
+  for (const auto& entry : index) {
+    CHECK_EQ(1, entry.timestamp % 2);
+    CHECK(index.contains(entry.block));
+  }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file diagnostic_call_site-test.cpp
+ * @brief Unit tests of the CallSiteRegistry and CallSiteCache classes.
+ *
+ */
+
+// My header
+#include "diagnostic/call_site.h"
+
+// Library headers
+#include "doctest.h"
+
+using namespace allok8or;
+using namespace allok8or::diagnostic;
+
+TEST_CASE("unknown_site") {
+  auto& registry = CallSiteRegistry::instance();
+
+  CHECK(registry.num_sites() >= 1);
+
+  const auto& site = registry.site(UNKNOWN_SITE);
+  CHECK(site.type_name == nullptr);
+  CHECK(site.file_name == nullptr);
+  CHECK(site.line == 0);
+
+  site_id_t id;
+  CHECK(registry.find(CallSite{nullptr, nullptr, 0}, id));
+  CHECK(id == UNKNOWN_SITE);
+}
+
+TEST_CASE("intern") {
+  auto& registry = CallSiteRegistry::instance();
+  const CallSite site{"int", __FILE__, __LINE__};
+
+  SUBCASE("same_site_same_id") {
+    const auto id = registry.intern(site);
+    CHECK(id != UNKNOWN_SITE);
+    CHECK(registry.intern(site) == id);
+
+    const auto& interned = registry.site(id);
+    CHECK(interned.type_name == site.type_name);
+    CHECK(interned.file_name == site.file_name);
+    CHECK(interned.line == site.line);
+  }
+
+  SUBCASE("ids_are_dense") {
+    const auto first = registry.intern(CallSite{"long", __FILE__, __LINE__});
+    const auto second = registry.intern(CallSite{"long", __FILE__, __LINE__});
+    CHECK(second == first + 1);
+    CHECK(registry.num_sites() == second + 1);
+  }
+
+  SUBCASE("find") {
+    const CallSite new_site{"char", __FILE__, __LINE__};
+    site_id_t id;
+    CHECK_FALSE(registry.find(new_site, id));
+
+    const auto interned = registry.intern(new_site);
+    CHECK(registry.find(new_site, id));
+    CHECK(id == interned);
+  }
+
+  SUBCASE("unassigned_id") {
+    const auto unassigned = static_cast<site_id_t>(registry.num_sites());
+    CHECK(registry.site(unassigned).file_name == nullptr);
+  }
+}
+
+TEST_CASE("many_sites") {
+  auto& registry = CallSiteRegistry::instance();
+
+  // Spans more than one chunk of the site table.
+  const auto count = CallSiteRegistry::SITES_PER_CHUNK + 1;
+  site_id_t first = UNKNOWN_SITE;
+  for (int line = 0; line < static_cast<int>(count); ++line) {
+    const auto id = registry.intern(CallSite{"many", __FILE__, line});
+    if (line == 0) {
+      first = id;
+    }
+    REQUIRE(id == first + static_cast<site_id_t>(line));
+  }
+
+  const auto last = first + static_cast<site_id_t>(count - 1);
+  CHECK(registry.site(last).line == static_cast<int>(count - 1));
+  CHECK(registry.site(first).line == 0);
+}
+
+TEST_CASE("cache") {
+  CallSiteCache cache;
+  CHECK(cache.id() == UNKNOWN_SITE);
+
+  cache.id(42);
+  CHECK(cache.id() == 42);
+}
@@ -0,0 +1,215 @@
+/**
+ * @file diagnostic_flat_map-test.cpp
+ * @brief Unit tests of the FlatMap class.
+ *
+ */
+
+// My header
+#include "diagnostic/flat_map.h"
+
+// Project headers
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstddef>
+#include <functional>
+
+using namespace allok8or;
+
+namespace {
+
+struct IntHash {
+  size_t operator()(int key) const {
+    auto hash = diagnostic::mix_hash(static_cast<uint64_t>(key));
+    return static_cast<size_t>(hash);
+  }
+};
+
+// Sends every key to the same slot, to exercise probing.
+struct CollidingHash {
+  size_t operator()(int) const { return 7; }
+};
+
+template <typename THash>
+using IntMap = diagnostic::
+    FlatMap<int, long, THash, std::equal_to<int>, PassThroughAllocator>;
+
+// Serves only the first allocation.
+class OneShotAllocator : public Allocator<OneShotAllocator> {
+public:
+  void* allocate(size_t bytes,
+                 size_t alignment = alignof(std::max_align_t)) const {
+    return m_used++ ? nullptr : m_allocator.allocate(bytes, alignment);
+  }
+  void deallocate(void* memory) const { m_allocator.deallocate(memory); }
+
+private:
+  PassThroughAllocator m_allocator;
+  mutable int m_used = 0;
+};
+
+} // namespace
+
+TEST_CASE("create") {
+  PassThroughAllocator pass_through;
+
+  SUBCASE("default_capacity") {
+    IntMap<IntHash> map(pass_through);
+    CHECK_EQ(0, map.size());
+    CHECK_EQ(IntMap<IntHash>::DEFAULT_CAPACITY, map.capacity());
+    CHECK(map.begin() == map.end());
+  }
+
+  SUBCASE("capacity_rounded_to_power_of_2") {
+    IntMap<IntHash> map(pass_through, 100);
+    CHECK_EQ(128, map.capacity());
+  }
+}
+
+TEST_CASE("insert_find") {
+  PassThroughAllocator pass_through;
+  IntMap<IntHash> map(pass_through);
+
+  map[42] = 420;
+  map[7] += 70;
+  map[7] += 1;
+
+  CHECK_EQ(2, map.size());
+  REQUIRE_NE(nullptr, map.find(42));
+  CHECK_EQ(420, *map.find(42));
+  REQUIRE_NE(nullptr, map.find(7));
+  CHECK_EQ(71, *map.find(7));
+  CHECK_EQ(nullptr, map.find(8));
+}
+
+TEST_CASE("grow") {
+  PassThroughAllocator pass_through;
+  IntMap<IntHash> map(pass_through, 4);
+
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    map[i] = i * 10;
+  }
+
+  CHECK_EQ(count, map.size());
+  CHECK_GE(map.capacity() * 3, map.size() * 4);
+  for (int i = 0; i < count; ++i) {
+    REQUIRE_NE(nullptr, map.find(i));
+    CHECK_EQ(i * 10, *map.find(i));
+  }
+}
+
+TEST_CASE("full_and_cannot_grow") {
+  OneShotAllocator one_shot;
+  diagnostic::FlatMap<int, long, IntHash, std::equal_to<int>, OneShotAllocator>
+      map(one_shot, 4);
+
+  for (int i = 0; i < 10; ++i) {
+    map[i] = i;
+  }
+
+  // The keys that fit are kept; the rest are dropped, not fatal.
+  CHECK_EQ(3, map.size());
+  CHECK_EQ(4, map.capacity());
+  for (int i = 0; i < 3; ++i) {
+    REQUIRE_NE(nullptr, map.find(i));
+    CHECK_EQ(i, *map.find(i));
+  }
+  CHECK_EQ(nullptr, map.find(9));
+}
+
+TEST_CASE("collisions") {
+  PassThroughAllocator pass_through;
+  IntMap<CollidingHash> map(pass_through, 8);
+
+  for (int i = 0; i < 20; ++i) {
+    map[i] = i;
+  }
+
+  CHECK_EQ(20, map.size());
+  for (int i = 0; i < 20; ++i) {
+    REQUIRE_NE(nullptr, map.find(i));
+    CHECK_EQ(i, *map.find(i));
+  }
+  CHECK_EQ(nullptr, map.find(20));
+}
+
+TEST_CASE("erase") {
+  PassThroughAllocator pass_through;
+
+  SUBCASE("missing_key") {
+    IntMap<IntHash> map(pass_through);
+    map[1] = 10;
+    CHECK_FALSE(map.erase(2));
+    CHECK_EQ(1, map.size());
+  }
+
+  SUBCASE("collisions_wrap_around") {
+    // Every key probes from the last slot, wrapping to the front.
+    IntMap<CollidingHash> map(pass_through, 8);
+    for (int i = 0; i < 5; ++i) {
+      map[i] = i;
+    }
+
+    CHECK(map.erase(0));
+    CHECK(map.erase(3));
+    CHECK_FALSE(map.erase(3));
+
+    CHECK_EQ(3, map.size());
+    CHECK_EQ(nullptr, map.find(0));
+    CHECK_EQ(nullptr, map.find(3));
+    for (int i : {1, 2, 4}) {
+      REQUIRE_NE(nullptr, map.find(i));
+      CHECK_EQ(i, *map.find(i));
+    }
+  }
+
+  SUBCASE("erase_and_reinsert") {
+    IntMap<IntHash> map(pass_through);
+    const int count = 40;
+    for (int round = 0; round < 10; ++round) {
+      for (int i = 0; i < count; ++i) {
+        map[i + round] = i + round;
+      }
+      for (int i = 0; i < count; i += 2) {
+        CHECK(map.erase(i + round));
+      }
+      for (int i = 0; i < count; ++i) {
+        const auto value = map.find(i + round);
+        if (i % 2) {
+          REQUIRE_NE(nullptr, value);
+          CHECK_EQ(i + round, *value);
+        } else {
+          CHECK_EQ(nullptr, value);
+        }
+      }
+      for (int i = 1; i < count; i += 2) {
+        CHECK(map.erase(i + round));
+      }
+      CHECK_EQ(0, map.size());
+    }
+    CHECK_EQ(IntMap<IntHash>::DEFAULT_CAPACITY, map.capacity());
+  }
+}
+
+TEST_CASE("iterate") {
+  PassThroughAllocator pass_through;
+  IntMap<IntHash> map(pass_through);
+
+  long sum = 0;
+  for (int i = 1; i <= 100; ++i) {
+    map[i] = i;
+    sum += i;
+  }
+
+  size_t visited = 0;
+  long visited_sum = 0;
+  for (const auto& entry : map) {
+    CHECK_EQ(entry.first, entry.second);
+    ++visited;
+    visited_sum += entry.second;
+  }
+  CHECK_EQ(map.size(), visited);
+  CHECK_EQ(sum, visited_sum);
+}
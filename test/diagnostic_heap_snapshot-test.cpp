@@ -0,0 +1,330 @@
+/**
+ * @file diagnostic_heap_snapshot-test.cpp
+ * @brief Unit tests of the HeapSnapshot and HeapDiff classes.
+ *
+ */
+
+// My header
+#include "diagnostic/heap_snapshot.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "diagnostic.h"
+#include "diagnostic/allocation_stats.h"
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace allok8or;
+using namespace allok8or::diagnostic;
+
+namespace {
+
+site_id_t intern_site(int line) {
+  return CallSiteRegistry::instance().intern(
+      CallSite{"HeapSnapshotType", "heap_snapshot.cpp", line});
+}
+
+/**
+ * @brief Type allocated from a diagnostic allocator of its own, for the `new`
+ * macro tests at the end.
+ */
+template <typename TAllocator>
+struct Tracked {
+  static void* operator new(size_t size) { return allocator->allocate(size); }
+  static void operator delete(void* data) { allocator->deallocate(data); }
+
+  static TAllocator* allocator;
+  int value = 0;
+};
+
+template <typename TAllocator>
+TAllocator* Tracked<TAllocator>::allocator = nullptr;
+
+} // namespace
+
+TEST_CASE("snapshot") {
+  const auto site_a = intern_site(1);
+  const auto site_b = intern_site(2);
+  const auto site_c = intern_site(3);
+
+  AllocationStatsTracker tracker;
+  tracker.track_allocation(site_a, 100);
+  tracker.track_allocation(site_a, 100);
+  tracker.track_allocation(site_b, 30);
+  tracker.track_allocation(site_c, 8);
+  tracker.track_deallocation(site_c, 8);
+
+  const auto snapshot = tracker.snapshot();
+  CHECK_EQ(2, snapshot.live(site_a).allocations);
+  CHECK_EQ(200, snapshot.live(site_a).bytes);
+  CHECK_EQ(1, snapshot.live(site_b).allocations);
+  CHECK_EQ(30, snapshot.live(site_b).bytes);
+  CHECK_EQ(0, snapshot.live(site_c).allocations);
+  CHECK_EQ(0, snapshot.live(site_c).bytes);
+  CHECK_EQ(3, snapshot.live_allocations());
+  CHECK_EQ(230, snapshot.live_bytes());
+
+  SUBCASE("unchanged_by_later_allocations") {
+    tracker.track_allocation(site_b, 30);
+    CHECK_EQ(1, snapshot.live(site_b).allocations);
+    CHECK_EQ(230, snapshot.live_bytes());
+  }
+
+  SUBCASE("unknown_site") {
+    const auto unknown = static_cast<site_id_t>(snapshot.num_sites());
+    CHECK_EQ(0, snapshot.live(unknown).allocations);
+    CHECK_EQ(0, snapshot.live(unknown).bytes);
+  }
+
+  SUBCASE("move") {
+    auto moved = std::move(const_cast<HeapSnapshot&>(snapshot));
+    CHECK_EQ(200, moved.live(site_a).bytes);
+    CHECK_EQ(230, moved.live_bytes());
+  }
+}
+
+TEST_CASE("snapshot_add") {
+  const auto site = intern_site(4);
+
+  AllocationStatsTracker tracker1;
+  AllocationStatsTracker tracker2;
+  tracker1.track_allocation(site, 16);
+  tracker2.track_allocation(site, 16);
+  tracker2.track_allocation(site, 16);
+
+  HeapSnapshot snapshot;
+  snapshot.add(tracker1);
+  snapshot.add(tracker2);
+  CHECK_EQ(3, snapshot.live(site).allocations);
+  CHECK_EQ(48, snapshot.live(site).bytes);
+}
+
+TEST_CASE("diff") {
+  const auto site_grows = intern_site(10);
+  const auto site_grows_more = intern_site(11);
+  const auto site_shrinks = intern_site(12);
+  const auto site_unchanged = intern_site(13);
+
+  AllocationStatsTracker tracker;
+  tracker.track_allocation(site_grows, 10);
+  tracker.track_allocation(site_shrinks, 10);
+  tracker.track_allocation(site_unchanged, 10);
+  const auto before = tracker.snapshot();
+
+  tracker.track_allocation(site_grows, 10);
+  tracker.track_allocation(site_grows_more, 50);
+  tracker.track_deallocation(site_shrinks, 10);
+  tracker.track_allocation(site_unchanged, 10);
+  tracker.track_deallocation(site_unchanged, 10);
+  const auto after = tracker.snapshot();
+
+  const auto growth = diff(before, after);
+  REQUIRE_EQ(2, growth.size());
+  CHECK_EQ(site_grows_more, growth[0].site);
+  CHECK_EQ(1, growth[0].allocations);
+  CHECK_EQ(50, growth[0].bytes);
+  CHECK_EQ(site_grows, growth[1].site);
+  CHECK_EQ(1, growth[1].allocations);
+  CHECK_EQ(10, growth[1].bytes);
+  CHECK_GE(growth.elapsed_ns(), 0);
+
+  SUBCASE("reversed") {
+    const auto reversed = diff(after, before);
+    REQUIRE_EQ(1, reversed.size());
+    CHECK_EQ(site_shrinks, reversed[0].site);
+    CHECK_EQ(10, reversed[0].bytes);
+  }
+
+  SUBCASE("no_growth") {
+    CHECK(diff(after, after).empty());
+  }
+
+  SUBCASE("site_new_since_before") {
+    const auto new_site = intern_site(14);
+    tracker.track_allocation(new_site, 1000);
+    const auto later = tracker.snapshot();
+
+    const auto new_growth = diff(after, later);
+    REQUIRE_EQ(1, new_growth.size());
+    CHECK_EQ(new_site, new_growth[0].site);
+    CHECK_EQ(1000, new_growth[0].bytes);
+  }
+
+  SUBCASE("ties_by_blocks") {
+    const auto site_few = intern_site(15);
+    const auto site_many = intern_site(16);
+    tracker.track_allocation(site_few, 64);
+    tracker.track_allocation(site_many, 32);
+    tracker.track_allocation(site_many, 32);
+
+    const auto tied = diff(after, tracker.snapshot());
+    REQUIRE_EQ(2, tied.size());
+    CHECK_EQ(site_many, tied[0].site);
+    CHECK_EQ(site_few, tied[1].site);
+  }
+}
+
+TEST_CASE("allocator_heap_snapshot") {
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  const auto before = allocator.Tracker().heap_snapshot();
+  auto memory = call_allocate(allocator, 64);
+  const auto after = allocator.Tracker().heap_snapshot();
+
+  CHECK_EQ(before.live_allocations() + 1, after.live_allocations());
+  const auto growth = diff(before, after);
+  REQUIRE_EQ(1, growth.size());
+  CHECK_EQ(UNKNOWN_SITE, growth[0].site);
+  CHECK_GT(growth[0].bytes, 0);
+
+  call_deallocate(allocator, memory);
+  CHECK(diff(before, allocator.Tracker().heap_snapshot()).empty());
+}
+
+TEST_CASE("sharded_heap_snapshot") {
+  PassThroughAllocator pass_through;
+  ShardedDiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+
+  const int num_threads = 4;
+  std::vector<void*> leaked(num_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      auto memory = call_allocate(allocator, 64);
+      call_deallocate(allocator, memory);
+      leaked[t] = call_allocate(allocator, 64);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto snapshot = allocator.Tracker().heap_snapshot();
+  CHECK_EQ(num_threads, snapshot.live(UNKNOWN_SITE).allocations);
+  CHECK_EQ(allocator.Tracker().num_bytes(), snapshot.live_bytes());
+
+  for (auto memory : leaked) {
+    call_deallocate(allocator, memory);
+  }
+  CHECK_EQ(0, allocator.Tracker().heap_snapshot().live_allocations());
+}
+
+// Last, as it redefines new for the rest of the file.
+#include "diagnostic/new.h"
+
+namespace {
+
+/**
+ * @brief Allocates through the `new` macro, and without it, while it's being
+ * constructed.
+ */
+template <typename TAllocator>
+struct TrackedOuter : Tracked<TAllocator> {
+  TrackedOuter()
+      : inner(new Tracked<TAllocator>()), inner_line(__LINE__),
+        scratch(call_allocate(*Tracked<TAllocator>::allocator, 16)) {}
+  ~TrackedOuter() {
+    delete inner;
+    call_deallocate(*Tracked<TAllocator>::allocator, scratch);
+  }
+
+  Tracked<TAllocator>* inner;
+  int inner_line;
+  void* scratch;
+};
+
+/**
+ * @brief Allocates many blocks without the `new` macro while it's being
+ * constructed, and destroys another allocator.
+ */
+template <typename TAllocator>
+struct TrackedBusy : Tracked<TAllocator> {
+  static const size_t NUM_SCRATCH = 32;
+
+  TrackedBusy() {
+    for (auto& block : scratch) {
+      block = call_allocate(*Tracked<TAllocator>::allocator, 16);
+    }
+    PassThroughAllocator pass_through;
+    TAllocator other(pass_through);
+    call_deallocate(other, call_allocate(other, 16));
+  }
+  ~TrackedBusy() {
+    for (auto block : scratch) {
+      call_deallocate(*Tracked<TAllocator>::allocator, block);
+    }
+  }
+
+  void* scratch[NUM_SCRATCH];
+};
+
+} // namespace
+
+TEST_CASE_TEMPLATE("new_macro_heap_snapshot",
+                   TAllocator,
+                   DiagnosticAllocator<PassThroughAllocator>,
+                   ShardedDiagnosticAllocator<PassThroughAllocator>) {
+  PassThroughAllocator pass_through;
+  TAllocator allocator(pass_through);
+  Tracked<TAllocator>::allocator = &allocator;
+  const auto before = allocator.Tracker().heap_snapshot();
+
+  SUBCASE("counted_at_caller_site") {
+    auto object = new Tracked<TAllocator>();
+    const int line = __LINE__ - 1;
+    const auto header = BlockHeader::get_header(object);
+    CHECK_EQ(line, header->line());
+
+    // Moved from UNKNOWN_SITE when the macro set the site.
+    auto snapshot = allocator.Tracker().heap_snapshot();
+    CHECK_EQ(1, snapshot.live(header->site()).allocations);
+    CHECK_EQ(before.live(UNKNOWN_SITE).allocations,
+             snapshot.live(UNKNOWN_SITE).allocations);
+
+    const auto site = header->site();
+    delete object;
+    snapshot = allocator.Tracker().heap_snapshot();
+    CHECK_EQ(0, snapshot.live(site).allocations);
+    CHECK(diff(before, snapshot).empty());
+  }
+
+  SUBCASE("nested") {
+    auto outer = new TrackedOuter<TAllocator>();
+    const int line = __LINE__ - 1;
+    CHECK_EQ(line, BlockHeader::get_header(outer)->line());
+    CHECK_EQ(outer->inner_line, BlockHeader::get_header(outer->inner)->line());
+    CHECK_EQ(UNKNOWN_SITE, BlockHeader::get_header(outer->scratch)->site());
+
+    const auto snapshot = allocator.Tracker().heap_snapshot();
+    CHECK_EQ(3, snapshot.live_allocations() - before.live_allocations());
+    CHECK_EQ(before.live(UNKNOWN_SITE).allocations + 1,
+             snapshot.live(UNKNOWN_SITE).allocations);
+
+    delete outer;
+    CHECK(diff(before, allocator.Tracker().heap_snapshot()).empty());
+  }
+
+  SUBCASE("busy_constructor") {
+    auto busy = new TrackedBusy<TAllocator>();
+    const int line = __LINE__ - 1;
+    const auto header = BlockHeader::get_header(busy);
+    CHECK_EQ(line, header->line());
+
+    const auto snapshot = allocator.Tracker().heap_snapshot();
+    CHECK_EQ(1, snapshot.live(header->site()).allocations);
+    CHECK_EQ(before.live(UNKNOWN_SITE).allocations +
+                 TrackedBusy<TAllocator>::NUM_SCRATCH,
+             snapshot.live(UNKNOWN_SITE).allocations);
+
+    delete busy;
+    CHECK(diff(before, allocator.Tracker().heap_snapshot()).empty());
+  }
+
+  Tracked<TAllocator>::allocator = nullptr;
+}
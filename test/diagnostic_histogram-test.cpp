@@ -0,0 +1,74 @@
+/**
+ * @file diagnostic_histogram-test.cpp
+ * @brief Unit tests of the Log2Histogram class.
+ *
+ */
+
+// My header
+#include "diagnostic/histogram.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+
+using namespace allok8or;
+
+using Histogram = diagnostic::Log2Histogram<8>;
+
+TEST_CASE("bit_width") {
+  CHECK_EQ(0, diagnostic::bit_width(0));
+  CHECK_EQ(1, diagnostic::bit_width(1));
+  CHECK_EQ(2, diagnostic::bit_width(2));
+  CHECK_EQ(2, diagnostic::bit_width(3));
+  CHECK_EQ(3, diagnostic::bit_width(4));
+  CHECK_EQ(10, diagnostic::bit_width(1023));
+  CHECK_EQ(11, diagnostic::bit_width(1024));
+  CHECK_EQ(64, diagnostic::bit_width(UINT64_MAX));
+}
+
+TEST_CASE("buckets") {
+  SUBCASE("powers_of_2") {
+    CHECK_EQ(0, Histogram::bucket(0));
+    CHECK_EQ(1, Histogram::bucket(1));
+    CHECK_EQ(2, Histogram::bucket(2));
+    CHECK_EQ(2, Histogram::bucket(3));
+    CHECK_EQ(3, Histogram::bucket(4));
+    CHECK_EQ(3, Histogram::bucket(7));
+  }
+
+  SUBCASE("last_bucket_holds_the_rest") {
+    CHECK_EQ(7, Histogram::bucket(64));
+    CHECK_EQ(7, Histogram::bucket(1 << 20));
+    CHECK_EQ(7, Histogram::bucket(UINT64_MAX));
+  }
+
+  SUBCASE("lower_bounds") {
+    for (size_t bucket = 0; bucket < Histogram::NUM_BUCKETS; ++bucket) {
+      CHECK_EQ(bucket, Histogram::bucket(Histogram::lower_bound(bucket)));
+    }
+    CHECK_EQ(0, Histogram::lower_bound(0));
+    CHECK_EQ(1, Histogram::lower_bound(1));
+    CHECK_EQ(64, Histogram::lower_bound(7));
+  }
+}
+
+TEST_CASE("record_merge") {
+  Histogram histogram;
+  CHECK_EQ(0, histogram.total());
+
+  histogram.record(0);
+  histogram.record(5);
+  histogram.record(6);
+  histogram.record(1000);
+
+  CHECK_EQ(4, histogram.total());
+  CHECK_EQ(1, histogram.counts[0]);
+  CHECK_EQ(2, histogram.counts[3]);
+  CHECK_EQ(1, histogram.counts[7]);
+
+  Histogram other;
+  other.record(5);
+  histogram.merge(other);
+  CHECK_EQ(5, histogram.total());
+  CHECK_EQ(3, histogram.counts[3]);
+}
@@ -0,0 +1,209 @@
+/**
+ * @file diagnostic_sampler-test.cpp
+ * @brief Unit tests of the AllocationSampler and SampledBlockTable classes.
+ *
+ */
+
+// My header
+#include "diagnostic/sampler.h"
+
+// Project headers
+#include "diagnostic/allocation_stats.h"
+
+// Library headers
+#include "doctest.h"
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace allok8or;
+using namespace allok8or::diagnostic;
+
+namespace {
+
+/**
+ * @brief Sets the sample interval for one test, and restores the default.
+ */
+class ScopedSampleInterval {
+public:
+  explicit ScopedSampleInterval(size_t interval) {
+    AllocationSampler::sample_interval(interval);
+    AllocationSampler::local().reset();
+  }
+  ~ScopedSampleInterval() {
+    AllocationSampler::sample_interval(
+        AllocationSampler::DEFAULT_SAMPLE_INTERVAL);
+    AllocationSampler::local().reset();
+  }
+};
+
+} // namespace
+
+//
+// AllocationSampler tests
+//
+TEST_CASE("default_interval") {
+  CHECK_EQ(AllocationSampler::DEFAULT_SAMPLE_INTERVAL,
+           AllocationSampler::sample_interval());
+}
+
+TEST_CASE("sample_every_allocation") {
+  ScopedSampleInterval interval(0);
+  auto& sampler = AllocationSampler::local();
+
+  for (int i = 0; i < 100; ++i) {
+    CHECK(sampler.sample(1));
+  }
+}
+
+TEST_CASE("sample_rate") {
+  const size_t sample_interval = 1024;
+  const size_t size = 64;
+  const int count = 100000;
+  ScopedSampleInterval interval(sample_interval);
+  auto& sampler = AllocationSampler::local();
+
+  int sampled = 0;
+  for (int i = 0; i < count; ++i) {
+    sampled += sampler.sample(size) ? 1 : 0;
+  }
+
+  const double expected =
+      count * -std::expm1(-static_cast<double>(size) / sample_interval);
+  CHECK_GT(sampled, expected * 0.9);
+  CHECK_LT(sampled, expected * 1.1);
+}
+
+TEST_CASE("large_allocations_always_sampled") {
+  ScopedSampleInterval interval(1024);
+  auto& sampler = AllocationSampler::local();
+
+  // The chance of missing one is exp(-1024), i.e. none.
+  for (int i = 0; i < 100; ++i) {
+    CHECK(sampler.sample(1024 * 1024));
+  }
+}
+
+//
+// extrapolate_stats tests
+//
+TEST_CASE("extrapolate_stats") {
+  const CallSite site{"int", __FILE__, __LINE__};
+  AllocationStatsTracker sampled;
+
+  SUBCASE("no_interval") {
+    sampled.track_allocation(site, 64);
+    auto estimates = extrapolate_stats(sampled, 0);
+    CHECK_EQ(1, estimates->stats(site).allocations);
+    CHECK_EQ(64, estimates->stats(site).bytes_allocated);
+  }
+
+  SUBCASE("scaled_by_sample_probability") {
+    const size_t sample_interval = 1024;
+    for (int i = 0; i < 10; ++i) {
+      sampled.track_allocation(site, 64);
+    }
+    for (int i = 0; i < 5; ++i) {
+      sampled.track_deallocation(site, 64);
+    }
+
+    const double weight = 1.0 / -std::expm1(-64.0 / sample_interval);
+    auto estimates = extrapolate_stats(sampled, sample_interval);
+    const auto& stats = estimates->stats(site);
+    CHECK_EQ(std::llround(10 * weight), stats.allocations);
+    CHECK_EQ(std::llround(640 * weight), stats.bytes_allocated);
+    CHECK_EQ(std::llround(5 * weight), stats.deallocations);
+    CHECK_EQ(std::llround(320 * weight), stats.bytes_deallocated);
+  }
+
+  SUBCASE("estimates_real_totals") {
+    const size_t sample_interval = 4096;
+    const size_t size = 48;
+    const int count = 200000;
+    ScopedSampleInterval interval(sample_interval);
+    auto& sampler = AllocationSampler::local();
+
+    for (int i = 0; i < count; ++i) {
+      if (sampler.sample(size)) {
+        sampled.track_allocation(site, size);
+      }
+    }
+
+    auto estimates = extrapolate_stats(sampled, sample_interval);
+    const auto& stats = estimates->stats(site);
+    CHECK_GT(stats.allocations, count * 0.9);
+    CHECK_LT(stats.allocations, count * 1.1);
+    CHECK_GT(stats.bytes_allocated, count * size * 0.9);
+    CHECK_LT(stats.bytes_allocated, count * size * 1.1);
+  }
+}
+
+//
+// SampledBlockTable tests
+//
+TEST_CASE("sampled_block_table") {
+  SampledBlockTable table;
+  int blocks[1000] = {};
+
+  SUBCASE("empty") {
+    CHECK_EQ(0, table.size());
+    CHECK_FALSE(table.contains(&blocks[0]));
+    CHECK_FALSE(table.erase(&blocks[0]));
+  }
+
+  SUBCASE("insert_erase") {
+    CHECK(table.insert(&blocks[0]));
+    CHECK_FALSE(table.insert(&blocks[0]));
+    CHECK(table.contains(&blocks[0]));
+    CHECK_FALSE(table.contains(&blocks[1]));
+    CHECK_FALSE(table.contains(nullptr));
+    CHECK_EQ(1, table.size());
+
+    CHECK(table.erase(&blocks[0]));
+    CHECK_FALSE(table.erase(&blocks[0]));
+    CHECK_FALSE(table.contains(&blocks[0]));
+    CHECK_EQ(0, table.size());
+  }
+
+  SUBCASE("many") {
+    for (auto& block : blocks) {
+      REQUIRE(table.insert(&block));
+    }
+    CHECK_EQ(1000, table.size());
+
+    for (size_t i = 0; i < 1000; i += 2) {
+      CHECK(table.erase(&blocks[i]));
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+      CHECK_EQ(i % 2 == 1, table.contains(&blocks[i]));
+    }
+    CHECK_EQ(500, table.size());
+  }
+
+  SUBCASE("grows") {
+    std::vector<int> many(2 * 16 * SampledBlockTable::INITIAL_CAPACITY);
+    const auto half = many.size() / 2;
+    for (size_t i = 0; i < half; ++i) {
+      REQUIRE(table.insert(&many[i]));
+    }
+    CHECK_EQ(half, table.size());
+
+    for (size_t i = 0; i < many.size(); ++i) {
+      CHECK_EQ(i < half, table.contains(&many[i]));
+    }
+  }
+
+  SUBCASE("churn") {
+    // Erased slots are reclaimed, so churn doesn't fill the table.
+    std::vector<int> many(16 * SampledBlockTable::INITIAL_CAPACITY);
+    for (size_t i = 0; i < many.size(); ++i) {
+      REQUIRE(table.insert(&many[i]));
+      if (i >= 10) {
+        REQUIRE(table.erase(&many[i - 10]));
+      }
+    }
+    CHECK_EQ(10, table.size());
+    CHECK(table.contains(&many.back()));
+    CHECK_FALSE(table.contains(&many.front()));
+  }
+}
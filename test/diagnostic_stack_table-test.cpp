@@ -0,0 +1,236 @@
+/**
+ * @file diagnostic_stack_table-test.cpp
+ * @brief Unit tests of stack capture and the StackTable class.
+ *
+ */
+
+// My header
+#include "diagnostic/stack_table.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "diagnostic.h"
+#include "diagnostic/allocation_stats.h"
+#include "diagnostic/allocation_stats_reporter.h"
+#include "pass_through.h"
+#include "portability.h"
+
+// Library headers
+#include "doctest.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace allok8or;
+using namespace allok8or::diagnostic;
+
+namespace {
+
+// Keeps the callers below from being folded into one.
+volatile uintptr_t sink;
+
+ALK8_NOINLINE stack_id_t capture_here() {
+  return StackTable::instance().capture();
+}
+
+ALK8_NOINLINE stack_id_t capture_from_a() {
+  auto id = capture_here();
+  sink = id;
+  return id;
+}
+
+ALK8_NOINLINE stack_id_t capture_from_b() {
+  auto id = capture_here();
+  sink = id;
+  return id;
+}
+
+ALK8_NOINLINE site_id_t site_from_a() {
+  auto id = capture_stack_site();
+  sink = id;
+  return id;
+}
+
+ALK8_NOINLINE site_id_t site_from_b() {
+  auto id = capture_stack_site();
+  sink = id;
+  return id;
+}
+
+ALK8_NOINLINE site_id_t site_from_new_thread() {
+  site_id_t site = UNKNOWN_SITE;
+  std::thread([&] { site = site_from_a(); }).join();
+  return site;
+}
+
+template <typename TAllocator>
+ALK8_NOINLINE void* allocate_from_a(TAllocator& allocator) {
+  auto memory = call_allocate(allocator, 64);
+  sink = reinterpret_cast<uintptr_t>(memory);
+  return memory;
+}
+
+template <typename TAllocator>
+ALK8_NOINLINE void* allocate_from_b(TAllocator& allocator) {
+  auto memory = call_allocate(allocator, 64);
+  sink = reinterpret_cast<uintptr_t>(memory);
+  return memory;
+}
+
+} // namespace
+
+TEST_CASE("capture_stack") {
+  void* frames[MAX_STACK_DEPTH] = {};
+  const auto depth = capture_stack(frames, MAX_STACK_DEPTH);
+
+  REQUIRE_GT(depth, 0);
+  CHECK_LE(depth, MAX_STACK_DEPTH);
+  for (size_t i = 0; i < depth; ++i) {
+    CHECK_NE(nullptr, frames[i]);
+  }
+
+  SUBCASE("max_depth") {
+    CHECK_EQ(1, capture_stack(frames, 1));
+  }
+}
+
+TEST_CASE("intern") {
+  auto& table = StackTable::instance();
+
+  SUBCASE("empty_stack") {
+    CHECK_EQ(NO_STACK, table.intern(nullptr, 0));
+    CHECK_EQ(0, table.stack(NO_STACK).depth);
+  }
+
+  SUBCASE("same_frames_same_id") {
+    int markers[3];
+    void* frames[] = {&markers[0], &markers[1], &markers[2]};
+    void* copy[] = {&markers[0], &markers[1], &markers[2]};
+
+    const auto id = table.intern(frames, 3);
+    CHECK_NE(NO_STACK, id);
+    CHECK_EQ(id, table.intern(copy, 3));
+    CHECK_NE(id, table.intern(frames, 2));
+
+    const auto stack = table.stack(id);
+    REQUIRE_EQ(3, stack.depth);
+    CHECK_NE(static_cast<void* const*>(frames), stack.frames);
+    for (size_t i = 0; i < 3; ++i) {
+      CHECK_EQ(frames[i], stack.frames[i]);
+    }
+  }
+
+  SUBCASE("too_deep") {
+    std::vector<char> markers(MAX_STACK_DEPTH + 8);
+    std::vector<void*> frames;
+    for (auto& marker : markers) {
+      frames.push_back(&marker);
+    }
+
+    const auto id = table.intern(frames.data(), frames.size());
+    CHECK_EQ(MAX_STACK_DEPTH, table.stack(id).depth);
+  }
+
+  SUBCASE("unassigned_id") {
+    const auto unassigned = static_cast<stack_id_t>(table.num_stacks());
+    CHECK_EQ(0, table.stack(unassigned).depth);
+  }
+}
+
+TEST_CASE("capture") {
+  SUBCASE("same_path_same_id") {
+    std::vector<stack_id_t> ids;
+    for (int i = 0; i < 3; ++i) {
+      ids.push_back(capture_from_a());
+    }
+    CHECK_NE(NO_STACK, ids[0]);
+    CHECK_EQ(ids[0], ids[1]);
+    CHECK_EQ(ids[0], ids[2]);
+  }
+
+  SUBCASE("different_paths_different_ids") {
+    CHECK_NE(capture_from_a(), capture_from_b());
+  }
+}
+
+TEST_CASE("capture_stack_site") {
+  SUBCASE("same_path_same_site") {
+    // One call, so each has the same stack; only the first is new.
+    site_id_t sites[4];
+    size_t num_stacks = 0;
+    size_t num_sites = 0;
+    for (auto& site : sites) {
+      site = site_from_a();
+      if (&site == &sites[0]) {
+        num_stacks = StackTable::instance().num_stacks();
+        num_sites = CallSiteRegistry::instance().num_sites();
+      }
+    }
+
+    CHECK_NE(UNKNOWN_SITE, sites[0]);
+    CHECK_NE(NO_STACK, CallSiteRegistry::instance().site(sites[0]).stack);
+    for (auto site : sites) {
+      CHECK_EQ(sites[0], site);
+    }
+    CHECK_EQ(num_stacks, StackTable::instance().num_stacks());
+    CHECK_EQ(num_sites, CallSiteRegistry::instance().num_sites());
+  }
+
+  SUBCASE("different_paths_different_sites") {
+    CHECK_NE(site_from_a(), site_from_b());
+  }
+
+  SUBCASE("new_threads_same_site") {
+    // Each thread starts with an empty cache, and finds the site it interned.
+    CHECK_EQ(site_from_new_thread(), site_from_new_thread());
+  }
+}
+
+TEST_CASE("symbolize") {
+  auto& table = StackTable::instance();
+  const auto id = capture_from_a();
+
+  std::stringstream output;
+  table.symbolize(id, output);
+  auto text = output.str();
+
+  CHECK_EQ(table.stack(id).depth,
+           static_cast<size_t>(std::count(text.begin(), text.end(), '\n')));
+  CHECK_NE(std::string::npos, text.find("#0 "));
+}
+
+TEST_CASE("allocator_captures_stacks") {
+  PassThroughAllocator pass_through;
+  DiagnosticAllocator<PassThroughAllocator> allocator(pass_through);
+  CHECK_FALSE(allocator.capture_stacks());
+  allocator.capture_stacks(true);
+
+  auto memory_a = allocate_from_a(allocator);
+  // One call, so both have the same stack.
+  void* memory_b[2];
+  for (auto& memory : memory_b) {
+    memory = allocate_from_b(allocator);
+  }
+
+  auto site_a = BlockHeader::get_header(memory_a)->site();
+  auto site_b = BlockHeader::get_header(memory_b[0])->site();
+  CHECK_NE(UNKNOWN_SITE, site_a);
+  CHECK_NE(site_a, site_b);
+  CHECK_EQ(site_b, BlockHeader::get_header(memory_b[1])->site());
+  CHECK_NE(NO_STACK, CallSiteRegistry::instance().site(site_a).stack);
+
+  const auto& tracker = allocator.Tracker().tracker();
+  CHECK_EQ(1, tracker.stats(site_a).allocations);
+  CHECK_EQ(2, tracker.stats(site_b).allocations);
+
+  std::stringstream output;
+  AllocationStackReporter().report_stats(tracker.stats(), output);
+  CHECK_NE(std::string::npos, output.str().find("2 net allocs"));
+
+  call_deallocate(allocator, memory_a);
+  call_deallocate(allocator, memory_b[0]);
+  call_deallocate(allocator, memory_b[1]);
+  CHECK_EQ(0, allocator.Tracker().num_blocks());
+}
@@ -10,6 +10,7 @@
 
 // Project headers
 #include "align.h"
+#include "diagnostic/allocation_stats.h"
 
 // Library headers
 #include "doctest.h"
@@ -75,8 +76,25 @@ const size_t AllocationTrackerFixture<T>::aligned_user_data_size =
     align::get_aligned_size(user_data_size, user_data_alignment);
 template <typename T>
 const size_t AllocationTrackerFixture<T>::aligned_header_size =
-    align::get_aligned_size(sizeof(diagnostic::BlockHeader),
-                            alignof(diagnostic::BlockHeader));
+    diagnostic::BlockHeader::block_size(aligned_user_data_size,
+                                        user_data_alignment) -
+    aligned_user_data_size;
+
+#ifndef ALLOK8OR_FULL_BLOCK_HEADER
+/**
+ * @brief Returns true if the pool's side index lists the block exactly once.
+ */
+bool indexed_once(const diagnostic::AllocationTrackingPool& pool,
+                  const diagnostic::BlockHeader* block) {
+  int count = 0;
+  for (const auto& entry : pool.blocks()) {
+    if (entry.block == block) {
+      ++count;
+    }
+  }
+  return count == 1;
+}
+#endif
 
 
 //
@@ -98,12 +116,19 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
 
     pool.add(header);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, header->next());
     CHECK_EQ(nullptr, header->prev());
+#endif
     CHECK_EQ(true, pool.in_list(header));
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(header, pool.head());
     CHECK_EQ(header, pool.tail());
+#else
+    CHECK_EQ(1, pool.blocks().size());
+    CHECK(indexed_once(pool, header));
+#endif
     CHECK_EQ(1, pool.num_blocks());
     CHECK_EQ(FixtureT::user_data_size, pool.num_bytes());
   }
@@ -120,16 +145,43 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
     tracker.add(header);
     tracker.remove(header);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, header->next());
     CHECK_EQ(nullptr, header->prev());
+#endif
     CHECK_EQ(false, tracker.in_list(header));
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, tracker.head());
     CHECK_EQ(nullptr, tracker.tail());
+#else
+    CHECK_EQ(0, tracker.blocks().size());
+#endif
     CHECK_EQ(0, tracker.num_blocks());
     CHECK_EQ(0, tracker.num_bytes());
   }
 
+  SUBCASE("remove_block_freed_at") {
+    using Stats = diagnostic::AllocationStats;
+    diagnostic::AllocationTrackingPool tracker;
+
+    auto memory = fixture.create_buffer(FixtureT::aligned_user_data_size +
+                                        FixtureT::aligned_header_size);
+    auto header = diagnostic::BlockHeader::create(memory,
+                                                  FixtureT::user_data_size,
+                                                  FixtureT::user_data_alignment);
+
+    // The lifetime runs to the given free time, not to the call.
+    const uint64_t lifetime = uint64_t(3) << 39;
+    const auto freed_at = diagnostic::timestamp_ns() + lifetime;
+    tracker.add(header);
+    CHECK(tracker.remove(header, freed_at));
+
+    const auto& lifetimes = tracker.tracker().stats(header->site()).lifetimes;
+    CHECK_EQ(1, lifetimes.total());
+    CHECK_EQ(1, lifetimes.counts[Stats::LifetimeHistogram::bucket(lifetime)]);
+  }
+
   SUBCASE("add_several_blocks") {
     diagnostic::AllocationTrackingPool tracker;
 
@@ -147,6 +199,7 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
     CHECK_EQ(num_blocks, tracker.num_blocks());
     CHECK_EQ(FixtureT::user_data_size * num_blocks, tracker.num_bytes());
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     // Iterate to the last block.
     int count = 0;
     auto block = tracker.head();
@@ -169,6 +222,12 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
 
     // Head block has nothing before it.
     CHECK_EQ(nullptr, block->prev());
+#else
+    CHECK_EQ(num_blocks, tracker.blocks().size());
+    for (const auto& entry : tracker.blocks()) {
+      CHECK(tracker.in_list(entry.block));
+    }
+#endif
   }
 
   SUBCASE("remove_middle_block") {
@@ -193,14 +252,17 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
     const auto header_to_remove = headers[current_num_blocks / 2];
     tracker.remove(header_to_remove);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, header_to_remove->next());
     CHECK_EQ(nullptr, header_to_remove->prev());
+#endif
     CHECK_EQ(false, tracker.in_list(header_to_remove));
 
     CHECK_EQ(current_num_blocks, tracker.num_blocks());
     CHECK_EQ(FixtureT::user_data_size * current_num_blocks,
              tracker.num_bytes());
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     // Iterate to the last block.
     int count = 0;
     auto block = tracker.head();
@@ -223,6 +285,15 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
 
     // Head block has nothing before it.
     CHECK_EQ(nullptr, block->prev());
+#else
+    // Every remaining block is indexed once.
+    CHECK_EQ(current_num_blocks, tracker.blocks().size());
+    for (auto header : headers) {
+      if (header != header_to_remove) {
+        CHECK(indexed_once(tracker, header));
+      }
+    }
+#endif
   }
 
   SUBCASE("remove_first_block") {
@@ -247,14 +318,17 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
     auto header_to_remove = headers[headers.size() - 1];
     tracker.remove(header_to_remove);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, header_to_remove->next());
     CHECK_EQ(nullptr, header_to_remove->prev());
+#endif
     CHECK_EQ(false, tracker.in_list(header_to_remove));
 
     CHECK_EQ(current_num_blocks, tracker.num_blocks());
     CHECK_EQ(FixtureT::user_data_size * current_num_blocks,
              tracker.num_bytes());
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     // Iterate to the last block.
     int count = 0;
     auto block = tracker.head();
@@ -277,6 +351,15 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
 
     // Head block has nothing before it.
     CHECK_EQ(nullptr, block->prev());
+#else
+    // Every remaining block is indexed once.
+    CHECK_EQ(current_num_blocks, tracker.blocks().size());
+    for (auto header : headers) {
+      if (header != header_to_remove) {
+        CHECK(indexed_once(tracker, header));
+      }
+    }
+#endif
   }
 
   SUBCASE("remove_last_block") {
@@ -301,14 +384,17 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
     auto header_to_remove = headers[0];
     tracker.remove(header_to_remove);
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     CHECK_EQ(nullptr, header_to_remove->next());
     CHECK_EQ(nullptr, header_to_remove->prev());
+#endif
     CHECK_EQ(false, tracker.in_list(header_to_remove));
 
     CHECK_EQ(current_num_blocks, tracker.num_blocks());
     CHECK_EQ(FixtureT::user_data_size * current_num_blocks,
              tracker.num_bytes());
 
+#ifdef ALLOK8OR_FULL_BLOCK_HEADER
     // Iterate to the last block.
     int count = 0;
     auto block = tracker.head();
@@ -331,6 +417,15 @@ TEST_CASE_TEMPLATE_DEFINE("pool", T, tracker_test_id) {
 
     // Head block has nothing before it.
     CHECK_EQ(nullptr, block->prev());
+#else
+    // Every remaining block is indexed once.
+    CHECK_EQ(current_num_blocks, tracker.blocks().size());
+    for (auto header : headers) {
+      if (header != header_to_remove) {
+        CHECK(indexed_once(tracker, header));
+      }
+    }
+#endif
   }
 }
 
@@ -131,6 +131,30 @@ TEST_CASE_TEMPLATE_DEFINE("fixed_block_pool", T, tracker_test_id) {
     CHECK_EQ(0, pool.num_bytes());
   }
 
+  SUBCASE("get_block") {
+    FixedBlockPool<FixedBlockT> pool;
+
+    auto memory1 = fixture.create_buffer(FixtureT::aligned_user_data_size +
+                                         FixtureT::aligned_header_size);
+    auto memory2 = fixture.create_buffer(FixtureT::aligned_user_data_size +
+                                         FixtureT::aligned_header_size);
+    auto header1 = FixedBlockT::create(memory1);
+    auto header2 = FixedBlockT::create(memory2);
+
+    pool.add(header1);
+    pool.add(header2);
+
+    // Blocks come back from the head, most recently added first.
+    CHECK_EQ(header2, pool.get());
+    CHECK_EQ(false, pool.in_list(header2));
+    CHECK_EQ(1, pool.num_blocks());
+
+    CHECK_EQ(header1, pool.get());
+    CHECK_EQ(0, pool.num_blocks());
+
+    CHECK_EQ(nullptr, pool.get());
+  }
+
   SUBCASE("add_several_blocks") {
     FixedBlockPool<FixedBlockT> pool;
 
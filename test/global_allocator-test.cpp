@@ -57,5 +57,10 @@ TEST_CASE("global_allocator") {
 
       // What to test, really? Make sure it links.
     }
+
+    SUBCASE("deallocate_sized") {
+      auto memory = Global::allocate(1024, 8);
+      Global::deallocate(memory, 1024, 8);
+    }
   }
 }
@@ -0,0 +1,224 @@
+/**
+ * @file global_new-test.cpp
+ * @brief Unit tests of the global operator new/delete replacements.
+ *
+ * NOTE: This executable links allok8or-new, so everything in it (including
+ * doctest) allocates through the routes under test.
+ */
+
+// My header
+#include "global_new.h"
+
+// Project headers
+#include "allocator.h"
+#include "context.h"
+#include "memory.h"
+
+// Library headers
+#include "doctest.h"
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+using namespace allok8or;
+
+/**
+ * @brief Thread-safe allocator that remembers its most recent calls.
+ */
+class RecordingAllocator : public Allocator<RecordingAllocator> {
+public:
+  void* allocate(size_t size,
+                 size_t alignment = alignof(std::max_align_t)) const {
+    last_allocate_size = size;
+    last_allocate_alignment = alignment;
+    auto memory = memory::aligned_malloc(size, alignment);
+    last_allocate = memory;
+    return memory;
+  }
+
+  void deallocate(void* data) const {
+    last_deallocate = data;
+    last_deallocate_size = 0;
+    memory::aligned_free(data);
+  }
+
+  void deallocate(void* data, size_t size, size_t alignment) const {
+    last_deallocate = data;
+    last_deallocate_size = size;
+    last_deallocate_alignment = alignment;
+    memory::aligned_free(data);
+  }
+
+  mutable std::atomic<void*> last_allocate{nullptr};
+  mutable std::atomic<size_t> last_allocate_size{0};
+  mutable std::atomic<size_t> last_allocate_alignment{0};
+  mutable std::atomic<void*> last_deallocate{nullptr};
+  mutable std::atomic<size_t> last_deallocate_size{0};
+  mutable std::atomic<size_t> last_deallocate_alignment{0};
+};
+
+// Outlives every allocation made through it.
+static RecordingAllocator s_allocator;
+
+struct alignas(64) OverAligned {
+  char data[64];
+};
+
+// Allocated before any route is set.
+static int* s_early = nullptr;
+static char* s_early_large = nullptr; // Larger than the bootstrap buffer.
+
+// NOTE: Test cases run in file order; this one must come first.
+TEST_CASE("bootstrap") {
+  // Doctest has already allocated during static init.
+  CHECK_GT(global::new_bootstrap_size_used(), 0);
+
+  auto bootstrap_used = global::new_bootstrap_size_used();
+  s_early = new int(1);
+  CHECK_GT(global::new_bootstrap_size_used(), bootstrap_used);
+
+  // Falls back to the system heap.
+  bootstrap_used = global::new_bootstrap_size_used();
+  auto heap_blocks = global::new_bootstrap_heap_blocks();
+  s_early_large = new char[1024 * 1024];
+  CHECK_EQ(global::new_bootstrap_size_used(), bootstrap_used);
+  CHECK_EQ(global::new_bootstrap_heap_blocks(), heap_blocks + 1);
+}
+
+// More than the live system heap blocks tracked before a route is set; see
+// ALK8_NEW_BOOTSTRAP_HEAP_BLOCKS.
+const size_t num_many_early = 5000;
+static int* s_many_early[num_many_early];
+
+TEST_CASE("bootstrap_heap_blocks_full") {
+  // Uses up the bootstrap buffer.
+  size_t bootstrap_used;
+  do {
+    bootstrap_used = global::new_bootstrap_size_used();
+    new char[256];
+  } while (global::new_bootstrap_size_used() != bootstrap_used);
+
+  // Past the tracked blocks, memory still comes from the system heap.
+  for (auto& early : s_many_early) {
+    early = new int(2);
+    REQUIRE(early);
+  }
+  CHECK_LT(global::new_bootstrap_heap_blocks(), num_many_early);
+}
+
+TEST_CASE("routed") {
+  global::install_global_new(&s_allocator);
+
+  SUBCASE("new_and_delete_are_routed") {
+    auto value = new long(42);
+    void* allocated = s_allocator.last_allocate;
+    size_t allocated_size = s_allocator.last_allocate_size;
+    CHECK_EQ(allocated, value);
+    CHECK_EQ(allocated_size, sizeof(long));
+
+    delete value;
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, value);
+  }
+
+  SUBCASE("arrays_and_nothrow") {
+    auto values = new (std::nothrow) int[100];
+    void* allocated = s_allocator.last_allocate;
+    CHECK_EQ(allocated, values);
+
+    delete[] values;
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, values);
+  }
+
+#if defined(__cpp_aligned_new)
+  SUBCASE("aligned_new") {
+    auto value = new OverAligned;
+    size_t alignment = s_allocator.last_allocate_alignment;
+    CHECK_EQ(reinterpret_cast<uintptr_t>(value) % alignof(OverAligned), 0);
+    CHECK_EQ(alignment, alignof(OverAligned));
+
+    delete value;
+  }
+#endif
+
+  SUBCASE("context_overrides_route") {
+    RecordingAllocator scoped_allocator;
+    long* value = nullptr;
+    void* allocated = nullptr;
+    void* deallocated = nullptr;
+    {
+      // No doctest calls in here; they'd allocate from scoped_allocator.
+      ScopedAllocatorContext context(scoped_allocator, owns_every_block);
+      value = new long(42);
+      allocated = scoped_allocator.last_allocate;
+      delete value;
+      deallocated = scoped_allocator.last_deallocate;
+    }
+    CHECK_EQ(allocated, value);
+    CHECK_EQ(deallocated, value);
+
+    s_allocator.last_allocate = nullptr;
+    auto outside = new int(1);
+    void* routed = s_allocator.last_allocate;
+    CHECK_EQ(routed, outside);
+    delete outside;
+  }
+
+  SUBCASE("bootstrap_memory_is_not_routed") {
+    REQUIRE(s_early);
+    s_allocator.last_deallocate = nullptr;
+    delete s_early;
+    s_early = nullptr;
+
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, nullptr);
+  }
+
+  SUBCASE("bootstrap_heap_memory_is_freed_to_the_heap") {
+    REQUIRE(s_early_large);
+    auto heap_blocks = global::new_bootstrap_heap_blocks();
+    s_allocator.last_deallocate = nullptr;
+    delete[] s_early_large;
+    s_early_large = nullptr;
+
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, nullptr);
+    CHECK_EQ(global::new_bootstrap_heap_blocks(), heap_blocks - 1);
+  }
+
+  SUBCASE("bootstrap_heap_blocks_full_are_not_routed") {
+    s_allocator.last_deallocate = nullptr;
+    for (auto& early : s_many_early) {
+      CHECK_EQ(2, *early);
+      delete early;
+      early = nullptr;
+    }
+
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, nullptr);
+
+    // Frees of routed memory still reach the route once the set is empty.
+    auto value = new int(3);
+    delete value;
+    deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, value);
+  }
+
+  SUBCASE("retired_route_never_frees") {
+    auto value = new int(7);
+
+    global::retire_global_new<RecordingAllocator>();
+    s_allocator.last_deallocate = nullptr;
+    delete value;
+    void* deallocated = s_allocator.last_deallocate;
+    CHECK_EQ(deallocated, nullptr);
+
+    auto late = new int(8);
+    void* allocated = s_allocator.last_allocate;
+    CHECK_NE(allocated, late);
+    delete late;
+
+    global::install_global_new(&s_allocator);
+  }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file inline_allocator-test.cpp
+ * @brief Unit tests of the InlineAllocator class.
+ */
+
+// My header
+#include "inline.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "mock_allocator.h"
+#include "std_allocator_adapter.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace allok8or;
+
+TEST_CASE("allocate_inline") {
+  int fallback_calls = 0;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_calls; });
+  InlineAllocator<256, test::MockAllocator> allocator(fallback);
+
+  auto first = call_allocate(allocator, 24);
+  auto second = call_allocate(allocator, 8, 64);
+
+  CHECK(allocator.owns(first));
+  CHECK(allocator.owns(second));
+  CHECK_EQ(reinterpret_cast<uintptr_t>(second) % 64, 0);
+  CHECK_EQ(fallback_calls, 0);
+}
+
+TEST_CASE("allocate_falls_back") {
+  int fallback_calls = 0;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_calls; });
+  InlineAllocator<64, test::MockAllocator> allocator(fallback);
+
+  auto inline_memory = call_allocate(allocator, 48);
+  auto fallback_memory = call_allocate(allocator, 48);
+
+  CHECK(allocator.owns(inline_memory));
+  CHECK_FALSE(allocator.owns(fallback_memory));
+  CHECK_EQ(fallback_calls, 1);
+
+  int deallocate_calls = 0;
+  test::MockAllocator counting(nullptr, [&](void*) { ++deallocate_calls; });
+  InlineAllocator<64, test::MockAllocator> other(counting);
+  auto memory = call_allocate(other, 128);
+  call_deallocate(other, memory);
+  CHECK_EQ(deallocate_calls, 1);
+
+  call_deallocate(allocator, fallback_memory);
+}
+
+TEST_CASE("deallocate_reuses_last_block") {
+  test::MockAllocator fallback;
+  InlineAllocator<128, test::MockAllocator> allocator(fallback);
+
+  SUBCASE("unsized") {
+    auto first = call_allocate(allocator, 32);
+    call_deallocate(allocator, first);
+    CHECK_EQ(allocator.used(), 0);
+  }
+
+  SUBCASE("sized_stack_order") {
+    auto first = call_allocate(allocator, 16, 16);
+    auto second = call_allocate(allocator, 16, 16);
+    call_deallocate(allocator, second, 16, 16);
+    call_deallocate(allocator, first, 16, 16);
+    CHECK_EQ(allocator.used(), 0);
+  }
+
+  SUBCASE("not_last_is_kept") {
+    auto first = call_allocate(allocator, 16, 16);
+    call_allocate(allocator, 16, 16);
+    call_deallocate(allocator, first, 16, 16);
+    CHECK_EQ(allocator.used(), 32);
+
+    allocator.reset();
+    CHECK_EQ(allocator.used(), 0);
+  }
+}
+
+TEST_CASE("try_expand_in_place") {
+  test::MockAllocator fallback;
+  InlineAllocator<128, test::MockAllocator> allocator(fallback);
+
+  auto memory = call_allocate(allocator, 16);
+  CHECK(call_try_expand_in_place(allocator, memory, 100));
+  CHECK_EQ(allocator.used(), 100);
+  CHECK_FALSE(call_try_expand_in_place(allocator, memory, 200));
+}
+
+TEST_CASE("short_allocator_vector") {
+  int fallback_calls = 0;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_calls; });
+  InlineAllocator<16 * sizeof(int), test::MockAllocator> arena(fallback);
+
+  using Alloc = ShortAllocator<int, 16 * sizeof(int), test::MockAllocator>;
+  std::vector<int, Alloc> numbers{Alloc(arena)};
+
+  numbers.reserve(16);
+  for (int i = 0; i < 16; ++i) {
+    numbers.push_back(i);
+  }
+  CHECK_EQ(fallback_calls, 0);
+
+  numbers.push_back(16);
+  CHECK_EQ(fallback_calls, 1);
+  CHECK_EQ(numbers[16], 16);
+}
+
+TEST_CASE("short_allocator_string") {
+  int fallback_calls = 0;
+  test::MockAllocator fallback([&](size_t, size_t) { ++fallback_calls; });
+  InlineAllocator<128, test::MockAllocator> arena(fallback);
+
+  using Alloc = ShortAllocator<char, 128, test::MockAllocator>;
+  std::basic_string<char, std::char_traits<char>, Alloc> text{Alloc(arena)};
+
+  text.assign("a string that is too long for the small string optimization");
+  CHECK_EQ(fallback_calls, 0);
+  CHECK_GT(arena.used(), 0);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file memory_resource_adapter-test.cpp
+ * @brief Unit tests of the MemoryResourceAdapter class.
+ */
+
+// My header
+#include "memory_resource_adapter.h"
+
+// Project headers
+#include "arena.h"
+#include "mock_allocator.h"
+#include "page.h"
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace allok8or;
+
+TEST_CASE("allocate_passes_size_and_alignment") {
+  size_t allocated_size = 0;
+  size_t allocated_alignment = 0;
+  auto on_allocate = [&](size_t size, size_t alignment) {
+    allocated_size = size;
+    allocated_alignment = alignment;
+  };
+
+  size_t deallocated_size = 0;
+  size_t deallocated_alignment = 0;
+  auto on_deallocate_sized = [&](void*, size_t size, size_t alignment) {
+    deallocated_size = size;
+    deallocated_alignment = alignment;
+  };
+
+  test::MockAllocator mock(on_allocate, nullptr, on_deallocate_sized);
+  MemoryResourceAdapter<test::MockAllocator> resource(mock);
+
+  auto memory = resource.allocate(100, 64);
+  CHECK_EQ(allocated_size, 100);
+  CHECK_EQ(allocated_alignment, 64);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 64, 0);
+
+  resource.deallocate(memory, 100, 64);
+  CHECK_EQ(deallocated_size, 100);
+  CHECK_EQ(deallocated_alignment, 64);
+}
+
+/**
+ * @brief Allocator that is always out of memory.
+ */
+class ExhaustedAllocator : public Allocator<ExhaustedAllocator> {
+public:
+  void* allocate(size_t, size_t = alignof(std::max_align_t)) const {
+    return nullptr;
+  }
+  void deallocate(void*) const {}
+};
+
+TEST_CASE("allocate_failure_throws") {
+  ExhaustedAllocator exhausted;
+  MemoryResourceAdapter<ExhaustedAllocator> resource(exhausted);
+
+  CHECK_THROWS_AS((void)resource.allocate(4096), std::bad_alloc);
+}
+
+TEST_CASE("is_equal") {
+  PassThroughAllocator pass_through1;
+  PassThroughAllocator pass_through2;
+  MemoryResourceAdapter<PassThroughAllocator> resource1(pass_through1);
+  MemoryResourceAdapter<PassThroughAllocator> resource2(pass_through2);
+
+  PageAllocator pages(1024);
+  Arena arena1(pages);
+  Arena arena2(pages);
+  MemoryResourceAdapter<Arena> arena_resource1(arena1);
+  MemoryResourceAdapter<Arena> arena_resource1_again(arena1);
+  MemoryResourceAdapter<Arena> arena_resource2(arena2);
+
+  SUBCASE("same_instance") { CHECK(resource1.is_equal(resource1)); }
+
+  SUBCASE("stateless_allocators") { CHECK(resource1.is_equal(resource2)); }
+
+  SUBCASE("same_stateful_allocator") {
+    CHECK(arena_resource1.is_equal(arena_resource1_again));
+  }
+
+  SUBCASE("different_stateful_allocators") {
+    CHECK_FALSE(arena_resource1.is_equal(arena_resource2));
+  }
+
+  SUBCASE("different_types") {
+    CHECK_FALSE(resource1.is_equal(arena_resource1));
+    CHECK_FALSE(resource1.is_equal(*std::pmr::new_delete_resource()));
+  }
+}
+
+TEST_CASE("pmr_containers") {
+  PageAllocator pages(16384);
+  Arena arena(pages);
+  MemoryResourceAdapter<Arena> resource(arena);
+
+  std::pmr::vector<std::pmr::string> names(&resource);
+  std::pmr::map<int, std::pmr::string> ids(&resource);
+  for (int i = 0; i < 100; ++i) {
+    names.emplace_back("a name that is long enough to need an allocation");
+    ids.emplace(i, names.back());
+  }
+
+  CHECK_EQ(names.size(), 100);
+  CHECK_EQ(ids.size(), 100);
+  CHECK_EQ(ids.at(42), names[42]);
+  CHECK_GT(arena.num_pages(), 1);
+
+  // Moving between containers on equal resources just swaps pointers.
+  MemoryResourceAdapter<Arena> same_resource(arena);
+  std::pmr::vector<std::pmr::string> moved(&same_resource);
+  auto data = names.data();
+  moved = std::move(names);
+  CHECK_EQ(moved.data(), data);
+}
@@ -17,17 +17,22 @@ namespace test {
 
 typedef std::function<void(size_t, size_t)> CbAllocate;
 typedef std::function<void(void*)> CbDeallocate;
+typedef std::function<void(void*, size_t, size_t)> CbDeallocateSized;
 
 class MockAllocator : public Allocator<MockAllocator> {
 public:
   explicit MockAllocator(CbAllocate on_allocate = nullptr,
-                         CbDeallocate on_deallocate = nullptr)
-      : m_on_allocate(on_allocate), m_on_deallocate(on_deallocate) {}
+                         CbDeallocate on_deallocate = nullptr,
+                         CbDeallocateSized on_deallocate_sized = nullptr)
+      : m_on_allocate(on_allocate),
+        m_on_deallocate(on_deallocate),
+        m_on_deallocate_sized(on_deallocate_sized) {}
 
   // Public API
   void* allocate(size_t bytes,
                  size_t alignment = alignof(std::max_align_t)) const;
   void deallocate(void* user_data) const;
+  void deallocate(void* user_data, size_t bytes, size_t alignment) const;
 
 private:
   friend constexpr bool operator==(const MockAllocator& lhs,
@@ -36,6 +41,7 @@ private:
   PassThroughAllocator m_allocator; // for real allocation/deallocation
   mutable CbAllocate m_on_allocate;
   mutable CbDeallocate m_on_deallocate;
+  mutable CbDeallocateSized m_on_deallocate_sized;
 };
 
 inline void* MockAllocator::allocate(
@@ -51,6 +57,14 @@ inline void MockAllocator::deallocate(void* memory) const {
   m_allocator.deallocate(memory);
 }
 
+inline void MockAllocator::deallocate(void* memory,
+                                     size_t bytes,
+                                     size_t alignment) const {
+  if (m_on_deallocate_sized)
+    m_on_deallocate_sized(memory, bytes, alignment);
+  deallocate(memory);
+}
+
 inline constexpr bool operator==(const MockAllocator& lhs,
                                  const MockAllocator& rhs) {
   return lhs.m_allocator == rhs.m_allocator;
@@ -0,0 +1,138 @@
+/**
+ * @file node_std_allocator_adapter-test.cpp
+ * @brief Unit tests of the NodeStdAllocatorAdapter class.
+ */
+
+// My header
+#include "node_std_allocator_adapter.h"
+
+// Project headers
+#include "mock_allocator.h"
+#include "page.h"
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace allok8or;
+
+TEST_CASE("single_nodes_come_from_pools") {
+  int backing_allocations = 0;
+  auto on_allocate = [&](size_t, size_t) { ++backing_allocations; };
+
+  test::MockAllocator mock(on_allocate, nullptr);
+  PageAllocator pages(4096);
+  NodePoolSet<test::MockAllocator> pools(mock, pages);
+
+  using MapT = std::map<int,
+                        double,
+                        std::less<int>,
+                        NodeStdAllocatorAdapter<std::pair<const int, double>,
+                                                test::MockAllocator>>;
+  {
+    MapT map{MapT::allocator_type(pools)};
+    for (int i = 0; i < 500; ++i) {
+      map.emplace(i, i * 0.5);
+    }
+
+    CHECK_EQ(map.size(), 500);
+    CHECK_EQ(map.at(250), 125.0);
+
+    // Only the pool itself comes from the backing allocator, not the nodes.
+    CHECK_EQ(pools.num_pools(), 1);
+    CHECK_EQ(backing_allocations, 2);
+    CHECK_GT(pages.num_pages(), 1);
+  }
+
+  // Nodes went back to the pool; its pages are kept until the set goes away.
+  CHECK_EQ(pages.num_free_pages(), 0);
+}
+
+TEST_CASE("arrays_come_from_backing_allocator") {
+  size_t allocated_size = 0;
+  auto on_allocate = [&](size_t size, size_t) { allocated_size = size; };
+
+  test::MockAllocator mock(on_allocate, nullptr);
+  PageAllocator pages(4096);
+  NodePoolSet<test::MockAllocator> pools(mock, pages);
+
+  using AllocatorT = NodeStdAllocatorAdapter<int, test::MockAllocator>;
+  std::vector<int, AllocatorT> numbers{AllocatorT(pools)};
+  numbers.reserve(10);
+
+  CHECK_EQ(allocated_size, 10 * sizeof(int));
+  CHECK_EQ(pools.num_pools(), 0);
+}
+
+TEST_CASE("node_containers") {
+  PassThroughAllocator pass_through;
+  PageAllocator pages(4096);
+  NodePoolSet<PassThroughAllocator> pools(pass_through, pages);
+
+  SUBCASE("list") {
+    using AllocatorT =
+        NodeStdAllocatorAdapter<std::string, PassThroughAllocator>;
+    std::list<std::string, AllocatorT> names{AllocatorT(pools)};
+    for (int i = 0; i < 100; ++i) {
+      names.push_back(std::to_string(i));
+    }
+    names.remove("50");
+
+    CHECK_EQ(names.size(), 99);
+    CHECK_EQ(names.back(), "99");
+  }
+
+  SUBCASE("unordered_map") {
+    using AllocatorT =
+        NodeStdAllocatorAdapter<std::pair<const std::string, int>,
+                                PassThroughAllocator>;
+    std::unordered_map<std::string,
+                       int,
+                       std::hash<std::string>,
+                       std::equal_to<std::string>,
+                       AllocatorT>
+        ids{0,
+            std::hash<std::string>(),
+            std::equal_to<std::string>(),
+            AllocatorT(pools)};
+    for (int i = 0; i < 100; ++i) {
+      ids.emplace(std::to_string(i), i);
+    }
+    ids.erase("50");
+
+    CHECK_EQ(ids.size(), 99);
+    CHECK_EQ(ids.at("42"), 42);
+    CHECK_EQ(ids.count("50"), 0);
+  }
+
+  SUBCASE("nodes_of_equal_size_share_a_pool") {
+    std::list<long, NodeStdAllocatorAdapter<long, PassThroughAllocator>> longs{
+        NodeStdAllocatorAdapter<long, PassThroughAllocator>(pools)};
+    std::list<double, NodeStdAllocatorAdapter<double, PassThroughAllocator>>
+        doubles{NodeStdAllocatorAdapter<double, PassThroughAllocator>(pools)};
+    longs.push_back(1);
+    doubles.push_back(1.0);
+
+    CHECK_EQ(pools.num_pools(), 1);
+  }
+}
+
+TEST_CASE("equality") {
+  PassThroughAllocator pass_through;
+  PageAllocator pages(4096);
+  NodePoolSet<PassThroughAllocator> pools1(pass_through, pages);
+  NodePoolSet<PassThroughAllocator> pools2(pass_through, pages);
+
+  NodeStdAllocatorAdapter<int, PassThroughAllocator> adapter1(pools1);
+  NodeStdAllocatorAdapter<double, PassThroughAllocator> adapter1_rebound(
+      adapter1);
+  NodeStdAllocatorAdapter<int, PassThroughAllocator> adapter2(pools2);
+
+  CHECK(adapter1 == adapter1_rebound);
+  CHECK(adapter1 != adapter2);
+}
@@ -12,6 +12,8 @@
 
 // Library headers
 #include "doctest.h"
+#include <cstdint>
+#include <cstring>
 
 
 TEST_CASE("allocate") {
@@ -41,6 +43,39 @@ TEST_CASE("deallocate") {
   // What to test, really? Make sure it links.
 }
 
+TEST_CASE("reallocate") {
+  allok8or::PassThroughAllocator allocator;
+
+  SUBCASE("default_alignment") {
+    auto memory = static_cast<char*>(call_allocate(allocator, 16));
+    std::memcpy(memory, "hello", 6);
+
+    memory = static_cast<char*>(call_reallocate(
+        allocator, memory, 16, 1 << 20, alignof(std::max_align_t)));
+    CHECK_NE(memory, nullptr);
+    CHECK_EQ(std::strcmp(memory, "hello"), 0);
+    call_deallocate(allocator, memory);
+  }
+
+  SUBCASE("over_aligned") {
+    auto memory = static_cast<char*>(call_allocate(allocator, 16, 256));
+    std::memcpy(memory, "hello", 6);
+
+    memory =
+        static_cast<char*>(call_reallocate(allocator, memory, 16, 4096, 256));
+    CHECK_NE(memory, nullptr);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 256, 0);
+    CHECK_EQ(std::strcmp(memory, "hello"), 0);
+    call_deallocate(allocator, memory);
+  }
+
+  SUBCASE("null_allocates") {
+    auto memory = call_reallocate(allocator, nullptr, 0, 64, 8);
+    CHECK_NE(memory, nullptr);
+    call_deallocate(allocator, memory);
+  }
+}
+
 TEST_CASE("compare_equal") {
   allok8or::PassThroughAllocator allocator1 ;
   allok8or::PassThroughAllocator allocator2;
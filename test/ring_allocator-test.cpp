@@ -0,0 +1,190 @@
+/**
+ * @file ring_allocator-test.cpp
+ * @brief Unit tests of the RingAllocator class.
+ */
+
+// My header
+#include "ring.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "page.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace allok8or;
+
+static const size_t DEFAULT_PAGE_SIZE = 1024;
+
+// Header plus rounded-up user data.
+static size_t block_span(size_t size) {
+  const size_t granularity = alignof(std::max_align_t);
+  return granularity + (size + granularity - 1) / granularity * granularity;
+}
+
+TEST_CASE("create_ring_allocator") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<> ring(pages);
+
+  CHECK_GT(ring.capacity(), 0);
+  CHECK_LE(ring.capacity(), pages.user_data_size());
+  CHECK_EQ(ring.used(), 0);
+  CHECK_EQ(pages.num_pages(), 1);
+}
+
+TEST_CASE("destroy_returns_page") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  { RingAllocator<> ring(pages); }
+
+  CHECK_EQ(pages.num_free_pages(), 1);
+}
+
+TEST_CASE("allocate_deallocate_in_order") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<> ring(pages);
+
+  auto first = call_allocate(ring, 40);
+  auto second = call_allocate(ring, 40);
+  CHECK_NE(first, nullptr);
+  CHECK_NE(second, nullptr);
+  CHECK_EQ(static_cast<char*>(second) - static_cast<char*>(first),
+           block_span(40));
+  CHECK_EQ(ring.used(), 2 * block_span(40));
+
+  call_deallocate(ring, first);
+  CHECK_EQ(ring.used(), block_span(40));
+
+  call_deallocate(ring, second);
+  CHECK_EQ(ring.used(), 0);
+}
+
+TEST_CASE("deallocate_out_of_order") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<> ring(pages);
+
+  auto a = call_allocate(ring, 16);
+  auto b = call_allocate(ring, 16);
+  auto c = call_allocate(ring, 16);
+
+  // Not at the tail: only marked free.
+  call_deallocate(ring, b);
+  CHECK_EQ(ring.used(), 3 * block_span(16));
+
+  // Tail advances past a and the already free b.
+  call_deallocate(ring, a);
+  CHECK_EQ(ring.used(), block_span(16));
+
+  call_deallocate(ring, c);
+  CHECK_EQ(ring.used(), 0);
+}
+
+TEST_CASE("wrap_around") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<> ring(pages);
+
+  const size_t size = ring.capacity() / 3 - block_span(0);
+  auto first = call_allocate(ring, size);
+  call_allocate(ring, size);
+  call_allocate(ring, size);
+  CHECK_EQ(call_allocate(ring, size), nullptr); // full
+
+  call_deallocate(ring, first);
+  auto wrapped = call_allocate(ring, size);
+  CHECK_EQ(wrapped, first);
+}
+
+TEST_CASE("allocate_full_capacity_after_drain") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<ring::NonBlocking> ring(pages);
+
+  // Fill past the middle of the region, then drain.
+  auto first = call_allocate(ring, ring.capacity() / 2);
+  CHECK_NE(first, nullptr);
+  call_deallocate(ring, first);
+  CHECK_EQ(ring.used(), 0);
+
+  // Doesn't fit before the end, and with the skip wouldn't fit at all.
+  const size_t size = ring.capacity() - block_span(0);
+  auto second = call_allocate(ring, size);
+  CHECK_EQ(second, first);
+  CHECK_EQ(ring.used(), ring.capacity());
+
+  call_deallocate(ring, second);
+  CHECK_EQ(ring.used(), 0);
+}
+
+TEST_CASE("full_non_blocking") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<ring::NonBlocking> ring(pages);
+
+  CHECK_EQ(call_allocate(ring, ring.capacity()), nullptr);
+
+  int count = 0;
+  while (call_allocate(ring, 64)) {
+    ++count;
+  }
+  CHECK_EQ(count, ring.capacity() / block_span(64));
+}
+
+TEST_CASE("aligned") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<> ring(pages);
+
+  call_allocate(ring, 8);
+  auto memory = call_allocate(ring, 8, 128);
+  CHECK_NE(memory, nullptr);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 128, 0);
+
+  call_deallocate(ring, memory);
+  CHECK_GT(ring.used(), 0);
+}
+
+TEST_CASE("spsc_blocking") {
+  PageAllocator pages(DEFAULT_PAGE_SIZE);
+  RingAllocator<ring::Blocking> ring(pages);
+
+  const int num_messages = 10000;
+  std::deque<uint32_t*> queue;
+  std::mutex mutex;
+
+  std::thread producer([&]() {
+    for (int i = 0; i < num_messages; ++i) {
+      auto message = static_cast<uint32_t*>(
+          call_allocate(ring, sizeof(uint32_t) * (1 + i % 32)));
+      *message = static_cast<uint32_t>(i);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(message);
+    }
+  });
+
+  int received = 0;
+  bool in_order = true;
+  while (received < num_messages) {
+    uint32_t* message = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!queue.empty()) {
+        message = queue.front();
+        queue.pop_front();
+      }
+    }
+
+    if (message) {
+      in_order = in_order && (*message == static_cast<uint32_t>(received));
+      call_deallocate(ring, message);
+      ++received;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  producer.join();
+  CHECK(in_order);
+  CHECK_EQ(ring.used(), 0);
+}
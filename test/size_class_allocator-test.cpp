@@ -0,0 +1,298 @@
+/**
+ * @file size_class_allocator-test.cpp
+ * @brief Unit tests of the SizeClassAllocator class.
+ */
+
+// My header
+#include "size_class.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace allok8or;
+
+TEST_CASE("size_classes") {
+  CHECK_EQ(SizeClassAllocator::size_class_index(0), 0);
+  CHECK_EQ(SizeClassAllocator::size_class_index(1), 0);
+  CHECK_EQ(SizeClassAllocator::size_class_index(16), 0);
+  CHECK_EQ(SizeClassAllocator::size_class_index(17), 1);
+  CHECK_EQ(SizeClassAllocator::size_class_index(128), 7);
+  CHECK_EQ(SizeClassAllocator::size_class_index(129), 8);
+  CHECK_EQ(SizeClassAllocator::size_class_index(
+               SizeClassAllocator::MAX_SMALL_SIZE),
+           SizeClassAllocator::NUM_SIZE_CLASSES - 1);
+
+  // Every size maps to the smallest class that fits it.
+  for (size_t size = 1; size <= SizeClassAllocator::MAX_SMALL_SIZE; ++size) {
+    auto index = SizeClassAllocator::size_class_index(size);
+    REQUIRE_GE(SizeClassAllocator::size_class_size(index), size);
+    if (index > 0) {
+      REQUIRE_LT(SizeClassAllocator::size_class_size(index - 1), size);
+    }
+  }
+}
+
+TEST_CASE("allocate_and_deallocate") {
+  SizeClassAllocator allocator;
+
+  SUBCASE("small") {
+    std::set<void*> blocks;
+    for (size_t size = 1; size <= 4096; size += 37) {
+      auto memory = allocator.allocate(size);
+      REQUIRE(memory);
+      CHECK_EQ(reinterpret_cast<uintptr_t>(memory) %
+                   SizeClassAllocator::MIN_ALIGNMENT,
+               0);
+      CHECK_GE(allocator.usable_size(memory), size);
+      memset(memory, 0xAB, size);
+      blocks.insert(memory);
+    }
+    for (auto memory : blocks) {
+      allocator.deallocate(memory);
+    }
+  }
+
+  SUBCASE("aligned") {
+    for (size_t alignment = 32; alignment <= 2 * SizeClassAllocator::CHUNK_SIZE;
+         alignment *= 2) {
+      auto memory = allocator.allocate(100, alignment);
+      REQUIRE(memory);
+      CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % alignment, 0);
+      CHECK_GE(allocator.usable_size(memory), 100);
+      allocator.deallocate(memory);
+    }
+  }
+
+  SUBCASE("large") {
+    const size_t size = 1024 * 1024;
+    auto memory = static_cast<char*>(allocator.allocate(size));
+    REQUIRE(memory);
+    CHECK_GE(allocator.usable_size(memory), size);
+    memory[0] = 1;
+    memory[size - 1] = 2;
+    allocator.deallocate(memory);
+  }
+
+  SUBCASE("blocks_are_reused") {
+    auto memory = allocator.allocate(64);
+    allocator.deallocate(memory);
+    CHECK_EQ(allocator.allocate(64), memory);
+    allocator.deallocate(memory);
+  }
+
+  SUBCASE("large_spans_are_reused") {
+    const size_t size = 100 * 1024;
+    auto memory = allocator.allocate(size);
+    REQUIRE(memory);
+    allocator.deallocate(memory);
+    CHECK_EQ(allocator.allocate(size), memory);
+    CHECK_GE(allocator.usable_size(memory), size);
+    allocator.deallocate(memory);
+  }
+
+  allocator.release();
+}
+
+TEST_CASE("reallocate") {
+  SizeClassAllocator allocator;
+
+  SUBCASE("small_in_place") {
+    auto memory = allocator.allocate(20);
+    CHECK_EQ(call_reallocate(allocator, memory, 20, 32, 16), memory);
+    allocator.deallocate(memory);
+  }
+
+  SUBCASE("small_to_large") {
+    auto memory = static_cast<char*>(allocator.allocate(100));
+    memset(memory, 7, 100);
+
+    auto resized = static_cast<char*>(
+        call_reallocate(allocator, memory, 100, 1024 * 1024, 16));
+    REQUIRE(resized);
+    CHECK_EQ(resized[0], 7);
+    CHECK_EQ(resized[99], 7);
+    allocator.deallocate(resized);
+  }
+
+  SUBCASE("large_keeps_contents") {
+    const size_t size = 512 * 1024;
+    auto memory = static_cast<char*>(allocator.allocate(size));
+    memory[0] = 1;
+    memory[size - 1] = 2;
+
+    // Block the pages after it, so the mapping has to move.
+    auto neighbour = allocator.allocate(size);
+
+    auto resized = static_cast<char*>(
+        call_reallocate(allocator, memory, size, 8 * size, 16));
+    REQUIRE(resized);
+    CHECK_EQ(resized[0], 1);
+    CHECK_EQ(resized[size - 1], 2);
+    CHECK_GE(allocator.usable_size(resized), 8 * size);
+    resized[8 * size - 1] = 3;
+
+    allocator.deallocate(resized);
+    allocator.deallocate(neighbour);
+  }
+
+  allocator.release();
+}
+
+TEST_CASE("allocate_bulk") {
+  SizeClassAllocator allocator;
+  void* blocks[100];
+
+  SUBCASE("small") {
+    CHECK_EQ(allocator.allocate_bulk(48, 32, blocks, 100), 100);
+    std::set<void*> unique(blocks, blocks + 100);
+    CHECK_EQ(unique.size(), 100);
+    for (auto block : blocks) {
+      CHECK_EQ(reinterpret_cast<uintptr_t>(block) % 32, 0);
+      CHECK_GE(allocator.usable_size(block), 48);
+    }
+  }
+
+  SUBCASE("large") {
+    const size_t size = SizeClassAllocator::MAX_SMALL_SIZE + 1;
+    CHECK_EQ(allocator.allocate_bulk(size, 16, blocks, 3), 3);
+    CHECK_GE(allocator.usable_size(blocks[2]), size);
+    for (size_t i = 3; i < 100; ++i) {
+      blocks[i] = nullptr;
+    }
+  }
+
+  for (auto block : blocks) {
+    if (block) {
+      call_deallocate(allocator, block);
+    }
+  }
+  allocator.release();
+}
+
+TEST_CASE("trim") {
+  SizeClassAllocator allocator;
+
+  // Enough blocks for a few slabs.
+  const size_t size = 48;
+  std::vector<void*> blocks;
+  for (size_t ix = 0; ix < 3 * SizeClassAllocator::CHUNK_SIZE / size; ++ix) {
+    blocks.push_back(allocator.allocate(size));
+  }
+  auto large = allocator.allocate(SizeClassAllocator::MAX_SMALL_SIZE + 1);
+  REQUIRE(large);
+
+  SUBCASE("keeps_slabs_in_use") {
+    CHECK_EQ(allocator.trim(), 0);
+    for (auto memory : blocks) {
+      allocator.deallocate(memory);
+    }
+    allocator.deallocate(large);
+  }
+
+  SUBCASE("releases_empty_slabs") {
+    auto kept = blocks.back();
+    blocks.pop_back();
+    for (auto memory : blocks) {
+      allocator.deallocate(memory);
+    }
+    allocator.deallocate(large);
+
+    CHECK_GE(allocator.trim(), 2 * SizeClassAllocator::CHUNK_SIZE +
+                                   SizeClassAllocator::MAX_SMALL_SIZE);
+    CHECK_EQ(allocator.trim(), 0);
+
+    // The kept block's slab serves allocations as before.
+    auto memory = static_cast<char*>(allocator.allocate(size));
+    REQUIRE(memory);
+    memset(memory, 0xAB, size);
+    allocator.deallocate(memory);
+    allocator.deallocate(kept);
+  }
+
+  SUBCASE("counts_thread_cached_blocks_as_used") {
+    SizeClassAllocator::ThreadCache cache = {};
+    for (auto memory : blocks) {
+      allocator.deallocate(cache, memory);
+    }
+    allocator.deallocate(large);
+    CHECK_LT(allocator.trim(), 3 * SizeClassAllocator::CHUNK_SIZE);
+
+    allocator.flush(cache);
+    CHECK_GE(allocator.trim(), 2 * SizeClassAllocator::CHUNK_SIZE);
+  }
+
+  allocator.release();
+}
+
+TEST_CASE("thread_cache") {
+  SizeClassAllocator allocator;
+
+  SUBCASE("cached_blocks_are_reused") {
+    SizeClassAllocator::ThreadCache cache = {};
+    auto memory = allocator.allocate(cache, 48);
+    allocator.deallocate(cache, memory);
+    CHECK_EQ(allocator.allocate(cache, 48), memory);
+    allocator.deallocate(cache, memory);
+    allocator.flush(cache);
+  }
+
+  SUBCASE("flushed_blocks_go_to_central_bin") {
+    SizeClassAllocator::ThreadCache cache = {};
+    auto memory = allocator.allocate(cache, 48);
+    allocator.deallocate(cache, memory);
+    allocator.flush(cache);
+    CHECK_EQ(cache.bins[SizeClassAllocator::size_class_index(48)].count, 0);
+
+    // Central blocks are available to an uncached caller.
+    std::set<void*> blocks;
+    for (int ix = 0; ix < 1000; ++ix) {
+      blocks.insert(allocator.allocate(48));
+    }
+    CHECK_EQ(blocks.count(memory), 1);
+    for (auto block : blocks) {
+      allocator.deallocate(block);
+    }
+  }
+
+  SUBCASE("threads") {
+    const int num_threads = 4;
+    const int num_allocations = 10000;
+
+    std::vector<std::thread> threads;
+    for (int ix = 0; ix < num_threads; ++ix) {
+      threads.emplace_back([&allocator, ix]() {
+        SizeClassAllocator::ThreadCache cache = {};
+        std::vector<char*> blocks;
+        for (int jx = 0; jx < num_allocations; ++jx) {
+          const size_t size = 1 + (jx * 31) % 2000;
+          auto memory = static_cast<char*>(allocator.allocate(cache, size));
+          memory[0] = static_cast<char>(ix);
+          blocks.push_back(memory);
+          if (jx % 3 == 0) {
+            auto victim = blocks[blocks.size() / 2];
+            REQUIRE_EQ(victim[0], static_cast<char>(ix));
+            allocator.deallocate(cache, victim);
+            blocks.erase(blocks.begin() + blocks.size() / 2);
+          }
+        }
+        for (auto memory : blocks) {
+          allocator.deallocate(cache, memory);
+        }
+        allocator.flush(cache);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  allocator.release();
+}
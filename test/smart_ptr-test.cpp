@@ -0,0 +1,123 @@
+/**
+ * @file smart_ptr-test.cpp
+ * @brief Unit tests of allocate_unique, allocate_shared and AllocatorDeleter.
+ */
+
+// My header
+#include "smart_ptr.h"
+
+// Project headers
+#include "mock_allocator.h"
+#include "pass_through.h"
+#include "std_allocator_adapter.h"
+
+// Library headers
+#include "doctest.h"
+#include <stdexcept>
+#include <string>
+
+using namespace allok8or;
+
+struct Widget {
+  Widget(std::string name, int value, int* destroyed)
+      : name(std::move(name)), value(value), destroyed(destroyed) {}
+  ~Widget() { ++*destroyed; }
+
+  std::string name;
+  int value;
+  int* destroyed;
+};
+
+struct Throws {
+  Throws() { throw std::runtime_error("constructor"); }
+  long value;
+};
+
+TEST_CASE("deleter_size") {
+  // Stateless allocator: no state in the deleter.
+  CHECK(std::is_empty<AllocatorDeleter<Widget, PassThroughAllocator>>::value);
+  CHECK_EQ(sizeof(UniquePtr<Widget, PassThroughAllocator>), sizeof(Widget*));
+
+  // Stateful allocator: one pointer.
+  CHECK_EQ(sizeof(UniquePtr<Widget, test::MockAllocator>), 2 * sizeof(void*));
+}
+
+TEST_CASE("allocate_unique") {
+  int allocations = 0;
+  int sized_deallocations = 0;
+  size_t deallocated_size = 0;
+  test::MockAllocator allocator(
+      [&](size_t, size_t) { ++allocations; },
+      nullptr,
+      [&](void*, size_t size, size_t) {
+        ++sized_deallocations;
+        deallocated_size = size;
+      });
+  int destroyed = 0;
+
+  SUBCASE("construct_and_delete") {
+    {
+      auto widget = allocate_unique<Widget>(allocator, "one", 1, &destroyed);
+      CHECK_EQ(widget->name, "one");
+      CHECK_EQ(widget->value, 1);
+      CHECK_EQ(allocations, 1);
+    }
+    CHECK_EQ(destroyed, 1);
+    CHECK_EQ(sized_deallocations, 1);
+    CHECK_EQ(deallocated_size, sizeof(Widget));
+  }
+
+  SUBCASE("stateless") {
+    PassThroughAllocator pass_through;
+    auto widget = allocate_unique<Widget>(pass_through, "two", 2, &destroyed);
+    widget.reset();
+    CHECK_EQ(destroyed, 1);
+  }
+
+  SUBCASE("std_allocator_adapter") {
+    StdAllocatorAdapter<char, test::MockAllocator> adapter(allocator);
+    {
+      auto widget = allocate_unique<Widget>(adapter, "three", 3, &destroyed);
+      CHECK_EQ(allocations, 1);
+    }
+    CHECK_EQ(destroyed, 1);
+  }
+
+  SUBCASE("constructor_throws") {
+    CHECK_THROWS_AS(allocate_unique<Throws>(allocator), std::runtime_error);
+    CHECK_EQ(allocations, 1);
+    CHECK_EQ(sized_deallocations, 1);
+  }
+}
+
+TEST_CASE("allocate_shared") {
+  int allocations = 0;
+  int deallocations = 0;
+  test::MockAllocator allocator(
+      [&](size_t, size_t) { ++allocations; },
+      nullptr,
+      [&](void*, size_t, size_t) { ++deallocations; });
+  int destroyed = 0;
+
+  SUBCASE("one_allocation") {
+    {
+      auto widget = allocate_shared<Widget>(allocator, "four", 4, &destroyed);
+      auto copy = widget;
+      std::weak_ptr<Widget> weak = widget;
+      CHECK_EQ(copy->value, 4);
+      CHECK_EQ(allocations, 1);
+    }
+    CHECK_EQ(destroyed, 1);
+    CHECK_EQ(deallocations, 1);
+  }
+
+  SUBCASE("std_allocator_adapter") {
+    StdAllocatorAdapter<int, test::MockAllocator> adapter(allocator);
+    {
+      auto widget = allocate_shared<Widget>(adapter, "five", 5, &destroyed);
+      CHECK_EQ(allocations, 1);
+    }
+    CHECK_EQ(destroyed, 1);
+    CHECK_EQ(deallocations, 1);
+  }
+}
@@ -10,14 +10,17 @@
 #include "allocator.h"
 #include "diagnostic.h"
 #include "mock_allocator.h"
+#include "pass_through.h"
 
 // Library headers
 #include "doctest.h"
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 // Test data types.
 template <typename T>
@@ -47,6 +50,11 @@ bool operator==(const BarT<T>& lhs, const BarT<T>& rhs) {
   return lhs.m_data == rhs.m_data;
 }
 
+// Padded to a cache line, like a per-thread counter.
+struct alignas(64) CacheLineCounter {
+  long value = 0;
+};
+
 using namespace allok8or;
 
 TEST_CASE("allocate") {
@@ -107,6 +115,21 @@ TEST_CASE("deallocate_array") {
   CHECK_NE(memory, nullptr); // What to test, really? Make sure it links.
 }
 
+TEST_CASE("deallocate_sized") {
+  size_t deallocated_size = 0;
+  auto on_deallocate_sized = [&](void*, size_t size, size_t) {
+    deallocated_size = size;
+  };
+
+  test::MockAllocator internal_allocator(nullptr, nullptr, on_deallocate_sized);
+  StdAllocatorAdapter<BarT<double>, test::MockAllocator> allocator(
+      internal_allocator);
+
+  auto memory = allocator.allocate(3);
+  allocator.deallocate(memory, 3);
+  CHECK_EQ(deallocated_size, 3 * sizeof(BarT<double>));
+}
+
 TEST_CASE("compare_with_pass_through") {
   // NOTE: test::MockAllocator has no state, so all are equivalent.
 
@@ -242,3 +265,101 @@ TEST_CASE("std_map_add_remove_with_copy") {
   test_map_copy[42000] = db1;
   CHECK_GT(allocate_called, 0);
 }
+
+TEST_CASE("allocate_passes_alignment") {
+  size_t allocated_alignment = 0;
+  auto on_allocate = [&](size_t, size_t alignment) {
+    allocated_alignment = alignment;
+  };
+  size_t deallocated_alignment = 0;
+  auto on_deallocate_sized = [&](void*, size_t, size_t alignment) {
+    deallocated_alignment = alignment;
+  };
+
+  test::MockAllocator internal_allocator(
+      on_allocate, nullptr, on_deallocate_sized);
+  StdAllocatorAdapter<CacheLineCounter, test::MockAllocator> allocator(
+      internal_allocator);
+
+  auto memory = allocator.allocate(3);
+  CHECK_EQ(allocated_alignment, alignof(CacheLineCounter));
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % alignof(CacheLineCounter), 0);
+
+  allocator.deallocate(memory, 3);
+  CHECK_EQ(deallocated_alignment, alignof(CacheLineCounter));
+}
+
+TEST_CASE("std_vector_over_aligned") {
+  PassThroughAllocator internal_allocator;
+  using TestAllocator =
+      StdAllocatorAdapter<CacheLineCounter, PassThroughAllocator>;
+  std::vector<CacheLineCounter, TestAllocator> counters(
+      TestAllocator{internal_allocator});
+
+  for (int i = 0; i < 100; ++i) {
+    counters.emplace_back();
+    CHECK_EQ(reinterpret_cast<uintptr_t>(&counters.back()) %
+                 alignof(CacheLineCounter),
+             0);
+  }
+}
+
+TEST_CASE("aligned_adapter") {
+  size_t allocated_alignment = 0;
+  auto on_allocate = [&](size_t, size_t alignment) {
+    allocated_alignment = alignment;
+  };
+  size_t deallocated_alignment = 0;
+  auto on_deallocate_sized = [&](void*, size_t, size_t alignment) {
+    deallocated_alignment = alignment;
+  };
+
+  test::MockAllocator internal_allocator(
+      on_allocate, nullptr, on_deallocate_sized);
+
+  SUBCASE("uses_requested_alignment") {
+    AlignedStdAllocatorAdapter<float, test::MockAllocator, 64> allocator(
+        internal_allocator);
+
+    auto memory = allocator.allocate(16);
+    CHECK_EQ(allocated_alignment, 64);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(memory) % 64, 0);
+
+    allocator.deallocate(memory, 16);
+    CHECK_EQ(deallocated_alignment, 64);
+  }
+
+  SUBCASE("uses_type_alignment_when_larger") {
+    AlignedStdAllocatorAdapter<CacheLineCounter, test::MockAllocator, 16>
+        allocator(internal_allocator);
+
+    allocator.deallocate(allocator.allocate(1), 1);
+    CHECK_EQ(allocated_alignment, alignof(CacheLineCounter));
+    CHECK_EQ(deallocated_alignment, alignof(CacheLineCounter));
+  }
+
+  SUBCASE("rebind_keeps_alignment") {
+    using FloatAllocator =
+        AlignedStdAllocatorAdapter<float, test::MockAllocator, 32>;
+    using IntAllocator = std::allocator_traits<
+        FloatAllocator>::rebind_alloc<int32_t>;
+    static_assert(IntAllocator::alignment() == 32, "alignment lost on rebind");
+
+    FloatAllocator float_allocator(internal_allocator);
+    IntAllocator int_allocator(float_allocator);
+    CHECK_EQ(float_allocator, int_allocator);
+  }
+}
+
+TEST_CASE("std_vector_simd_data") {
+  PassThroughAllocator internal_allocator;
+  using TestAllocator =
+      AlignedStdAllocatorAdapter<float, PassThroughAllocator, 64>;
+  std::vector<float, TestAllocator> data(TestAllocator{internal_allocator});
+
+  for (int i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<float>(i));
+    CHECK_EQ(reinterpret_cast<uintptr_t>(data.data()) % 64, 0);
+  }
+  CHECK_EQ(data[999], 999.0f);
+}
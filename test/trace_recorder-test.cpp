@@ -0,0 +1,257 @@
+/**
+ * @file trace_recorder-test.cpp
+ * @brief Unit tests of the AllocationTraceRecorder and TraceWriter classes.
+ *
+ */
+
+// My header
+#include "trace_recorder.h"
+
+// Project headers
+#include "allocator_call_helper.h"
+#include "mock_allocator.h"
+#include "pass_through.h"
+
+// Library headers
+#include "doctest.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+using namespace allok8or;
+using namespace allok8or::diagnostic;
+
+namespace {
+
+const char* const trace_path = "trace_recorder-test.trace";
+
+/**
+ * @brief Reads a whole trace file back.
+ */
+struct TraceFile {
+  explicit TraceFile(const char* path) : header() {
+    auto file = std::fopen(path, "rb");
+    REQUIRE(file);
+    REQUIRE_EQ(1, std::fread(&header, sizeof(header), 1, file));
+
+    TraceEvent event;
+    while (std::fread(&event, sizeof(event), 1, file) == 1) {
+      events.push_back(event);
+    }
+    std::fclose(file);
+    std::remove(path);
+  }
+
+  TraceFileHeader header;
+  std::vector<TraceEvent> events;
+};
+
+} // namespace
+
+TEST_CASE("record_allocations") {
+  PassThroughAllocator pass_through;
+  void* memory1 = nullptr;
+  void* memory2 = nullptr;
+  uint64_t num_written = 0;
+
+  {
+    AllocationTraceRecorder<PassThroughAllocator> recorder(pass_through,
+                                                           trace_path);
+    REQUIRE(recorder.Writer().is_open());
+
+    memory1 = call_allocate(recorder, 24);
+    memory2 = call_allocate(recorder, 100, 64);
+    call_deallocate(recorder, memory1);
+    call_deallocate(recorder, memory2, 100, 64);
+    recorder.deallocate(nullptr);
+
+    recorder.flush();
+    num_written = recorder.Writer().num_written();
+    CHECK_EQ(0, recorder.Writer().num_dropped());
+  }
+  CHECK_EQ(4, num_written);
+
+  TraceFile trace(trace_path);
+  CHECK_EQ(0, std::memcmp(TRACE_MAGIC, trace.header.magic, 8));
+  CHECK_EQ(TRACE_VERSION, trace.header.version);
+  CHECK_EQ(sizeof(TraceEvent), trace.header.event_size);
+  CHECK_GT(trace.header.ticks_per_second, 0);
+  CHECK_EQ(4, trace.header.num_events);
+  REQUIRE_EQ(4, trace.events.size());
+
+  const auto& events = trace.events;
+  CHECK_EQ(TRACE_ALLOCATE, events[0].type);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory1), events[0].pointer);
+  CHECK_EQ(24, events[0].size);
+  CHECK_EQ(alignof(std::max_align_t), events[0].alignment);
+  CHECK_EQ(UNKNOWN_SITE, events[0].site);
+
+  CHECK_EQ(TRACE_ALLOCATE, events[1].type);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory2), events[1].pointer);
+  CHECK_EQ(100, events[1].size);
+  CHECK_EQ(64, events[1].alignment);
+
+  CHECK_EQ(TRACE_DEALLOCATE, events[2].type);
+  CHECK_EQ(reinterpret_cast<uintptr_t>(memory1), events[2].pointer);
+  CHECK_EQ(0, events[2].size);
+
+  CHECK_EQ(TRACE_DEALLOCATE, events[3].type);
+  CHECK_EQ(100, events[3].size);
+  CHECK_EQ(64, events[3].alignment);
+
+  for (size_t i = 1; i < events.size(); ++i) {
+    CHECK_EQ(events[0].thread, events[i].thread);
+    CHECK_LE(events[i - 1].timestamp, events[i].timestamp);
+  }
+}
+
+TEST_CASE("forwards_to_backing_allocator") {
+  int allocations = 0;
+  int sized_deallocations = 0;
+  test::MockAllocator mock(
+      [&](size_t size, size_t) {
+        ++allocations;
+        CHECK_EQ(16, size);
+      },
+      nullptr,
+      [&](void*, size_t size, size_t) {
+        ++sized_deallocations;
+        CHECK_EQ(16, size);
+      });
+
+  {
+    AllocationTraceRecorder<test::MockAllocator> recorder(mock, trace_path);
+    auto memory = call_allocate(recorder, 16);
+    call_deallocate(recorder, memory, 16, alignof(std::max_align_t));
+  }
+  CHECK_EQ(1, allocations);
+  CHECK_EQ(1, sized_deallocations);
+  std::remove(trace_path);
+}
+
+TEST_CASE("full_buffer_is_flushed_not_dropped") {
+  PassThroughAllocator pass_through;
+  const size_t num_pairs = 1000;
+
+  {
+    // Far fewer slots than events.
+    AllocationTraceRecorder<PassThroughAllocator> recorder(
+        pass_through, trace_path, 4);
+    for (size_t i = 0; i < num_pairs; ++i) {
+      call_deallocate(recorder, call_allocate(recorder, i + 1));
+    }
+    CHECK_EQ(0, recorder.Writer().num_dropped());
+  }
+
+  TraceFile trace(trace_path);
+  REQUIRE_EQ(2 * num_pairs, trace.events.size());
+  for (size_t i = 0; i < num_pairs; ++i) {
+    CHECK_EQ(TRACE_ALLOCATE, trace.events[2 * i].type);
+    CHECK_EQ(i + 1, trace.events[2 * i].size);
+    CHECK_EQ(TRACE_DEALLOCATE, trace.events[2 * i + 1].type);
+  }
+}
+
+TEST_CASE("per_thread_order") {
+  PassThroughAllocator pass_through;
+  const size_t num_threads = 4;
+  const size_t per_thread = 5000;
+
+  {
+    AllocationTraceRecorder<PassThroughAllocator> recorder(
+        pass_through, trace_path, 256);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&] {
+        for (size_t i = 0; i < per_thread; ++i) {
+          call_deallocate(recorder, call_allocate(recorder, i + 1));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  TraceFile trace(trace_path);
+  REQUIRE_EQ(2 * num_threads * per_thread, trace.events.size());
+
+  // Each thread's events are complete, and in the order it made them.
+  std::map<uint32_t, std::vector<TraceEvent>> by_thread;
+  for (const auto& event : trace.events) {
+    by_thread[event.thread].push_back(event);
+  }
+  REQUIRE_EQ(num_threads, by_thread.size());
+  for (const auto& thread_events : by_thread) {
+    const auto& events = thread_events.second;
+    REQUIRE_EQ(2 * per_thread, events.size());
+    for (size_t i = 0; i < per_thread; ++i) {
+      CHECK_EQ(i + 1, events[2 * i].size);
+      CHECK_EQ(events[2 * i].pointer, events[2 * i + 1].pointer);
+      if (i) {
+        CHECK_LE(events[2 * i - 1].timestamp, events[2 * i].timestamp);
+      }
+    }
+  }
+}
+
+TEST_CASE("exited_threads_buffers_reused") {
+  PassThroughAllocator pass_through;
+  const size_t num_threads = 8;
+
+  {
+    AllocationTraceRecorder<PassThroughAllocator> recorder(
+        pass_through, trace_path, 256);
+    for (size_t t = 0; t < num_threads; ++t) {
+      std::thread([&] {
+        call_deallocate(recorder, call_allocate(recorder, t + 1));
+      }).join();
+    }
+
+    // One at a time, so each took the buffer the last one freed, and flushed
+    // it as it exited.
+    CHECK_EQ(1, recorder.Writer().num_buffers());
+    CHECK_EQ(2 * num_threads, recorder.Writer().num_written());
+  }
+
+  TraceFile trace(trace_path);
+  REQUIRE_EQ(2 * num_threads, trace.events.size());
+  std::map<uint32_t, size_t> by_thread;
+  for (const auto& event : trace.events) {
+    ++by_thread[event.thread];
+  }
+  CHECK_EQ(num_threads, by_thread.size());
+  for (size_t t = 0; t < num_threads; ++t) {
+    CHECK_EQ(t + 1, trace.events[2 * t].size);
+  }
+}
+
+TEST_CASE("unopened_file") {
+  PassThroughAllocator pass_through;
+  AllocationTraceRecorder<PassThroughAllocator> recorder(
+      pass_through, "no-such-directory/trace");
+  CHECK_FALSE(recorder.Writer().is_open());
+
+  auto memory = call_allocate(recorder, 16);
+  CHECK_NE(nullptr, memory);
+  call_deallocate(recorder, memory);
+  CHECK_EQ(2, recorder.Writer().num_dropped());
+}
+
+TEST_CASE("capture_stacks") {
+  PassThroughAllocator pass_through;
+  {
+    AllocationTraceRecorder<PassThroughAllocator> recorder(pass_through,
+                                                           trace_path);
+    recorder.capture_stacks(true);
+    call_deallocate(recorder, call_allocate(recorder, 16));
+  }
+
+  TraceFile trace(trace_path);
+  REQUIRE_EQ(2, trace.events.size());
+  CHECK_NE(UNKNOWN_SITE, trace.events[0].site);
+  CHECK_NE(NO_STACK,
+           CallSiteRegistry::instance().site(trace.events[0].site).stack);
+}